@@ -0,0 +1,509 @@
+#ifndef AUDIO_BEAT_H
+#define AUDIO_BEAT_H
+
+/*
+ * Beat-reactive playback
+ *
+ * A microphone (an electret module with its output biased at mid-rail) on an analog pin is sampled at
+ * AUDIO_BEAT_SAMPLE_RATE by the ADC's hardware trigger into a DMA ring (AudioSampler.h), and loop() copies the 12 bit
+ * readings that have come in into a ring here with pushSamples().  update() takes them in hops of AUDIO_BEAT_HOP, and
+ * for each hop:
+ *
+ *   - windows the last AUDIO_BEAT_FFT_SIZE samples (Hann, the DC taken out) and runs a fixed point radix-2 FFT on
+ *     them, Q15 twiddles on 32 bit data, so nothing saturates and there's no per stage scaling
+ *   - sums the bins' magnitudes (alpha max plus beta min) into AUDIO_BEAT_BANDS log spaced bands, 43 Hz to 11 kHz,
+ *     and takes their log2 in Q8
+ *   - takes the onset strength, the spectral flux: the rise of each band's log energy since the hop before, weighted
+ *     towards the bass, kept for the last AUDIO_BEAT_HISTORY_HOPS.  Onsets proper (over an adaptive threshold, with
+ *     a refractory time) are only counted for the stats
+ *
+ * Every AUDIO_BEAT_ESTIMATE_HOPS the beat is estimated from the onset strength:
+ *
+ *   - tempo - its autocorrelation over the last AUDIO_BEAT_ACF_HOPS, at lags from AUDIO_BEAT_MAX_BPM to
+ *     AUDIO_BEAT_MIN_BPM, each lag scored with its double (a beat repeats a beat later and a bar later, an off beat
+ *     doesn't) and weighted by a log normal prior around AUDIO_BEAT_REFERENCE_BPM, refined between hops by a parabola
+ *   - confidence - the autocorrelation at that lag over the energy; under AUDIO_BEAT_MIN_CONFIDENCE there's no beat,
+ *     and the clock lets go after AUDIO_BEAT_LOST_MS of that
+ *   - phase - the offset of a comb of AUDIO_BEAT_COMB_BEATS beats back from the latest hop that sums the most onset
+ *     strength, less AUDIO_BEAT_ONSET_DELAY, the time from an onset to the hop whose window has it in the middle
+ *
+ * The first confident estimate sets the beat clock going, and it runs on its own between estimates, each one pulling
+ * its period and phase part of the way towards it.  Once locked, estimates are folded into the clock's octave and
+ * the phase is only looked for within a quarter beat of the clock's, so it can't flip between tempo and half tempo,
+ * or on to the off beat.  Half or double the tempo of the music is a fair lock (the prior decides, it's the same
+ * beat), and beats are predicted, so they land on the music rather than a hop and half a window after it.
+ *
+ * While it's locked, the clock modulates:
+ *   - frame pacing - frameTime() runs a playback clock at the tempo over AUDIO_BEAT_REFERENCE_BPM (tempo on), with a
+ *     surge of pulse % on each beat that eases off over it and averages out, so GIFs play on the beat
+ *   - brightness - brightness() flashes towards the maximum on each beat by flash %, decaying over the beat
+ *
+ * All positions are in samples, counted by pushSamples(), so the clock follows the audio rather than micros() and it
+ * runs the same on the bench's synthesized tracks.  A hop's work, and the copying of its samples in, are measured
+ * with micros(): together they should stay under AUDIO_BEAT_BUDGET_US, 5% of the CPU at the hop rate on a Teensy 4,
+ * alongside GIF decode (led_bench audio measures it on the host, the console's stats on the rig).  Sampling takes
+ * no CPU besides.  The buffers and tables take about 9 KB, and an estimate uses 1.4 KB of stack.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define AUDIO_BEAT_SAMPLE_RATE      22050
+#define AUDIO_BEAT_FFT_SIZE         512         // 43 Hz bins
+#define AUDIO_BEAT_FFT_BITS         9
+#define AUDIO_BEAT_HOP              256         // 11.6 ms
+#define AUDIO_BEAT_RING_SAMPLES     2048        // 93 ms of samples, and as many in the sampler's DMA ring
+#define AUDIO_BEAT_BANDS            8
+
+#define AUDIO_BEAT_MIN_BPM          60
+#define AUDIO_BEAT_MAX_BPM          180
+#define AUDIO_BEAT_REFERENCE_BPM    120         // GIFs play at their own speed at this tempo
+#define AUDIO_BEAT_PRIOR_OCTAVES    1.0         // how far from it tempos are taken
+#define AUDIO_BEAT_HISTORY_HOPS     512         // 5.9 s of onset strength
+#define AUDIO_BEAT_ACF_HOPS         320         // the last 3.7 s of it correlated for the tempo
+#define AUDIO_BEAT_ESTIMATE_HOPS    43          // tempo and phase every 0.5 s
+#define AUDIO_BEAT_COMB_BEATS       4
+#define AUDIO_BEAT_MIN_CONFIDENCE   128         // autocorrelation at the beat over the energy, Q8
+#define AUDIO_BEAT_LOST_MS          4000
+#define AUDIO_BEAT_REFRACTORY_MS    150
+#define AUDIO_BEAT_THRESHOLD_Q4     24          // mean deviations over the mean flux for an onset, in 16ths
+#define AUDIO_BEAT_MIN_FLUX         96          // log2 Q8, below this it's noise
+#define AUDIO_BEAT_ONSET_DELAY      (AUDIO_BEAT_FFT_SIZE / 2)   // samples from an onset to the hop that sees it
+#define AUDIO_BEAT_BUDGET_US        580
+
+#define AUDIO_BEAT_DEFAULT_PULSE_PERCENT    30
+#define AUDIO_BEAT_DEFAULT_FLASH_PERCENT    40
+
+struct AudioBeatStats {
+    uint32_t hops;
+    uint32_t onsets;
+    uint32_t beats;
+    uint32_t overruns;              // samples dropped because loop() didn't take them in time
+    uint32_t overBudget;            // hops that took over AUDIO_BEAT_BUDGET_US
+    uint32_t hop_us;                // total time in the hops since the last report
+    uint32_t sample_us;             // and in pushSamples()
+    uint32_t maxHop_us;
+};
+
+class AudioBeat {
+public:
+    static const uint32_t RATE_ONE = 65536;
+    // beat periods in hops, the fastest and slowest tempos
+    static constexpr double HOPS_PER_MINUTE = 60.0 * AUDIO_BEAT_SAMPLE_RATE / AUDIO_BEAT_HOP;
+    static const uint16_t MIN_LAG = (uint16_t)(HOPS_PER_MINUTE / AUDIO_BEAT_MAX_BPM);
+    static const uint16_t MAX_LAG = (uint16_t)(HOPS_PER_MINUTE / AUDIO_BEAT_MIN_BPM + 1);
+
+    // Builds the tables, time_ms is the clock frameTime() will be given
+    void begin(uint32_t time_ms, uint32_t now_us) {
+        for (uint16_t i = 0; i < AUDIO_BEAT_FFT_SIZE / 2; i++) {
+            double angle = 2 * M_PI * i / AUDIO_BEAT_FFT_SIZE;
+            cosTable[i] = (int16_t)lround(cos(angle) * 32767);
+            sinTable[i] = (int16_t)lround(sin(angle) * 32767);
+        }
+        for (uint16_t i = 0; i < AUDIO_BEAT_FFT_SIZE; i++) {
+            hann[i] = (int16_t)lround((0.5 - 0.5 * cos(2 * M_PI * i / AUDIO_BEAT_FFT_SIZE)) * 32767);
+        }
+        // a log normal prior on the tempo, AUDIO_BEAT_PRIOR_OCTAVES wide
+        for (uint16_t lag = MIN_LAG; lag <= MAX_LAG; lag++) {
+            double octaves = log2(HOPS_PER_MINUTE / lag / AUDIO_BEAT_REFERENCE_BPM) / AUDIO_BEAT_PRIOR_OCTAVES;
+            prior[lag - MIN_LAG] = (uint16_t)lround(256 * exp(-0.5 * octaves * octaves));
+        }
+        lastTime_ms = time_ms;
+        playback = (uint64_t)time_ms * RATE_ONE;
+        dc_q8 = 2048 << 8;
+        reportStart_us = now_us;
+    }
+
+    // The 12 bit ADC readings that have come in since the last call
+    void pushSamples(const uint16_t *samples, uint32_t count) {
+        uint32_t start = micros();
+        for (uint32_t i = 0; i < count; i++) {
+            ring[(head + i) % AUDIO_BEAT_RING_SAMPLES] = samples[i];
+        }
+        head += count;
+        stats.sample_us += micros() - start;
+    }
+
+    // Readings the sampler lost before loop() took them, the DC level in their place, so the clock keeps to the audio
+    void skipSamples(uint32_t count) {
+        stats.overruns += count;
+        uint16_t silence = (uint16_t)(dc_q8 >> 8);
+        for (uint32_t i = 0; i < count && i < AUDIO_BEAT_RING_SAMPLES; i++) {
+            ring[(head + i) % AUDIO_BEAT_RING_SAMPLES] = silence;
+        }
+        head += count;
+    }
+
+    // Analyses the hops the ring holds and runs the beat clock up to the latest sample, returns true on a new beat
+    bool update(void) {
+        uint32_t pushed = head;
+        if (pushed - tail > AUDIO_BEAT_RING_SAMPLES) {
+            stats.overruns += pushed - tail - AUDIO_BEAT_RING_SAMPLES;
+            tail = pushed - AUDIO_BEAT_RING_SAMPLES;
+        }
+        while (pushed - tail >= AUDIO_BEAT_HOP) {
+            uint32_t start = micros();
+            analyseHop();
+            uint32_t hop_us = micros() - start;
+            stats.hop_us += hop_us;
+            if (hop_us > stats.maxHop_us)
+                stats.maxHop_us = hop_us;
+            if (hop_us > AUDIO_BEAT_BUDGET_US)
+                stats.overBudget++;
+        }
+        position = pushed;
+
+        bool beat = false;
+        while (locked && (int32_t)(position - nextBeat) >= 0) {
+            lastBeat = nextBeat;
+            nextBeat += period;
+            stats.beats++;
+            beat = true;
+        }
+        return beat;
+    }
+
+    bool isLocked(void) const { return locked; }
+
+    // How periodic the onsets were at the last estimate, 0-256
+    uint16_t getConfidence(void) const { return confidence; }
+
+    // Tempo in tenths of a BPM, 0 until the clock has locked on
+    uint32_t bpm_x10(void) const {
+        return locked ? (uint32_t)((uint64_t)AUDIO_BEAT_SAMPLE_RATE * 600 / period) : 0;
+    }
+
+    // Where the latest sample is in the beat, 0 on it to RATE_ONE - 1 just before the next
+    uint32_t phase(void) const {
+        if (!locked)
+            return 0;
+        uint32_t into = position - lastBeat;
+        return into >= period ? RATE_ONE - 1 : (uint32_t)((uint64_t)into * RATE_ONE / period);
+    }
+
+    void setPulse(uint8_t percent) { pulsePercent = percent > 100 ? 100 : percent; }
+    void setFlash(uint8_t percent) { flashPercent = percent > 100 ? 100 : percent; }
+    void setTempo(bool follow) { tempo = follow; }
+    uint8_t getPulse(void) const { return pulsePercent; }
+    uint8_t getFlash(void) const { return flashPercent; }
+    bool getTempo(void) const { return tempo; }
+
+    // How fast GIFs play, RATE_ONE at their own speed
+    uint32_t rate(void) const {
+        if (!locked)
+            return RATE_ONE;
+        uint64_t r = RATE_ONE;
+        if (tempo) {
+            r = (uint64_t)RATE_ONE * bpm_x10() / (AUDIO_BEAT_REFERENCE_BPM * 10);
+            r = r < RATE_ONE / 2 ? RATE_ONE / 2 : r > RATE_ONE * 2 ? RATE_ONE * 2 : r;
+        }
+        // 1 + pulse at the beat down to 1 - pulse just before the next, 1 on average
+        int64_t pulse = (int64_t)pulsePercent * ((int64_t)RATE_ONE - 2 * (int64_t)phase()) / 100;
+        return (uint32_t)(r * (RATE_ONE + pulse) / RATE_ONE);
+    }
+
+    // The clock to pace GIF frames by, in ms, from time_ms (millis() or frame sync's frameTime())
+    uint32_t frameTime(uint32_t time_ms) {
+        playback += (uint64_t)(time_ms - lastTime_ms) * rate();
+        lastTime_ms = time_ms;
+        return (uint32_t)(playback / RATE_ONE);
+    }
+
+    // base, flashing towards max on each beat by flash %
+    int brightness(int base, int max) const {
+        if (!locked || max <= base)
+            return base;
+        uint32_t decay = RATE_ONE - phase();
+        uint32_t envelope = (uint32_t)((uint64_t)decay * decay / RATE_ONE);
+        return base + (int)((int64_t)(max - base) * flashPercent * envelope / 100 / RATE_ONE);
+    }
+
+    const AudioBeatStats & getStats(void) const { return stats; }
+
+    // Prints the stats and starts a new reporting interval
+    template <typename Printer>
+    void printReport(Printer &out, uint32_t now_us) {
+        uint32_t elapsed_us = now_us - reportStart_us;
+        uint32_t busy_us = stats.hop_us + stats.sample_us;
+        uint32_t cpu_ppm = elapsed_us ? (uint32_t)((uint64_t)busy_us * 1000000 / elapsed_us) : 0;
+        uint32_t bpm = bpm_x10();
+        out.printf("Audio: %s %lu.%lu bpm, %lu beats, %lu onsets, %lu hops, avg %lu us, max %lu us, %lu over budget, "
+            "sampling %lu us, %lu overruns, cpu %lu.%02lu%%\n", locked ? "locked" : "free", (unsigned long)(bpm / 10),
+            (unsigned long)(bpm % 10), (unsigned long)stats.beats, (unsigned long)stats.onsets,
+            (unsigned long)stats.hops, (unsigned long)(stats.hops ? stats.hop_us / stats.hops : 0),
+            (unsigned long)stats.maxHop_us, (unsigned long)stats.overBudget, (unsigned long)stats.sample_us,
+            (unsigned long)stats.overruns, (unsigned long)(cpu_ppm / 10000), (unsigned long)(cpu_ppm / 100 % 100));
+        memset(&stats, 0, sizeof(stats));
+        reportStart_us = now_us;
+    }
+
+    // Band energies of the last hop, log2 Q8, for the bench
+    const uint16_t * getBands(void) const { return bands; }
+
+private:
+    static uint32_t samples(uint32_t ms) { return ms * (AUDIO_BEAT_SAMPLE_RATE / 10) / 100; }
+
+    static uint16_t log2q8(uint32_t x) {
+        if (!x)
+            return 0;
+        uint8_t msb = 31 - __builtin_clz(x);
+        uint32_t fraction = msb >= 8 ? x >> (msb - 8) : x << (8 - msb);
+        return (uint16_t)(msb * 256 + (fraction & 0xFF));
+    }
+
+    void analyseHop(void) {
+        // slide the window on by a hop, taking the DC out with a slow high pass
+        memmove(window, window + AUDIO_BEAT_HOP, (AUDIO_BEAT_FFT_SIZE - AUDIO_BEAT_HOP) * sizeof(window[0]));
+        int16_t *in = window + AUDIO_BEAT_FFT_SIZE - AUDIO_BEAT_HOP;
+        for (uint16_t i = 0; i < AUDIO_BEAT_HOP; i++) {
+            int32_t sample = (int32_t)ring[tail % AUDIO_BEAT_RING_SAMPLES] << 8;
+            tail++;
+            dc_q8 += (sample - dc_q8) >> 10;
+            int32_t ac = (sample - dc_q8) >> 4;
+            in[i] = (int16_t)(ac > 32767 ? 32767 : ac < -32768 ? -32768 : ac);
+        }
+        stats.hops++;
+
+        for (uint16_t i = 0; i < AUDIO_BEAT_FFT_SIZE; i++) {
+            uint16_t j = reverseBits(i);
+            re[j] = ((int32_t)window[i] * hann[i]) >> 15;
+            im[j] = 0;
+        }
+        fft();
+
+        // bins 1-255 into bands, edges an octave apart
+        static const uint16_t edges[AUDIO_BEAT_BANDS + 1] = { 1, 3, 6, 12, 24, 48, 96, 192, AUDIO_BEAT_FFT_SIZE / 2 };
+        static const uint8_t weights[AUDIO_BEAT_BANDS] = { 4, 3, 2, 1, 1, 1, 1, 1 };
+        uint32_t flux = 0;
+        for (uint8_t b = 0; b < AUDIO_BEAT_BANDS; b++) {
+            uint32_t energy = 0;
+            for (uint16_t k = edges[b]; k < edges[b + 1]; k++) {
+                uint32_t x = re[k] < 0 ? -re[k] : re[k];
+                uint32_t y = im[k] < 0 ? -im[k] : im[k];
+                energy += x > y ? x + (y >> 2) + (y >> 3) : y + (x >> 2) + (x >> 3);
+            }
+            uint16_t level = log2q8(energy);
+            if (level > bands[b])
+                flux += (uint32_t)(level - bands[b]) * weights[b];
+            bands[b] = level;
+        }
+        detectOnset(flux, tail - AUDIO_BEAT_ONSET_DELAY);
+    }
+
+    void detectOnset(uint32_t flux, uint32_t at) {
+        strength[hops % AUDIO_BEAT_HISTORY_HOPS] = (uint16_t)(flux > 65535 ? 65535 : flux);
+        hops++;
+
+        int32_t deviation = (int32_t)(flux << 4) - mean_q4;
+        int32_t threshold = mean_q4 + deviation_q4 * AUDIO_BEAT_THRESHOLD_Q4 / 16 + (AUDIO_BEAT_MIN_FLUX << 4);
+        bool onset = (int32_t)(flux << 4) > threshold &&
+            (int32_t)(at - lastOnset) >= (int32_t)samples(AUDIO_BEAT_REFRACTORY_MS);
+        mean_q4 += deviation / 32;
+        deviation_q4 += ((deviation < 0 ? -deviation : deviation) - deviation_q4) / 32;
+        if (onset) {
+            stats.onsets++;
+            lastOnset = at;
+        }
+
+        if (hops >= AUDIO_BEAT_ACF_HOPS + 2 * MAX_LAG && hops % AUDIO_BEAT_ESTIMATE_HOPS == 0)
+            estimate();
+    }
+
+    // Onset strength hop - back hops before the latest, less the mean of the last AUDIO_BEAT_ACF_HOPS
+    int32_t strengthAt(uint32_t back) const {
+        return strength[(hops - 1 - back) % AUDIO_BEAT_HISTORY_HOPS] - strengthMean;
+    }
+
+    // Tempo by autocorrelation of the onset strength, phase by a comb over the last beats, then steers the clock
+    void estimate(void) {
+        int32_t sum = 0;
+        for (uint16_t i = 0; i < AUDIO_BEAT_ACF_HOPS; i++)
+            sum += strength[(hops - 1 - i) % AUDIO_BEAT_HISTORY_HOPS];
+        strengthMean = sum / AUDIO_BEAT_ACF_HOPS;
+
+        // lags of MIN_LAG - 2 * MAX_LAG hops, the doubles back up each tempo's octave below
+        int64_t acf[2 * MAX_LAG + 1];
+        int64_t energy = 0;
+        for (uint16_t i = 0; i < AUDIO_BEAT_ACF_HOPS; i++)
+            energy += (int64_t)strengthAt(i) * strengthAt(i);
+        if (energy <= 0)
+            return lose();
+        for (uint16_t lag = MIN_LAG; lag <= 2 * MAX_LAG; lag++) {
+            int64_t c = 0;
+            for (uint16_t i = 0; i < AUDIO_BEAT_ACF_HOPS; i++)
+                c += (int64_t)strengthAt(i) * strengthAt(i + lag);
+            acf[lag] = c;
+        }
+
+        // the best lag, weighted towards AUDIO_BEAT_REFERENCE_BPM
+        // a period between whole hops splits its peak, so each lag takes the best of its neighbours
+        auto near = [&](uint16_t lag) {
+            int64_t c = acf[lag];
+            if (lag > MIN_LAG && acf[lag - 1] > c)
+                c = acf[lag - 1];
+            if (lag < 2 * MAX_LAG && acf[lag + 1] > c)
+                c = acf[lag + 1];
+            return c;
+        };
+        int64_t score[MAX_LAG + 1];
+        uint16_t best = 0;
+        for (uint16_t lag = MIN_LAG; lag <= MAX_LAG; lag++) {
+            int64_t c = near(lag) + near(2 * lag);
+            score[lag] = c > 0 ? c / 256 * prior[lag - MIN_LAG] : 0;
+            if (!best || score[lag] > score[best])
+                best = lag;
+        }
+        if (best > MIN_LAG && acf[best - 1] > acf[best])
+            best--;
+        else if (best < MAX_LAG && acf[best + 1] > acf[best])
+            best++;
+        confidence = (uint16_t)(acf[best] > 0 ? acf[best] * 256 / energy : 0);
+        if (confidence < AUDIO_BEAT_MIN_CONFIDENCE)
+            return lose();
+
+        // a fraction of a hop from a parabola through the peak
+        int32_t fraction_q8 = 0;
+        if (best > MIN_LAG && best < 2 * MAX_LAG) {
+            int64_t before = acf[best - 1], peak = acf[best], after = acf[best + 1];
+            int64_t curve = before - 2 * peak + after;
+            if (curve < 0)
+                fraction_q8 = (int32_t)((before - after) * 128 / curve);
+        }
+        uint32_t lag_q8 = best * 256 + fraction_q8;
+
+        // once locked, in the clock's octave and towards it a fraction at a time, so neither the tempo nor the phase
+        // jumps between the beat and its half or double
+        if (locked) {
+            uint32_t period_q8 = (uint32_t)((uint64_t)period * 256 / AUDIO_BEAT_HOP);
+            while (lag_q8 > period_q8 * 3 / 2)
+                lag_q8 /= 2;
+            while (lag_q8 < period_q8 * 3 / 4)
+                lag_q8 *= 2;
+            lag_q8 = (period_q8 * 3 + lag_q8) / 4;
+            lag_q8 = lag_q8 < MIN_LAG * 256u ? MIN_LAG * 256u : lag_q8 > MAX_LAG * 256u ? MAX_LAG * 256u : lag_q8;
+        }
+
+        // the phase whose comb of beats back from the latest hop has the strongest onsets; once locked, within a
+        // quarter beat of the clock's, as at half tempo the off beat's onsets are as strong as the beat's
+        uint16_t lag = (lag_q8 + 128) / 256;
+        uint16_t expected = 0;
+        if (locked) {
+            int32_t ahead = (int32_t)(nextBeat - (tail - AUDIO_BEAT_ONSET_DELAY)) % (int32_t)period;
+            if (ahead < 0)
+                ahead += period;
+            expected = (uint16_t)((period - ahead) / AUDIO_BEAT_HOP % lag);
+        }
+        uint16_t bestPhase = 0;
+        int32_t bestComb = INT32_MIN;
+        for (uint16_t phase = 0; phase < lag; phase++) {
+            uint16_t distance = phase > expected ? phase - expected : expected - phase;
+            if (locked && distance > lag / 4 && lag - distance > lag / 4)
+                continue;
+            int32_t comb = 0;
+            for (uint8_t k = 0; k < AUDIO_BEAT_COMB_BEATS; k++)
+                comb += strengthAt(phase + (k * lag_q8 + 128) / 256);
+            if (comb > bestComb) {
+                bestComb = comb;
+                bestPhase = phase;
+            }
+        }
+
+        uint32_t beatAt = tail - bestPhase * AUDIO_BEAT_HOP - AUDIO_BEAT_ONSET_DELAY;
+        period = lag_q8 * AUDIO_BEAT_HOP / 256;
+        lastConfident = tail;
+        if (!locked) {
+            locked = true;
+            lastBeat = beatAt;
+            nextBeat = beatAt + period;
+            return;
+        }
+        // the clock half way to the comb's beat, so it doesn't jitter
+        int32_t error = (int32_t)(beatAt - nextBeat) % (int32_t)period;
+        if (error > (int32_t)period / 2)
+            error -= period;
+        else if (error < -(int32_t)period / 2)
+            error += period;
+        nextBeat += error / 2;
+    }
+
+    void lose(void) {
+        confidence = 0;
+        if (locked && (int32_t)(tail - lastConfident) > (int32_t)samples(AUDIO_BEAT_LOST_MS))
+            locked = false;
+    }
+
+    static uint16_t reverseBits(uint16_t i) {
+        uint16_t r = 0;
+        for (uint8_t b = 0; b < AUDIO_BEAT_FFT_BITS; b++) {
+            r = (r << 1) | (i & 1);
+            i >>= 1;
+        }
+        return r;
+    }
+
+    // In place, on bit reversed input
+    void fft(void) {
+        for (uint16_t size = 2; size <= AUDIO_BEAT_FFT_SIZE; size <<= 1) {
+            uint16_t half = size / 2;
+            uint16_t step = AUDIO_BEAT_FFT_SIZE / size;
+            for (uint16_t start = 0; start < AUDIO_BEAT_FFT_SIZE; start += size) {
+                for (uint16_t k = 0; k < half; k++) {
+                    int32_t c = cosTable[k * step], s = sinTable[k * step];
+                    int32_t *ar = re + start + k, *ai = im + start + k;
+                    int32_t *br = ar + half, *bi = ai + half;
+                    // b * e^(-i angle)
+                    int32_t tr = (int32_t)(((int64_t)*br * c + (int64_t)*bi * s) >> 15);
+                    int32_t ti = (int32_t)(((int64_t)*bi * c - (int64_t)*br * s) >> 15);
+                    *br = *ar - tr;
+                    *bi = *ai - ti;
+                    *ar += tr;
+                    *ai += ti;
+                }
+            }
+        }
+    }
+
+    uint16_t ring[AUDIO_BEAT_RING_SAMPLES];
+    uint32_t head = 0;              // samples pushed
+    uint32_t tail = 0;              // samples analysed
+    uint32_t position = 0;          // head at the last update()
+
+    int16_t window[AUDIO_BEAT_FFT_SIZE] = {};
+    int16_t hann[AUDIO_BEAT_FFT_SIZE];
+    int16_t cosTable[AUDIO_BEAT_FFT_SIZE / 2];
+    int16_t sinTable[AUDIO_BEAT_FFT_SIZE / 2];
+    int32_t re[AUDIO_BEAT_FFT_SIZE];
+    int32_t im[AUDIO_BEAT_FFT_SIZE];
+    int32_t dc_q8 = 0;
+
+    uint16_t bands[AUDIO_BEAT_BANDS] = {};
+    int32_t mean_q4 = 0;            // running mean flux, and mean deviation from it, in 16ths
+    int32_t deviation_q4 = 0;
+    uint32_t lastOnset = 0;
+
+    // onset strength of the last hops, for the tempo
+    uint16_t strength[AUDIO_BEAT_HISTORY_HOPS] = {};
+    uint32_t hops = 0;
+    int32_t strengthMean = 0;
+    uint16_t prior[MAX_LAG - MIN_LAG + 1];
+    uint16_t confidence = 0;        // of the last estimate, Q8
+
+    // the beat clock, in samples
+    bool locked = false;
+    uint32_t period = 0;
+    uint32_t lastBeat = 0;
+    uint32_t nextBeat = 0;
+    uint32_t lastConfident = 0;
+
+    uint8_t pulsePercent = AUDIO_BEAT_DEFAULT_PULSE_PERCENT;
+    uint8_t flashPercent = AUDIO_BEAT_DEFAULT_FLASH_PERCENT;
+    bool tempo = true;
+    uint32_t lastTime_ms = 0;
+    uint64_t playback = 0;          // frameTime() in ms * RATE_ONE
+    uint32_t reportStart_us = 0;
+
+    AudioBeatStats stats = {};
+};
+
+#endif
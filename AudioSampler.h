@@ -0,0 +1,109 @@
+#ifndef AUDIO_SAMPLER_H
+#define AUDIO_SAMPLER_H
+
+/*
+ * Sampling the microphone without the CPU (Teensy 4)
+ *
+ * AudioBeat wants the microphone read AUDIO_BEAT_SAMPLE_RATE times a second.  An IntervalTimer interrupt calling
+ * analogRead() did that by busy waiting out each conversion, 22050 times a second.  Here the hardware does all of it:
+ *
+ *   PIT channel 3 --XBAR1--> ADC_ETC trigger 0 --> ADC1 conversion of the pin --> DMA into a ring
+ *
+ * The PIT counts down the 24 MHz clock and pulses its trigger at the sample rate (22059 Hz, 0.04% fast; AudioBeat
+ * only cares that it's steady).  ADC_ETC starts a conversion of the pin's channel on each pulse and asks for DMA
+ * when it's done, and the DMA channel copies the result into the next slot of the ring, wrapping round it on its own.
+ * Nothing interrupts the CPU.  take() in loop() hands the readings that have come in since its last call to AudioBeat,
+ * which times that copy along with the hops.
+ *
+ * The ring is in RAM2 (DMAMEM), off the RAM1 budget, so its cache lines are dropped before each read.  It holds
+ * AUDIO_BEAT_RING_SAMPLES: if loop() is away longer than that, the DMA laps take() and the lapped readings are
+ * passed on to AudioBeat as lost.
+ *
+ * begin() lets the core set the pin up with an analogRead(), then takes ADC1 over for the hardware trigger, so the
+ * pin has to be one on ADC1 (all but A12 and A13), and analogRead() of ADC1's pins no longer works.  PIT channel 3
+ * is left enabled, so IntervalTimers pass it over.
+ */
+
+#include <Arduino.h>
+#include <DMAChannel.h>
+
+#include "AudioBeat.h"
+
+#define AUDIO_SAMPLER_PIT_HZ        24000000
+
+static DMAMEM uint16_t audioSamplerRing[AUDIO_BEAT_RING_SAMPLES] __attribute__((aligned(32)));
+
+class AudioSampler {
+public:
+    void begin(uint8_t pin) {
+        // the core muxes the pin to the ADC, calibrates ADC1 and leaves the pin's channel in HC0
+        analogReadResolution(12);
+        analogReadAveraging(1);
+        analogRead(pin);
+        uint8_t channel = ADC1_HC0 & 0x1F;
+        ADC1_CFG |= ADC_CFG_ADTRG;
+        ADC1_HC0 = ADC_HC_ADCH(16);     // the channel ADC_ETC's chain asks for
+
+        if (ADC_ETC_CTRL & (ADC_ETC_CTRL_SOFTRST | ADC_ETC_CTRL_TSC_BYPASS)) {
+            ADC_ETC_CTRL = 0;           // out of reset
+            ADC_ETC_CTRL = 0;           // then off the touchscreen bypass
+        }
+        IMXRT_ADC_ETC.TRIG[0].CTRL = ADC_ETC_TRIG_CTRL_TRIG_CHAIN(0) | ADC_ETC_TRIG_CTRL_TRIG_PRIORITY(7);
+        IMXRT_ADC_ETC.TRIG[0].CHAIN_1_0 = ADC_ETC_TRIG_CHAIN_HWTS0(1) | ADC_ETC_TRIG_CHAIN_CSEL0(channel) |
+            ADC_ETC_TRIG_CHAIN_B2B0;
+        ADC_ETC_CTRL |= ADC_ETC_CTRL_TRIG_ENABLE(1) | ADC_ETC_CTRL_DMA_MODE_SEL;
+        ADC_ETC_DMA_CTRL |= ADC_ETC_DMA_CTRL_TRIQ_ENABLE(0);
+
+        dma.begin(true);
+        dma.source(*(volatile uint16_t *)&IMXRT_ADC_ETC.TRIG[0].RESULT_1_0);
+        dma.destinationBuffer(audioSamplerRing, sizeof(audioSamplerRing));
+        dma.triggerAtHardwareEvent(DMAMUX_SOURCE_ADC_ETC);
+        dma.enable();
+
+        CCM_CCGR2 |= CCM_CCGR2_XBAR1(CCM_CCGR_ON);
+        connect(XBARA1_IN_PIT_TRIGGER3, XBARA1_OUT_ADC_ETC_TRIG00);
+
+        CCM_CCGR1 |= CCM_CCGR1_PIT(CCM_CCGR_ON);
+        PIT_MCR = 1;                    // as IntervalTimer has it
+        PIT_LDVAL3 = AUDIO_SAMPLER_PIT_HZ / AUDIO_BEAT_SAMPLE_RATE - 1;
+        PIT_TCTRL3 = PIT_TCTRL_TEN;     // no interrupt, just the trigger
+
+        taken = 0;
+        taken_us = micros();
+    }
+
+    // Pushes the readings the DMA has written since the last call into beat
+    void take(AudioBeat &beat) {
+        uint32_t now_us = micros();
+        uint32_t written = ((uint16_t *)dma.TCD->DADDR - audioSamplerRing) % AUDIO_BEAT_RING_SAMPLES;
+        uint32_t count = (written - taken + AUDIO_BEAT_RING_SAMPLES) % AUDIO_BEAT_RING_SAMPLES;
+        // the time away says how many laps of the ring the DMA made
+        uint32_t due = (uint32_t)((uint64_t)(now_us - taken_us) * AUDIO_BEAT_SAMPLE_RATE / 1000000);
+        uint32_t laps = due > count ? (due - count + AUDIO_BEAT_RING_SAMPLES / 2) / AUDIO_BEAT_RING_SAMPLES : 0;
+        if (laps)
+            beat.skipSamples(laps * AUDIO_BEAT_RING_SAMPLES);
+        taken_us = now_us;
+
+        arm_dcache_delete(audioSamplerRing, sizeof(audioSamplerRing));
+        if (taken + count > AUDIO_BEAT_RING_SAMPLES) {
+            uint32_t first = AUDIO_BEAT_RING_SAMPLES - taken;
+            beat.pushSamples(audioSamplerRing + taken, first);
+            beat.pushSamples(audioSamplerRing, count - first);
+        } else {
+            beat.pushSamples(audioSamplerRing + taken, count);
+        }
+        taken = written;
+    }
+
+private:
+    static void connect(unsigned int input, unsigned int output) {
+        volatile uint16_t *select = &XBARA1_SEL0 + output / 2;
+        *select = output & 1 ? (*select & 0x00FF) | (input << 8) : (*select & 0xFF00) | input;
+    }
+
+    DMAChannel dma;
+    uint32_t taken = 0;             // the slot of the ring take() reads from next
+    uint32_t taken_us = 0;          // micros() at the last take()
+};
+
+#endif
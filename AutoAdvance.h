@@ -0,0 +1,147 @@
+#ifndef AUTO_ADVANCE_H
+#define AUTO_ADVANCE_H
+
+/*
+ * Auto-advancing playlist
+ *
+ * Moves the playlist on by itself: each GIF plays on until a loop of it ends at least the display time after it
+ * started (or it's been through the cycle limit), and the next one comes in on that loop boundary.  The sketch reports
+ * each loop's end with loopEnded(), the decode after the last frame of a loop being the first of the next, and
+ * switches when it returns true.
+ *
+ * A loop ahead of the switch the GIF's last loop is known: from the cycle time (GifDecoder::getCycleTime()) once it's
+ * been through once, or in its first loop when the display time is up.  lastLoop() is true from then on and the
+ * sketch opens the next GIF and reads its first blocks while the last loop plays (prefetchGifByIndex()), so it comes
+ * in without waiting on the card.  The switch carries straight on from the frame up - no blank frame between them.
+ *
+ * The settings are the playlist's: ADVANCE_FILE in its directory, if there is one, sets them with lines of
+ *
+ *   seconds 20                 the least each GIF plays for, 0 to leave switching to the remote
+ *   cycles 50                  loops at most, 0 for no limit
+ *
+ * and '#' starts a comment.  The stats are the switches, how many of them found the next GIF already open, and how
+ * long after the last frame's delay ran out the next GIF's first frame went up.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PlaybackStats.h"
+
+#define ADVANCE_FILE_MAX_BYTES      256
+
+struct AutoAdvanceStats {
+    uint32_t switches;              // GIFs advanced to at the end of a loop
+    uint32_t prefetched;            // ... that were already open
+    StageTimer cut;                 // from the last frame's delay running out to the next GIF's first frame
+};
+
+class AutoAdvance {
+public:
+    AutoAdvance(uint32_t seconds, uint16_t cycles) : minDisplay_ms(seconds * 1000), maxCycles(cycles) {}
+
+    // Reads the playlist's settings, false if the file has a line it doesn't know
+    template <typename File>
+    bool load(File &file) {
+        char text[ADVANCE_FILE_MAX_BYTES + 1];
+        int length = file.read((uint8_t *)text, ADVANCE_FILE_MAX_BYTES);
+        text[length > 0 ? length : 0] = 0;
+
+        bool ok = true;
+        for (char *line = text; *line; ) {
+            char *end = line + strcspn(line, "\r\n");
+            char *next = *end ? end + 1 : end;
+            *end = 0;
+            char *comment = strchr(line, '#');
+            if (comment)
+                *comment = 0;
+            line += strspn(line, " \t");
+            if (strncmp(line, "seconds", 7) == 0) {
+                setSeconds(atoi(line + 7));
+            } else if (strncmp(line, "cycles", 6) == 0) {
+                setCycles(atoi(line + 6));
+            } else if (*line) {
+                ok = false;
+            }
+            line = next;
+        }
+        return ok;
+    }
+
+    void setSeconds(int seconds) { minDisplay_ms = seconds > 0 ? seconds * 1000 : 0; }
+    void setCycles(int cycles) { maxCycles = cycles > 0 ? (cycles < UINT16_MAX ? cycles : UINT16_MAX) : 0; }
+    uint32_t getSeconds(void) const { return minDisplay_ms / 1000; }
+    uint16_t getCycles(void) const { return maxCycles; }
+    bool isOn(void) const { return minDisplay_ms != 0; }
+
+    // A GIF started playing at now_ms
+    void gifStarted(uint32_t now_ms) {
+        start_ms = loopStart_ms = now_ms;
+        opened = false;
+    }
+
+    // True if the loop playing is the GIF's last, with cycles loops done before it and the GIF's cycleTime_ms, 0 if
+    // it hasn't been through once yet
+    bool lastLoop(uint32_t now_ms, uint32_t cycles, uint32_t cycleTime_ms) const {
+        if (!isOn())
+            return false;
+        if (maxCycles && cycles + 1 >= maxCycles)
+            return true;
+        // when the loop ends, or now if it's running over
+        uint32_t end_ms = now_ms;
+        if (cycleTime_ms && (int32_t)(loopStart_ms + cycleTime_ms - now_ms) > 0)
+            end_ms = loopStart_ms + cycleTime_ms;
+        return end_ms - start_ms >= minDisplay_ms;
+    }
+
+    // A loop ended at now_ms, the GIF's cycles-th: true if the next GIF takes over now
+    bool loopEnded(uint32_t now_ms, uint32_t cycles, uint32_t cycleTime_ms) {
+        if (cycles && lastLoop(now_ms, cycles - 1, cycleTime_ms))
+            return true;
+        loopStart_ms = now_ms;
+        return false;
+    }
+
+    // Whether to open the next GIF now: its last loop has started and it isn't yet
+    bool opensNext(uint32_t now_ms, uint32_t cycles, uint32_t cycleTime_ms) const {
+        return !opened && lastLoop(now_ms, cycles, cycleTime_ms);
+    }
+    void nextOpened(void) { opened = true; }
+
+    // The next GIF's first frame went up cut_us after the last frame's delay ran out, prefetched or not
+    void switched(uint32_t cut_us, bool prefetched) {
+        stats.switches++;
+        stats.cut.add(cut_us);
+        if (prefetched)
+            stats.prefetched++;
+    }
+
+    const AutoAdvanceStats & getStats(void) const { return stats; }
+
+    template <typename Printer>
+    void printReport(Printer &out) const {
+        if (!isOn()) {
+            out.printf("Auto-advance: off\n");
+            return;
+        }
+        out.printf("Auto-advance: after %lu s", (unsigned long)getSeconds());
+        if (maxCycles)
+            out.printf(" or %u loops", maxCycles);
+        out.printf(", %lu GIFs at the end of a loop, %lu prefetched, up %lu us after the last frame on average "
+            "(max %lu)\n", (unsigned long)stats.switches, (unsigned long)stats.prefetched,
+            (unsigned long)stats.cut.average_us(), (unsigned long)stats.cut.max_us);
+    }
+
+    void resetStats(void) { stats = {}; }
+
+private:
+    uint32_t minDisplay_ms;
+    uint16_t maxCycles;
+    uint32_t start_ms = 0;          // the GIF started
+    uint32_t loopStart_ms = 0;      // the loop playing started
+    bool opened = false;            // the next GIF, in its last loop
+    AutoAdvanceStats stats = {};
+};
+
+#endif
@@ -16,8 +16,8 @@
  * Wiring for ESP32 follows the default for the ESP32 SD Library, see: https://github.com/espressif/arduino-esp32/tree/master/libraries/SD
  *
  * This code first looks for .gif files in the /gifs/ directory
- * (customize below with the GIF_DIRECTORY definition) then plays random GIFs in the directory,
- * looping each GIF for DISPLAY_TIME_SECONDS
+ * (customize below with the GIF_DIRECTORY definition) then plays the GIFs in the directory in turn,
+ * looping each GIF for DISPLAY_TIME_SECONDS and moving on at the end of a loop (see AutoAdvance.h)
  *
  * If you find any GIFs that won't play properly, please attach them to a new
  * Issue post in the GitHub repo here:
@@ -62,6 +62,7 @@ const int gifsSizeList[] = { sizeof(bm_ariel_dance) };
 
 #include "FilenameFunctions.h"
 
+// Auto-advance's defaults, the playlist's ADVANCE_FILE overrides them
 #define DISPLAY_TIME_SECONDS 10
 #define NUMBER_FULL_CYCLES   100
 
@@ -82,8 +83,8 @@ const bool use_spi1 = true;
 #define IR_RECEIVE_PIN 16
 
 // range 0-255 technically, but battery drives less than that. Stop it
-// at 180.
-const int max_brightness = 180;
+// at 180 (set maxbright on the console changes it).
+static int max_brightness = 180;
 // Start at low brightness - 26.
 static int brightness = 26;
 
@@ -115,29 +116,278 @@ SMARTMATRIX_ALLOCATE_BACKGROUND_LAYER(backgroundLayer, kMatrixWidth, kMatrixHeig
 SMARTMATRIX_ALLOCATE_SCROLLING_LAYER(scrollingLayer, kMatrixWidth, kMatrixHeight, COLOR_DEPTH, kScrollingLayerOptions);
 SMARTMATRIX_ALLOCATE_INDEXED_LAYER(indexedLayer, kMatrixWidth, kMatrixHeight, COLOR_DEPTH, kIndexedLayerOptions);
 
-/* template parameters are maxGifWidth, maxGifHeight, lzwMaxBits
+/* The decoder state, the interpolator frames, the file cache, the GIF snapshots and the turbo buffer for the current
+ * GIF are carved out of one static arena.  160KB holds the AnimatedGIF state, two 64x64 interpolator frames, a 64KB
+ * file cache and a turbo buffer for canvases up to 128x128, larger GIFs are still played but without turbo, and the
+ * snapshots have kGifSnapshotBytes on top of that.
+ */
+// GIFs switched away from with the remote are kept where they were, and switching back resumes them from there
+// instead of starting over (see GifSnapshots.h), as many as fit in this - four at 64x64
+const uint32_t kGifSnapshotBytes = 56 * 1024;
+const uint32_t kGifArenaBytes = 160 * 1024 + kGifSnapshotBytes;
+GIF_ARENA_ALLOCATE(gifArena, kGifArenaBytes);
+
+// The first part of the playing GIF is kept in RAM so its later loops read less from the SD card (see
+// FilenameFunctions.cpp), resized with set cache on the console
+const uint32_t kFileCacheBytes = 64 * 1024;
+static uint8_t *fileCacheBuffer = NULL;
+
+/* template parameters are maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc
  * 
  * lzwMaxBits is included for backwards compatibility reasons, but isn't used anymore
+ * useMalloc keeps the AnimatedGIF state out of the decoder object, here it's taken from gifArena
+ */
+GifDecoder<kMatrixWidth, kMatrixHeight, 12, true> decoder(gifArena);
+
+/* Each decodeFrame() stops after about kDecodeBudget pixels (decoded and drawn, with turbo) and the frame is
+ * finished over the next loops, so a big or broken GIF can't hold up IR, the console, the stream and sync for a whole
+ * frame - a 64x64 frame still fits in one call.  GIFs with a canvas over kMaxCanvasPixels aren't played at all.
  */
-GifDecoder<kMatrixWidth, kMatrixHeight, 12> decoder;
+const int kDecodeBudget = 16384;
+const uint32_t kMaxCanvasPixels = 480 * 320;
+
+#include "FrameInterpolator.h"
+
+// Blends between GIF frames at this rate, 0 to play frames as decoded
+const uint8_t kInterpolationFps = 60;
+FrameInterpolator<kMatrixWidth, kMatrixHeight> interpolator;
+
+#include "FrameStream.h"
+
+// Live frames from a laptop over USB serial take over from the GIFs while they keep coming (see FrameStream.h)
+const bool use_stream = true;
+FrameStream<kMatrixWidth, kMatrixHeight> frameStream;
+
+#include "FrameSync.h"
+
+// Rigs side by side keep to the same frame over Serial3: the one with FRAME_SYNC_LEADER_PIN jumpered high leads,
+// the others follow it, and play on their own when there's no leader (see FrameSync.h)
+const bool use_sync = true;
+FrameSync frameSync;
+
+#include "AudioBeat.h"
+
+// A microphone on AUDIO_PIN paces GIFs to the beat and flashes the brightness on it (see AudioBeat.h).  Off until
+// one's wired up; the simulator turns it on when it's given --audio
+#ifdef SIMULATOR_MODE
+bool use_audio = false;
+#else
+const bool use_audio = false;
+#endif
+#define AUDIO_PIN 21
+AudioBeat audioBeat;
+
+#ifndef SIMULATOR_MODE
+#include "AudioSampler.h"
 
-GIFIMAGE gif;
-int iGIFWidth, iGIFHeight;
-uint8_t *pGIFBuf;
+// The ADC samples AUDIO_PIN on a hardware trigger, DMA'd into a ring pollAudio() takes them from
+AudioSampler audioSampler;
+#endif
+
+#include "Console.h"
+#include "PlaybackStats.h"
+
+// Commands typed into the USB serial port, see consoleCommands below
+const bool use_console = true;
+
+// Per-stage timings for the console's stats and trace, since the last stats
+static StageTimer decodeTimer;          // decodeFrame(), less the swap wait
+static StageTimer compositeTimer;       // decodeFrame()'s drawing of its lines into the draw buffer, part of decode
+static uint32_t composite_us = 0;       // by the decodeFrame() under way
+static StageTimer swapTimer;            // swapBuffers() waiting for the refresh to take the frame
+static StageTimer streamTimer;          // pollFrameStream()
+static StageTimer syncTimer;            // pollFrameSync()
+static StageTimer audioTimer;           // pollAudio(), the hops analysed and the clock
+static StageTimer loopTimer;            // all of loop()
+static uint32_t framesShown = 0;
+static uint32_t framesHeld = 0;         // GIF frames the same as the one up, or empty, held instead of swapped
+static uint32_t swapPendingLoops = 0;   // loops the interpolator waited for the last swap
+static uint32_t lastSwap_us = 0;
+static unsigned long statsStart = 0;
+static bool trace = false;
+static StageTimer switchTimer;          // from switching GIFs to the first frame of the new one
+static LatenessHistogram lateFrames;    // GIF frames against when the frame before said they were due
+static bool switchPending = false;      // switched GIFs at switchStart_us, the new one's first frame isn't up yet
+static uint32_t switchStart_us = 0;
+static bool frameDueValid = false;      // false until the first frame of a GIF is up
+static uint32_t frameDue_us = 0;
+
+#include "GifSnapshots.h"
+
+const bool use_snapshots = true;
+GifSnapshots<kMatrixWidth, kMatrixHeight> snapshots;
+static bool resumeNextGif = false;      // the GIF being switched to carries on from its snapshot, if it has one
+static bool switchResumed = false;      // the switch pending did
+
+#include "Telemetry.h"
+
+// A black box of playback on the SD card, TELEMETRY_FILE, read back with led_telemetry (see Telemetry.h)
+const bool use_telemetry = true;
+Telemetry telemetry;
+File telemetryFile;
+
+#include "Show.h"
+
+// A show on the SD card, SHOW_FILE compiled by led_show, plays its timeline of cues from boot (see Show.h), and
+// without one the GIFs play as usual
+const bool use_show = true;
+ShowPlayer show;
+File showFile;
+// The GIF a show or auto-advance plays next has this much of it read ahead, taken from the GIF arena when a show
+// starts or at boot for auto-advance
+const uint32_t kPrefetchBytes = 4 * 1024;
+static uint8_t *gifPrefetchBuffer = NULL;
+const uint32_t kPrefetchIdle_us = 2000;         // slack before the next frame for a block read
+static bool showGifPending = false;             // a GIF cue switched GIFs, its first frame isn't up yet
+static uint32_t showPrefetchedOpens = 0;        // the file cache's counts when it did
+static uint32_t showCardReads = 0;
+
+#include "AutoAdvance.h"
+
+// The playlist moves on by itself at the end of a loop, once a GIF has played DISPLAY_TIME_SECONDS, opening the next
+// GIF a loop ahead (see AutoAdvance.h); a show, a frame sync leader or the bench pick GIFs instead
+const bool use_advance = true;
+#define ADVANCE_FILE GIF_DIRECTORY "advance.txt"
+AutoAdvance advance(DISPLAY_TIME_SECONDS, NUMBER_FULL_CYCLES);
+static bool advancePending = false;             // advanced at the end of a loop, the new GIF's first frame isn't up
+static uint32_t advanceDue_us = 0;              // when the last frame's delay ran out
+static uint32_t advancePrefetchedOpens = 0;     // the file cache's count when it did
+static bool gifLoopEnded = false;               // the last frame decoded was the last of a loop
+
+#include "Idle.h"
+
+// loop() sleeps until it next has something to do instead of running round (see Idle.h)
+const bool use_idle = true;
+Idle idle;
+const uint32_t kIdleMax_us = 50000;             // the longest sleep, whatever's due
+const uint32_t kIdleStream_us = 1000;           // between a live stream's packets
+const uint32_t kIdleRamp_us = 10000;            // between the steps of a show's brightness ramp
+// audio hops are analysed as they come while the beat's locked, to flash on it, and otherwise before the ring fills
+const uint32_t kIdleAudioLocked_us = AUDIO_BEAT_HOP * 1000000ULL / AUDIO_BEAT_SAMPLE_RATE;
+const uint32_t kIdleAudio_us = AUDIO_BEAT_RING_SAMPLES / 2 * 1000000ULL / AUDIO_BEAT_SAMPLE_RATE;
+static uint32_t idleSlept_us = 0;               // by the last loop(), which the next doesn't count as its time
+
+#include "RamBudget.h"
+
+// Keep in sync with the allocations above - the build fails here if the configuration won't fit
+constexpr RamBudgetConfig kRamBudgetConfig = {
+    kMatrixWidth, kMatrixHeight, kRefreshDepth, kDmaBufferRows, kPanelType, COLOR_DEPTH,
+    true,                   // scrollingLayer
+    true,                   // indexedLayer
+    false,                  // backgroundInExtmem
+    sizeof(decoder),
+    kMatrixWidth,           // gifCanvasWidth
+    kMatrixHeight,          // gifCanvasHeight
+    false,                  // gifTurbo - the turbo buffer comes from gifArena
+    false,                  // gifFrameBuffer
+    0,                      // cacheBytes
+    sizeof(bm_brat) + sizeof(bm_surprised_pikachu), // bm_ariel_dance is PROGMEM
+    sizeof(audioBeat) + sizeof(telemetry) + sizeof(frameStream) + sizeof(frameSync) + GIF_NAME_POOL_BYTES,
+    kGifArenaBytes
+};
+constexpr RamBudget kRamBudget = planRamBudget(kRamBudgetConfig);
+static_assert(kRamBudget.fitsRam1(), "RAM1 over budget: lower the layer sizes or COLOR_DEPTH, or raise RAM_BUDGET_RAM1_BYTES");
+static_assert(kRamBudget.fitsRam2(), "RAM2 over budget: lower kRefreshDepth, kDmaBufferRows or the GIF buffers/caches");
+static_assert(kRamBudget.fitsExtmem(), "EXTMEM over budget");
+
+
+// Whether the GIF frame being decoded has drawn anything the draw buffer didn't already have. The decoder draws
+// frames on top of the one before, so a frame that hasn't changed can stay up for its delay too, without a swap.
+static bool frameChanged = false;
+// The GIF playing's decoded frames, and how many were held
+static uint32_t gifFrames = 0;
+static uint32_t gifFramesHeld = 0;
+// Times the GIF playing has been through on screen, which the decoder is a frame ahead of with the interpolator
+static uint32_t gifCyclesShown = 0;
+static bool aheadEndsLoop = false;      // the frame decoded ahead of the interpolator is the last of a loop
+
+// A decoded GIF frame that's the same as the one up, or empty, so it stays up without a swap
+void countHeldFrame(void) {
+  framesHeld++;
+  gifFramesHeld++;
+}
 
+// With the interpolator, which presents on its own timing, the frame up takes on the held frame's delay
+void holdShownFrame(uint16_t delay_ms) {
+  countHeldFrame();
+  if (frameDueValid) {
+    frameDue_us += delay_ms * 1000;
+  }
+  frameSync.frameHeld(delay_ms);
+}
 
 void screenClearCallback(void) {
   backgroundLayer.fillScreen({0,0,0});
+  frameChanged = true;
 }
 
 void updateScreenCallback(void) {
-  backgroundLayer.swapBuffers();
+  bool changed = frameChanged;
+  frameChanged = false;
+  gifFrames++;
+  if (interpolator.isRunning()) {
+    if (!changed && interpolator.holdFrame(decoder.getFrameDelay_ms())) {
+      holdShownFrame(decoder.getFrameDelay_ms());
+      return;
+    }
+    // presented later by drawImageWithSD(), blended with the frame before it
+    interpolator.captureFrame(backgroundLayer.backBuffer(), decoder.getFrameDelay_ms(), !changed);
+  } else if (!changed) {
+    // the draw buffer is still what's on screen, drawImageWithSD() holds it up for this frame's delay as well
+    countHeldFrame();
+  } else {
+    uint32_t start = micros();
+    backgroundLayer.swapBuffers();
+    lastSwap_us = micros() - start;
+    swapTimer.add(lastSwap_us);
+    telemetry.swap.add(lastSwap_us);
+    framesShown++;
+    telemetry.frames++;
+  }
 }
 
 void drawPixelCallback(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    // compared until the first pixel that changes, after that it's drawn regardless
+    if (!frameChanged) {
+        rgb24 pixel = backgroundLayer.readPixel(x, y);
+        if (pixel.red == red && pixel.green == green && pixel.blue == blue) {
+            return;
+        }
+        frameChanged = true;
+    }
     backgroundLayer.drawPixel(x, y, {red, green, blue});
 }
 
+// Frames of up to 16 colours (GIFDECODER_RUN_MAX_BPP) or of long runs (GIFDECODER_RUN_MIN_LENGTH) come a run of one
+// colour at a time, drawn as a line
+const bool use_runs = true;
+
+void drawRunCallback(int16_t x, int16_t y, int16_t count, uint8_t red, uint8_t green, uint8_t blue) {
+    // as drawPixelCallback(), the leading pixels the draw buffer already has are skipped until one changes
+    if (!frameChanged) {
+        while (count > 0) {
+            rgb24 pixel = backgroundLayer.readPixel(x, y);
+            if (pixel.red != red || pixel.green != green || pixel.blue != blue) {
+                break;
+            }
+            x++;
+            count--;
+        }
+        if (!count) {
+            return;
+        }
+        frameChanged = true;
+    }
+    backgroundLayer.drawFastHLine(x, x + count - 1, y, {red, green, blue});
+}
+
+// The decoder's own compositing, a line at a time, timed for compositeTimer
+void drawLineCallback(GIFDRAW *pDraw) {
+    uint32_t start = micros();
+    decoder.compositeLine(pDraw);
+    composite_us += micros() - start;
+}
+
 int wrap_enumerateGIFFiles(const char *directoryName, bool displayFilenames) {
     if (use_sd) {
         return enumerateGIFFiles(directoryName, displayFilenames);
@@ -200,7 +450,7 @@ void maybeClearDebugScreen(unsigned long now) {
 
 // Writes debug string text. If end == true, clears
 // debug text after a few seconds of no changes.
-void writeDebugScreen(char text[], unsigned long now, bool allow_clear = true) {
+void writeDebugScreen(const char *text, unsigned long now, bool allow_clear = true) {
     allow_debug_clear = allow_clear;
     indexedLayer.fillScreen(0);
     indexedLayer.setIndexedColor(1, COLOR_BLACK);
@@ -300,8 +550,27 @@ void adjustBrightness(int amount) {
 int num_files = 0;
 static int cur_image_idx = 0;
 bool is_first_frame = true;
+
+// Keeps the GIF playing where it is, before switching away from it
+void snapshotGif(void) {
+    if (is_first_frame || decoder.isFramePending()) {
+        return;
+    }
+    // the canvas the decoder draws the next frame over
+    const rgb24 *canvas = interpolator.isRunning() ? interpolator.newestFrame() : backgroundLayer.backBuffer();
+    snapshots.save(cur_image_idx, decoder, canvas);
+}
+
+// Switches GIFs by amount, or starts the one playing over with 0
 void change_image_idx(int amount) {
+    // a leader's GIFs start from the top, where its followers start them
+    bool resume = amount && use_snapshots && snapshots.getCount() && frameSync.getRole() != FRAME_SYNC_LEADER;
+    if (resume) {
+        snapshotGif();
+    }
     cur_image_idx = cur_image_idx + amount;
+    switchPending = true;
+    switchStart_us = micros();
 
     // Wrap around images on overflow.
     if (cur_image_idx < 0) {
@@ -309,10 +578,15 @@ void change_image_idx(int amount) {
     } else if (cur_image_idx >= num_files) {
         cur_image_idx = 0;
     }
-    backgroundLayer.fillScreen(COLOR_BLACK);
-    backgroundLayer.swapBuffers();
-    backgroundLayer.fillScreen(COLOR_BLACK);
-    backgroundLayer.swapBuffers();
+    resumeNextGif = resume;
+    advancePending = false;
+    // a GIF that resumes puts its own frame straight back up
+    if (!resume || !snapshots.has(cur_image_idx)) {
+        backgroundLayer.fillScreen(COLOR_BLACK);
+        backgroundLayer.swapBuffers();
+        backgroundLayer.fillScreen(COLOR_BLACK);
+        backgroundLayer.swapBuffers();
+    }
     is_first_frame = true;
 }
 
@@ -345,19 +619,23 @@ void HandleIRInputs(unsigned long now) {
     switch(received_data) {
         case BUT_VOL_DOWN:
             adjustBrightness(-26);
-            strcat(debug_buf, "BRT: ");
-            strcat(debug_buf, String(brightness).c_str());
+            snprintf(debug_buf, sizeof(debug_buf), "BRT: %d", brightness);
             break;
         case BUT_VOL_UP:
             adjustBrightness(26);
-            strcat(debug_buf, "BRT: ");
-            strcat(debug_buf, String(brightness).c_str());
+            snprintf(debug_buf, sizeof(debug_buf), "BRT: %d", brightness);
             break;
+        // ignored during a live stream, clearing the screen would corrupt its next delta, and while following a
+        // leader, which picks the GIF
         case BUT_LEFT:
-            change_image_idx(-1);
+            if (!frameStream.isActive(now) && !frameSync.isFollowing(micros())) {
+                change_image_idx(-1);
+            }
             break;
         case BUT_RIGHT:
-            change_image_idx(1);
+            if (!frameStream.isActive(now) && !frameSync.isFollowing(micros())) {
+                change_image_idx(1);
+            }
             break;
         default:
             // Unhandled buttons just display name.
@@ -372,6 +650,102 @@ void HandleIRInputs(unsigned long now) {
     IrReceiver.resume(); // Receive the next value
 }
 
+// bench <gif> times two loops of a GIF as it plays, the first read from the SD card and the second mostly from the
+// file cache, then goes back to the GIF that was playing
+static int benchGif = -1;               // -1 when no bench is running
+static int benchReturnGif = 0;
+static int benchCycle = -1;             // loops timed so far, -1 until the GIF has started
+static unsigned long benchStart = 0;
+static StageTimer benchDecode;
+static FileCacheStats benchCache;
+
+void startBench(int index) {
+    benchReturnGif = cur_image_idx;
+    benchGif = index;
+    benchCycle = -1;
+    cur_image_idx = index;
+    change_image_idx(0);
+}
+
+void endBench(void) {
+    benchGif = -1;
+    cur_image_idx = benchReturnGif;
+    change_image_idx(0);
+}
+
+void benchGifStarted(unsigned long now) {
+    if (cur_image_idx != benchGif) {
+        Serial.println("bench: interrupted by another GIF");
+        benchGif = -1;
+        return;
+    }
+    benchCycle = 0;
+    benchStart = now;
+    benchDecode.reset();
+    benchCache = getFileCacheStats();
+}
+
+void benchFrame(unsigned long now, uint32_t decode_us, int result) {
+    if (benchCycle < 0) {
+        return;
+    }
+    if (result < 0) {
+        Serial.printf("bench: decoder error %d\n", result);
+        endBench();
+        return;
+    }
+    benchDecode.add(decode_us);
+    if (decoder.getCycleNumber() == benchCycle) {
+        return;
+    }
+
+    const FileCacheStats &cache = getFileCacheStats();
+    uint32_t cached = cache.hitBytes - benchCache.hitBytes;
+    uint32_t total = cached + cache.missBytes - benchCache.missBytes + cache.uncachedBytes - benchCache.uncachedBytes;
+    Serial.printf("bench %s loop %d: %d frames in %lu ms (%d ms in the GIF), decode %lu us avg %lu us max, "
+        "%lu card reads in %lu us, %lu%% of %lu bytes from the cache\n", my_sd_file.name(), benchCycle + 1,
+        decoder.getFrameCount(), now - benchStart, decoder.getCycleTime(), benchDecode.average_us(),
+        benchDecode.max_us, cache.cardReads - benchCache.cardReads, cache.read_us - benchCache.read_us,
+        total ? cached * 100 / total : 0, total);
+
+    benchCycle++;
+    benchStart = now;
+    benchDecode.reset();
+    benchCache = cache;
+    if (benchCycle == 2) {
+        endBench();
+    }
+}
+
+// decoder.decodeFrame() with its time recorded for stats, trace and bench
+int decodeFrameTimed(unsigned long now) {
+    uint32_t cardReads = getFileCacheStats().cardReads;
+    uint32_t held = gifFramesHeld;
+    lastSwap_us = 0;
+    composite_us = 0;
+    uint32_t start = micros();
+    int result = decoder.decodeFrame(false);
+    uint32_t decode_us = micros() - start - lastSwap_us;
+    if (result != ERROR_WAITING) {
+        gifLoopEnded = result == ERROR_DONE_PARSING;
+    }
+    decodeTimer.add(decode_us);
+    compositeTimer.add(composite_us);
+    telemetry.decode.add(decode_us);
+
+    if (trace) {
+        Serial.printf("frame %d%s at %lu: %u ms delay, decode %lu us, swap %lu us, %lu card reads\n",
+            decoder.getFrameNumber(), result == ERROR_WAITING ? " (part)" : decoder.isFrameEmpty() ? " (empty)" :
+            gifFramesHeld != held ? " (held)" : "", now, decoder.getFrameDelay_ms(),
+            decode_us, lastSwap_us,
+            getFileCacheStats().cardReads - cardReads);
+    }
+    if (benchGif >= 0) {
+        benchFrame(now, decode_us, result);
+    }
+    return result;
+}
+
 void drawBitmap64(int16_t x, int16_t y, const gimp64x64bitmap* bitmap) {
   for(unsigned int i=0; i < bitmap->height; i++) {
     for(unsigned int j=0; j < bitmap->width; j++) {
@@ -383,68 +757,156 @@ void drawBitmap64(int16_t x, int16_t y, const gimp64x64bitmap* bitmap) {
   }
 }
 
-void displayGIFFromMemoryById(int id, unsigned long now) {
-    // these variables keep track of when we're done displaying the last frame and are ready for a new frame
-    static uint32_t lastFrameDisplayTime = 0;
-    static unsigned int currentFrameDelay = 0;
+#include "ContentSource.h"
 
-    // Check if we should display the next frame on this cycle.
-    if ((now - lastFrameDisplayTime) > currentFrameDelay) {
-        if (is_first_frame) {
-            if(decoder.startDecoding((uint8_t *)gifsList[0], gifsSizeList[0]) < 0) {
-                writeDebugScreen("Bad frame", now);
-                lastFrameDisplayTime = 0;
-            }
+// A still image, or black without one
+class BitmapSource : public StaticSource {
+public:
+    BitmapSource(const gimp64x64bitmap *bitmap) : bitmap(bitmap) {}
+
+protected:
+    void draw(void) override {
+        if (bitmap) {
+            drawBitmap64(0, 0, bitmap);
+        } else {
+            backgroundLayer.fillScreen(COLOR_BLACK);
         }
-        // decode frame without delaying after decode
-        int result = decoder.decodeFrame(false);
+    }
+
+private:
+    const gimp64x64bitmap *bitmap;
+};
 
-        lastFrameDisplayTime = now;
-        currentFrameDelay = decoder.getFrameDelay_ms();
+// A GIF built into the sketch, the decoder's callbacks swap its frames up
+class MemoryGifSource : public ContentSource {
+public:
+    MemoryGifSource(const uint8_t *gif, int size) : gif(gif), size(size) {}
 
-        // it's time to start decoding a new GIF if there was an error, and don't wait to decode
-        if(result < 0) {
-            writeDebugScreen("Bad frame", now);
-            lastFrameDisplayTime = 0;
-            currentFrameDelay = 0;
+    bool prepare(uint32_t now_ms) override {
+        lastFrame_ms = 0;
+        frameDelay_ms = 0;
+        if (decoder.startDecoding((uint8_t *)gif, size) < 0) {
+            writeDebugScreen("Bad frame", millis());
+            return false;
         }
+        return true;
+    }
+
+    bool nextFrameDeadline(uint32_t now_ms, uint32_t &at_ms) const override {
+        // partway through a frame, or after an error, it carries straight on
+        at_ms = decoder.isFramePending() || !lastFrame_ms ? now_ms : lastFrame_ms + frameDelay_ms + 1;
+        return true;
     }
+
+    bool render(uint32_t now_ms) override {
+        int result = decodeFrameTimed(millis());
+        if (result == ERROR_WAITING) {
+            return false;
+        }
+        lastFrame_ms = now_ms;
+        frameDelay_ms = decoder.getFrameDelay_ms();
+        if (result < 0) {
+            writeDebugScreen("Bad frame", millis());
+            lastFrame_ms = 0;
+            frameDelay_ms = 0;
+        }
+        return false;
+    }
+
+private:
+    const uint8_t *gif;
+    int size;
+    uint32_t lastFrame_ms = 0;
+    uint32_t frameDelay_ms = 0;
+};
+
+// Without the SD card, what each image index shows
+BitmapSource blackSource(NULL);
+BitmapSource bratSource(&bm_brat);
+BitmapSource pikachuSource(&bm_surprised_pikachu);
+MemoryGifSource arielSource(gifsList[0], gifsSizeList[0]);
+ContentSource * const noSdSources[] = { &blackSource, &bratSource, &pikachuSource, &arielSource };
+
+// 0 until the GIF has been through once on screen
+uint32_t gifCycleTime(void) {
+    return gifCyclesShown ? decoder.getCycleTime() : 0;
 }
 
-void drawImageNoSD(unsigned long now) {
-    switch(cur_image_idx) {
-        case 0:
-            backgroundLayer.fillScreen(COLOR_BLACK);
-            backgroundLayer.swapBuffers();
-            break;
-        case 1:
-            drawBitmap64(0, 0, &bm_brat);
-            backgroundLayer.swapBuffers();
-            break;
-        case 2:
-            drawBitmap64(0, 0, &bm_surprised_pikachu);
-            backgroundLayer.swapBuffers();
-            break;
-        case 3:
-            displayGIFFromMemoryById(0, now);
-            break;
-        default:
-            backgroundLayer.fillScreen(COLOR_BLACK);
-            backgroundLayer.swapBuffers();
+// The next GIF frame is more than margin_us off, time enough for a card access that won't hold it up
+bool nextFrameFarOff(uint32_t now_us, uint32_t margin_us) {
+    return frameDueValid && !decoder.isFramePending() && (int32_t)(frameDue_us - now_us) > (int32_t)margin_us;
+}
+
+// A GIF frame went up at frameTime, for delay ms: tells frame sync, and times how late it was and a GIF switch
+void gifFrameShown(unsigned long frameTime, uint32_t delay) {
+    uint32_t now_us = micros();
+    if (frameDueValid) {
+        uint32_t late_us = (int32_t)(now_us - frameDue_us) > 0 ? now_us - frameDue_us : 0;
+        lateFrames.add(late_us);
+        telemetry.addLate(late_us);
+    }
+    if (switchPending) {
+        // a GIF auto-advance switched to is timed from the end of the last one's loop instead
+        if (advancePending) {
+            uint32_t cut_us = (int32_t)(now_us - advanceDue_us) > 0 ? now_us - advanceDue_us : 0;
+            advance.switched(cut_us, getFileCacheStats().prefetchedOpens != advancePrefetchedOpens);
+            advancePending = false;
+        } else {
+            switchTimer.add(now_us - switchStart_us);
+        }
+        if (switchResumed) {
+            snapshots.resumeShown(now_us - switchStart_us);
+        }
+        switchPending = false;
+    }
+    if (showGifPending) {
+        const FileCacheStats &cache = getFileCacheStats();
+        show.gifShown(millis(), cache.prefetchedOpens != showPrefetchedOpens, cache.cardReads - showCardReads);
+        showGifPending = false;
     }
+    frameDue_us = now_us + delay * 1000;
+    frameDueValid = true;
+    frameSync.frameShown(frameTime, delay, gifCycleTime());
 }
 
-void drawImageWithSD(unsigned long now) {
-    // For GIFs
-    // these variables keep track of when we're done displaying the last frame and are ready for a new frame
-    static uint32_t lastFrameDisplayTime = 0;
-    static unsigned int currentFrameDelay = 0;
-    static bool start_ok = true;
+// Auto-advance picks the GIFs unless a show, a frame sync leader or the bench does
+bool advancing(uint32_t now_us) {
+    return use_advance && advance.isOn() && num_files > 1 && benchGif < 0 && !(use_show && show.isRunning()) &&
+        !(use_sync && frameSync.isFollowing(now_us));
+}
+
+// Moves on to the next GIF at the end of a loop, its first frame following on from the last frame up
+void advanceGif(void) {
+    cur_image_idx = (cur_image_idx + 1) % num_files;
+    switchPending = true;
+    switchStart_us = micros();
+    advancePending = true;
+    advanceDue_us = frameDueValid ? frameDue_us : switchStart_us;
+    advancePrefetchedOpens = getFileCacheStats().prefetchedOpens;
+    resumeNextGif = false;
+    is_first_frame = true;
+}
+
+// For GIFs
+// these variables keep track of when we're done displaying the last frame and are ready for a new frame
+static uint32_t lastFrameDisplayTime = 0;
+static unsigned int currentFrameDelay = 0;
+static bool start_ok = true;
+
+// frames are paced by frameTime, which is now unless frame sync is slewing it
+void drawImageWithSD(unsigned long now, unsigned long frameTime) {
+    // at the end of a loop, when the next frame would be the first of the next loop
+    if (!is_first_frame && gifLoopEnded && !decoder.isFramePending() && (interpolator.isRunning() ?
+            interpolator.needsDecode(frameTime) && !backgroundLayer.isSwapPending() :
+            (frameTime - lastFrameDisplayTime) > currentFrameDelay) && advancing(micros()) &&
+            advance.loopEnded(now, gifCyclesShown, gifCycleTime())) {
+        advanceGif();
+    }
 
     if (is_first_frame) {
-        char name_buf[63];
+        char name_buf[GIF_NAME_BYTES];
         name_buf[0] = 0;
-        if(!openGifFilenameByIndex("/gifs/", cur_image_idx, name_buf)) {
+        if(!openGifFilenameByIndex("/gifs/", cur_image_idx, name_buf, sizeof(name_buf))) {
             writeDebugScreen("Fail", now);
             Serial.println("Fail");
         } else {
@@ -459,31 +921,774 @@ void drawImageWithSD(unsigned long now) {
     }
 
     // // Check if we should display the next frame on this cycle.
-    if ((now - lastFrameDisplayTime) > currentFrameDelay) {
+    if ((frameTime - lastFrameDisplayTime) > currentFrameDelay) {
         if (is_first_frame || !start_ok) {
-            backgroundLayer.fillScreen(COLOR_BLACK);
-            backgroundLayer.swapBuffers();
-            if(decoder.startDecoding() < 0) {
+            // the draw buffer is only ours once the last swap has gone through
+            while (backgroundLayer.isSwapPending());
+            uint16_t resumedDelay_ms = 0;
+            switchResumed = is_first_frame && resumeNextGif &&
+                snapshots.resume(cur_image_idx, decoder, backgroundLayer.backBuffer(), resumedDelay_ms);
+            // a GIF advanced to at the end of a loop goes up in place of the last frame, startDecoding() clears the
+            // draw buffer for it
+            if (!switchResumed && !advancePending) {
+                backgroundLayer.fillScreen(COLOR_BLACK);
+                backgroundLayer.swapBuffers();
+            }
+#ifdef SIMULATOR_MODE
+            if (gifFrames) {
+                Serial.printf("Held %lu of the last GIF's %lu frames\n", (unsigned long)gifFramesHeld,
+                    (unsigned long)gifFrames);
+            }
+#endif
+            frameChanged = false;
+            gifFrames = gifFramesHeld = 0;
+            if(!switchResumed && decoder.startDecoding() < 0) {
                 lastFrameDisplayTime = 0;
                 start_ok = false;
                 return;
             }
+            frameSync.gifStarted(cur_image_idx, frameTime);
+            advance.gifStarted(now);
+            gifLoopEnded = false;
+            gifCyclesShown = decoder.getCycleNumber();
+            aheadEndsLoop = false;
+            frameDueValid = false;
+            if (benchGif >= 0) {
+                benchGifStarted(now);
+            }
+#ifdef SIMULATOR_MODE
+            gifArena.printReport(Serial);
+            interpolator.printReport(Serial);
+#endif
+            if (kInterpolationFps) {
+                if (advancePending) {
+                    interpolator.follow();
+                } else {
+                    interpolator.start();
+                }
+            }
+            // the frame up when the GIF was left goes back up, and the next decoded goes on from it
+            if (switchResumed) {
+                if (interpolator.isRunning()) {
+                    interpolator.captureFrame(backgroundLayer.backBuffer(), resumedDelay_ms);
+                } else {
+                    backgroundLayer.swapBuffers();
+                    framesShown++;
+                    telemetry.frames++;
+                    lastFrameDisplayTime = frameTime;
+                    currentFrameDelay = resumedDelay_ms;
+                    start_ok = true;
+                    gifFrameShown(frameTime, currentFrameDelay);
+                    return;
+                }
+            }
         }
         start_ok = true;
-        // decode frame without delaying after decode
-        int result = decoder.decodeFrame(false);
+        if (!interpolator.isRunning()) {
+            // decode frame without delaying after decode
+            int result = decodeFrameTimed(now);
+            // partway through the frame, carry on with it next loop
+            if (result == ERROR_WAITING) {
+                return;
+            }
+
+            lastFrameDisplayTime = frameTime;
+            currentFrameDelay = decoder.getFrameDelay_ms();
+
+            if(result < 0) {
+                lastFrameDisplayTime = 0;
+                currentFrameDelay = 0;
+                start_ok = false;
+            } else {
+                if (decoder.isFrameEmpty()) {
+                    gifFrames++;
+                    countHeldFrame();
+                }
+                if (result == ERROR_DONE_PARSING) {
+                    gifCyclesShown++;
+                }
+                gifFrameShown(frameTime, currentFrameDelay);
+            }
+        }
+    }
+
+    // the interpolator decodes one frame ahead and presents on its own timing
+    if (interpolator.isRunning()) {
+        // the draw buffer is only ours again once the last swap has gone through
+        if (backgroundLayer.isSwapPending()) {
+            swapPendingLoops++;
+            return;
+        }
+        if (interpolator.needsDecode(frameTime)) {
+            // a frame left partway through goes on over the lines already drawn
+            if (!decoder.isFramePending()) {
+                interpolator.prepareDecode(backgroundLayer.backBuffer());
+            }
+            int result = decodeFrameTimed(now);
+            if (result < 0) {
+                interpolator.stop();
+                lastFrameDisplayTime = 0;
+                currentFrameDelay = 0;
+                start_ok = false;
+                return;
+            }
+            // the draw buffer holds part of a frame until the next loops finish it
+            if (result == ERROR_WAITING) {
+                return;
+            }
+            if (decoder.isFrameEmpty()) {
+                gifFrames++;
+                if (interpolator.holdFrame(decoder.getFrameDelay_ms())) {
+                    holdShownFrame(decoder.getFrameDelay_ms());
+                }
+            }
+            // a loop's last frame ends it on screen when it goes up, or now if it was held on the one up
+            if (result == ERROR_DONE_PARSING) {
+                if (interpolator.hasAhead()) {
+                    aheadEndsLoop = true;
+                } else {
+                    gifCyclesShown++;
+                }
+            }
+        }
+        uint32_t keyFrames = interpolator.getStats().keyFrames;
+        if (interpolator.present(frameTime, backgroundLayer.backBuffer())) {
+            backgroundLayer.swapBuffers(false);
+            framesShown++;
+            telemetry.frames++;
+            if (interpolator.getStats().keyFrames != keyFrames) {
+                if (aheadEndsLoop) {
+                    gifCyclesShown++;
+                    aheadEndsLoop = false;
+                }
+                gifFrameShown(frameTime, interpolator.getShownDelay_ms());
+            }
+        }
+    }
+}
+
+// The SD card's GIF at cur_image_idx, drawImageWithSD() paced by the frame clock.  It opens the GIF on its first
+// render(), as it does the next one when auto-advance moves on at the end of a loop, and swaps its frames up itself
+class GifFileSource : public ContentSource {
+public:
+    bool prepare(uint32_t now_ms) override {
+        return true;
+    }
+
+    bool nextFrameDeadline(uint32_t now_ms, uint32_t &at_ms) const override {
+        // a GIF starting or a frame partway through carries straight on
+        if (is_first_frame || decoder.isFramePending()) {
+            at_ms = now_ms;
+            return true;
+        }
+        // the interpolator's next decode or blend, and until the last swap has gone through, whether it has
+        if (interpolator.isRunning()) {
+            bool due = backgroundLayer.isSwapPending() || interpolator.needsDecode(now_ms);
+            at_ms = due ? now_ms : interpolator.nextPresent(now_ms);
+            return true;
+        }
+        at_ms = lastFrameDisplayTime + currentFrameDelay + 1;
+        return true;
+    }
+
+    bool render(uint32_t now_ms) override {
+        drawImageWithSD(millis(), now_ms);
+        return false;
+    }
+};
+
+GifFileSource gifFileSource;
+
+// The live stream, while it plays instead of the GIFs: FrameStream draws its frames straight into the draw buffer as
+// they come in over Serial, and render() swaps them up
+class StreamSource : public ContentSource {
+public:
+    // Reads what's come in, true while a stream is playing.  Called every loop, a stream starts with a key frame
+    bool receive(uint32_t now_ms) {
+        // the draw buffer is only the stream's once the last swap has gone through and the frame in it is up
+        if (!ready && !backgroundLayer.isSwapPending()) {
+            ready = frameStream.poll(Serial, backgroundLayer.backBuffer(), now_ms) == FRAME_STREAM_FRAME_READY;
+        }
+        return frameStream.isActive(now_ms);
+    }
+
+    bool prepare(uint32_t now_ms) override {
+        interpolator.stop();
+        writeDebugScreen("LIVE", now_ms);
+        return true;
+    }
+
+    bool nextFrameDeadline(uint32_t now_ms, uint32_t &at_ms) const override {
+        at_ms = now_ms;
+        return ready;
+    }
+
+    bool render(uint32_t now_ms) override {
+        // copy, the next delta applies to this frame
+        uint32_t swapStart = micros();
+        backgroundLayer.swapBuffers();
+        uint32_t swap_us = micros() - swapStart;
+        swapTimer.add(swap_us);
+        telemetry.swap.add(swap_us);
+        framesShown++;
+        telemetry.frames++;
+        frameStream.framePresented(Serial);
+        ready = false;
+        return false;
+    }
+
+private:
+    bool ready = false;             // a frame in the draw buffer to go up
+};
+
+StreamSource streamSource;
+
+// Returns true while a live stream is playing instead of the GIFs, its frames go up through the content player
+bool pollFrameStream(unsigned long now) {
+    static bool streaming = false;
+    uint32_t start = micros();
+
+    bool active = streamSource.receive(now);
+    if (!active && streaming) {
+#ifdef SIMULATOR_MODE
+        frameStream.printReport(Serial);
+#endif
+        // back to the GIF that was playing, from the start
+        change_image_idx(0);
+    }
+    streaming = active;
+    streamTimer.add(micros() - start);
+    return streaming;
+}
+
+// Whatever's on the screen goes through this, a GIF, a still image or the live stream
+ContentPlayer content;
+
+// What the playlist shows at cur_image_idx: the SD card's GIFs, or without the card what's built into the sketch
+ContentSource * playlistSource(void) {
+    if (use_sd) {
+        return &gifFileSource;
+    }
+    int count = sizeof(noSdSources) / sizeof(noSdSources[0]);
+    return cur_image_idx >= 0 && cur_image_idx < count ? noSdSources[cur_image_idx] : &blackSource;
+}
+
+// Plays source, switched to when it isn't what's up or the playlist has moved on, paced by the frame clock
+void playContent(ContentSource *source, unsigned long frameTime) {
+    if (source != content.getSource() || (source != &streamSource && is_first_frame)) {
+        content.play(source);
+    }
+    if (content.poll(frameTime)) {
+        uint32_t start = micros();
+        backgroundLayer.swapBuffers();
+        swapTimer.add(micros() - start);
+        framesShown++;
+        telemetry.frames++;
+    }
+}
+
+// Returns the time to pace GIF frames by
+unsigned long pollFrameSync(unsigned long now) {
+    uint32_t now_us = micros();
+    frameSync.update(Serial3, now_us);
+    syncTimer.add(micros() - now_us);
+
+    // followers play whatever the leader plays
+    int32_t gif = frameSync.leaderGif(now_us);
+    if (gif >= 0 && num_files && gif % num_files != cur_image_idx) {
+        cur_image_idx = gif % num_files;
+        change_image_idx(0);
+    }
+
+#ifdef SIMULATOR_MODE
+    static unsigned long lastReport = 0;
+    if (now - lastReport >= 5000) {
+        lastReport = now;
+        frameSync.printReport(Serial, now_us);
+    }
+#endif
+    return frameSync.frameTime();
+}
+
+#ifdef SIMULATOR_MODE
+// The simulator has no ADC trigger, the samples due since the last call are read here (from --audio's WAV file)
+void sampleAudio(void) {
+    static uint32_t last_us = micros();
+    static uint64_t owed = 0;   // samples * 1000000
+    uint32_t now_us = micros();
+    owed += (uint64_t)(now_us - last_us) * AUDIO_BEAT_SAMPLE_RATE;
+    last_us = now_us;
+    uint16_t samples[AUDIO_BEAT_HOP];
+    uint32_t count = 0;
+    for (; owed >= 1000000; owed -= 1000000) {
+        samples[count++] = analogRead(AUDIO_PIN);
+        if (count == AUDIO_BEAT_HOP) {
+            audioBeat.pushSamples(samples, count);
+            count = 0;
+        }
+    }
+    audioBeat.pushSamples(samples, count);
+}
+#endif
 
-        lastFrameDisplayTime = now;
-        currentFrameDelay = decoder.getFrameDelay_ms();
+// Returns the time to pace GIF frames by, frameTime run at the music's tempo and pulsed on its beats
+unsigned long pollAudio(unsigned long frameTime) {
+    uint32_t start = micros();
+#ifdef SIMULATOR_MODE
+    sampleAudio();
+#else
+    audioSampler.take(audioBeat);
+#endif
+    audioBeat.update();
+    audioTimer.add(micros() - start);
+
+    // a follower keeps to its leader's frames and brightness
+    if (use_sync && frameSync.isFollowing(start)) {
+        return frameTime;
+    }
+    static int shownBrightness = -1;
+    int flashed = audioBeat.brightness(brightness, max_brightness);
+    if (flashed != shownBrightness) {
+        shownBrightness = flashed;
+        matrix.setBrightness(flashed);
+    }
+    // a leader's frame times are on the sync clock its followers steer to, so it only flashes
+    uint32_t paced = audioBeat.frameTime(frameTime);
+    return use_sync && frameSync.getRole() == FRAME_SYNC_LEADER ? frameTime : paced;
+}
+
+// The panel's current at the brightness shown, from the last frame the draw buffer held
+uint16_t estimateCurrent_mA(uint8_t shownBrightness) {
+    static uint16_t level = 0;
+    if (!backgroundLayer.isSwapPending()) {
+        level = Telemetry::lightLevel(backgroundLayer.backBuffer(), kMatrixWidth * kMatrixHeight);
+    }
+    return Telemetry::current_mA(level, kMatrixWidth * kMatrixHeight, shownBrightness);
+}
+
+// Records the last period when it's due, and writes a block to the card when the next frame is far enough off
+void pollTelemetry(unsigned long now) {
+    if (!telemetry.isRecording()) {
+        return;
+    }
+    bool streaming = use_stream && frameStream.isActive(now);
+    if (telemetry.due(now)) {
+        uint8_t flags = (streaming ? TELEMETRY_STREAMING : 0) |
+            (use_sync && frameSync.isFollowing(micros()) ? TELEMETRY_FOLLOWING : 0) |
+            (use_audio && audioBeat.isLocked() ? TELEMETRY_BEAT_LOCKED : 0) |
+            (backgroundLayer.isSwapPending() ? TELEMETRY_SWAP_PENDING : 0);
+        uint8_t shown = use_audio ? audioBeat.brightness(brightness, max_brightness) : brightness;
+        telemetry.record(now, cur_image_idx, shown, estimateCurrent_mA(shown), flags);
+    }
+
+    uint32_t now_us = micros();
+    bool idle = streaming ? frameStream.isIdle() : nextFrameFarOff(now_us, TELEMETRY_IDLE_US);
+    if (idle) {
+        telemetry.flush(telemetryFile, now_us);
+    }
+}
+
+int showGifIndex(const char *name) {
+    return findGIFIndexByName(GIF_DIRECTORY, name);
+}
+
+// Takes the buffer the next GIF is read ahead into from the GIF arena, once, without one if there's no room
+void allocPrefetchBuffer(void) {
+    if (!gifPrefetchBuffer) {
+        gifPrefetchBuffer = (uint8_t *)gifArena.alloc(kPrefetchBytes, "prefetch");
+        setPrefetchBuffer(gifPrefetchBuffer, gifPrefetchBuffer ? kPrefetchBytes : 0);
+    }
+}
+
+// (Re)loads SHOW_FILE and plays it from the start, false if there isn't one that plays
+bool startShow(unsigned long now) {
+    show.stop();
+    showFile = SD.open(SHOW_FILE);
+    if (!showFile) {
+        return false;
+    }
+    if (!show.open(showFile, showGifIndex)) {
+        Serial.println("Can't play " SHOW_FILE ", recompile it with led_show");
+        return false;
+    }
+    allocPrefetchBuffer();
+    show.resetStats();
+    show.start(now);
+    return true;
+}
+
+// Ramps brightness to level over ms, with the audio's flash on top when there is one
+static int rampFrom = 0, rampTo = 0;
+static uint32_t rampStart = 0, rampMs = 0;
+static bool ramping = false;
+static int fadedBrightness = -1;        // before the last fade out, until the fade in
+
+void rampBrightness(int level, uint32_t ms, unsigned long now) {
+    rampFrom = brightness;
+    rampTo = constrain(level, 0, max_brightness);
+    rampStart = now;
+    rampMs = ms;
+    ramping = true;
+}
+
+void applyShowCue(const ShowCue &cue, unsigned long now) {
+    int index;
+    switch (cue.type) {
+        case SHOW_CUE_PREFETCH:
+            index = show.gifIndex(cue);
+            if (index >= 0 && index != cur_image_idx) {
+                prefetchGifByIndex(GIF_DIRECTORY, index);
+            }
+            break;
+        case SHOW_CUE_GIF:
+            index = show.gifIndex(cue);
+            if (index < 0 || benchGif >= 0) {
+                break;
+            }
+            cur_image_idx = index;
+            // a live stream keeps the panel, and goes back to this GIF when it stops
+            if (!frameStream.isActive(now)) {
+                switchPending = true;
+                switchStart_us = micros();
+                is_first_frame = true;
+                resumeNextGif = false;
+                advancePending = false;
+                showGifPending = true;
+                showPrefetchedOpens = getFileCacheStats().prefetchedOpens;
+                showCardReads = getFileCacheStats().cardReads;
+            }
+            break;
+        case SHOW_CUE_BRIGHTNESS:
+            rampBrightness(cue.value, cue.ms, now);
+            break;
+        case SHOW_CUE_FADE_OUT:
+            fadedBrightness = ramping ? rampTo : brightness;
+            rampBrightness(0, cue.ms, now);
+            break;
+        case SHOW_CUE_FADE_IN:
+            if (fadedBrightness >= 0) {
+                rampBrightness(fadedBrightness, cue.ms, now);
+                fadedBrightness = -1;
+            }
+            break;
+        case SHOW_CUE_EFFECT:
+            if (cue.effect == SHOW_EFFECT_PULSE) {
+                audioBeat.setPulse(min(cue.value, (uint16_t)100));
+            } else if (cue.effect == SHOW_EFFECT_FLASH) {
+                audioBeat.setFlash(min(cue.value, (uint16_t)100));
+            } else if (cue.effect == SHOW_EFFECT_TEMPO) {
+                audioBeat.setTempo(cue.value != 0);
+            } else if (cue.effect == SHOW_EFFECT_SMOOTH) {
+                interpolator.setTargetFps(cue.value);
+            }
+            break;
+        case SHOW_CUE_END:
+            Serial.println(show.isRunning() ? "Show starting over" : "Show over");
+            break;
+    }
+}
+
+// Fires the show's cues that are due, and reads ahead the GIF it plays next when there's a moment
+void pollShow(unsigned long now) {
+    // a follower plays what its leader's show does
+    if (!show.isRunning() || (use_sync && frameSync.isFollowing(micros()))) {
+        return;
+    }
+    ShowCue cue;
+    while (show.next(showFile, now, cue)) {
+        applyShowCue(cue, now);
+    }
 
-        if(result < 0) {
-            lastFrameDisplayTime = 0;
-            currentFrameDelay = 0;
-            start_ok = false;
+    if (ramping) {
+        uint32_t elapsed = now - rampStart;
+        int level = elapsed >= rampMs ? rampTo : rampFrom + (rampTo - rampFrom) * (int32_t)elapsed / (int32_t)rampMs;
+        ramping = elapsed < rampMs;
+        if (level != brightness) {
+            brightness = level;
+            // pollAudio() sets it, with any flash
+            if (!use_audio) {
+                matrix.setBrightness(brightness);
+            }
         }
     }
+
+    if (nextFrameFarOff(micros(), kPrefetchIdle_us)) {
+        pollPrefetch();
+    }
+}
+
+// Opens the GIF auto-advance plays next once the last loop of the one playing starts, and reads it ahead when there's
+// a moment
+void pollAdvance(unsigned long now) {
+    uint32_t now_us = micros();
+    if (!advancing(now_us) || is_first_frame || !nextFrameFarOff(now_us, kPrefetchIdle_us)) {
+        return;
+    }
+    if (advance.opensNext(now, gifCyclesShown, gifCycleTime())) {
+        prefetchGifByIndex(GIF_DIRECTORY, (cur_image_idx + 1) % num_files);
+        advance.nextOpened();
+    } else if (advance.lastLoop(now, gifCyclesShown, gifCycleTime())) {
+        pollPrefetch();
+    }
+}
+
+
+// (Re)allocates the file cache from the GIF arena, without one if there's no room
+bool allocFileCache(uint32_t bytes) {
+    setFileCache(NULL, 0);
+    gifArena.free(fileCacheBuffer);
+    fileCacheBuffer = bytes ? (uint8_t *)gifArena.alloc(bytes, "file cache") : NULL;
+    setFileCache(fileCacheBuffer, bytes);
+    return fileCacheBuffer || !bytes;
 }
 
+void resetStats(unsigned long now) {
+    statsStart = now;
+    framesShown = 0;
+    framesHeld = 0;
+    swapPendingLoops = 0;
+    loopTimer.reset();
+    decodeTimer.reset();
+    compositeTimer.reset();
+    swapTimer.reset();
+    streamTimer.reset();
+    syncTimer.reset();
+    audioTimer.reset();
+    switchTimer.reset();
+    lateFrames.reset();
+    snapshots.resetStats();
+    advance.resetStats();
+    idle.resetStats();
+    content.resetStats();
+}
+
+#ifdef SIMULATOR_MODE
+// For the simulator's scenario runner, which calls these between loops
+void getPlaybackStats(PlaybackStats &stats) {
+    stats.elapsed_ms = millis() - statsStart;
+    stats.framesShown = framesShown;
+    stats.framesHeld = framesHeld;
+    stats.swapPendingLoops = swapPendingLoops;
+    stats.loop = loopTimer;
+    stats.decode = decodeTimer;
+    stats.composite = compositeTimer;
+    stats.swap = swapTimer;
+    stats.stream = streamTimer;
+    stats.sync = syncTimer;
+    stats.audio = audioTimer;
+    stats.gifSwitch = switchTimer;
+    stats.gifAdvance = advance.getStats().cut;
+    stats.lateness = lateFrames;
+    stats.idle = idle.getStats().sleeps;
+    stats.gif = cur_image_idx;
+    stats.gifCount = num_files;
+    stats.gifStarting = switchPending;
+    stats.gifCycles = gifCyclesShown;
+}
+
+void resetPlaybackStats(void) {
+    resetStats(millis());
+}
+#endif
+
+void printStage(const char *name, const StageTimer &timer) {
+    Serial.printf("  %-9s %7lu %9lu %9lu\n", name, (unsigned long)timer.count, (unsigned long)timer.average_us(),
+        (unsigned long)timer.max_us);
+}
+
+void statsCommand(int argc, char *argv[]) {
+    static FileCacheStats statsCache;
+    unsigned long now = millis();
+    unsigned long elapsed = max(now - statsStart, 1UL);
+
+    Serial.printf("%lu ms: %lu loops/s, %lu.%lu fps, refresh %u Hz%s%s, brightness %d of %d\n", elapsed,
+        loopTimer.count * 1000 / elapsed, framesShown * 1000 / elapsed, framesShown * 10000 / elapsed % 10,
+        matrix.getRefreshRate(), matrix.getRefreshRateLoweredFlag() ? " (lowered)" : "",
+        matrix.getdmaBufferUnderrunFlag() ? " (DMA underrun)" : "", brightness, max_brightness);
+    Serial.printf("  %-9s %7s %9s %9s\n", "stage", "count", "avg us", "max us");
+    printStage("loop", loopTimer);
+    printStage("decode", decodeTimer);
+    printStage("composite", compositeTimer);
+    printStage("swap", swapTimer);
+    printStage("stream", streamTimer);
+    printStage("sync", syncTimer);
+    printStage("audio", audioTimer);
+    printStage("switch", switchTimer);
+    printStage("late", lateFrames.late);
+    Serial.printf("  frames late by");
+    for (uint8_t i = 0; i < LATENESS_BUCKETS - 1; i++) {
+        Serial.printf(" <=%lums %lu", (unsigned long)LatenessHistogram::limit_us(i) / 1000,
+            (unsigned long)lateFrames.buckets[i]);
+    }
+    Serial.printf(" more %lu\n", (unsigned long)lateFrames.buckets[LATENESS_BUCKETS - 1]);
+    Serial.printf("  %lu loops waited for a swap\n", (unsigned long)swapPendingLoops);
+    Serial.printf("  %lu GIF frames held without a swap, the same as the one before or empty; %lu of %lu in this GIF\n",
+        (unsigned long)framesHeld, (unsigned long)gifFramesHeld, (unsigned long)gifFrames);
+    if (use_idle) {
+        Serial.print("  ");
+        idle.printReport(Serial, elapsed * 1000);
+    }
+    if (use_audio) {
+        Serial.print("  ");
+        audioBeat.printReport(Serial, micros());
+    }
+    Serial.print("  ");
+    content.printReport(Serial);
+    if (snapshots.getCount()) {
+        Serial.print("  ");
+        snapshots.printReport(Serial);
+    }
+    if (show.isLoaded()) {
+        Serial.print("  ");
+        show.printReport(Serial, now);
+    }
+    if (use_advance && use_sd) {
+        Serial.print("  ");
+        advance.printReport(Serial);
+    }
+    if (use_telemetry) {
+        Serial.print("  ");
+        telemetry.printReport(Serial);
+    }
+
+    const FileCacheStats &cache = getFileCacheStats();
+    uint32_t cached = cache.hitBytes - statsCache.hitBytes;
+    uint32_t total = cached + cache.missBytes - statsCache.missBytes + cache.uncachedBytes - statsCache.uncachedBytes;
+    uint32_t reads = cache.cardReads - statsCache.cardReads;
+    Serial.printf("  SD card %lu reads, %lu us/read, file cache %lu KB, %lu%% of %lu bytes hit\n",
+        (unsigned long)reads, (unsigned long)(reads ? (cache.read_us - statsCache.read_us) / reads : 0),
+        (unsigned long)getFileCacheBytes() / 1024, (unsigned long)(total ? cached * 100 / total : 0),
+        (unsigned long)total);
+
+    statsCache = cache;
+    resetStats(now);
+}
+
+void setCommand(int argc, char *argv[]) {
+    if (argc < 3) {
+        Serial.println("set refresh|brightness|maxbright|cache|calcdiv|pulse|flash|tempo|advance|cycles <value>");
+        return;
+    }
+    int value = atoi(argv[2]);
+    if (strcmp(argv[1], "refresh") == 0) {
+        matrix.setRefreshRate(value);
+        Serial.printf("refresh %u Hz\n", matrix.getRefreshRate());
+    } else if (strcmp(argv[1], "brightness") == 0) {
+        brightness = constrain(value, 0, max_brightness);
+        matrix.setBrightness(brightness);
+        Serial.printf("brightness %d\n", brightness);
+    } else if (strcmp(argv[1], "maxbright") == 0) {
+        max_brightness = constrain(value, 0, 255);
+        adjustBrightness(0);
+        Serial.printf("max brightness %d, brightness %d\n", max_brightness, brightness);
+    } else if (strcmp(argv[1], "cache") == 0) {
+        // in KB
+        if (!allocFileCache(max(value, 0) * 1024)) {
+            Serial.printf("No room in the GIF arena for a %d KB cache, largest free %lu bytes\n", value,
+                (unsigned long)gifArena.largestFree());
+        }
+        Serial.printf("file cache %lu KB\n", (unsigned long)getFileCacheBytes() / 1024);
+    } else if (strcmp(argv[1], "calcdiv") == 0) {
+        // setCalcRefreshRateDivider() is ESP32 only
+        Serial.println("Teensy 4 calculates every refresh, there's no divider - set refresh lower to free up CPU");
+    } else if (strcmp(argv[1], "pulse") == 0) {
+        audioBeat.setPulse(constrain(value, 0, 100));
+        Serial.printf("pulse %u%%\n", audioBeat.getPulse());
+    } else if (strcmp(argv[1], "flash") == 0) {
+        audioBeat.setFlash(constrain(value, 0, 100));
+        Serial.printf("flash %u%%\n", audioBeat.getFlash());
+    } else if (strcmp(argv[1], "tempo") == 0) {
+        audioBeat.setTempo(value != 0);
+        Serial.printf("tempo %s\n", audioBeat.getTempo() ? "on" : "off");
+    } else if (strcmp(argv[1], "advance") == 0) {
+        // in seconds, 0 for the remote only
+        advance.setSeconds(value);
+        Serial.printf("advance %lu s\n", (unsigned long)advance.getSeconds());
+    } else if (strcmp(argv[1], "cycles") == 0) {
+        advance.setCycles(value);
+        Serial.printf("cycles %u\n", advance.getCycles());
+    } else {
+        Serial.printf("Unknown setting %s\n", argv[1]);
+    }
+}
+
+void cacheCommand(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "flush") == 0) {
+        flushFileCache();
+        Serial.println("file cache flushed");
+        return;
+    }
+    const FileCacheStats &cache = getFileCacheStats();
+    Serial.printf("file cache %lu KB, %lu bytes hit, %lu missed, %lu past it, %lu card reads in %lu us, %lu GIFs "
+        "opened prefetched with %lu bytes read ahead\n", (unsigned long)getFileCacheBytes() / 1024,
+        (unsigned long)cache.hitBytes, (unsigned long)cache.missBytes, (unsigned long)cache.uncachedBytes,
+        (unsigned long)cache.cardReads, (unsigned long)cache.read_us, (unsigned long)cache.prefetchedOpens,
+        (unsigned long)cache.prefetchedBytes);
+    gifArena.printReport(Serial);
+}
+
+void showCommand(int argc, char *argv[]) {
+    unsigned long now = millis();
+    if (argc > 1 && strcmp(argv[1], "start") == 0) {
+        if (!use_sd || !startShow(now)) {
+            Serial.println("No show in " SHOW_FILE);
+            return;
+        }
+    } else if (argc > 1 && strcmp(argv[1], "stop") == 0) {
+        show.stop();
+    }
+    show.printReport(Serial, now);
+}
+
+void traceCommand(int argc, char *argv[]) {
+    trace = argc > 1 && strcmp(argv[1], "on") == 0;
+    Serial.printf("trace %s\n", trace ? "on" : "off");
+}
+
+void benchCommand(int argc, char *argv[]) {
+    if (argc < 2) {
+        Serial.println("bench <gif name or number>");
+        return;
+    }
+    if (!use_sd) {
+        Serial.println("bench: needs the SD card");
+        return;
+    }
+    if (frameStream.isActive(millis()) || frameSync.isFollowing(micros())) {
+        Serial.println("bench: not while streaming or following a leader");
+        return;
+    }
+    if (benchGif >= 0) {
+        Serial.println("bench: already running");
+        return;
+    }
+
+    // a number from the list printed at startup, or a file name
+    int index;
+    if (argv[1][strspn(argv[1], "0123456789")] == 0) {
+        index = atoi(argv[1]) - 1;
+    } else {
+        index = findGIFIndexByName(GIF_DIRECTORY, argv[1]);
+    }
+    if (index < 0 || index >= num_files) {
+        Serial.printf("bench: no GIF %s\n", argv[1]);
+        return;
+    }
+    startBench(index);
+}
+
+const ConsoleCommand consoleCommands[] = {
+    { "stats", "per-stage timings, fps, swap waits and cache hits since the last stats", statsCommand },
+    { "set", "refresh|brightness|maxbright|cache|calcdiv|pulse|flash|tempo|advance|cycles <value>, cache in KB, pulse "
+        "and flash in %, tempo 0|1, advance in seconds (0 for the remote only), cycles 0 for no limit", setCommand },
+    { "cache", "[flush] file cache and GIF arena use, or empty the cache", cacheCommand },
+    { "show", "[start|stop] the show's timeline accuracy, or play " SHOW_FILE " from the start, or stop it",
+        showCommand },
+    { "trace", "on|off, a line per decoded frame", traceCommand },
+    { "bench", "<gif name or number> time two loops of a GIF, then go back", benchCommand },
+};
+Console console(consoleCommands, sizeof(consoleCommands) / sizeof(consoleCommands[0]));
+
 
 // Setup method runs once, when the sketch starts
 void setup() {
@@ -494,6 +1699,10 @@ void setup() {
     decoder.setScreenClearCallback(screenClearCallback);
     decoder.setUpdateScreenCallback(updateScreenCallback);
     decoder.setDrawPixelCallback(drawPixelCallback);
+    if (use_runs) {
+        decoder.setDrawRunCallback(drawRunCallback);
+    }
+    decoder.setDrawIndexedLineCallback(drawLineCallback);
 
     decoder.setFileSeekCallback(fileSeekCallback);
     decoder.setFilePositionCallback(filePositionCallback);
@@ -503,11 +1712,30 @@ void setup() {
     // NOTE: new callback function required after we moved to using the external AnimatedGIF library to decode GIFs
     decoder.setFileSizeCallback(fileSizeCallback);
 
+    decoder.setTurboMode(true);
+    decoder.setDecodeBudget(kDecodeBudget);
+    decoder.setCanvasLimit(kMaxCanvasPixels);
+
     Serial.begin(115200);
 
     // give time for USB Serial to be ready
     delay(1000);
 
+#ifdef SIMULATOR_MODE
+    printRamBudget(kRamBudget);
+#endif
+
+    // without room in the arena for its frames, GIFs play as decoded
+    if (kInterpolationFps && !interpolator.begin(gifArena, kInterpolationFps)) {
+        Serial.println("GIF arena too small for frame interpolation");
+    }
+    if (use_sd && !allocFileCache(kFileCacheBytes)) {
+        Serial.println("GIF arena too small for the file cache");
+    }
+    if (use_sd && use_snapshots && !snapshots.begin(gifArena, kGifSnapshotBytes)) {
+        Serial.println("GIF arena too small for GIF snapshots, GIFs start over when switched back to");
+    }
+
     matrix.addLayer(&backgroundLayer); 
     matrix.addLayer(&indexedLayer); 
     matrix.addLayer(&scrollingLayer);
@@ -520,6 +1748,26 @@ void setup() {
     //matrix.setRefreshRate(90);
     matrix.begin();
 
+    // live frames are sent in the layer's buffer order, the sender rotates them
+    frameStream.setRotation(backgroundLayer.getLayerRotation());
+    frameStream.setShared(use_console);
+
+    if (use_sync) {
+        Serial3.begin(FRAME_SYNC_BAUD);
+        pinMode(FRAME_SYNC_LEADER_PIN, INPUT_PULLDOWN);
+        frameSync.begin(digitalRead(FRAME_SYNC_LEADER_PIN) == HIGH ? FRAME_SYNC_LEADER : FRAME_SYNC_FOLLOWER, micros());
+    }
+
+#ifdef SIMULATOR_MODE
+    use_audio = !_analog_samples.empty();
+#endif
+    if (use_audio) {
+        audioBeat.begin(use_sync ? frameSync.frameTime() : millis(), micros());
+#ifndef SIMULATOR_MODE
+        audioSampler.begin(AUDIO_PIN);
+#endif
+    }
+
 
     // Clear screen
     backgroundLayer.fillScreen(COLOR_BLACK);
@@ -563,30 +1811,186 @@ void setup() {
 
     if (use_sd) {
         char buf[60];
-        buf[0] = 0;
-        strcat(buf, "Found ");
-        strcat(buf, String(num_files).c_str());
+        snprintf(buf, sizeof(buf), "Found %d", num_files);
         writeDebugScreen(buf, now);
     }
 
+    if (use_sd && use_telemetry) {
+        telemetryFile = SD.open(TELEMETRY_FILE, FILE_WRITE);
+        if (!telemetryFile || !telemetry.open(telemetryFile, millis())) {
+            Serial.println("Can't write " TELEMETRY_FILE ", no telemetry");
+        }
+    }
+
+    if (use_sd && use_advance) {
+        File advanceFile = SD.open(ADVANCE_FILE);
+        if (advanceFile) {
+            if (!advance.load(advanceFile)) {
+                Serial.println("Lines in " ADVANCE_FILE " not understood, they're left out");
+            }
+            advanceFile.close();
+        }
+        allocPrefetchBuffer();
+    }
+
+    if (use_sd && use_show && startShow(millis())) {
+        Serial.println("Playing the show in " SHOW_FILE);
+    }
+
     // ----------------------------------------------
     // ---------- IR Receiver Setup  ----------------
     // ----------------------------------------------
     IrReceiver.begin(IR_RECEIVE_PIN, DISABLE_LED_FEEDBACK); // Start the receiver
+
+    statsStart = millis();
+}
+
+
+// When loop() next has something to do, on micros(), now_us if it has something now
+uint32_t nextLoopDue_us(unsigned long now, unsigned long frameTime, uint32_t now_us) {
+    uint32_t due_us = now_us + kIdleMax_us;
+    auto until_us = [&](uint32_t at_us) {
+        if ((int32_t)(at_us - due_us) < 0) {
+            due_us = at_us;
+        }
+    };
+    auto until_ms = [&](unsigned long clock, uint32_t at_ms) {
+        int32_t ms = (int32_t)(at_ms - clock);
+        until_us(ms > 0 ? now_us + ms * 1000 : now_us);
+    };
+
+    bool following = use_sync && frameSync.isFollowing(now_us);
+    if (use_stream && frameStream.isActive(now)) {
+        if (!frameStream.isIdle()) {
+            return now_us;
+        }
+        until_us(now_us + kIdleStream_us);
+    } else if (!use_sd) {
+        if (is_first_frame) {
+            return now_us;
+        }
+        // a still image has nothing more to draw
+        uint32_t at_ms;
+        if (content.nextDeadline(frameTime, at_ms)) {
+            until_ms(frameTime, at_ms);
+        }
+    } else {
+        // a GIF starting, a frame partway through, or the next to decode ahead of the interpolator
+        if (is_first_frame || decoder.isFramePending() || (interpolator.isRunning() ?
+                interpolator.needsDecode(frameTime) && !backgroundLayer.isSwapPending() : !frameDueValid)) {
+            return now_us;
+        }
+        // with a swap pending it wakes when that goes through
+        if (!interpolator.isRunning()) {
+            until_us(frameDue_us);
+        } else if (!backgroundLayer.isSwapPending()) {
+            until_ms(frameTime, interpolator.nextPresent(frameTime));
+        }
+        // card writes and reads wait for a gap before the next frame, this is one
+        if ((use_telemetry && telemetry.hasQueued() && nextFrameFarOff(now_us, TELEMETRY_IDLE_US)) ||
+            (use_show && show.isRunning() && !following && isPrefetching() &&
+                nextFrameFarOff(now_us, kPrefetchIdle_us))) {
+            return now_us;
+        }
+        if (use_advance && !is_first_frame && advancing(now_us) && nextFrameFarOff(now_us, kPrefetchIdle_us)) {
+            if (advance.opensNext(now, gifCyclesShown, gifCycleTime()) ||
+                    (isPrefetching() && advance.lastLoop(now, gifCyclesShown, gifCycleTime()))) {
+                return now_us;
+            }
+        }
+    }
+
+    if (allow_debug_clear && last_debug_write_time > 0) {
+        until_ms(now, last_debug_write_time + 3001);
+    }
+    if (use_telemetry && telemetry.isRecording()) {
+        until_ms(now, telemetry.nextDue_ms());
+    }
+    uint32_t at;
+    if (use_show && !following && show.nextCueAt(at)) {
+        until_ms(now, at);
+    }
+    if (use_show && ramping) {
+        until_us(now_us + kIdleRamp_us);
+    }
+    if (use_sync && frameSync.nextSend(at)) {
+        until_us(at);
+    }
+    if (use_audio) {
+        until_us(now_us + (audioBeat.isLocked() ? kIdleAudioLocked_us : kIdleAudio_us));
+    }
+    return due_us;
 }
 
+// Sleeps until loop() next has something to do, or something wakes it
+void sleepUntilDue(unsigned long now, unsigned long frameTime) {
+    bool swapPending = backgroundLayer.isSwapPending();
+    idleSlept_us = idle.sleepUntil(nextLoopDue_us(now, frameTime, micros()), [swapPending]() {
+        if (IrReceiver.available()) {
+            return IDLE_WAKE_IR;
+        }
+        if ((use_console || use_stream) && Serial.available() > 0) {
+            return IDLE_WAKE_SERIAL;
+        }
+        if (use_sync && Serial3.available() > 0) {
+            return IDLE_WAKE_SYNC;
+        }
+        if (swapPending && !backgroundLayer.isSwapPending()) {
+            return IDLE_WAKE_SWAP;
+        }
+        return IDLE_WAKE_NONE;
+    });
+}
 
 void loop() {
     unsigned long now = millis();
 
+    // time between loops less any sleep, for stats
+    static uint32_t lastLoop_us = micros();
+    uint32_t now_us = micros();
+    loopTimer.add(now_us - lastLoop_us - idleSlept_us);
+    telemetry.loop.add(now_us - lastLoop_us - idleSlept_us);
+    lastLoop_us = now_us;
+    idleSlept_us = 0;
+
     maybeClearDebugScreen(now);
 
     HandleIRInputs(now);
 
-    if (!use_sd) {
-        drawImageNoSD(now);
-    } else {
-        drawImageWithSD(now);
+    // typed commands share Serial with the live stream, they're only read between its packets
+    if (use_console && (!use_stream || frameStream.isIdle())) {
+        console.poll(Serial, use_stream);
+    }
+
+    if (use_telemetry) {
+        pollTelemetry(now);
+    }
+
+    if (use_show) {
+        pollShow(now);
     }
+
+    if (use_advance) {
+        pollAdvance(now);
+    }
+
+    if (use_stream && pollFrameStream(now)) {
+        playContent(&streamSource, now);
+        if (use_idle) {
+            sleepUntilDue(now, now);
+        }
+        return;
+    }
+
+    unsigned long frameTime = use_sync ? pollFrameSync(now) : now;
+    if (use_audio) {
+        frameTime = pollAudio(frameTime);
+    }
+
+    playContent(playlistSource(), frameTime);
     is_first_frame = false;
+
+    if (use_idle) {
+        sleepUntilDue(now, frameTime);
+    }
 }
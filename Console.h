@@ -0,0 +1,126 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+/*
+ * Command console on a serial port
+ *
+ * Lines of text typed into the USB serial port (the simulator's stdin) are split on spaces and run as commands from
+ * a table the sketch passes in, e.g.
+ *
+ *   stats
+ *   set refresh 180
+ *   cache flush
+ *
+ * poll() reads at most CONSOLE_POLL_BYTES per call and a command only runs once its line is complete, so typing
+ * doesn't stall playback.  Handlers run from loop() and have to return quickly too; anything that takes longer (e.g.
+ * timing a GIF) is started by its handler and finished by the sketch over the following loops.
+ *
+ * The port can be shared with the live frame stream: only printable text, tabs, backspaces and line ends are taken,
+ * and with shared set the first other byte is left in the port for the stream, as is everything while the caller
+ * holds off polling (a packet is being received).  Otherwise other bytes are dropped.  The stream leaves text between
+ * its packets to the console in turn (FrameStream::setShared()), so lines longer than a poll, or several at once,
+ * are read over the following loops.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define CONSOLE_LINE_BYTES          80
+#define CONSOLE_MAX_ARGS            6
+#define CONSOLE_POLL_BYTES          32
+
+// Bytes the console takes: printable text, tabs, backspaces and line ends
+inline bool isConsoleText(int b) {
+    return (b >= ' ' && b < 0x7F) || b == '\t' || b == '\b' || b == '\r' || b == '\n';
+}
+
+typedef void (*ConsoleHandler)(int argc, char *argv[]);
+
+struct ConsoleCommand {
+    const char *name;
+    const char *usage;              // arguments and what it does, for help
+    ConsoleHandler handler;
+};
+
+class Console {
+public:
+    Console(const ConsoleCommand *commands, uint8_t count) : commands(commands), count(count) {}
+
+    // port is Serial, or anything else with available(), peek(), read() and printf()
+    template <typename Port>
+    bool poll(Port &port, bool shared, uint32_t maxBytes = CONSOLE_POLL_BYTES) {
+        bool ran = false;
+        while (maxBytes && port.available() > 0) {
+            int b = port.peek();
+            bool text = isConsoleText(b);
+            if (!text && shared)
+                break;
+            port.read();
+            maxBytes--;
+
+            if (b == '\r' || b == '\n') {
+                if (length) {
+                    line[length] = 0;
+                    length = 0;
+                    run(port);
+                    ran = true;
+                }
+            } else if (b == '\b') {
+                if (length)
+                    length--;
+            } else if (text && length < CONSOLE_LINE_BYTES - 1) {
+                line[length++] = b == '\t' ? ' ' : b;
+            }
+        }
+        return ran;
+    }
+
+    template <typename Port>
+    void printHelp(Port &port) const {
+        for (uint8_t i = 0; i < count; i++)
+            port.printf("  %-8s %s\n", commands[i].name, commands[i].usage);
+    }
+
+private:
+    template <typename Port>
+    void run(Port &port) {
+        char *argv[CONSOLE_MAX_ARGS];
+        int argc = 0;
+        char *p = line;
+        while (*p && argc < CONSOLE_MAX_ARGS) {
+            while (*p == ' ')
+                *p++ = 0;
+            if (!*p)
+                break;
+            argv[argc++] = p;
+            while (*p && *p != ' ')
+                p++;
+        }
+        if (!argc)
+            return;
+
+        port.printf("> %s", argv[0]);
+        for (int i = 1; i < argc; i++)
+            port.printf(" %s", argv[i]);
+        port.printf("\n");
+
+        if (strcmp(argv[0], "help") == 0) {
+            printHelp(port);
+            return;
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            if (strcmp(argv[0], commands[i].name) == 0) {
+                commands[i].handler(argc, argv);
+                return;
+            }
+        }
+        port.printf("Unknown command %s, try help\n", argv[0]);
+    }
+
+    const ConsoleCommand *commands;
+    uint8_t count;
+    char line[CONSOLE_LINE_BYTES];
+    uint8_t length = 0;
+};
+
+#endif
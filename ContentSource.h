@@ -0,0 +1,132 @@
+#ifndef CONTENT_SOURCE_H
+#define CONTENT_SOURCE_H
+
+/*
+ * What's on the screen, from wherever it comes
+ *
+ * A ContentSource is one thing to show - a still image, a GIF built into the sketch or on the SD card, the live
+ * stream, an effect - behind three hooks: prepare() when it's switched to, nextFrameDeadline() for when it next has a
+ * frame to draw and render() to draw it into the background layer's draw buffer.  ContentPlayer does the rest the same
+ * way for each of them: prepares the source switched to, renders it when it's due and says when that is, so the sketch
+ * swaps a frame up only when one was drawn and sleeps until the next (Idle.h).  Times are on the clock poll() is
+ * given, the sketch's frame clock: millis(), unless frame sync or the audio is pacing it.
+ *
+ * A StaticSource draws once after each prepare() and then says it has nothing more to draw, so a still image costs a
+ * draw and a swap when it's switched to and nothing at all after that; the layer's swapBuffers() copies the frame
+ * back, so the draw buffer still holds it for whatever comes next.
+ *
+ * Sources that swap their own frames up return false from render(): a GIF's decoder callbacks swap its frames, the
+ * SD card's GIFs go through the frame interpolator, and the live stream acknowledges each frame once it's up.
+ */
+
+#include <stdint.h>
+
+#include "PlaybackStats.h"
+
+class ContentSource {
+public:
+    virtual ~ContentSource() {}
+
+    // Switched to at now_ms, render() comes next.  False if it can't be shown
+    virtual bool prepare(uint32_t now_ms) = 0;
+
+    // When render() next has a frame to draw, false if the one drawn stays up
+    virtual bool nextFrameDeadline(uint32_t now_ms, uint32_t &at_ms) const = 0;
+
+    // Draws the next frame, true if there's one in the draw buffer to swap up and false if the source swapped it
+    // itself or has none yet
+    virtual bool render(uint32_t now_ms) = 0;
+};
+
+// A frame that never changes: drawn by draw() once after each prepare(), then held up
+class StaticSource : public ContentSource {
+public:
+    bool prepare(uint32_t now_ms) override {
+        drawn = false;
+        return true;
+    }
+
+    bool nextFrameDeadline(uint32_t now_ms, uint32_t &at_ms) const override {
+        at_ms = now_ms;
+        return !drawn;
+    }
+
+    bool render(uint32_t now_ms) override {
+        draw();
+        drawn = true;
+        return true;
+    }
+
+protected:
+    virtual void draw(void) = 0;
+
+private:
+    bool drawn = false;
+};
+
+struct ContentPlayerStats {
+    uint32_t prepares;
+    uint32_t failed;                // sources that couldn't be prepared
+    StageTimer render;              // render() calls, each due
+};
+
+class ContentPlayer {
+public:
+    // Switches to source, prepared at the next poll()
+    void play(ContentSource *source) {
+        current = source;
+        prepared = false;
+    }
+
+    ContentSource * getSource(void) const { return current; }
+
+    // Prepares the source switched to and renders it if it's due by now_ms.  True with a frame in the draw buffer to
+    // swap up
+    bool poll(uint32_t now_ms) {
+        if (!current)
+            return false;
+        if (!prepared) {
+            prepared = true;
+            stats.prepares++;
+            if (!current->prepare(now_ms))
+                stats.failed++;
+        }
+        uint32_t at_ms;
+        if (!current->nextFrameDeadline(now_ms, at_ms) || (int32_t)(now_ms - at_ms) < 0)
+            return false;
+
+        uint32_t start = micros();
+        bool drawn = current->render(now_ms);
+        stats.render.add(micros() - start);
+        return drawn;
+    }
+
+    // When poll() next has something to do, false if what's up stays up
+    bool nextDeadline(uint32_t now_ms, uint32_t &at_ms) const {
+        if (!current)
+            return false;
+        if (!prepared) {
+            at_ms = now_ms;
+            return true;
+        }
+        return current->nextFrameDeadline(now_ms, at_ms);
+    }
+
+    const ContentPlayerStats & getStats(void) const { return stats; }
+
+    template <typename Printer>
+    void printReport(Printer &out) const {
+        out.printf("Content: %lu prepared (%lu failed), %lu renders of %lu us on average (max %lu)\n",
+            (unsigned long)stats.prepares, (unsigned long)stats.failed, (unsigned long)stats.render.count,
+            (unsigned long)stats.render.average_us(), (unsigned long)stats.render.max_us);
+    }
+
+    void resetStats(void) { stats = {}; }
+
+private:
+    ContentSource *current = NULL;
+    bool prepared = false;
+    ContentPlayerStats stats = {};
+};
+
+#endif
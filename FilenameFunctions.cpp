@@ -11,29 +11,151 @@
 #include <SD.h>
 #include <SPI.h>
 
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+
 // Global file handle shared across all translation units
 File my_sd_file;
 
 int numberOfFiles;
 
+/* Reads for the decoder go through a cache of the first part of the open file, in FILE_CACHE_BLOCK_BYTES blocks
+ * filled on first use, so every loop of a GIF after the first only reads the rest of it from the card.  The cache
+ * buffer belongs to the sketch (setFileCache()) and is emptied whenever another file is opened.
+ */
+static uint8_t *fileCache = NULL;
+static uint32_t fileCacheBlocks = 0;
+static uint8_t fileCacheValid[FILE_CACHE_MAX_BLOCKS / 8];
+static FileCacheStats fileCacheStats;
+
+static unsigned long filePosition = 0;     // the decoder's position
+static unsigned long cardPosition = 0;     // my_sd_file's position
+static unsigned long openFileSize = 0;
+
+/* The GIF to play next can be opened beside the playing one with prefetchGifByIndex(), and its first blocks read
+ * into the prefetch buffer by pollPrefetch() a block at a time, when the sketch has a moment.  When
+ * openGifFilenameByIndex() comes to it, the directory walk and the open are already done, and the blocks read go
+ * straight into the file cache.
+ */
+static File prefetchFile;
+static int prefetchIndex = -1;
+static uint8_t *prefetchBuffer = NULL;
+static uint32_t prefetchBlocks = 0;        // the buffer's size in blocks
+static uint32_t prefetchedBlocks = 0;      // read into it
+static char prefetchName[GIF_NAME_BYTES];
+
+/* enumerateGIFFiles() keeps the GIFs' names, one after the other, so switching GIFs finds the one at an index without
+ * walking the directory: on the Teensy every entry walked is another File, taken from the heap.  With more names than
+ * fit the directory is walked as before.
+ */
+static char gifNames[GIF_NAME_POOL_BYTES];
+static char gifNamesDirectory[GIF_NAME_BYTES];
+static bool gifNamesComplete = false;
+
+// The name at index in gifNames, if it holds them all for directoryName
+static const char *keptGifName(const char *directoryName, int index) {
+    if (!gifNamesComplete || strcmp(directoryName, gifNamesDirectory) != 0)
+        return NULL;
+    const char *name = gifNames;
+    while (index-- > 0)
+        name += strlen(name) + 1;
+    return name;
+}
+
+static int cardRead(unsigned long position, uint8_t *buffer, int numberOfBytes) {
+    if (cardPosition != position) {
+        if (!my_sd_file.seek(position))
+            return -1;
+        cardPosition = position;
+    }
+    uint32_t start = micros();
+    int n = my_sd_file.read(buffer, numberOfBytes);
+    fileCacheStats.read_us += micros() - start;
+    fileCacheStats.cardReads++;
+    if (n > 0)
+        cardPosition += n;
+    return n;
+}
+
 bool fileSeekCallback(unsigned long position) {
-    return my_sd_file.seek(position);
+    if (position > openFileSize)
+        return false;
+    filePosition = position;
+    return true;
 }
 
 unsigned long filePositionCallback(void) {
-    return my_sd_file.position();
+    return filePosition;
 }
 
 int fileReadCallback(void) {
-    return my_sd_file.read();
+    uint8_t b;
+    return fileReadBlockCallback(&b, 1) == 1 ? b : -1;
 }
 
 int fileReadBlockCallback(void * buffer, int numberOfBytes) {
-    return my_sd_file.read((uint8_t*)buffer, numberOfBytes);
+    uint8_t *out = (uint8_t *)buffer;
+    int done = 0;
+
+    while (done < numberOfBytes && filePosition < openFileSize) {
+        uint32_t block = filePosition / FILE_CACHE_BLOCK_BYTES;
+
+        // past the cached part, straight from the card
+        if (block >= fileCacheBlocks) {
+            int n = cardRead(filePosition, out + done, numberOfBytes - done);
+            if (n <= 0)
+                break;
+            fileCacheStats.uncachedBytes += n;
+            filePosition += n;
+            done += n;
+            break;
+        }
+
+        unsigned long blockStart = (unsigned long)block * FILE_CACHE_BLOCK_BYTES;
+        uint32_t blockBytes = min((unsigned long)FILE_CACHE_BLOCK_BYTES, openFileSize - blockStart);
+        uint8_t *cached = fileCache + blockStart;
+        bool hit = fileCacheValid[block / 8] & (1 << (block % 8));
+        if (!hit) {
+            if (cardRead(blockStart, cached, blockBytes) != (int)blockBytes)
+                break;
+            fileCacheValid[block / 8] |= 1 << (block % 8);
+        }
+
+        uint32_t offset = filePosition - blockStart;
+        uint32_t n = min(blockBytes - offset, (uint32_t)(numberOfBytes - done));
+        memcpy(out + done, cached + offset, n);
+        if (hit) {
+            fileCacheStats.hitBytes += n;
+        } else {
+            fileCacheStats.missBytes += n;
+        }
+        filePosition += n;
+        done += n;
+    }
+    return done;
 }
 
 int fileSizeCallback(void) {
-    return my_sd_file.size();
+    return openFileSize;
+}
+
+void setFileCache(uint8_t *buffer, uint32_t bytes) {
+    fileCache = buffer;
+    fileCacheBlocks = buffer ? min(bytes / FILE_CACHE_BLOCK_BYTES, (uint32_t)FILE_CACHE_MAX_BLOCKS) : 0;
+    flushFileCache();
+}
+
+uint32_t getFileCacheBytes(void) {
+    return fileCacheBlocks * FILE_CACHE_BLOCK_BYTES;
+}
+
+void flushFileCache(void) {
+    memset(fileCacheValid, 0, sizeof(fileCacheValid));
+}
+
+const FileCacheStats & getFileCacheStats(void) {
+    return fileCacheStats;
 }
 
 bool initSDCard(int chipSelectPin, bool use_spi1) {
@@ -51,22 +173,21 @@ bool initSDCard(int chipSelectPin, bool use_spi1) {
     return true;
 }
 
+// Without String, which would take the name's copy from the heap for every file of every directory listing
 bool isAnimationFile(const char filename []) {
-    String filenameString(filename);
-
 #if defined(ESP32)
     // ESP32 filename includes the full path, so need to remove the path before looking at the filename
-    int pathindex = filenameString.lastIndexOf("/");
-    if(pathindex >= 0)
-        filenameString.remove(0, pathindex + 1);
+    const char *slash = strrchr(filename, '/');
+    if (slash)
+        filename = slash + 1;
 #endif
 
-    if ((filenameString[0] == '_') || (filenameString[0] == '~') || (filenameString[0] == '.')) {
+    if ((filename[0] == '_') || (filename[0] == '~') || (filename[0] == '.')) {
         return false;
     }
 
-    filenameString.toUpperCase();
-    if (filenameString.endsWith(".GIF") != 1)
+    size_t length = strlen(filename);
+    if (length < 4 || strcasecmp(filename + length - 4, ".GIF") != 0)
         return false;
 
     return true;
@@ -76,6 +197,9 @@ bool isAnimationFile(const char filename []) {
 int enumerateGIFFiles(const char *directoryName, bool displayFilenames) {
 
     numberOfFiles = 0;
+    gifNamesComplete = false;
+    size_t namesLength = 0;
+    bool namesFit = true;
 
     File directory = SD.open(directoryName);
     File file;
@@ -87,6 +211,13 @@ int enumerateGIFFiles(const char *directoryName, bool displayFilenames) {
     while (file = directory.openNextFile()) {
         if (isAnimationFile(file.name())) {
             numberOfFiles++;
+            size_t length = strlen(file.name()) + 1;
+            if (namesFit && namesLength + length <= sizeof(gifNames)) {
+                memcpy(gifNames + namesLength, file.name(), length);
+                namesLength += length;
+            } else {
+                namesFit = false;
+            }
             if (displayFilenames) {
                 Serial.print(numberOfFiles);
                 Serial.print(":");
@@ -104,9 +235,28 @@ int enumerateGIFFiles(const char *directoryName, bool displayFilenames) {
     //    file.close();
     directory.close();
 
+    snprintf(gifNamesDirectory, sizeof(gifNamesDirectory), "%s", directoryName);
+    gifNamesComplete = namesFit && strlen(directoryName) < sizeof(gifNamesDirectory);
     return numberOfFiles;
 }
 
+// The path of the GIF called name in directoryName
+static void gifPathname(const char *directoryName, const char *name, char *pnBuffer) {
+    // Copy the directory name into the pathname buffer
+    strcpy(pnBuffer, directoryName);
+
+    //ESP32 SD Library includes the full path name in the filename, so no need to add the directory name
+#if defined(ESP32)
+    pnBuffer[0] = 0;
+#else
+    int len = strlen(pnBuffer);
+    if (len == 0 || pnBuffer[len - 1] != '/') strcat(pnBuffer, "/");
+#endif
+
+    // Append the filename to the pathname
+    strcat(pnBuffer, name);
+}
+
 // Get the full path/filename of the GIF file with specified index
 void getGIFFilenameByIndex(const char *directoryName, int index, char *pnBuffer) {
 
@@ -115,42 +265,90 @@ void getGIFFilenameByIndex(const char *directoryName, int index, char *pnBuffer)
     if ((index < 0) || (index >= numberOfFiles))
         return;
 
+    const char *kept = keptGifName(directoryName, index);
+    if (kept) {
+        gifPathname(directoryName, kept, pnBuffer);
+        return;
+    }
+
     File directory = SD.open(directoryName);
     if (!directory)
         return;
 
+    // a File of its own, my_sd_file may be the GIF playing if this is for a prefetch
+    File file;
     while ((index >= 0)) {
-        my_sd_file = directory.openNextFile();
-        if (!my_sd_file) break;
+        file = directory.openNextFile();
+        if (!file) break;
 
-        if (isAnimationFile(my_sd_file.name())) {
+        if (isAnimationFile(file.name())) {
             index--;
+            gifPathname(directoryName, file.name(), pnBuffer);
+        }
 
-            // Copy the directory name into the pathname buffer			
-            strcpy(pnBuffer, directoryName);
-			
-			//ESP32 SD Library includes the full path name in the filename, so no need to add the directory name
-#if defined(ESP32)
-            pnBuffer[0] = 0;
-#else
-            int len = strlen(pnBuffer);
-            if (len == 0 || pnBuffer[len - 1] != '/') strcat(pnBuffer, "/");
-#endif
+        file.close();
+    }
 
-            // Append the filename to the pathname
-            strcat(pnBuffer, my_sd_file.name());
-        }
+    directory.close();
+}
 
-        my_sd_file.close();
+// Returns the index of the animated GIF called name in the directory, or -1
+int findGIFIndexByName(const char *directoryName, const char *name) {
+    const char *kept = keptGifName(directoryName, 0);
+    if (kept) {
+        for (int index = 0; index < numberOfFiles; index++, kept += strlen(kept) + 1) {
+            if (strcasecmp(kept, name) == 0)
+                return index;
+        }
+        return -1;
     }
 
-    my_sd_file.close();
+    File directory = SD.open(directoryName);
+    if (!directory)
+        return -1;
+
+    int index = 0;
+    int found = -1;
+    File file;
+    while (found < 0 && (file = directory.openNextFile())) {
+        if (isAnimationFile(file.name())) {
+            if (strcasecmp(file.name(), name) == 0)
+                found = index;
+            index++;
+        }
+        file.close();
+    }
     directory.close();
+    return found;
 }
 
-bool openGifFilenameByIndex(const char *directoryName, int index, char* name_buf) {
+bool openGifFilenameByIndex(const char *directoryName, int index, char* name_buf, size_t name_bytes) {
     char pathname[255];
 
+    if (prefetchFile && index == prefetchIndex) {
+        if(my_sd_file)
+            my_sd_file.close();
+        // on a Teensy File is a reference to the open file, closing the prefetch copy would close it for both
+        my_sd_file = std::move(prefetchFile);
+        prefetchFile = File();
+        prefetchIndex = -1;
+        filePosition = 0;
+        openFileSize = my_sd_file.size();
+        cardPosition = min((unsigned long)prefetchedBlocks * FILE_CACHE_BLOCK_BYTES, openFileSize);
+        flushFileCache();
+        uint32_t blocks = min(prefetchedBlocks, fileCacheBlocks);
+        if (blocks) {
+            memcpy(fileCache, prefetchBuffer, blocks * FILE_CACHE_BLOCK_BYTES);
+            memset(fileCacheValid, 0xFF, blocks / 8);
+            for (uint32_t block = blocks / 8 * 8; block < blocks; block++)
+                fileCacheValid[block / 8] |= 1 << (block % 8);
+        }
+        fileCacheStats.prefetchedOpens++;
+        fileCacheStats.prefetchedBytes += min((unsigned long)blocks * FILE_CACHE_BLOCK_BYTES, openFileSize);
+        snprintf(name_buf, name_bytes, "%s", prefetchName);
+        return true;
+    }
+
     getGIFFilenameByIndex(directoryName, index, pathname);
     
     Serial.print("Pathname: ");
@@ -161,12 +359,16 @@ bool openGifFilenameByIndex(const char *directoryName, int index, char* name_buf
 
     // Attempt to open the file for reading
     my_sd_file = SD.open(pathname);
+    filePosition = 0;
+    cardPosition = 0;
+    openFileSize = my_sd_file ? my_sd_file.size() : 0;
+    flushFileCache();
     if (!my_sd_file) {
         Serial.println("Error opening GIF file");
         return false;
     }
 
-    strcpy(name_buf, my_sd_file.name());
+    snprintf(name_buf, name_bytes, "%s", my_sd_file.name());
 
     return true;
 }
@@ -178,3 +380,62 @@ void chooseRandomGIFFilename(const char *directoryName, char *pnBuffer) {
     int index = random(numberOfFiles);
     getGIFFilenameByIndex(directoryName, index, pnBuffer);
 }
+
+// Opens the GIF at index beside the one playing, ready for openGifFilenameByIndex(), and starts reading it ahead
+bool prefetchGifByIndex(const char *directoryName, int index) {
+    if (prefetchFile && index == prefetchIndex)
+        return true;
+    prefetchFile = File();
+    prefetchIndex = -1;
+    prefetchedBlocks = 0;
+
+    char pathname[255];
+    pathname[0] = 0;
+    getGIFFilenameByIndex(directoryName, index, pathname);
+    if (!pathname[0])
+        return false;
+    prefetchFile = SD.open(pathname);
+    if (!prefetchFile)
+        return false;
+    snprintf(prefetchName, sizeof(prefetchName), "%s", prefetchFile.name());
+    prefetchIndex = index;
+    return true;
+}
+
+// Reads the next block of the prefetched GIF, one card read.  False once there's nothing more to read ahead.
+bool pollPrefetch(void) {
+    if (!prefetchFile || prefetchedBlocks >= prefetchBlocks)
+        return false;
+    unsigned long size = prefetchFile.size();
+    unsigned long blockStart = (unsigned long)prefetchedBlocks * FILE_CACHE_BLOCK_BYTES;
+    if (blockStart >= size)
+        return false;
+    uint32_t blockBytes = min((unsigned long)FILE_CACHE_BLOCK_BYTES, size - blockStart);
+    uint32_t start = micros();
+    int n = prefetchFile.read(prefetchBuffer + blockStart, blockBytes);
+    fileCacheStats.read_us += micros() - start;
+    fileCacheStats.cardReads++;
+    if (n != (int)blockBytes) {
+        // played the usual way when it comes to it
+        prefetchFile = File();
+        prefetchIndex = -1;
+        return false;
+    }
+    prefetchedBlocks++;
+    return true;
+}
+
+// True while pollPrefetch() has blocks left to read
+bool isPrefetching(void) {
+    return prefetchFile && prefetchedBlocks < prefetchBlocks &&
+        (unsigned long)prefetchedBlocks * FILE_CACHE_BLOCK_BYTES < prefetchFile.size();
+}
+
+// The buffer read ahead into, the sketch's like the file cache; without one, prefetching only opens the GIF
+void setPrefetchBuffer(uint8_t *buffer, uint32_t bytes) {
+    prefetchFile = File();
+    prefetchIndex = -1;
+    prefetchBuffer = buffer;
+    prefetchBlocks = buffer ? bytes / FILE_CACHE_BLOCK_BYTES : 0;
+    prefetchedBlocks = 0;
+}
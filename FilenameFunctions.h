@@ -6,9 +6,29 @@
 
 extern File my_sd_file;
 
+// Reads through setFileCache() are cached in blocks this size, for up to FILE_CACHE_MAX_BLOCKS of them
+#define FILE_CACHE_BLOCK_BYTES  512
+#define FILE_CACHE_MAX_BLOCKS   512
+
+// Size of the buffers GIF names are copied into, terminator included; longer names are cut short
+#define GIF_NAME_BYTES          64
+// The directory's GIF names are kept in this much RAM, see enumerateGIFFiles()
+#define GIF_NAME_POOL_BYTES     2048
+
+struct FileCacheStats {
+    uint32_t hitBytes;              // bytes read from the cache
+    uint32_t missBytes;             // bytes read from the card into the cache
+    uint32_t uncachedBytes;         // bytes read from the card past the cached part of the file
+    uint32_t cardReads;
+    uint32_t read_us;               // time in card reads
+    uint32_t prefetchedOpens;       // GIFs opened from a prefetch
+    uint32_t prefetchedBytes;       // read ahead by pollPrefetch() and used
+};
+
 int enumerateGIFFiles(const char *directoryName, bool displayFilenames);
 void getGIFFilenameByIndex(const char *directoryName, int index, char *pnBuffer);
-bool openGifFilenameByIndex(const char *directoryName, int index, char* name_buf);
+int findGIFIndexByName(const char *directoryName, const char *name);
+bool openGifFilenameByIndex(const char *directoryName, int index, char* name_buf, size_t name_bytes);
 bool initSDCard(int chipSelectPin, bool use_spi1);
 
 bool fileSeekCallback(unsigned long position);
@@ -17,4 +37,14 @@ int fileReadCallback(void);
 int fileReadBlockCallback(void * buffer, int numberOfBytes);
 int fileSizeCallback(void);
 
+void setFileCache(uint8_t *buffer, uint32_t bytes);
+uint32_t getFileCacheBytes(void);
+void flushFileCache(void);
+const FileCacheStats & getFileCacheStats(void);
+
+bool prefetchGifByIndex(const char *directoryName, int index);
+bool pollPrefetch(void);
+bool isPrefetching(void);
+void setPrefetchBuffer(uint8_t *buffer, uint32_t bytes);
+
 #endif
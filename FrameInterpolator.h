@@ -0,0 +1,269 @@
+#ifndef FRAME_INTERPOLATOR_H
+#define FRAME_INTERPOLATOR_H
+
+/*
+ * Motion smoothing for low frame rate GIFs
+ *
+ * Keeps the frame on screen and the one decoded after it, and while the frame is up presents blends of the two at a
+ * target rate (60fps by default) instead of holding it for its whole delay.  That puts playback one frame behind the
+ * decoder: the next frame is decoded as soon as the current one goes up, so it's ready to blend towards.
+ *
+ * Frames are kept in the background layer's native (rotated) layout so they can be copied to and from backBuffer()
+ * without remapping, and both are taken from the GIF arena - if it's too small, begin() fails and the sketch plays
+ * GIFs the regular way.
+ *
+ * Blending is skipped for the rest of a frame when it wouldn't leave the decoder enough time: the estimated cost of
+ * decoding the next frame plus all the blends for this one is compared against the frame's delay, using running
+ * averages of both measured with micros().  Frames with delays too short to fit two blends are shown as is.
+ *
+ * Usage, with the decoder drawing into backgroundLayer:
+ *   updateScreenCallback():  if running, captureFrame(backBuffer(), getFrameDelay_ms()) instead of swapBuffers(),
+ *                            or holdFrame(getFrameDelay_ms()) if the frame came out the same as the one before it
+ *   each loop, once isSwapPending() is false:
+ *     if needsDecode(now): prepareDecode(backBuffer()), then decodeFrame()
+ *     if present(now, backBuffer()): swapBuffers(false)
+ *
+ * A held frame lengthens the one on screen instead of being decoded ahead, so the decoder doesn't go on decoding
+ * frames that come out the same back to back: once one's held, the next is decoded when the frame up is within a
+ * decode of its end (nextPresent() says when), keeping the decoder a frame ahead of the screen in the GIF's time too.
+ * A frame captured the same as the one up - a hold as long as a delay goes - goes up without blends between them.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "PlaybackStats.h"
+
+#define FRAME_INTERPOLATOR_DEFAULT_FPS          60
+// Largest share of a frame's delay the decode and blends for it can take before blending is skipped
+#define FRAME_INTERPOLATOR_LOAD_LIMIT_PERCENT   75
+
+struct FrameInterpolatorStats {
+    uint32_t keyFrames;             // decoded frames presented
+    uint32_t blendedFrames;         // intermediate frames presented
+    uint32_t skippedKeyFrames;      // decoded frames held without blending: under load, too short a delay, or the same
+    uint32_t heldFrames;            // decoded frames the same as the one before, added to its delay instead
+    uint32_t averageBlend_us;
+    uint32_t averageDecode_us;
+};
+
+template <uint16_t width, uint16_t height>
+class FrameInterpolator {
+public:
+    static const uint32_t PIXELS = (uint32_t)width * height;
+    static const uint32_t FRAME_BYTES = PIXELS * sizeof(rgb24);
+
+    // Returns false if the arena can't hold both frames, the interpolator then stays stopped
+    bool begin(GifArena &arena, uint8_t fps = FRAME_INTERPOLATOR_DEFAULT_FPS) {
+        if (!frames[0]) {
+            frames[0] = (rgb24 *)arena.alloc(FRAME_BYTES, "interpolator frame");
+            frames[1] = (rgb24 *)arena.alloc(FRAME_BYTES, "interpolator frame");
+            if (!frames[1]) {
+                arena.free(frames[0]);
+                frames[0] = NULL;
+                return false;
+            }
+        }
+        setTargetFps(fps);
+        return true;
+    }
+
+    void setTargetFps(uint8_t fps) {
+        blendInterval_ms = fps ? 1000 / fps : 0;
+    }
+
+    // Called when a new GIF starts, the next frames decoded are presented from scratch
+    void start(void) {
+        running = frames[0] != NULL;
+        haveShown = haveAhead = fresh = holding = false;
+        decodeStart_us = 0;
+    }
+
+    // Called when a new GIF follows on from the frame up without a gap: that stays up for the rest of its delay,
+    // without blending into the new GIF, and the new GIF's first frame is decoded from scratch to come in after it
+    void follow(void) {
+        if (!running || !haveShown) {
+            start();
+            return;
+        }
+        haveAhead = false;
+        holding = false;
+        fresh = true;
+        decided = true;
+        blending = false;
+        decodeStart_us = 0;
+    }
+
+    void stop(void) { running = false; }
+    bool hasAhead(void) const { return running && haveAhead; }
+    bool isRunning(void) const { return running; }
+
+    // True when the frame after the one on screen hasn't been decoded yet and it's time to: as soon as the frame goes
+    // up, or once held frames have lengthened it, within a decode of its end on the clock present() is given
+    bool needsDecode(uint32_t now) const {
+        return running && !haveAhead && (!holding || (int32_t)(now - decodeAt()) >= 0);
+    }
+
+    // The decoder draws frames on top of the previous one, so put the newest decoded frame back in the draw buffer
+    void prepareDecode(rgb24 *backBuffer) {
+        if (haveShown && !fresh)
+            memcpy((void *)backBuffer, frames[shownIndex], FRAME_BYTES);
+        decodeStart_us = micros();
+    }
+
+    // same if the frame came out the same as the one up, it isn't blended towards
+    void captureFrame(const rgb24 *backBuffer, uint16_t delay_ms, bool same = false) {
+        memcpy((void *)frames[shownIndex ^ 1], backBuffer, FRAME_BYTES);
+        aheadDelay_ms = delay_ms;
+        aheadSame = same && haveShown && !fresh;
+        haveAhead = true;
+        fresh = false;
+        if (decodeStart_us) {
+            runningAverage(stats.averageDecode_us, micros() - decodeStart_us);
+            decodeStart_us = 0;
+        }
+    }
+
+    // A decoded frame that's the same as the newest one (or empty) lengthens it instead of being blended towards.
+    // Returns false if there's no frame up to hold (or it's held as long as a delay goes), capture the frame instead
+    bool holdFrame(uint16_t delay_ms) {
+        if (!running || !haveShown || haveAhead || fresh || shownDelay_ms + delay_ms > UINT16_MAX)
+            return false;
+        shownDelay_ms += delay_ms;
+        holding = true;
+        stats.heldFrames++;
+        return true;
+    }
+
+    // Writes the next frame to present into backBuffer and returns true, or returns false if it's not time yet
+    bool present(uint32_t now, rgb24 *backBuffer) {
+        if (!running)
+            return false;
+
+        if (!haveShown || now - shownAt >= shownDelay_ms) {
+            if (!haveAhead)
+                return false;
+
+            // keep the GIF's timing unless we've fallen more than a frame behind
+            if (haveShown && now - shownAt < 2U * shownDelay_ms)
+                shownAt += shownDelay_ms;
+            else
+                shownAt = now;
+            shownIndex ^= 1;
+            shownDelay_ms = aheadDelay_ms;
+            haveShown = true;
+            haveAhead = false;
+            holding = false;
+            lastPresent = now;
+            // a frame the same as the one before has nothing to blend towards
+            decided = aheadSame;
+            blending = false;
+            if (aheadSame)
+                stats.skippedKeyFrames++;
+
+            memcpy((void *)backBuffer, frames[shownIndex], FRAME_BYTES);
+            stats.keyFrames++;
+            return true;
+        }
+
+        // the next frame is decoded as soon as this one goes up, wait for it before deciding whether to blend
+        if (!haveAhead || !blendInterval_ms || now - lastPresent < blendInterval_ms)
+            return false;
+
+        if (!decided) {
+            decided = true;
+            blending = shouldBlend();
+            if (!blending)
+                stats.skippedKeyFrames++;
+        }
+        if (!blending)
+            return false;
+
+        uint32_t start = micros();
+        uint16_t alpha = (uint16_t)(((now - shownAt) << 8) / shownDelay_ms);
+        blend(backBuffer, frames[shownIndex], frames[shownIndex ^ 1], PIXELS, alpha);
+        runningAverage(stats.averageBlend_us, micros() - start);
+
+        lastPresent = now;
+        stats.blendedFrames++;
+        return true;
+    }
+
+    // When present() next has something to do on the clock it's given, now if it might already or there's a frame to
+    // decode first
+    uint32_t nextPresent(uint32_t now) const {
+        if (!running || !haveShown)
+            return now;
+        // a held frame's next decode waits for it
+        if (!haveAhead)
+            return holding && (int32_t)(decodeAt() - now) > 0 ? decodeAt() : now;
+        uint32_t at = shownAt + shownDelay_ms;
+        if (blendInterval_ms && (!decided || blending) && (int32_t)(lastPresent + blendInterval_ms - at) < 0)
+            at = lastPresent + blendInterval_ms;
+        return (int32_t)(at - now) > 0 ? at : now;
+    }
+
+    // out = a + (b - a) * alpha / 256, alpha from 0 (all a) to 256 (all b)
+    static void blend(rgb24 *out, const rgb24 *a, const rgb24 *b, uint32_t pixels, uint16_t alpha) {
+        const uint8_t *pa = (const uint8_t *)a;
+        const uint8_t *pb = (const uint8_t *)b;
+        uint8_t *po = (uint8_t *)out;
+        const uint16_t inverse = 256 - alpha;
+
+        for (uint32_t i = 0; i < pixels * 3; i++)
+            po[i] = (uint8_t)((pa[i] * inverse + pb[i] * alpha) >> 8);
+    }
+
+    // The newest decoded frame, the one the decoder carries on from, NULL before the first
+    const rgb24 * newestFrame(void) const {
+        return haveAhead ? frames[shownIndex ^ 1] : haveShown ? frames[shownIndex] : NULL;
+    }
+
+    // Delay of the decoded frame last presented, or being blended from
+    uint16_t getShownDelay_ms(void) const { return shownDelay_ms; }
+
+    const FrameInterpolatorStats & getStats(void) const { return stats; }
+
+    template <typename Printer>
+    void printReport(Printer &out) const {
+        out.printf("Interpolator: %lu key frames (%lu without blending), %lu held, %lu blended, %lu us/blend, "
+            "%lu us/decode\n", (unsigned long)stats.keyFrames, (unsigned long)stats.skippedKeyFrames,
+            (unsigned long)stats.heldFrames, (unsigned long)stats.blendedFrames, (unsigned long)stats.averageBlend_us,
+            (unsigned long)stats.averageDecode_us);
+    }
+
+private:
+    bool shouldBlend(void) const {
+        if (shownDelay_ms < 2U * blendInterval_ms)
+            return false;
+
+        uint32_t blends = shownDelay_ms / blendInterval_ms - 1;
+        uint32_t work_us = stats.averageDecode_us + blends * stats.averageBlend_us;
+        return work_us <= (uint32_t)shownDelay_ms * 10 * FRAME_INTERPOLATOR_LOAD_LIMIT_PERCENT;
+    }
+
+    // When the next frame's decoded while the one up is held: a decode, and a ms to spare, before its end
+    uint32_t decodeAt(void) const {
+        return shownAt + shownDelay_ms - (stats.averageDecode_us / 1000 + 1);
+    }
+
+    rgb24 *frames[2] = { NULL, NULL };
+    uint8_t shownIndex = 0;         // frames[shownIndex] is on screen, the other is the next decoded frame
+    bool running = false;
+    bool haveShown = false;
+    bool haveAhead = false;
+    bool fresh = false;             // the next frame decoded starts a GIF after the one up, follow()
+    bool holding = false;           // frames were held on the one up since it went up
+    bool aheadSame = false;         // the frame ahead came out the same as the one up
+    bool decided = false;           // blending is decided once per key frame
+    bool blending = false;
+    uint16_t blendInterval_ms = 0;
+    uint16_t shownDelay_ms = 0;
+    uint16_t aheadDelay_ms = 0;
+    uint32_t shownAt = 0;
+    uint32_t lastPresent = 0;
+    uint32_t decodeStart_us = 0;
+    FrameInterpolatorStats stats = {};
+};
+
+#endif
@@ -0,0 +1,731 @@
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+/*
+ * Live frames over USB serial
+ *
+ * A laptop pushes frames to the panel as a stream of packets:
+ *
+ *   0xA5, type, length (2 bytes, little endian), payload[length], checksum
+ *
+ * where checksum is the low byte of the sum of type, both length bytes and the payload.  Packets sent to the panel:
+ *
+ *   'H' hello      no payload, the panel replies with its own 'H' packet
+ *   'K' key        first row (u16), then raw rgb24 for whole rows from there - a key frame can take several packets
+ *   'D' delta      first row (u16), then ops covering pixels from the start of that row (see below)
+ *   'P' palette    first index (u8), count - 1 (u8), then count rgb24 entries
+ *   'S' sync       frame number (u32), ends a frame, which is presented once the layer can take it
+ *
+ * and by the panel:
+ *
+ *   'H' hello      width (u16), height (u16), rotation (u8, rotationDegrees), window (u8)
+ *   'A' ack        frame number (u32) of a frame that has been presented
+ *   'N' nak        frame number (u32) of a frame that was dropped, the next frame has to be a key frame
+ *
+ * Delta ops are one control byte, the top two bits the op and the low six bits the pixel count - 1, followed by:
+ *   skip       nothing, the pixels keep their value from the frame before
+ *   literal    count rgb24 pixels
+ *   run        one rgb24 pixel, repeated count times
+ *   indexed    count palette indexes
+ *
+ * Pixels are in the background layer's buffer order (rows of width pixels, before rotation), so payloads go straight
+ * from the serial buffer into backBuffer() without another copy and the sender does any rotation - it's in the hello
+ * reply.  The sender keeps at most window frames unacknowledged, which is what paces it: frames are only acked after
+ * swapBuffers() has gone through.  Deltas apply to the frame last presented, so the sketch swaps with copy enabled.
+ *
+ * poll() reads at most maxBytes each call so playback and IR input aren't stalled, and is ignored by the sketch until
+ * a packet header has been seen.  Anything that isn't a packet (e.g. the sketch's own Serial prints echoed back) is
+ * skipped while looking for the next 0xA5, except that with setShared() text between packets is left in the port
+ * for the console (Console.h) reading the same one.
+ *
+ * FrameStreamEncoder is the sender's half, used by the host tools; the panel only instantiates FrameStream.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Console.h"
+#include "PlaybackStats.h"
+
+#define FRAME_STREAM_MAGIC          0xA5
+
+#define FRAME_STREAM_HELLO          'H'
+#define FRAME_STREAM_KEY            'K'
+#define FRAME_STREAM_DELTA          'D'
+#define FRAME_STREAM_PALETTE        'P'
+#define FRAME_STREAM_SYNC           'S'
+#define FRAME_STREAM_ACK            'A'
+#define FRAME_STREAM_NAK            'N'
+
+#define FRAME_STREAM_OP_SKIP        0x00
+#define FRAME_STREAM_OP_LITERAL     0x40
+#define FRAME_STREAM_OP_RUN         0x80
+#define FRAME_STREAM_OP_INDEXED     0xC0
+#define FRAME_STREAM_OP_MAX_COUNT   64
+
+#define FRAME_STREAM_HEADER_BYTES   4
+#define FRAME_STREAM_MAX_PAYLOAD    0xFFFF
+
+// Frames the sender may have in flight before waiting for an ack
+#define FRAME_STREAM_WINDOW         2
+// The stream is considered gone (and the sketch goes back to GIFs) after this long without a packet
+#define FRAME_STREAM_TIMEOUT_MS     2000
+#define FRAME_STREAM_POLL_BYTES     4096
+
+enum FrameStreamEvent {
+    FRAME_STREAM_IDLE,              // nothing received
+    FRAME_STREAM_RECEIVING,         // bytes received, no frame completed
+    FRAME_STREAM_FRAME_READY        // a frame is complete in the back buffer, present it and call framePresented()
+};
+
+struct FrameStreamStats {
+    uint32_t frames;                // frames presented
+    uint32_t droppedFrames;         // frames nak'ed because of a bad packet or a missing key frame
+    uint32_t keyPackets;
+    uint32_t deltaPackets;
+    uint32_t paletteUpdates;
+    uint32_t badPackets;            // checksum, length or bounds errors
+    uint32_t skippedBytes;          // bytes outside of packets
+    uint32_t bytes;
+    uint32_t averageDecode_us;      // time in poll() per frame
+};
+
+template <uint16_t width, uint16_t height>
+class FrameStream {
+public:
+    static const uint32_t PIXELS = (uint32_t)width * height;
+    static const uint32_t FRAME_BYTES = PIXELS * 3;
+
+    void setRotation(uint8_t rotation) { helloRotation = rotation; }
+
+    // With the console on the same port, poll() stops at text between packets and leaves it there
+    void setShared(bool isShared) { shared = isShared; }
+
+    // port is Serial, or anything else with available(), peek(), read(), readBytes() and write()
+    template <typename Port>
+    FrameStreamEvent poll(Port &port, rgb24 *backBuffer, uint32_t now, uint32_t maxBytes = FRAME_STREAM_POLL_BYTES) {
+        uint8_t *frame = (uint8_t *)backBuffer;
+        FrameStreamEvent event = FRAME_STREAM_IDLE;
+        uint32_t start = micros();
+
+        while (maxBytes && event != FRAME_STREAM_FRAME_READY) {
+            int available = port.available();
+            if (available <= 0)
+                break;
+            event = FRAME_STREAM_RECEIVING;
+
+            if (state == STATE_RAW) {
+                // straight from the serial buffer to the frame or palette
+                uint32_t n = rawLeft;
+                if (n > (uint32_t)available) n = available;
+                if (n > maxBytes) n = maxBytes;
+                port.readBytes((char *)rawDst, n);
+                for (uint32_t i = 0; i < n; i++)
+                    checksum += rawDst[i];
+                rawDst += n;
+                rawLeft -= n;
+                payloadLeft -= n;
+                maxBytes -= n;
+                stats.bytes += n;
+                if (!rawLeft)
+                    state = rawNext;
+                if (!payloadLeft)
+                    endPayload();
+                continue;
+            }
+
+            if (state == STATE_MAGIC && shared && isConsoleText(port.peek()))
+                break;
+
+            uint8_t b = port.read();
+            maxBytes--;
+            stats.bytes++;
+            if (consume(port, frame, b, now))
+                event = FRAME_STREAM_FRAME_READY;
+        }
+
+        if (event != FRAME_STREAM_IDLE)
+            frameDecode_us += micros() - start;
+        return event;
+    }
+
+    // Call once the frame from FRAME_STREAM_FRAME_READY has been swapped in
+    template <typename Port>
+    void framePresented(Port &port) {
+        stats.frames++;
+        runningAverage(stats.averageDecode_us, frameDecode_us);
+        frameDecode_us = 0;
+        sendFrameNumber(port, FRAME_STREAM_ACK, frameNumber);
+    }
+
+    // True from the first packet header until FRAME_STREAM_TIMEOUT_MS without one
+    bool isActive(uint32_t now) const { return seenPacket && now - lastPacket < FRAME_STREAM_TIMEOUT_MS; }
+
+    // True between packets, when the next byte on the port isn't part of one
+    bool isIdle(void) const { return state == STATE_MAGIC; }
+
+    const FrameStreamStats & getStats(void) const { return stats; }
+
+    template <typename Printer>
+    void printReport(Printer &out) const {
+        out.printf("Stream: %lu frames, %lu dropped, %lu key/%lu delta packets, %lu palettes, %lu bad, %lu bytes, "
+            "%lu us/frame\n", (unsigned long)stats.frames, (unsigned long)stats.droppedFrames,
+            (unsigned long)stats.keyPackets, (unsigned long)stats.deltaPackets, (unsigned long)stats.paletteUpdates,
+            (unsigned long)stats.badPackets, (unsigned long)stats.bytes, (unsigned long)stats.averageDecode_us);
+    }
+
+private:
+    enum State {
+        STATE_MAGIC, STATE_TYPE, STATE_LENGTH0, STATE_LENGTH1,
+        STATE_FIELDS,               // fixed fields at the start of the payload, collected in field[]
+        STATE_OP,                   // next delta control byte
+        STATE_RAW,                  // copying payload to rawDst
+        STATE_RUN,                  // run color, collected in field[]
+        STATE_INDEXED,              // palette indexes
+        STATE_DISCARD,              // rest of a bad packet
+        STATE_CHECKSUM
+    };
+
+    // Returns true when a sync packet completed a good frame
+    template <typename Port>
+    bool consume(Port &port, uint8_t *frame, uint8_t b, uint32_t now) {
+        switch (state) {
+        case STATE_MAGIC:
+            if (b == FRAME_STREAM_MAGIC)
+                state = STATE_TYPE;
+            else
+                stats.skippedBytes++;
+            return false;
+
+        case STATE_TYPE:
+            type = b;
+            checksum = b;
+            state = STATE_LENGTH0;
+            return false;
+
+        case STATE_LENGTH0:
+            payloadLeft = b;
+            checksum += b;
+            state = STATE_LENGTH1;
+            return false;
+
+        case STATE_LENGTH1:
+            payloadLeft |= (uint32_t)b << 8;
+            checksum += b;
+            seenPacket = true;
+            lastPacket = now;
+            packetBad = false;
+            beginPayload(frame);
+            return false;
+
+        case STATE_CHECKSUM:
+            state = STATE_MAGIC;
+            if (b != checksum || packetBad) {
+                stats.badPackets++;
+                frameBad = true;
+                return false;
+            }
+            return endPacket(port);
+
+        default:
+            break;
+        }
+
+        // payload bytes
+        checksum += b;
+        payloadLeft--;
+
+        switch (state) {
+        case STATE_FIELDS:
+            field[fieldCount++] = b;
+            if (fieldCount == fieldsNeeded)
+                fieldsDone(frame);
+            break;
+
+        case STATE_OP: {
+            uint32_t count = (b & 0x3F) + 1;
+            if (cursor + count > PIXELS) {
+                fail();
+                break;
+            }
+            switch (b & 0xC0) {
+            case FRAME_STREAM_OP_SKIP:
+                cursor += count;
+                break;
+            case FRAME_STREAM_OP_LITERAL:
+                startRaw(frame + cursor * 3, count * 3, STATE_OP);
+                cursor += count;
+                break;
+            case FRAME_STREAM_OP_RUN:
+                opCount = count;
+                fieldCount = 0;
+                state = STATE_RUN;
+                break;
+            default:
+                opCount = count;
+                state = STATE_INDEXED;
+                break;
+            }
+            break;
+        }
+
+        case STATE_RUN:
+            field[fieldCount++] = b;
+            if (fieldCount == 3) {
+                uint8_t *p = frame + cursor * 3;
+                for (uint32_t i = 0; i < opCount; i++, p += 3) {
+                    p[0] = field[0];
+                    p[1] = field[1];
+                    p[2] = field[2];
+                }
+                cursor += opCount;
+                state = STATE_OP;
+            }
+            break;
+
+        case STATE_INDEXED:
+            memcpy(frame + cursor * 3, palette[b], 3);
+            cursor++;
+            if (!--opCount)
+                state = STATE_OP;
+            break;
+
+        default:
+            break;
+        }
+
+        if (!payloadLeft)
+            endPayload();
+        return false;
+    }
+
+    void beginPayload(uint8_t *frame) {
+        fieldCount = 0;
+        switch (type) {
+        case FRAME_STREAM_KEY:
+        case FRAME_STREAM_DELTA:
+        case FRAME_STREAM_PALETTE:
+            fieldsNeeded = 2;
+            break;
+        case FRAME_STREAM_SYNC:
+            fieldsNeeded = 4;
+            break;
+        case FRAME_STREAM_HELLO:
+            fieldsNeeded = 0;
+            break;
+        default:
+            fieldsNeeded = 0;
+            packetBad = true;
+            break;
+        }
+
+        if (payloadLeft < fieldsNeeded)
+            packetBad = true;
+
+        if (packetBad)
+            state = payloadLeft ? STATE_DISCARD : STATE_CHECKSUM;
+        else if (fieldsNeeded)
+            state = STATE_FIELDS;
+        else
+            fieldsDone(frame);
+    }
+
+    void fieldsDone(uint8_t *frame) {
+        switch (type) {
+        case FRAME_STREAM_KEY: {
+            uint32_t offset = (uint32_t)(field[0] | field[1] << 8) * width * 3;
+            if (offset + payloadLeft > FRAME_BYTES || payloadLeft % (width * 3)) {
+                fail();
+                return;
+            }
+            startRaw(frame + offset, payloadLeft, STATE_CHECKSUM);
+            if (offset == 0)
+                keyStarted = true;
+            break;
+        }
+
+        case FRAME_STREAM_DELTA:
+            cursor = (uint32_t)(field[0] | field[1] << 8) * width;
+            if (cursor >= PIXELS) {
+                fail();
+                return;
+            }
+            state = STATE_OP;
+            break;
+
+        case FRAME_STREAM_PALETTE: {
+            uint32_t first = field[0], count = field[1] + 1U;
+            if (first + count > 256 || payloadLeft != count * 3) {
+                fail();
+                return;
+            }
+            startRaw(palette[first], payloadLeft, STATE_CHECKSUM);
+            break;
+        }
+
+        case FRAME_STREAM_SYNC:
+            pendingFrameNumber = field[0] | field[1] << 8 | (uint32_t)field[2] << 16 | (uint32_t)field[3] << 24;
+            state = STATE_CHECKSUM;
+            break;
+
+        default:
+            state = STATE_CHECKSUM;
+            break;
+        }
+
+        if (!payloadLeft && state != STATE_CHECKSUM)
+            endPayload();
+    }
+
+    void startRaw(uint8_t *dst, uint32_t bytes, State next) {
+        rawDst = dst;
+        rawLeft = bytes;
+        rawNext = next;
+        state = bytes ? STATE_RAW : next;
+    }
+
+    // a packet whose payload ends part way through a field or op is bad
+    void endPayload(void) {
+        if (state != STATE_CHECKSUM && state != STATE_OP && state != STATE_DISCARD)
+            packetBad = true;
+        state = STATE_CHECKSUM;
+    }
+
+    void fail(void) {
+        packetBad = true;
+        state = payloadLeft ? STATE_DISCARD : STATE_CHECKSUM;
+    }
+
+    template <typename Port>
+    bool endPacket(Port &port) {
+        switch (type) {
+        case FRAME_STREAM_HELLO:
+            sendHello(port);
+            return false;
+
+        case FRAME_STREAM_KEY:
+            stats.keyPackets++;
+            return false;
+
+        case FRAME_STREAM_DELTA:
+            stats.deltaPackets++;
+            return false;
+
+        case FRAME_STREAM_PALETTE:
+            stats.paletteUpdates++;
+            return false;
+
+        case FRAME_STREAM_SYNC: {
+            // a frame is only good if nothing in it was dropped and the back buffer has been keyed since the stream
+            // (re)started
+            bool good = !frameBad && (haveKey || keyStarted);
+            frameBad = false;
+            if (!good) {
+                haveKey = keyStarted = false;
+                stats.droppedFrames++;
+                frameDecode_us = 0;
+                sendFrameNumber(port, FRAME_STREAM_NAK, pendingFrameNumber);
+                return false;
+            }
+            haveKey = true;
+            keyStarted = false;
+            frameNumber = pendingFrameNumber;
+            return true;
+        }
+        }
+        return false;
+    }
+
+    template <typename Port>
+    void sendHello(Port &port) {
+        // starting over, the next frame has to be a key frame
+        haveKey = keyStarted = frameBad = false;
+        uint8_t payload[6] = { (uint8_t)width, (uint8_t)(width >> 8), (uint8_t)height, (uint8_t)(height >> 8),
+            helloRotation, FRAME_STREAM_WINDOW };
+        sendPacket(port, FRAME_STREAM_HELLO, payload, sizeof(payload));
+    }
+
+    template <typename Port>
+    void sendFrameNumber(Port &port, uint8_t packetType, uint32_t number) {
+        uint8_t payload[4] = { (uint8_t)number, (uint8_t)(number >> 8), (uint8_t)(number >> 16),
+            (uint8_t)(number >> 24) };
+        sendPacket(port, packetType, payload, sizeof(payload));
+    }
+
+    template <typename Port>
+    void sendPacket(Port &port, uint8_t packetType, const uint8_t *payload, uint8_t length) {
+        uint8_t packet[FRAME_STREAM_HEADER_BYTES + 8 + 1];
+        packet[0] = FRAME_STREAM_MAGIC;
+        packet[1] = packetType;
+        packet[2] = length;
+        packet[3] = 0;
+        uint8_t sum = packetType + length;
+        for (uint8_t i = 0; i < length; i++) {
+            packet[FRAME_STREAM_HEADER_BYTES + i] = payload[i];
+            sum += payload[i];
+        }
+        packet[FRAME_STREAM_HEADER_BYTES + length] = sum;
+        port.write(packet, FRAME_STREAM_HEADER_BYTES + length + 1);
+    }
+
+    bool shared = false;
+    State state = STATE_MAGIC;
+    State rawNext = STATE_MAGIC;
+    uint8_t type = 0;
+    uint8_t checksum = 0;
+    uint32_t payloadLeft = 0;
+    uint8_t field[4];
+    uint8_t fieldCount = 0;
+    uint8_t fieldsNeeded = 0;
+    uint32_t cursor = 0;            // pixel the next delta op writes
+    uint32_t opCount = 0;
+    uint8_t *rawDst = NULL;
+    uint32_t rawLeft = 0;
+    bool packetBad = false;
+    bool frameBad = false;
+    bool haveKey = false;           // the back buffer holds a complete frame from this stream
+    bool keyStarted = false;        // a key frame has started since the last sync
+    bool seenPacket = false;
+    uint32_t lastPacket = 0;
+    uint32_t pendingFrameNumber = 0;
+    uint32_t frameNumber = 0;
+    uint32_t frameDecode_us = 0;
+    uint8_t helloRotation = 0;
+    uint8_t palette[256][3];
+    FrameStreamStats stats = {};
+};
+
+/*
+ * Sender side: turns frames (in the panel's buffer order) into packets.  Each frame is sent as a delta against the
+ * last one unless a key frame is requested or would be smaller.  Literal pixels go out as palette indexes when the
+ * palette (kept from frame to frame, and extended or replaced with a palette packet) makes that cheaper.
+ */
+template <uint16_t width, uint16_t height>
+class FrameStreamEncoder {
+public:
+    static const uint32_t PIXELS = (uint32_t)width * height;
+    static const uint32_t FRAME_BYTES = PIXELS * 3;
+    // Output space encode() needs for one frame in the worst case
+    static const uint32_t MAX_FRAME_PACKETS_BYTES = 2 * FRAME_BYTES + 4096;
+
+    void requestKeyFrame(void) { forceKey = true; }
+
+    // Returns the number of bytes written to out, which must hold MAX_FRAME_PACKETS_BYTES
+    uint32_t encode(const rgb24 *frame, uint32_t frameNumber, uint8_t *out) {
+        const uint8_t *pixels = (const uint8_t *)frame;
+        uint32_t length = 0;
+
+        bool key = forceKey || !havePrevious;
+        if (!key) {
+            // the palette packet is kept even if this ends up a key frame, the encoder's palette has changed
+            uint32_t paletteLength = 0;
+            length = encodeDelta(pixels, out, paletteLength);
+            key = length >= paletteLength + FRAME_BYTES + FRAME_BYTES / 64;
+            if (key)
+                length = paletteLength;
+        }
+        if (key) {
+            length += encodeKey(pixels, out + length);
+            keyFrames++;
+        } else {
+            deltaFrames++;
+        }
+
+        uint8_t number[4] = { (uint8_t)frameNumber, (uint8_t)(frameNumber >> 8), (uint8_t)(frameNumber >> 16),
+            (uint8_t)(frameNumber >> 24) };
+        length += writePacket(out + length, FRAME_STREAM_SYNC, number, sizeof(number));
+
+        memcpy(previous, pixels, FRAME_BYTES);
+        havePrevious = true;
+        forceKey = false;
+        return length;
+    }
+
+    uint32_t getKeyFrames(void) const { return keyFrames; }
+    uint32_t getDeltaFrames(void) const { return deltaFrames; }
+
+    static uint32_t writePacket(uint8_t *out, uint8_t type, const uint8_t *payload, uint32_t length) {
+        out[0] = FRAME_STREAM_MAGIC;
+        out[1] = type;
+        out[2] = (uint8_t)length;
+        out[3] = (uint8_t)(length >> 8);
+        uint8_t sum = type + out[2] + out[3];
+        for (uint32_t i = 0; i < length; i++) {
+            out[FRAME_STREAM_HEADER_BYTES + i] = payload[i];
+            sum += payload[i];
+        }
+        out[FRAME_STREAM_HEADER_BYTES + length] = sum;
+        return FRAME_STREAM_HEADER_BYTES + length + 1;
+    }
+
+private:
+    static const uint32_t ROW_BYTES = (uint32_t)width * 3;
+    // payload limit per packet, leaving room for the row field and one row of ops
+    static const uint32_t PACKET_LIMIT = FRAME_STREAM_MAX_PAYLOAD - 2 - 4 * ROW_BYTES / 3;
+
+    uint32_t encodeKey(const uint8_t *pixels, uint8_t *out) {
+        uint32_t rowsPerPacket = (FRAME_STREAM_MAX_PAYLOAD - 2) / ROW_BYTES;
+        uint32_t length = 0;
+        for (uint32_t row = 0; row < height; row += rowsPerPacket) {
+            uint32_t rows = height - row < rowsPerPacket ? height - row : rowsPerPacket;
+            payload[0] = (uint8_t)row;
+            payload[1] = (uint8_t)(row >> 8);
+            memcpy(payload + 2, pixels + row * ROW_BYTES, rows * ROW_BYTES);
+            length += writePacket(out + length, FRAME_STREAM_KEY, payload, 2 + rows * ROW_BYTES);
+        }
+        return length;
+    }
+
+    uint32_t encodeDelta(const uint8_t *pixels, uint8_t *out, uint32_t &paletteLength) {
+        uint32_t length = 0;
+        bool indexed = choosePalette(pixels, out, length);
+        paletteLength = length;
+
+        uint32_t payloadLength = 0;
+        for (uint32_t row = 0; row < height; row++) {
+            if (!payloadLength) {
+                payload[0] = (uint8_t)row;
+                payload[1] = (uint8_t)(row >> 8);
+                payloadLength = 2;
+            }
+            payloadLength += encodeRow(pixels + row * ROW_BYTES, previous + row * ROW_BYTES, indexed,
+                payload + payloadLength);
+            if (payloadLength > PACKET_LIMIT || row == height - 1U) {
+                length += writePacket(out + length, FRAME_STREAM_DELTA, payload, payloadLength);
+                payloadLength = 0;
+            }
+        }
+        return length;
+    }
+
+    // Ops never cross rows, so packets can be split at any row
+    uint32_t encodeRow(const uint8_t *row, const uint8_t *before, bool indexed, uint8_t *ops) {
+        uint32_t length = 0;
+        uint32_t x = 0;
+        while (x < width) {
+            uint32_t limit = width - x < FRAME_STREAM_OP_MAX_COUNT ? width - x : FRAME_STREAM_OP_MAX_COUNT;
+
+            uint32_t same = 0;
+            while (same < limit && !memcmp(row + (x + same) * 3, before + (x + same) * 3, 3))
+                same++;
+            if (same) {
+                ops[length++] = FRAME_STREAM_OP_SKIP | (same - 1);
+                x += same;
+                continue;
+            }
+
+            uint32_t repeat = 1;
+            while (repeat < limit && !memcmp(row + (x + repeat) * 3, row + x * 3, 3))
+                repeat++;
+            if (repeat >= 3 || (repeat == 2 && !indexed)) {
+                ops[length++] = FRAME_STREAM_OP_RUN | (repeat - 1);
+                memcpy(ops + length, row + x * 3, 3);
+                length += 3;
+                x += repeat;
+                continue;
+            }
+
+            // literal up to the next pixel that's unchanged or starts a run
+            uint32_t count = 1;
+            while (count < limit) {
+                const uint8_t *p = row + (x + count) * 3;
+                if (!memcmp(p, before + (x + count) * 3, 3))
+                    break;
+                if (x + count + 2 < width && !memcmp(p, p + 3, 3) && !memcmp(p, p + 6, 3))
+                    break;
+                count++;
+            }
+            ops[length++] = (indexed ? FRAME_STREAM_OP_INDEXED : FRAME_STREAM_OP_LITERAL) | (count - 1);
+            for (uint32_t i = 0; i < count; i++) {
+                const uint8_t *p = row + (x + i) * 3;
+                if (indexed) {
+                    ops[length++] = (uint8_t)findColor(p);
+                } else {
+                    memcpy(ops + length, p, 3);
+                    length += 3;
+                }
+            }
+            x += count;
+        }
+        return length;
+    }
+
+    // Decides whether this frame's literals go out as palette indexes, writing a palette packet if the palette
+    // has to change for that
+    bool choosePalette(const uint8_t *pixels, uint8_t *out, uint32_t &length) {
+        // colors of every changed pixel, a superset of the literals
+        uint16_t colors = 0;
+        uint32_t changed = 0;
+        uint32_t missing = 0;
+        for (uint32_t i = 0; i < PIXELS; i++) {
+            const uint8_t *p = pixels + i * 3;
+            if (!memcmp(p, previous + i * 3, 3))
+                continue;
+            changed++;
+            bool known = false;
+            for (uint16_t c = 0; c < colors && !known; c++)
+                known = !memcmp(frameColors[c], p, 3);
+            if (known)
+                continue;
+            if (colors == 256)
+                return false;
+            memcpy(frameColors[colors++], p, 3);
+            if (findColor(p) < 0)
+                missing++;
+        }
+        if (!changed)
+            return false;
+
+        // one byte per changed pixel instead of three, against the cost of the palette packet
+        uint32_t update = 0;
+        if (missing) {
+            if (paletteSize + missing <= 256)
+                update = missing;
+            else
+                update = colors;
+        }
+        if (update * 3 + (update ? 7 : 0) >= changed * 2)
+            return false;
+
+        if (update) {
+            uint16_t first;
+            if (paletteSize + missing <= 256) {
+                first = paletteSize;
+                for (uint16_t c = 0; c < colors; c++) {
+                    if (findColor(frameColors[c]) < 0)
+                        memcpy(palette[paletteSize++], frameColors[c], 3);
+                }
+            } else {
+                first = 0;
+                memcpy(palette, frameColors, colors * 3);
+                paletteSize = colors;
+            }
+            uint16_t count = paletteSize - first;
+            payload[0] = (uint8_t)first;
+            payload[1] = (uint8_t)(count - 1);
+            memcpy(payload + 2, palette[first], count * 3);
+            length += writePacket(out + length, FRAME_STREAM_PALETTE, payload, 2 + count * 3);
+        }
+        return true;
+    }
+
+    int findColor(const uint8_t *p) const {
+        for (uint16_t c = 0; c < paletteSize; c++) {
+            if (!memcmp(palette[c], p, 3))
+                return c;
+        }
+        return -1;
+    }
+
+    uint8_t previous[FRAME_BYTES];
+    bool havePrevious = false;
+    bool forceKey = false;
+    uint8_t palette[256][3];
+    uint16_t paletteSize = 0;
+    uint8_t frameColors[256][3];
+    uint8_t payload[FRAME_STREAM_MAX_PAYLOAD];
+    uint32_t keyFrames = 0;
+    uint32_t deltaFrames = 0;
+};
+
+#endif
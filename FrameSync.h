@@ -0,0 +1,444 @@
+#ifndef FRAME_SYNC_H
+#define FRAME_SYNC_H
+
+/*
+ * Frame sync for walls of several panels
+ *
+ * Rigs side by side play the same GIFs from their own SD cards, and one of them (the leader) keeps the others
+ * (followers) on its frame over a serial link.  The leader broadcasts where it is in the animation; each follower
+ * paces its frames by a playback clock it runs slightly fast or slow until its own position matches the leader's.
+ * Packets are
+ *
+ *   0x5C, type, length (u8), payload[length], checksum
+ *
+ * where checksum is the low byte of the sum of type, length and the payload:
+ *
+ *   'S' sync    leader: leader micros() (u32), GIF index (u16), position (u32, us), cycle (u32, ms)
+ *   'Q' ping    follower: follower micros() (u32)
+ *   'R' pong    leader: the ping's timestamp (u32), leader micros() (u32) - heard by every follower, the one whose
+ *               timestamp it is takes it
+ *
+ * The position is time along the GIF's timeline - the sum of the delays of the frames shown since it started plus
+ * the time the current frame has been up, capped at its delay - modulo the cycle length once a whole cycle has been
+ * played.  It's independent of how late frames were actually shown, so it compares between rigs.
+ *
+ * A follower adds the link latency and the time since the sync arrived to the leader's position, and slews its
+ * playback clock by the difference: up to FRAME_SYNC_SLEW_PERCENT faster or slower, proportional to the error so
+ * it's gone in about FRAME_SYNC_CONVERGE_MS.  Errors over FRAME_SYNC_STEP_MS (a follower that just joined, or has
+ * switched to the leader's GIF) are stepped out instead, playing at FRAME_SYNC_CATCHUP_RATE or holding the frame.
+ * Followers that haven't heard a sync for FRAME_SYNC_TIMEOUT_MS play on their own.
+ *
+ * Followers ping the leader to measure the link latency (half the shortest round trip).  With the leader's TX wired
+ * to every follower's RX and no return path, there are no pongs, and the latency is taken as the wire time of a sync
+ * packet.  Clock offset and drift are estimated from the sync timestamps: the least delayed sync of each
+ * FRAME_SYNC_DRIFT_WINDOW_MS window gives the offset, and its change since the first window the drift.  They're reported,
+ * but pacing only depends on positions, so drift is corrected without knowing it.
+ *
+ * update() reads at most FRAME_SYNC_POLL_BYTES per call, and all timestamps are passed in, so it can run on
+ * simulated clocks.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "PlaybackStats.h"
+
+#define FRAME_SYNC_MAGIC            0x5C
+
+#define FRAME_SYNC_SYNC             'S'
+#define FRAME_SYNC_PING             'Q'
+#define FRAME_SYNC_PONG             'R'
+
+#define FRAME_SYNC_HEADER_BYTES     3
+#define FRAME_SYNC_MAX_PAYLOAD      16
+#define FRAME_SYNC_SYNC_BYTES       (FRAME_SYNC_HEADER_BYTES + 14 + 1)
+
+// Jumpered high on the leader, the other rigs leave it open (pulled down)
+#ifndef FRAME_SYNC_LEADER_PIN
+#define FRAME_SYNC_LEADER_PIN       17
+#endif
+#define FRAME_SYNC_BAUD             460800
+
+#define FRAME_SYNC_INTERVAL_MS      100
+#define FRAME_SYNC_PING_INTERVAL_MS 500
+#define FRAME_SYNC_TIMEOUT_MS       1000
+#define FRAME_SYNC_SLEW_PERCENT     10
+#define FRAME_SYNC_CONVERGE_MS      500
+#define FRAME_SYNC_STEP_MS          250
+#define FRAME_SYNC_CATCHUP_RATE     4
+#define FRAME_SYNC_DRIFT_WINDOW_MS  10000
+#define FRAME_SYNC_POLL_BYTES       64
+
+enum FrameSyncRole {
+    FRAME_SYNC_OFF,
+    FRAME_SYNC_LEADER,
+    FRAME_SYNC_FOLLOWER
+};
+
+struct FrameSyncStats {
+    uint32_t sent;                  // packets sent
+    uint32_t received;              // good packets received
+    uint32_t badPackets;            // checksum or length errors
+    uint32_t steps;                 // times a follower caught up at full speed or held instead of slewing
+    int32_t error_us;               // follower: the leader's position minus ours, at the last update
+    uint32_t averageError_us;       // running average of |error_us| while slewing, sampled once per sync
+    uint32_t maxError_us;           // largest |error_us| while slewing since the last report
+    uint32_t latency_us;            // one way, half the shortest ping round trip or the wire time of a sync
+    int32_t offset_us;              // the leader's clock minus ours, give or take the latency past the wire time
+    int32_t drift_ppm;              // how much faster the leader's clock runs than ours
+    int32_t rate_ppm;               // how much faster our playback clock runs than our clock
+    uint32_t cpu_us;                // time in update() since the last report
+};
+
+class FrameSync {
+public:
+    static const uint32_t RATE_ONE = 65536;
+    // time a sync takes on the wire
+    static const uint32_t WIRE_US = FRAME_SYNC_SYNC_BYTES * 10 * 1000000ULL / FRAME_SYNC_BAUD;
+
+    void begin(FrameSyncRole newRole, uint32_t now_us) {
+        role = newRole;
+        lastUpdate_us = now_us;
+        reportStart_us = now_us;
+        playback = (uint64_t)now_us * RATE_ONE;
+        stats.latency_us = WIRE_US;
+    }
+
+    FrameSyncRole getRole(void) const { return role; }
+
+    // True while a follower is tracking a leader, the leader picks the GIF then
+    bool isFollowing(uint32_t now_us) const {
+        return role == FRAME_SYNC_FOLLOWER && haveSync && now_us - syncAt_us < FRAME_SYNC_TIMEOUT_MS * 1000UL;
+    }
+
+    // The GIF the leader is playing, or -1 when not following
+    int32_t leaderGif(uint32_t now_us) const { return isFollowing(now_us) ? syncGif : -1; }
+
+    // The clock to pace GIF frames by, in ms: it runs with micros() except while a follower is converging
+    uint32_t frameTime(void) const { return (uint32_t)(playback / RATE_ONE / 1000); }
+
+    // port is Serial3, or anything else with available(), read() and write()
+    template <typename Port>
+    void update(Port &port, uint32_t now_us) {
+        if (role == FRAME_SYNC_OFF)
+            return;
+        uint32_t start = micros();
+
+        playback += (uint64_t)(now_us - lastUpdate_us) * rate;
+        lastUpdate_us = now_us;
+
+        for (uint32_t n = 0; n < FRAME_SYNC_POLL_BYTES && port.available() > 0; n++)
+            consume(port, (uint8_t)port.read(), now_us);
+
+        if (role == FRAME_SYNC_LEADER) {
+            if (syncDue || now_us - lastSend_us >= FRAME_SYNC_INTERVAL_MS * 1000UL) {
+                sendSync(port, now_us);
+                syncDue = false;
+                lastSend_us = now_us;
+            }
+        } else {
+            // no point pinging until there's a leader to answer
+            if (haveSync && now_us - lastSend_us >= FRAME_SYNC_PING_INTERVAL_MS * 1000UL) {
+                uint8_t payload[4];
+                put32(payload, now_us);
+                sendPacket(port, FRAME_SYNC_PING, payload, sizeof(payload));
+                lastSend_us = now_us;
+                pingSent = true;
+            }
+            steer(now_us);
+        }
+
+        stats.cpu_us += micros() - start;
+    }
+
+    // When update() next has a packet to send, on micros(), false if it has none coming
+    bool nextSend(uint32_t &at_us) const {
+        if (role == FRAME_SYNC_LEADER)
+            at_us = syncDue ? lastUpdate_us : lastSend_us + FRAME_SYNC_INTERVAL_MS * 1000UL;
+        else if (role == FRAME_SYNC_FOLLOWER && haveSync)
+            at_us = lastSend_us + FRAME_SYNC_PING_INTERVAL_MS * 1000UL;
+        else
+            return false;
+        return true;
+    }
+
+    // A GIF started playing, frameTime_ms from frameTime()
+    void gifStarted(uint16_t index, uint32_t frameTime_ms) {
+        gif = index;
+        timeline_ms = 0;
+        shownAt_ms = frameTime_ms;
+        shownDelay_ms = 0;
+        cycle_ms = 0;
+        haveFrame = false;
+        syncDue = true;
+    }
+
+    // A decoded frame went up; cycle_ms is the GIF's cycle length once it's known, 0 before
+    void frameShown(uint32_t frameTime_ms, uint16_t delay_ms, uint32_t gifCycle_ms) {
+        if (haveFrame)
+            timeline_ms += shownDelay_ms;
+        shownAt_ms = frameTime_ms;
+        shownDelay_ms = delay_ms;
+        cycle_ms = gifCycle_ms;
+        haveFrame = true;
+        if (cycle_ms)
+            timeline_ms %= cycle_ms;
+    }
+
+    // The frame up stays for delay_ms more, in place of a decoded frame the same as it
+    void frameHeld(uint16_t delay_ms) {
+        if (haveFrame && shownDelay_ms + delay_ms <= UINT16_MAX)
+            shownDelay_ms += delay_ms;
+    }
+
+    // Position along the GIF's timeline at the last update, in us
+    uint32_t position_us(void) const {
+        if (!haveFrame)
+            return 0;
+        uint32_t up_us = (uint32_t)(playback / RATE_ONE - (uint64_t)shownAt_ms * 1000);
+        if (up_us > shownDelay_ms * 1000UL)
+            up_us = shownDelay_ms * 1000UL;
+        uint32_t position = timeline_ms * 1000 + up_us;
+        return cycle_ms ? position % (cycle_ms * 1000) : position;
+    }
+
+    const FrameSyncStats & getStats(void) const { return stats; }
+
+    // Prints the stats and starts a new reporting interval
+    template <typename Printer>
+    void printReport(Printer &out, uint32_t now_us) {
+        uint32_t elapsed_us = now_us - reportStart_us;
+        uint32_t cpu_ppm = elapsed_us ? (uint32_t)((uint64_t)stats.cpu_us * 1000000 / elapsed_us) : 0;
+        if (role == FRAME_SYNC_LEADER) {
+            out.printf("Sync leader: %lu sent, %lu received, %lu bad, cpu %lu.%02lu%%\n", (unsigned long)stats.sent,
+                (unsigned long)stats.received, (unsigned long)stats.badPackets, (unsigned long)(cpu_ppm / 10000),
+                (unsigned long)(cpu_ppm / 100 % 100));
+        } else if (role == FRAME_SYNC_FOLLOWER) {
+            out.printf("Sync follower: %s, error %ld us (avg %lu, max %lu), %lu steps, latency %lu us, offset %ld us, "
+                "drift %ld ppm, rate %+ld ppm, %lu bad, cpu %lu.%02lu%%\n", isFollowing(now_us) ? "locked" : "free",
+                (long)stats.error_us, (unsigned long)stats.averageError_us, (unsigned long)stats.maxError_us,
+                (unsigned long)stats.steps, (unsigned long)stats.latency_us, (long)stats.offset_us,
+                (long)stats.drift_ppm, (long)stats.rate_ppm, (unsigned long)stats.badPackets,
+                (unsigned long)(cpu_ppm / 10000), (unsigned long)(cpu_ppm / 100 % 100));
+        }
+        stats.maxError_us = 0;
+        stats.cpu_us = 0;
+        reportStart_us = now_us;
+    }
+
+private:
+    // Follower: pick the playback rate that closes the gap to the leader
+    void steer(uint32_t now_us) {
+        if (!isFollowing(now_us)) {
+            // a leader that comes back may be another one, or rebooted
+            haveOffset = false;
+            windowSamples = 0;
+        }
+        if (!isFollowing(now_us) || syncGif != gif || !haveFrame) {
+            setRate(RATE_ONE);
+            stepping = false;
+            return;
+        }
+
+        // the leader has moved on since the sync was sent, at (near enough) our clock's rate
+        int64_t leader = (int64_t)syncPosition_us + stats.latency_us + (now_us - syncAt_us);
+        int64_t error = leader - position_us();
+        uint32_t cycle = syncCycle_ms ? syncCycle_ms : cycle_ms;
+        if (cycle) {
+            int64_t c = (int64_t)cycle * 1000;
+            error = ((error % c) + c) % c;
+            if (error > c / 2)
+                error -= c;
+        }
+        stats.error_us = (int32_t)error;
+
+        if (error > FRAME_SYNC_STEP_MS * 1000L || error < -FRAME_SYNC_STEP_MS * 1000L) {
+            if (!stepping)
+                stats.steps++;
+            stepping = true;
+            newSync = false;
+            setRate(error > 0 ? RATE_ONE * FRAME_SYNC_CATCHUP_RATE : 0);
+            return;
+        }
+        stepping = false;
+
+        if (newSync) {
+            newSync = false;
+            uint32_t magnitude = error < 0 ? -error : error;
+            runningAverage(stats.averageError_us, magnitude);
+            if (magnitude > stats.maxError_us)
+                stats.maxError_us = magnitude;
+        }
+
+        int64_t adjust = error * RATE_ONE / (FRAME_SYNC_CONVERGE_MS * 1000L);
+        const int64_t limit = RATE_ONE * FRAME_SYNC_SLEW_PERCENT / 100;
+        if (adjust > limit) adjust = limit;
+        if (adjust < -limit) adjust = -limit;
+        setRate((uint32_t)(RATE_ONE + adjust));
+    }
+
+    void setRate(uint32_t newRate) {
+        rate = newRate;
+        stats.rate_ppm = (int32_t)(((int64_t)rate - RATE_ONE) * 1000000 / RATE_ONE);
+    }
+
+    template <typename Port>
+    void consume(Port &port, uint8_t b, uint32_t now_us) {
+        if (!length && b != FRAME_SYNC_MAGIC)
+            return;
+        packet[length++] = b;
+        if (length == FRAME_SYNC_HEADER_BYTES && packet[2] > FRAME_SYNC_MAX_PAYLOAD) {
+            stats.badPackets++;
+            length = 0;
+            return;
+        }
+        if (length < FRAME_SYNC_HEADER_BYTES || length < FRAME_SYNC_HEADER_BYTES + packet[2] + 1U)
+            return;
+
+        uint8_t payloadLength = packet[2];
+        length = 0;
+        uint8_t sum = 0;
+        for (uint8_t i = 1; i < FRAME_SYNC_HEADER_BYTES + payloadLength; i++)
+            sum += packet[i];
+        if (sum != packet[FRAME_SYNC_HEADER_BYTES + payloadLength]) {
+            stats.badPackets++;
+            return;
+        }
+        stats.received++;
+        handle(port, packet[1], packet + FRAME_SYNC_HEADER_BYTES, payloadLength, now_us);
+    }
+
+    template <typename Port>
+    void handle(Port &port, uint8_t type, const uint8_t *payload, uint8_t payloadLength, uint32_t now_us) {
+        if (role == FRAME_SYNC_LEADER && type == FRAME_SYNC_PING && payloadLength >= 4) {
+            uint8_t reply[8];
+            memcpy(reply, payload, 4);
+            put32(reply + 4, now_us);
+            sendPacket(port, FRAME_SYNC_PONG, reply, sizeof(reply));
+        } else if (role == FRAME_SYNC_FOLLOWER && type == FRAME_SYNC_SYNC && payloadLength >= 14) {
+            uint32_t leader_us = get32(payload);
+            syncGif = payload[4] | payload[5] << 8;
+            syncPosition_us = get32(payload + 6);
+            syncCycle_ms = get32(payload + 10);
+            syncAt_us = now_us;
+            haveSync = true;
+            newSync = true;
+            trackOffset((int32_t)(leader_us + WIRE_US - now_us), now_us);
+        } else if (role == FRAME_SYNC_FOLLOWER && type == FRAME_SYNC_PONG && payloadLength >= 8) {
+            // every follower hears every pong, only ours echoes our last ping
+            if (!pingSent || get32(payload) != lastSend_us)
+                return;
+            pingSent = false;
+            uint32_t roundTrip = now_us - lastSend_us;
+            if (!haveRoundTrip || roundTrip < bestRoundTrip_us) {
+                bestRoundTrip_us = roundTrip;
+                haveRoundTrip = true;
+                stats.latency_us = roundTrip / 2;
+            }
+        }
+    }
+
+    // the least delayed sync of each window gives the largest offset
+    void trackOffset(int32_t offset, uint32_t now_us) {
+        if (!windowSamples || offset - windowOffset_us > 0) {
+            windowOffset_us = offset;
+            windowOffsetAt_us = now_us;
+        }
+        if (!windowSamples++)
+            windowStart_us = now_us;
+        if (now_us - windowStart_us < FRAME_SYNC_DRIFT_WINDOW_MS * 1000UL)
+            return;
+
+        // drift against the first window, so the odd late sample matters less the longer we're locked; the baseline
+        // restarts before the elapsed time could wrap
+        if (haveOffset && windowOffsetAt_us - baselineAt_us < 0x7fffffffUL) {
+            int64_t change = (int32_t)(windowOffset_us - baselineOffset_us);
+            stats.drift_ppm = (int32_t)(change * 1000000 / (int64_t)(windowOffsetAt_us - baselineAt_us));
+        } else {
+            baselineOffset_us = windowOffset_us;
+            baselineAt_us = windowOffsetAt_us;
+            haveOffset = true;
+        }
+        stats.offset_us = windowOffset_us;
+        windowSamples = 0;
+    }
+
+    template <typename Port>
+    void sendSync(Port &port, uint32_t now_us) {
+        uint8_t payload[14];
+        put32(payload, now_us);
+        payload[4] = gif & 0xff;
+        payload[5] = gif >> 8;
+        put32(payload + 6, position_us());
+        put32(payload + 10, cycle_ms);
+        sendPacket(port, FRAME_SYNC_SYNC, payload, sizeof(payload));
+    }
+
+    template <typename Port>
+    void sendPacket(Port &port, uint8_t type, const uint8_t *payload, uint8_t payloadLength) {
+        uint8_t out[FRAME_SYNC_HEADER_BYTES + FRAME_SYNC_MAX_PAYLOAD + 1];
+        out[0] = FRAME_SYNC_MAGIC;
+        out[1] = type;
+        out[2] = payloadLength;
+        memcpy(out + FRAME_SYNC_HEADER_BYTES, payload, payloadLength);
+        uint8_t sum = 0;
+        for (uint8_t i = 1; i < FRAME_SYNC_HEADER_BYTES + payloadLength; i++)
+            sum += out[i];
+        out[FRAME_SYNC_HEADER_BYTES + payloadLength] = sum;
+        port.write(out, FRAME_SYNC_HEADER_BYTES + payloadLength + 1);
+        stats.sent++;
+    }
+
+    static void put32(uint8_t *p, uint32_t value) {
+        p[0] = value;
+        p[1] = value >> 8;
+        p[2] = value >> 16;
+        p[3] = value >> 24;
+    }
+
+    static uint32_t get32(const uint8_t *p) {
+        return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+    }
+
+    FrameSyncRole role = FRAME_SYNC_OFF;
+    uint64_t playback = 0;          // playback clock in us, times RATE_ONE
+    uint32_t rate = RATE_ONE;
+    uint32_t lastUpdate_us = 0;
+    uint32_t lastSend_us = 0;
+    uint32_t reportStart_us = 0;
+    bool syncDue = false;
+    bool stepping = false;
+
+    // our place in the GIF, frame times in frameTime() ms
+    uint16_t gif = 0;
+    uint32_t timeline_ms = 0;       // sum of the delays of the frames before the one up
+    uint32_t shownAt_ms = 0;
+    uint16_t shownDelay_ms = 0;
+    uint32_t cycle_ms = 0;
+    bool haveFrame = false;
+
+    // the leader's, from the last sync
+    bool haveSync = false;
+    bool newSync = false;           // error stats are sampled once per sync
+    uint16_t syncGif = 0;
+    uint32_t syncPosition_us = 0;
+    uint32_t syncCycle_ms = 0;
+    uint32_t syncAt_us = 0;
+
+    bool pingSent = false;          // lastSend_us is the ping's timestamp until its pong comes back
+    bool haveRoundTrip = false;
+    uint32_t bestRoundTrip_us = 0;
+    bool haveOffset = false;
+    int32_t windowOffset_us = 0;
+    uint32_t windowOffsetAt_us = 0;
+    uint32_t windowSamples = 0;
+    uint32_t windowStart_us = 0;
+    int32_t baselineOffset_us = 0;
+    uint32_t baselineAt_us = 0;
+
+    uint8_t packet[FRAME_SYNC_HEADER_BYTES + FRAME_SYNC_MAX_PAYLOAD + 1];
+    uint8_t length = 0;
+    FrameSyncStats stats = {};
+};
+
+#endif
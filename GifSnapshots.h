@@ -0,0 +1,163 @@
+#ifndef GIF_SNAPSHOTS_H
+#define GIF_SNAPSHOTS_H
+
+/*
+ * Resuming GIFs where they were left
+ *
+ * Switching away from a GIF and back again would normally reopen it, parse its header and play it from the first
+ * frame.  Instead, the GIF being switched away from is kept: the decoder's state between frames (GifDecoderState -
+ * the file position, the header's fields and the global palette) and the canvas as it was after the last frame
+ * decoded.  Switching back puts that canvas straight up and decodes on from the frame after it, with the file still
+ * to open but nothing else read again.
+ *
+ * The canvas is kept as drawn, rgb24 in the background layer's layout: it's the result of every frame so far, each
+ * with its own palette, so it can't be kept indexed.  That makes a snapshot FRAME_BYTES plus about 800 bytes, and
+ * begin() takes as many as fit in the bytes given from the GIF arena, up to GIF_SNAPSHOTS_MAX; when they're all in
+ * use the least recently used one goes.  A snapshot is taken by resume() - the GIF is kept again the next time it's
+ * switched away from.
+ *
+ * Include after GifDecoder.h.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "PlaybackStats.h"
+
+#define GIF_SNAPSHOTS_MAX           8
+
+struct GifSnapshotStats {
+    uint32_t saves;
+    uint32_t resumes;
+    uint32_t misses;                // switched back to a GIF that wasn't kept, or had been evicted
+    uint32_t stale;                 // kept, but the file had changed
+    uint32_t evictions;             // least recently used snapshots dropped for another GIF
+    StageTimer resumeUp;            // from switching to a kept GIF to its frame going back up
+};
+
+template <uint16_t width, uint16_t height>
+class GifSnapshots {
+public:
+    static const uint32_t FRAME_BYTES = (uint32_t)width * height * sizeof(rgb24);
+
+    // Takes up to bytes from the arena for as many snapshots as fit, returns false if there isn't room for one
+    bool begin(GifArena &arena, uint32_t bytes) {
+        while (count < GIF_SNAPSHOTS_MAX && bytes >= SLOT_BYTES) {
+            uint8_t *block = (uint8_t *)arena.alloc(SLOT_BYTES, "GIF snapshot");
+            if (!block)
+                break;
+            slots[count].state = (GifDecoderState *)block;
+            slots[count].canvas = (rgb24 *)(block + STATE_BYTES);
+            slots[count].gif = -1;
+            count++;
+            bytes -= SLOT_BYTES;
+        }
+        return count > 0;
+    }
+
+    uint8_t getCount(void) const { return count; }
+
+    bool has(int gif) const { return find(gif) != NULL; }
+
+    // Keeps GIF number gif, as the decoder has it and with canvas as it was after the last frame decoded.  False if
+    // the decoder is partway through a frame, and the GIF starts over when it's next played
+    template <typename Decoder>
+    bool save(int gif, Decoder &decoder, const rgb24 *canvas) {
+        Slot *slot = find(gif);
+        if (!slot)
+            slot = leastRecentlyUsed();
+        if (!slot)
+            return false;
+        if (slot->gif >= 0 && slot->gif != gif)
+            stats.evictions++;
+        slot->gif = -1;
+        if (!canvas || !decoder.saveState(*slot->state))
+            return false;
+
+        memcpy((void *)slot->canvas, canvas, FRAME_BYTES);
+        slot->gif = gif;
+        slot->used = ++clock;
+        stats.saves++;
+        return true;
+    }
+
+    // Carries GIF number gif on where it was kept, with its file open on the decoder's callbacks again, and copies the
+    // canvas to put back up into canvas, with its delay.  False if it wasn't kept or the file has changed, and the GIF
+    // starts over
+    template <typename Decoder>
+    bool resume(int gif, Decoder &decoder, rgb24 *canvas, uint16_t &delay_ms) {
+        Slot *slot = find(gif);
+        if (!slot) {
+            stats.misses++;
+            return false;
+        }
+        slot->gif = -1;
+        if (decoder.resumeDecoding(*slot->state) < 0) {
+            stats.stale++;
+            return false;
+        }
+        memcpy((void *)canvas, slot->canvas, FRAME_BYTES);
+        delay_ms = (uint16_t)slot->state->frameDelay_ms;
+        stats.resumes++;
+        return true;
+    }
+
+    // The frame a resume() put back went up, elapsed_us after the switch to it
+    void resumeShown(uint32_t elapsed_us) { stats.resumeUp.add(elapsed_us); }
+
+    const GifSnapshotStats & getStats(void) const { return stats; }
+
+    template <typename Printer>
+    void printReport(Printer &out) const {
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < count; i++)
+            kept += slots[i].gif >= 0;
+        out.printf("Snapshots: %u of %u kept (%lu bytes each), %lu saved, %lu resumed up in %lu us on average (max %lu), "
+            "%lu not kept, %lu stale, %lu evicted\n", kept, count, (unsigned long)SLOT_BYTES,
+            (unsigned long)stats.saves, (unsigned long)stats.resumes, (unsigned long)stats.resumeUp.average_us(),
+            (unsigned long)stats.resumeUp.max_us, (unsigned long)stats.misses, (unsigned long)stats.stale,
+            (unsigned long)stats.evictions);
+    }
+
+    void resetStats(void) { stats = {}; }
+
+private:
+    // the canvas after the state, rounded so it starts aligned
+    static const uint32_t STATE_BYTES = (sizeof(GifDecoderState) + 7) & ~7UL;
+    static const uint32_t SLOT_BYTES = STATE_BYTES + FRAME_BYTES;
+
+    struct Slot {
+        int gif;                    // -1 when free
+        uint32_t used;              // clock when saved, the lowest goes first
+        GifDecoderState *state;
+        rgb24 *canvas;
+    };
+
+    Slot * find(int gif) const {
+        if (gif < 0)
+            return NULL;
+        for (uint8_t i = 0; i < count; i++) {
+            if (slots[i].gif == gif)
+                return (Slot *)&slots[i];
+        }
+        return NULL;
+    }
+
+    Slot * leastRecentlyUsed(void) {
+        Slot *oldest = NULL;
+        for (uint8_t i = 0; i < count; i++) {
+            if (slots[i].gif < 0)
+                return &slots[i];
+            if (!oldest || (int32_t)(slots[i].used - oldest->used) < 0)
+                oldest = &slots[i];
+        }
+        return oldest;
+    }
+
+    Slot slots[GIF_SNAPSHOTS_MAX];
+    uint8_t count = 0;
+    uint32_t clock = 0;
+    GifSnapshotStats stats = {};
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+/*
+ * Sleeping between frames
+ *
+ * Between two GIF frames loop() mostly has nothing to do, and ran round doing it.  Instead, at the end of each loop()
+ * the sketch works out when it next has something to do - the next frame or blend due, the debug screen to clear,
+ * the next telemetry record, show cue or frame sync packet, the audio's next hops - and sleepUntil() waits for then.
+ * On the Teensy that's WFI, which the 1 ms SysTick and the refresh's DMA interrupts bring back round to check; in the
+ * simulator it's a timed wait that IR codes and refreshes end early.
+ *
+ * Anything that needs the sketch sooner wakes it: the woken() it's given says what, and the sketch's looks for an IR
+ * code, a byte on Serial or Serial3, or the swap it was waiting on having gone through.
+ *
+ * The stats are the time asleep, as a share of all of it the idle CPU, and what ended each sleep.
+ */
+
+#include <stdint.h>
+
+#include "PlaybackStats.h"
+
+enum IdleWake : uint8_t {
+    IDLE_WAKE_NONE = 0,             // slept to the deadline
+    IDLE_WAKE_IR,
+    IDLE_WAKE_SERIAL,               // the console or a stream
+    IDLE_WAKE_SYNC,                 // Serial3
+    IDLE_WAKE_SWAP,                 // the swap waited on went through
+    IDLE_WAKE_COUNT
+};
+
+struct IdleStats {
+    StageTimer sleeps;              // each sleep, to its deadline or a wake
+    uint32_t wakes[IDLE_WAKE_COUNT];
+};
+
+class Idle {
+public:
+    // Sleeps until deadline_us on micros(), or until woken() returns other than IDLE_WAKE_NONE, which it's asked
+    // before each wait.  Returns the us slept.
+    template <typename Woken>
+    uint32_t sleepUntil(uint32_t deadline_us, Woken woken) {
+        uint32_t start = micros();
+#ifdef SIMULATOR_MODE
+        if (!_idle_enabled)
+            return 0;
+#endif
+        if ((int32_t)(deadline_us - start) <= 0)
+            return 0;
+
+        IdleWake wake = IDLE_WAKE_NONE;
+        while ((int32_t)(deadline_us - micros()) > 0 && (wake = woken()) == IDLE_WAKE_NONE) {
+#ifdef SIMULATOR_MODE
+            _idle_wait(deadline_us);
+#else
+            asm volatile("wfi");
+#endif
+        }
+        uint32_t slept_us = micros() - start;
+        stats.sleeps.add(slept_us);
+        stats.wakes[wake]++;
+        return slept_us;
+    }
+
+    const IdleStats & getStats(void) const { return stats; }
+
+    // With the time since the stats were reset
+    template <typename Printer>
+    void printReport(Printer &out, uint32_t elapsed_us) const {
+        uint32_t permille = elapsed_us ? (uint32_t)((uint64_t)stats.sleeps.total_us * 1000 / elapsed_us) : 0;
+        out.printf("Idle: %lu.%lu%% asleep, %lu sleeps of %lu us on average (max %lu), %lu to their deadline, woken by "
+            "%lu IR, %lu serial, %lu sync, %lu swaps\n", (unsigned long)(permille / 10), (unsigned long)(permille % 10),
+            (unsigned long)stats.sleeps.count, (unsigned long)stats.sleeps.average_us(),
+            (unsigned long)stats.sleeps.max_us, (unsigned long)stats.wakes[IDLE_WAKE_NONE],
+            (unsigned long)stats.wakes[IDLE_WAKE_IR], (unsigned long)stats.wakes[IDLE_WAKE_SERIAL],
+            (unsigned long)stats.wakes[IDLE_WAKE_SYNC], (unsigned long)stats.wakes[IDLE_WAKE_SWAP]);
+    }
+
+    void resetStats(void) { stats = {}; }
+
+private:
+    IdleStats stats = {};
+};
+
+#endif
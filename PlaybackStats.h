@@ -0,0 +1,87 @@
+#ifndef PLAYBACK_STATS_H
+#define PLAYBACK_STATS_H
+
+/*
+ * Playback timings
+ *
+ * StageTimer keeps the per-stage timings the sketch reports with its stats command, LatenessHistogram how late GIF
+ * frames went up, and PlaybackStats is all of it at once for the simulator's scenario runner and HUD.
+ * runningAverage() smooths the decode, blend and sync error times the frame interpolator, stream and sync report.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define LATENESS_BUCKETS            8
+
+// Running average weighted 1/8 to the newest sample, seeded with the first
+inline void runningAverage(uint32_t &avg, uint32_t sample) {
+    avg = avg ? (uint32_t)((int32_t)avg + ((int32_t)sample - (int32_t)avg) / 8) : sample;
+}
+
+// Count, average and worst time of one stage of the loop since the last reset()
+struct StageTimer {
+    uint32_t count;
+    uint32_t total_us;
+    uint32_t max_us;
+
+    void add(uint32_t us) {
+        count++;
+        total_us += us;
+        if (us > max_us)
+            max_us = us;
+    }
+
+    uint32_t average_us(void) const { return count ? total_us / count : 0; }
+
+    void reset(void) {
+        count = 0;
+        total_us = 0;
+        max_us = 0;
+    }
+};
+
+// How late frames went up against when the frame before said they were due: up to 1, 2, 5, 10, 20, 50, 100 ms and
+// more.  Frames are paced in whole milliseconds, so one on time can be up to 1 ms late.
+struct LatenessHistogram {
+    uint32_t buckets[LATENESS_BUCKETS];
+    StageTimer late;
+
+    static uint32_t limit_us(uint8_t bucket) {
+        static const uint32_t limits_ms[LATENESS_BUCKETS - 1] = { 1, 2, 5, 10, 20, 50, 100 };
+        return bucket < LATENESS_BUCKETS - 1 ? limits_ms[bucket] * 1000 : UINT32_MAX;
+    }
+
+    void add(uint32_t us) {
+        uint8_t bucket = 0;
+        while (us > limit_us(bucket))
+            bucket++;
+        buckets[bucket]++;
+        late.add(us);
+    }
+
+    void reset(void) {
+        memset(buckets, 0, sizeof(buckets));
+        late.reset();
+    }
+};
+
+// The stats command's numbers, and what's playing
+struct PlaybackStats {
+    uint32_t elapsed_ms;
+    uint32_t framesShown;
+    uint32_t framesHeld;            // GIF frames the same as the one up (or empty), held without a swap
+    uint32_t swapPendingLoops;
+    StageTimer loop, decode, swap, stream, sync, audio;
+    StageTimer composite;           // decodeFrame()'s drawing into the draw buffer, part of decode
+    StageTimer gifSwitch;           // from switching GIFs to the new one's first frame
+    StageTimer gifAdvance;          // GIFs auto-advance moved on to, from the end of the last one's loop (AutoAdvance.h)
+    LatenessHistogram lateness;
+    StageTimer idle;                // loop() asleep between frames
+    int gif;                        // index of the GIF playing, of gifCount
+    int gifCount;
+    bool gifStarting;               // switched to gif, its first frame isn't up yet
+    uint32_t gifCycles;             // times the GIF has played through on screen
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef RAM_BUDGET_H
+#define RAM_BUDGET_H
+
+/*
+ * Compile-time RAM budget for the matrix, layer and GIF decoder configuration
+ *
+ * Mirrors the buffers allocated by SMARTMATRIX_ALLOCATE_* (Teensy 4 HUB75 refresh), the GifDecoder instance, the
+ * GIF arena and the optional AnimatedGIF turbo/frame buffers, so a configuration that won't fit fails with a static_assert instead of
+ * at link time (or by quietly lowering the refresh rate).  Everything is constexpr so it can be checked in the sketch
+ * and also evaluated at runtime by the bench to plan other panel sizes.
+ *
+ * Teensy 4.0 memory regions:
+ *   RAM1 (DTCM/ITCM, 512K) - globals, statics, const data not marked PROGMEM, stack, and FASTRUN code
+ *   RAM2 (OCRAM, 512K)     - DMAMEM buffers and the malloc() heap
+ *   EXTMEM                 - PSRAM on Teensy 4.1 only, used for the background layer with SMARTMATRIX_USE_PSRAM
+ *
+ * GIFIMAGE, the decoder's state, is counted whole: its arrays are sized for any GIF (MAX_CODE_SIZE 12, MAX_WIDTH 480),
+ * about 24KB, and fixed at compile time inside AnimatedGIF's own translation unit, so an arena holds them at full size
+ * and only the turbo buffer is sized per file.
+ *
+ * Include after SmartMatrix.h (or MatrixCommonHub75.h) and GifDecoder.h (or AnimatedGIF.h).
+ */
+
+#include <stdint.h>
+
+// Budgets per region - define before including this file to override.  Defaults leave room in RAM1 for FASTRUN code
+// and the stack, and in RAM2 for the heap used by SD/USB
+#ifndef RAM_BUDGET_RAM1_BYTES
+#define RAM_BUDGET_RAM1_BYTES   (384UL * 1024)
+#endif
+#ifndef RAM_BUDGET_RAM2_BYTES
+#define RAM_BUDGET_RAM2_BYTES   (448UL * 1024)
+#endif
+#ifndef RAM_BUDGET_EXTMEM_BYTES
+#define RAM_BUDGET_EXTMEM_BYTES (8UL * 1024 * 1024)
+#endif
+
+// Same values as MatrixTeensy4Hub75Refresh.h (RGBDATA_SHIFTERS * PIXELS_PER_WORD), which is only included on Teensy 4
+#define RAM_BUDGET_T4_SHIFTER_PIXELS    (4 * 2)
+
+struct RamBudgetConfig {
+    uint16_t matrixWidth;
+    uint16_t matrixHeight;
+    uint8_t refreshDepth;
+    uint8_t dmaBufferRows;
+    uint8_t panelType;
+    uint8_t colorDepth;             // COLOR_DEPTH of the layers: 24 or 48
+    bool scrollingLayer;
+    bool indexedLayer;
+    bool backgroundInExtmem;        // SMARTMATRIX_USE_PSRAM on Teensy 4.1
+    uint32_t gifDecoderBytes;       // sizeof() the GifDecoder<> instance, includes GIFIMAGE unless it's in an arena
+    uint16_t gifCanvasWidth;        // largest canvas expected, for the turbo and frame buffers
+    uint16_t gifCanvasHeight;
+    bool gifTurbo;                  // AnimatedGIF::allocTurboBuf()
+    bool gifFrameBuffer;            // AnimatedGIF::allocFrameBuf()
+    uint32_t cacheBytes;            // frame/prefetch caches allocated from the heap
+    uint32_t staticImageBytes;      // const bitmaps without PROGMEM (copied to RAM1 on Teensy 4)
+    uint32_t sketchStateBytes;      // the sketch's other large globals: audio, telemetry, stream, sync, GIF names
+    uint32_t gifArenaBytes;         // GIF_ARENA_ALLOCATE(), in DMAMEM
+};
+
+struct RamBudget {
+    // RAM2
+    uint32_t rowDmaBuffers;
+    uint32_t gifTurboBuffer;
+    uint32_t gifFrameBuffer;
+    uint32_t caches;
+    uint32_t gifArena;
+    // RAM1 (or EXTMEM for the background bitmap)
+    uint32_t backgroundLayer;
+    uint32_t colorLut;
+    uint32_t scrollingLayer;
+    uint32_t indexedLayer;
+    uint32_t calcTempRows;
+    uint32_t gifDecoder;
+    uint32_t staticImages;
+    uint32_t sketchState;
+    bool backgroundInExtmem;
+
+    constexpr uint32_t ram1() const {
+        return (backgroundInExtmem ? 0 : backgroundLayer) + colorLut + scrollingLayer + indexedLayer + calcTempRows +
+            gifDecoder + staticImages + sketchState;
+    }
+    constexpr uint32_t ram2() const { return rowDmaBuffers + gifTurboBuffer + gifFrameBuffer + caches + gifArena; }
+    constexpr uint32_t extmem() const { return backgroundInExtmem ? backgroundLayer : 0; }
+
+    constexpr bool fitsRam1() const { return ram1() <= RAM_BUDGET_RAM1_BYTES; }
+    constexpr bool fitsRam2() const { return ram2() <= RAM_BUDGET_RAM2_BYTES; }
+    constexpr bool fitsExtmem() const { return extmem() <= RAM_BUDGET_EXTMEM_BYTES; }
+    constexpr bool fits() const { return fitsRam1() && fitsRam2() && fitsExtmem(); }
+};
+
+constexpr uint32_t ramBudgetPanelHeight(uint8_t panelType) {
+    return CONVERT_PANELTYPE_TO_MATRIXPANELHEIGHT(panelType);
+}
+
+constexpr uint32_t ramBudgetPhysicalRowsPerRefreshRow(uint8_t panelType) {
+    return CONVERT_PANELTYPE_TO_MATRIXPANELHEIGHT(panelType) / CONVERT_PANELTYPE_TO_MATRIXSCANMOD(panelType) /
+        HUB75_RGB_COLOR_CHANNELS_IN_PARALLEL;
+}
+
+// PIXELS_PER_LATCH
+constexpr uint32_t ramBudgetPixelsPerLatch(const RamBudgetConfig & c) {
+    return (uint32_t)c.matrixWidth * c.matrixHeight / ramBudgetPanelHeight(c.panelType) *
+        ramBudgetPhysicalRowsPerRefreshRow(c.panelType);
+}
+
+// SmartMatrixRefreshT4::rowBitStruct: packed data[PAD_PIXELS + PIXELS_PER_LATCH], rowAddress and timerpair, aligned(4)
+constexpr uint32_t ramBudgetT4RowBitStructBytes(const RamBudgetConfig & c) {
+    return ((2 * ((RAM_BUDGET_T4_SHIFTER_PIXELS - ramBudgetPixelsPerLatch(c) % RAM_BUDGET_T4_SHIFTER_PIXELS) %
+        RAM_BUDGET_T4_SHIFTER_PIXELS + RAM_BUDGET_T4_SHIFTER_PIXELS + ramBudgetPixelsPerLatch(c)) + 4 + 4) + 3) & ~3U;
+}
+
+// SmartMatrixRefreshT4::rowDataStruct holds one rowBitStruct per latch (refreshDepth / COLOR_CHANNELS_PER_PIXEL)
+constexpr uint32_t ramBudgetT4RowDataBytes(const RamBudgetConfig & c) {
+    return (c.refreshDepth / COLOR_CHANNELS_PER_PIXEL) * ramBudgetT4RowBitStructBytes(c);
+}
+
+constexpr RamBudget planRamBudget(const RamBudgetConfig & c) {
+    return RamBudget {
+        // rowsDataBuffer[buffer_rows] in SMARTMATRIX_ALLOCATE_BUFFERS
+        (uint32_t)c.dmaBufferRows * ramBudgetT4RowDataBytes(c),
+        // AnimatedGIF::allocTurboBuf()
+        c.gifTurbo ? (uint32_t)TURBO_BUFFER_SIZE + (uint32_t)c.gifCanvasWidth * c.gifCanvasHeight : 0,
+        // AnimatedGIF::allocFrameBuf()
+        c.gifFrameBuffer ? (uint32_t)c.gifCanvasWidth * (c.gifCanvasHeight + 3) : 0,
+        c.cacheBytes,
+        c.gifArenaBytes,
+        // SMARTMATRIX_ALLOCATE_BACKGROUND_LAYER: double buffered bitmap and the color correction LUT
+        2U * c.matrixWidth * c.matrixHeight * (c.colorDepth / 8U),
+        (c.colorDepth <= 24 ? 256U : 4096U) * (uint32_t)sizeof(uint16_t),
+        // SMARTMATRIX_ALLOCATE_SCROLLING_LAYER / SMARTMATRIX_ALLOCATE_INDEXED_LAYER: 1bpp bitmaps
+        c.scrollingLayer ? (uint32_t)c.matrixWidth * (c.matrixHeight / 8) : 0,
+        c.indexedLayer ? 2U * c.matrixWidth * (c.matrixHeight / 8U) : 0,
+        // SmartMatrixHub75Calc::loadMatrixBuffers48() tempRow0/tempRow1 of rgb48
+        2U * ramBudgetPixelsPerLatch(c) / ramBudgetPhysicalRowsPerRefreshRow(c.panelType) * 6,
+        c.gifDecoderBytes,
+        c.staticImageBytes,
+        c.sketchStateBytes,
+        c.backgroundInExtmem
+    };
+}
+
+inline void printRamBudget(const RamBudget & b) {
+    Serial.printf("RAM budget (Teensy 4 model):\n");
+    Serial.printf("  RAM1   %7lu / %7lu bytes%s\n", (unsigned long)b.ram1(), (unsigned long)RAM_BUDGET_RAM1_BYTES,
+        b.fitsRam1() ? "" : "  OVER BUDGET");
+    Serial.printf("    background layer %7lu%s\n", (unsigned long)b.backgroundLayer, b.backgroundInExtmem ? " (EXTMEM)" : "");
+    Serial.printf("    color LUT        %7lu\n", (unsigned long)b.colorLut);
+    Serial.printf("    scrolling layer  %7lu\n", (unsigned long)b.scrollingLayer);
+    Serial.printf("    indexed layer    %7lu\n", (unsigned long)b.indexedLayer);
+    Serial.printf("    calc temp rows   %7lu\n", (unsigned long)b.calcTempRows);
+    Serial.printf("    GIF decoder      %7lu\n", (unsigned long)b.gifDecoder);
+    Serial.printf("    static images    %7lu\n", (unsigned long)b.staticImages);
+    Serial.printf("    sketch state     %7lu\n", (unsigned long)b.sketchState);
+    Serial.printf("  RAM2   %7lu / %7lu bytes%s\n", (unsigned long)b.ram2(), (unsigned long)RAM_BUDGET_RAM2_BYTES,
+        b.fitsRam2() ? "" : "  OVER BUDGET");
+    Serial.printf("    row DMA buffers  %7lu\n", (unsigned long)b.rowDmaBuffers);
+    Serial.printf("    GIF turbo buffer %7lu\n", (unsigned long)b.gifTurboBuffer);
+    Serial.printf("    GIF frame buffer %7lu\n", (unsigned long)b.gifFrameBuffer);
+    Serial.printf("    caches           %7lu\n", (unsigned long)b.caches);
+    Serial.printf("    GIF arena        %7lu\n", (unsigned long)b.gifArena);
+    if (b.extmem())
+        Serial.printf("  EXTMEM %7lu / %7lu bytes\n", (unsigned long)b.extmem(), (unsigned long)RAM_BUDGET_EXTMEM_BYTES);
+}
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef SHOW_H
+#define SHOW_H
+
+/*
+ * Scheduled shows
+ *
+ * A show is a timeline of cues - GIFs, brightness, fades between GIFs and effects - written as text and compiled on
+ * a PC by led_show (simulator/bench) into SHOW_FILE on the SD card, which the sketch plays from when it boots:
+ *
+ *   header (32 bytes, ShowHeader), the GIF names (SHOW_NAME_BYTES each, zero padded), then the cues (12 bytes each,
+ *   ShowCue) in the order they fire
+ *
+ * little endian, as both the Teensy and a PC lay them out.  Everything that needs thinking about is done by the
+ * compiler: times are sorted, a fade becomes a fade out before the GIF's time and a fade in at it, and since the
+ * compiler knows which GIF comes next it adds a prefetch cue SHOW_PREFETCH_LEAD_MS before each one.  The sketch opens
+ * the GIF then and reads its first blocks while the one before plays, so the switch itself doesn't wait for the
+ * directory walk or the card.
+ *
+ * open() reads the header and looks each GIF name up on the card once.  From then on next() is a comparison of the
+ * show's time with the next cue's: cues are read SHOW_CUE_WINDOW at a time, one card read per window.  The stats
+ * are the timeline's accuracy: how late each cue fired, and how long after its cue each GIF's first frame went up.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "PlaybackStats.h"
+
+#define SHOW_FILE                   "/show.bin"
+#define SHOW_MAGIC                  0x574F4853  // "SHOW"
+#define SHOW_VERSION                1
+#define SHOW_HEADER_BYTES           32
+#define SHOW_CUE_BYTES              12
+#define SHOW_NAME_BYTES             32
+#define SHOW_MAX_GIFS               128
+#define SHOW_CUE_WINDOW             32          // cues read from the card at a time
+#define SHOW_PREFETCH_LEAD_MS       3000        // compiler default, how far ahead of its GIF a prefetch cue goes
+
+// ShowHeader flags
+#define SHOW_LOOP                   0x0001      // starts over at the end, otherwise GIFs play on as usual
+
+enum ShowCueType : uint8_t {
+    SHOW_CUE_PREFETCH = 1,          // gif: open it and read ahead, it's next
+    SHOW_CUE_GIF,                   // gif: switch to it
+    SHOW_CUE_BRIGHTNESS,            // value over ms
+    SHOW_CUE_FADE_OUT,              // to black over ms, remembering the brightness
+    SHOW_CUE_FADE_IN,               // back to the brightness before the fade out, over ms
+    SHOW_CUE_EFFECT,                // effect set to value
+    SHOW_CUE_END,                   // the end of the show, always the last cue
+};
+
+enum ShowEffect : uint8_t {
+    SHOW_EFFECT_PULSE = 1,          // beat pulse, % (AudioBeat)
+    SHOW_EFFECT_FLASH,              // beat flash, %
+    SHOW_EFFECT_TEMPO,              // 1 to pace GIFs to the beat, 0 not to
+    SHOW_EFFECT_SMOOTH,             // frame interpolation rate, fps (FrameInterpolator)
+};
+
+struct ShowHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint16_t gifCount;
+    uint16_t cueBytes;
+    uint32_t cueCount;
+    uint32_t length_ms;             // the END cue's time
+    uint32_t cuesOffset;            // from the start of the file
+    uint8_t reserved[8];
+};
+
+struct ShowCue {
+    uint32_t time_ms;               // from the start of the show
+    uint8_t type;                   // ShowCueType
+    uint8_t effect;                 // ShowEffect, for SHOW_CUE_EFFECT
+    uint16_t gif;                   // into the name table
+    uint16_t ms;                    // ramp time for brightness and fades
+    uint16_t value;
+};
+
+static_assert(sizeof(ShowHeader) == SHOW_HEADER_BYTES, "show header layout");
+static_assert(sizeof(ShowCue) == SHOW_CUE_BYTES, "show cue layout");
+
+struct ShowStats {
+    uint32_t cues;                  // fired
+    uint32_t loops;                 // times the show started over
+    uint32_t missingGifs;           // named in the show but not on the card
+    uint32_t windowReads;
+    uint32_t maxWindowRead_us;
+    uint32_t prefetched;            // GIF cues whose GIF was already open when they fired
+    uint32_t switchCardReads;       // card reads from GIF cues to their first frames
+    StageTimer late;                // cues, from their time to next() returning them
+    StageTimer gifUp;               // GIF cues, from their time to the GIF's first frame
+};
+
+class ShowPlayer {
+public:
+    // Reads the show's header and looks up each of its GIFs with gifIndex(name), which returns the GIF's index on
+    // the card or -1.  False if file isn't a show this sketch can play.
+    template <typename File>
+    bool open(File &file, int (*gifIndex)(const char *name)) {
+        running = false;
+        loaded = false;
+        ShowHeader h;
+        if (!file.seek(0) || file.read((uint8_t *)&h, sizeof(h)) != (int)sizeof(h))
+            return false;
+        if (h.magic != SHOW_MAGIC || h.version != SHOW_VERSION || h.cueBytes != SHOW_CUE_BYTES || !h.cueCount ||
+            h.gifCount > SHOW_MAX_GIFS || file.size() < h.cuesOffset + h.cueCount * SHOW_CUE_BYTES)
+            return false;
+
+        char name[SHOW_NAME_BYTES];
+        stats.missingGifs = 0;
+        for (uint16_t i = 0; i < h.gifCount; i++) {
+            if (file.read((uint8_t *)name, sizeof(name)) != (int)sizeof(name))
+                return false;
+            name[SHOW_NAME_BYTES - 1] = 0;
+            gifs[i] = (int16_t)gifIndex(name);
+            if (gifs[i] < 0)
+                stats.missingGifs++;
+        }
+        header = h;
+        loaded = true;
+        return true;
+    }
+
+    // Plays the show from the start, at now_ms
+    void start(uint32_t now_ms) {
+        running = loaded;
+        start_ms = now_ms;
+        nextCue = 0;
+        windowStart = windowCount = 0;
+    }
+
+    void stop(void) { running = false; }
+    bool isRunning(void) const { return running; }
+    bool isLoaded(void) const { return loaded; }
+
+    // The show's time at now_ms
+    uint32_t time_ms(uint32_t now_ms) const { return now_ms - start_ms; }
+
+    // Returns true with the next cue if it's due by now_ms, call it again until it returns false.  The END cue comes
+    // back too, after which the show has started over or stopped.
+    template <typename File>
+    bool next(File &file, uint32_t now_ms, ShowCue &cue) {
+        if (!running)
+            return false;
+        if (nextCue - windowStart >= windowCount && !readWindow(file))
+            return false;
+        const ShowCue &due = window[nextCue - windowStart];
+        uint32_t at_ms = time_ms(now_ms);
+        if ((int32_t)(at_ms - due.time_ms) < 0)
+            return false;
+
+        cue = due;
+        stats.cues++;
+        stats.late.add((at_ms - cue.time_ms) * 1000);
+        if (cue.type == SHOW_CUE_GIF)
+            gifCue_ms = start_ms + cue.time_ms;
+        if (++nextCue >= header.cueCount || cue.type == SHOW_CUE_END) {
+            if (header.flags & SHOW_LOOP) {
+                // on the show's clock, not from now, so a late END doesn't push the whole next pass back
+                start(start_ms + header.length_ms);
+                stats.loops++;
+            } else {
+                running = false;
+            }
+        }
+        return true;
+    }
+
+    // When the next cue is due, on the clock next() is given, false if the show isn't running.  Before its window is
+    // read that's the show's start, next() has a card read to do.
+    bool nextCueAt(uint32_t &at_ms) const {
+        if (!running)
+            return false;
+        at_ms = nextCue - windowStart < windowCount ? start_ms + window[nextCue - windowStart].time_ms : start_ms;
+        return true;
+    }
+
+    // The card's index for a cue's gif, -1 if it isn't on the card
+    int gifIndex(const ShowCue &cue) const {
+        return cue.gif < header.gifCount ? gifs[cue.gif] : -1;
+    }
+
+    // The first frame of the GIF the last GIF cue switched to went up at now_ms, prefetched or not, after cardReads
+    void gifShown(uint32_t now_ms, bool prefetched, uint32_t cardReads) {
+        stats.gifUp.add((now_ms - gifCue_ms) * 1000);
+        stats.switchCardReads += cardReads;
+        if (prefetched)
+            stats.prefetched++;
+    }
+
+    const ShowStats & getStats(void) const { return stats; }
+
+    template <typename Printer>
+    void printReport(Printer &out, uint32_t now_ms) const {
+        out.printf("Show: %s at %lu.%03lu s of %lu.%03lu, %lu cues fired %lu us late on average (max %lu), %lu loops\n",
+            running ? "playing" : loaded ? "stopped" : "none", (unsigned long)(time_ms(now_ms) / 1000),
+            (unsigned long)(time_ms(now_ms) % 1000), (unsigned long)(header.length_ms / 1000),
+            (unsigned long)(header.length_ms % 1000), (unsigned long)stats.cues,
+            (unsigned long)stats.late.average_us(), (unsigned long)stats.late.max_us, (unsigned long)stats.loops);
+        out.printf("  %lu GIFs up %lu us after their cue on average (max %lu), %lu prefetched, %lu card reads on the "
+            "way, %lu missing from the card; %lu cue reads, max %lu us\n", (unsigned long)stats.gifUp.count,
+            (unsigned long)stats.gifUp.average_us(), (unsigned long)stats.gifUp.max_us,
+            (unsigned long)stats.prefetched, (unsigned long)stats.switchCardReads, (unsigned long)stats.missingGifs,
+            (unsigned long)stats.windowReads, (unsigned long)stats.maxWindowRead_us);
+    }
+
+    void resetStats(void) {
+        uint32_t missing = stats.missingGifs;
+        stats = {};
+        stats.missingGifs = missing;
+    }
+
+private:
+    template <typename File>
+    bool readWindow(File &file) {
+        uint32_t start_us = micros();
+        uint32_t count = header.cueCount - nextCue;
+        if (count > SHOW_CUE_WINDOW)
+            count = SHOW_CUE_WINDOW;
+        int bytes = (int)(count * SHOW_CUE_BYTES);
+        if (!file.seek(header.cuesOffset + nextCue * SHOW_CUE_BYTES) || file.read((uint8_t *)window, bytes) != bytes) {
+            // a card that's gone away ends the show, the GIFs play on
+            running = false;
+            return false;
+        }
+        windowStart = nextCue;
+        windowCount = count;
+        uint32_t read_us = micros() - start_us;
+        stats.windowReads++;
+        if (read_us > stats.maxWindowRead_us)
+            stats.maxWindowRead_us = read_us;
+        return true;
+    }
+
+    ShowHeader header = {};
+    int16_t gifs[SHOW_MAX_GIFS];
+    ShowCue window[SHOW_CUE_WINDOW];
+    uint32_t windowStart = 0;       // cue number of window[0]
+    uint32_t windowCount = 0;
+    uint32_t nextCue = 0;
+    uint32_t start_ms = 0;
+    uint32_t gifCue_ms = 0;         // when the last GIF cue was due, on millis()
+    bool loaded = false;
+    bool running = false;
+    ShowStats stats = {};
+};
+
+#endif // SHOW_H
@@ -0,0 +1,315 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/*
+ * Black box telemetry
+ *
+ * Every TELEMETRY_PERIOD_MS the sketch records how playback went since the last record: loops and the longest gap
+ * between them, frames shown, decode and swap times, how late GIF frames went up and how many stuttered (more than
+ * TELEMETRY_STUTTER_MS late), the GIF, the brightness shown, an estimate of the panel's current and what was driving
+ * it (stream, sync, beat).  Records are collected into 512 byte blocks, one SD sector each:
+ *
+ *   header (32 bytes, TelemetryHeader) then TELEMETRY_BLOCK_RECORDS records (32 bytes each, TelemetryRecord)
+ *
+ * little endian, as both the Teensy and a PC lay them out.  The blocks go round a ring of TELEMETRY_FILE_BLOCKS in
+ * TELEMETRY_FILE on the card, about 50 minutes of records.  The file is written out to its full size the first time,
+ * so afterwards each block is a single sector written in place: no cluster allocation or FAT update on the way, and
+ * a rig that loses power mid-set keeps everything up to the block being filled.
+ *
+ * Each header has a sequence number that runs on across boots, the sequence the boot started at, and a CRC32 of the
+ * block.  open() finds where the last run left off with a binary search on the sequences, so a boot reads a dozen
+ * headers, not the file.  led_telemetry (simulator/bench) puts the blocks back in order and writes CSV or a plot.
+ *
+ * record() only copies into RAM.  Full blocks queue up, TELEMETRY_QUEUE_BLOCKS of them, until the sketch calls
+ * flush() at an idle moment (the next frame is over TELEMETRY_IDLE_US away), which writes one block.  If playback
+ * never leaves time the queue fills and records are dropped, counted in the next one that's kept - the recorder never
+ * holds a frame up.  The estimate of current is the level of the frame (every TELEMETRY_CURRENT_STEP'th pixel)
+ * times the brightness times TELEMETRY_WHITE_UA_PER_PIXEL, plus TELEMETRY_BASE_MA for the Teensy and the panel's
+ * drivers - good for spotting a brownout, not a meter.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "PlaybackStats.h"
+
+#define TELEMETRY_FILE              "/telemetry.bin"
+#define TELEMETRY_MAGIC             0x4D4C4554  // "TELM"
+#define TELEMETRY_VERSION           1
+#define TELEMETRY_BLOCK_BYTES       512
+#define TELEMETRY_HEADER_BYTES      32
+#define TELEMETRY_RECORD_BYTES      32
+#define TELEMETRY_BLOCK_RECORDS     ((TELEMETRY_BLOCK_BYTES - TELEMETRY_HEADER_BYTES) / TELEMETRY_RECORD_BYTES)
+#define TELEMETRY_FILE_BLOCKS       2048        // 1 MB, 51 minutes at TELEMETRY_PERIOD_MS
+#define TELEMETRY_QUEUE_BLOCKS      4           // 6 s of records waiting for an idle moment
+#define TELEMETRY_PERIOD_MS         100
+#define TELEMETRY_IDLE_US           4000        // slack before the next frame for a sector write
+#define TELEMETRY_STUTTER_MS        20
+
+#define TELEMETRY_CURRENT_STEP      4
+#define TELEMETRY_WHITE_UA_PER_PIXEL 1000       // full white at full brightness, a 64x64 panel takes about 4 A
+#define TELEMETRY_BASE_MA           250
+
+// TelemetryRecord flags
+#define TELEMETRY_STREAMING         0x01        // live frames, not GIFs
+#define TELEMETRY_FOLLOWING         0x02        // following a frame sync leader
+#define TELEMETRY_BEAT_LOCKED       0x04        // the audio beat clock was locked
+#define TELEMETRY_SWAP_PENDING      0x08        // the refresh hadn't taken the last frame when recorded
+
+struct TelemetryHeader {
+    uint32_t magic;
+    uint32_t sequence;              // blocks written, ever
+    uint32_t bootSequence;          // the first block written since the rig booted
+    uint16_t version;
+    uint16_t period_ms;
+    uint32_t blocks;                // in the ring
+    uint8_t count;                  // records in the block
+    uint8_t recordBytes;
+    uint8_t reserved[6];
+    uint32_t crc;                   // CRC32 of the block with this zero
+};
+
+struct TelemetryRecord {
+    uint32_t time_ms;               // millis() at the end of the period
+    uint16_t loops;
+    uint16_t frames;                // shown, GIF, blended or live
+    uint16_t loopMax_us;            // longest time between loops, saturates at 65535
+    uint16_t decodeAvg_us;
+    uint16_t decodeMax_us;
+    uint16_t swapMax_us;
+    uint16_t lateAvg_us;            // GIF frames against when they were due
+    uint16_t stutters;              // GIF frames over TELEMETRY_STUTTER_MS late
+    uint32_t lateMax_us;
+    uint16_t gif;
+    uint16_t current_mA;
+    uint8_t brightness;             // as shown, with any beat flash
+    uint8_t flags;
+    uint16_t dropped;               // records lost before this one, the queue was full
+};
+
+static_assert(sizeof(TelemetryHeader) == TELEMETRY_HEADER_BYTES, "telemetry header layout");
+static_assert(sizeof(TelemetryRecord) == TELEMETRY_RECORD_BYTES, "telemetry record layout");
+
+struct TelemetryStats {
+    uint32_t records;
+    uint32_t dropped;
+    uint32_t blocksWritten;
+    uint32_t writeErrors;
+    uint32_t write_us;              // total time in flush()'s writes
+    uint32_t maxWrite_us;
+};
+
+class Telemetry {
+public:
+    // What's timed between records, added to by the sketch next to its own stage timers
+    StageTimer loop, decode, swap, late;
+    uint32_t frames = 0;
+    uint32_t stutters = 0;
+
+    void addLate(uint32_t us) {
+        late.add(us);
+        if (us > TELEMETRY_STUTTER_MS * 1000UL)
+            stutters++;
+    }
+
+    // Makes file (open for reading and writing) the ring, writing it out to full size if it's short, and finds the
+    // block after the last one written.  False if the card won't take it, and record() and flush() do nothing.
+    template <typename File>
+    bool open(File &file, uint32_t now_ms) {
+        isOpen = false;
+        uint32_t size = file.size();
+        if (size < (uint32_t)TELEMETRY_FILE_BLOCKS * TELEMETRY_BLOCK_BYTES) {
+            uint8_t zero[TELEMETRY_BLOCK_BYTES];
+            memset(zero, 0, sizeof(zero));
+            if (!file.seek(size / TELEMETRY_BLOCK_BYTES * TELEMETRY_BLOCK_BYTES))
+                return false;
+            for (uint32_t block = size / TELEMETRY_BLOCK_BYTES; block < TELEMETRY_FILE_BLOCKS; block++) {
+                if (file.write(zero, sizeof(zero)) != sizeof(zero))
+                    return false;
+            }
+            file.flush();
+        }
+
+        // blocks 0 - last have sequences from the first block's up, the ones after are older or were never written
+        uint32_t first = readSequence(file, 0);
+        if (!first) {
+            nextBlock = 0;
+            sequence = 1;
+        } else {
+            uint32_t low = 0, high = TELEMETRY_FILE_BLOCKS;
+            while (high - low > 1) {
+                uint32_t middle = (low + high) / 2;
+                if (readSequence(file, middle) >= first)
+                    low = middle;
+                else
+                    high = middle;
+            }
+            nextBlock = (low + 1) % TELEMETRY_FILE_BLOCKS;
+            sequence = readSequence(file, low) + 1;
+        }
+        bootSequence = sequence;
+        lastRecord_ms = now_ms;
+        isOpen = true;
+        return true;
+    }
+
+    bool due(uint32_t now_ms) const { return isOpen && now_ms - lastRecord_ms >= TELEMETRY_PERIOD_MS; }
+
+    // When the next record is due, while recording
+    uint32_t nextDue_ms(void) const { return lastRecord_ms + TELEMETRY_PERIOD_MS; }
+
+    // Ends the period with a record of it, and starts the next
+    void record(uint32_t now_ms, uint16_t gif, uint8_t brightness, uint16_t current_mA, uint8_t flags) {
+        lastRecord_ms = now_ms;
+        if (!isOpen)
+            return;
+        if (queued == TELEMETRY_QUEUE_BLOCKS) {
+            droppedSince++;
+            stats.dropped++;
+        } else {
+            uint8_t *block = queue[(firstQueued + queued) % TELEMETRY_QUEUE_BLOCKS];
+            TelemetryRecord r;
+            r.time_ms = now_ms;
+            r.loops = saturate(loop.count);
+            r.frames = saturate(frames);
+            r.loopMax_us = saturate(loop.max_us);
+            r.decodeAvg_us = saturate(decode.average_us());
+            r.decodeMax_us = saturate(decode.max_us);
+            r.swapMax_us = saturate(swap.max_us);
+            r.lateAvg_us = saturate(late.average_us());
+            r.stutters = saturate(stutters);
+            r.lateMax_us = late.max_us;
+            r.gif = gif;
+            r.current_mA = current_mA;
+            r.brightness = brightness;
+            r.flags = flags;
+            r.dropped = saturate(droppedSince);
+            memcpy(block + TELEMETRY_HEADER_BYTES + filling * TELEMETRY_RECORD_BYTES, &r, sizeof(r));
+            droppedSince = 0;
+            stats.records++;
+            if (++filling == TELEMETRY_BLOCK_RECORDS) {
+                filling = 0;
+                queued++;
+            }
+        }
+        loop.reset();
+        decode.reset();
+        swap.reset();
+        late.reset();
+        frames = 0;
+        stutters = 0;
+    }
+
+    // Writes the oldest full block, if there is one: call it when there's time for a sector write
+    template <typename File>
+    bool flush(File &file, uint32_t now_us) {
+        if (!isOpen || !queued)
+            return false;
+        uint8_t *block = queue[firstQueued];
+        TelemetryHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = TELEMETRY_MAGIC;
+        h.sequence = sequence;
+        h.bootSequence = bootSequence;
+        h.version = TELEMETRY_VERSION;
+        h.period_ms = TELEMETRY_PERIOD_MS;
+        h.blocks = TELEMETRY_FILE_BLOCKS;
+        h.count = TELEMETRY_BLOCK_RECORDS;
+        h.recordBytes = TELEMETRY_RECORD_BYTES;
+        memcpy(block, &h, sizeof(h));
+        h.crc = crc32(block, TELEMETRY_BLOCK_BYTES);
+        memcpy(block, &h, sizeof(h));
+
+        bool ok = file.seek(nextBlock * TELEMETRY_BLOCK_BYTES) &&
+            file.write(block, TELEMETRY_BLOCK_BYTES) == TELEMETRY_BLOCK_BYTES;
+        uint32_t write_us = micros() - now_us;
+        stats.write_us += write_us;
+        if (write_us > stats.maxWrite_us)
+            stats.maxWrite_us = write_us;
+        // a block the card wouldn't take is dropped rather than retried, playback comes first
+        if (ok) {
+            stats.blocksWritten++;
+        } else {
+            stats.writeErrors++;
+        }
+        nextBlock = (nextBlock + 1) % TELEMETRY_FILE_BLOCKS;
+        sequence++;
+        firstQueued = (firstQueued + 1) % TELEMETRY_QUEUE_BLOCKS;
+        queued--;
+        return ok;
+    }
+
+    bool isRecording(void) const { return isOpen; }
+
+    // True while there are full blocks for flush()
+    bool hasQueued(void) const { return isOpen && queued; }
+
+    // Mean of the red, green and blue of every TELEMETRY_CURRENT_STEP'th pixel, 0-765
+    template <typename RGB>
+    static uint16_t lightLevel(const RGB *pixels, uint32_t count) {
+        uint32_t sum = 0, sampled = 0;
+        for (uint32_t i = 0; i < count; i += TELEMETRY_CURRENT_STEP, sampled++)
+            sum += pixels[i].red + pixels[i].green + pixels[i].blue;
+        return sampled ? (uint16_t)(sum / sampled) : 0;
+    }
+
+    static uint16_t current_mA(uint16_t level, uint32_t pixels, uint8_t brightness) {
+        uint64_t uA = (uint64_t)level * pixels * TELEMETRY_WHITE_UA_PER_PIXEL * brightness / (765 * 255);
+        return saturate((uint32_t)(uA / 1000) + TELEMETRY_BASE_MA);
+    }
+
+    static uint32_t crc32(const uint8_t *data, uint32_t length) {
+        uint32_t crc = 0xFFFFFFFF;
+        for (uint32_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (uint8_t bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+        return ~crc;
+    }
+
+    const TelemetryStats & getStats(void) const { return stats; }
+
+    template <typename Printer>
+    void printReport(Printer &out) const {
+        out.printf("Telemetry: %s, block %lu of %lu, %lu records, %lu dropped, %lu blocks written, %lu errors, "
+            "write avg %lu us, max %lu us\n", isOpen ? "recording" : "off", (unsigned long)nextBlock,
+            (unsigned long)TELEMETRY_FILE_BLOCKS, (unsigned long)stats.records, (unsigned long)stats.dropped,
+            (unsigned long)stats.blocksWritten, (unsigned long)stats.writeErrors,
+            (unsigned long)(stats.blocksWritten ? stats.write_us / stats.blocksWritten : 0),
+            (unsigned long)stats.maxWrite_us);
+    }
+
+private:
+    static uint16_t saturate(uint32_t value) { return value > 65535 ? 65535 : (uint16_t)value; }
+
+    // The block's sequence, 0 if it was never written or didn't survive
+    template <typename File>
+    static uint32_t readSequence(File &file, uint32_t block) {
+        uint8_t data[TELEMETRY_BLOCK_BYTES];
+        if (!file.seek(block * TELEMETRY_BLOCK_BYTES) || file.read(data, sizeof(data)) != (int)sizeof(data))
+            return 0;
+        TelemetryHeader h;
+        memcpy(&h, data, sizeof(h));
+        if (h.magic != TELEMETRY_MAGIC)
+            return 0;
+        uint32_t crc = h.crc;
+        memset(data + offsetof(TelemetryHeader, crc), 0, sizeof(h.crc));
+        return crc32(data, sizeof(data)) == crc ? h.sequence : 0;
+    }
+
+    uint8_t queue[TELEMETRY_QUEUE_BLOCKS][TELEMETRY_BLOCK_BYTES];
+    uint8_t firstQueued = 0;        // oldest full block
+    uint8_t queued = 0;             // full blocks waiting for flush()
+    uint8_t filling = 0;            // records in the block after them
+    uint32_t droppedSince = 0;
+    bool isOpen = false;
+    uint32_t nextBlock = 0;         // in the file
+    uint32_t sequence = 1;
+    uint32_t bootSequence = 1;
+    uint32_t lastRecord_ms = 0;
+    TelemetryStats stats = {};
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,205 @@
+/**
+ * Heap allocation tracker, see alloc_tracker.h.
+ *
+ * glibc lets a program replace malloc(), calloc(), realloc() and free() by defining them; these forward to its own
+ * __libc_ versions, so memalign() and the rest, left to glibc, still pair with free(). operator new is replaced as
+ * well so its allocations are put down to its caller rather than to libstdc++.
+ */
+
+#include "alloc_tracker.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *p);
+}
+
+namespace {
+
+#define ALLOC_TRACKER_SITES         1024    // distinct call sites, a power of two
+
+struct Site {
+    void *caller;                   // NULL when free
+    uint64_t count;
+    uint64_t bytes;
+};
+
+Site g_sites[ALLOC_TRACKER_SITES];
+Site g_overflow;                    // call sites beyond the table's
+std::atomic<uint64_t> g_total{0};
+std::atomic_flag g_lock = ATOMIC_FLAG_INIT;
+
+thread_local bool t_armed = false;
+thread_local bool t_inside = false; // the tracker's own allocations aren't counted
+
+void record(void *caller, size_t size) {
+    if (!t_armed || t_inside) {
+        return;
+    }
+    t_inside = true;
+    g_total++;
+    while (g_lock.test_and_set(std::memory_order_acquire)) {
+    }
+    Site *site = &g_overflow;
+    uintptr_t hash = ((uintptr_t)caller >> 2) * 0x9E3779B97F4A7C15ULL;
+    for (int probe = 0; probe < ALLOC_TRACKER_SITES; probe++) {
+        Site &candidate = g_sites[(hash + probe) & (ALLOC_TRACKER_SITES - 1)];
+        if (candidate.caller == caller || !candidate.caller) {
+            candidate.caller = caller;
+            site = &candidate;
+            break;
+        }
+    }
+    site->count++;
+    site->bytes += size;
+    g_lock.clear(std::memory_order_release);
+    t_inside = false;
+}
+
+void *allocate(void *caller, size_t size) {
+    record(caller, size);
+    void *p = __libc_malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *allocateAligned(void *caller, size_t size, std::align_val_t alignment) {
+    record(caller, size);
+    void *p = __libc_memalign((size_t)alignment, size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+} // namespace
+
+extern "C" {
+
+void *malloc(size_t size) {
+    record(__builtin_return_address(0), size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    record(__builtin_return_address(0), count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size) {
+    record(__builtin_return_address(0), size);
+    return __libc_realloc(p, size);
+}
+
+void free(void *p) {
+    __libc_free(p);
+}
+
+} // extern "C"
+
+void *operator new(size_t size) { return allocate(__builtin_return_address(0), size); }
+void *operator new[](size_t size) { return allocate(__builtin_return_address(0), size); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    record(__builtin_return_address(0), size);
+    return __libc_malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    record(__builtin_return_address(0), size);
+    return __libc_malloc(size ? size : 1);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return allocateAligned(__builtin_return_address(0), size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return allocateAligned(__builtin_return_address(0), size, alignment);
+}
+
+void operator delete(void *p) noexcept { __libc_free(p); }
+void operator delete[](void *p) noexcept { __libc_free(p); }
+void operator delete(void *p, size_t) noexcept { __libc_free(p); }
+void operator delete[](void *p, size_t) noexcept { __libc_free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { __libc_free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { __libc_free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { __libc_free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { __libc_free(p); }
+
+void allocTrackerArm(bool armed) {
+    t_armed = armed;
+}
+
+uint64_t allocTrackerCount(void) {
+    return g_total;
+}
+
+void allocTrackerReset(void) {
+    while (g_lock.test_and_set(std::memory_order_acquire)) {
+    }
+    memset((void *)g_sites, 0, sizeof(g_sites));
+    g_overflow = Site();
+    g_total = 0;
+    g_lock.clear(std::memory_order_release);
+}
+
+void allocTrackerReport(FILE *out, int maxSites) {
+    bool inside = t_inside;
+    t_inside = true;
+
+    std::vector<Site> sites;
+    while (g_lock.test_and_set(std::memory_order_acquire)) {
+    }
+    for (const Site &site : g_sites) {
+        if (site.caller) {
+            sites.push_back(site);
+        }
+    }
+    Site overflow = g_overflow;
+    g_lock.clear(std::memory_order_release);
+    std::sort(sites.begin(), sites.end(), [](const Site &a, const Site &b) { return a.count > b.count; });
+
+    for (int i = 0; i < (int)sites.size() && i < maxSites; i++) {
+        const Site &site = sites[i];
+        Dl_info info = {};
+        const char *module = "?";
+        std::string function = "?";
+        uintptr_t offset = 0;
+        if (dladdr(site.caller, &info) && info.dli_fname) {
+            module = strrchr(info.dli_fname, '/') ? strrchr(info.dli_fname, '/') + 1 : info.dli_fname;
+            offset = (uintptr_t)site.caller - (uintptr_t)info.dli_fbase;
+            if (info.dli_sname) {
+                int status = 0;
+                char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+                function = status == 0 && demangled ? demangled : info.dli_sname;
+                free(demangled);
+            }
+        }
+        fprintf(out, "  %8llu allocations %10llu bytes  %s (%s+0x%lx)\n", (unsigned long long)site.count,
+                (unsigned long long)site.bytes, function.c_str(), module, (unsigned long)offset);
+    }
+    if ((int)sites.size() > maxSites) {
+        fprintf(out, "  ... and %d more call sites\n", (int)sites.size() - maxSites);
+    }
+    if (overflow.count) {
+        fprintf(out, "  %8llu allocations %10llu bytes  from call sites past the table's %d\n",
+                (unsigned long long)overflow.count, (unsigned long long)overflow.bytes, ALLOC_TRACKER_SITES);
+    }
+    t_inside = inside;
+}
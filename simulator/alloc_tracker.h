@@ -0,0 +1,40 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+/**
+ * Heap allocation tracker for the simulator and the bench.
+ *
+ * alloc_tracker.cpp replaces malloc(), calloc(), realloc() and operator new for the whole process. Allocations by a
+ * thread inside an AllocScope are counted by the code that asked for them - the return address of the call, which
+ * the report resolves to a function - and everything else goes straight to the C library's allocator uncounted.
+ *
+ * The sketch runs from a fixed RAM budget once setup() is done (RamBudget.h, the GIF arena), so the simulator counts
+ * what loop() allocates: a scenario step with "allocs N" fails the run if loop() allocates more than N times during
+ * it (scenario.h), and `led_bench alloc` fails if steady playback through the decoder and the per-frame modules
+ * allocates at all.
+ */
+
+#include <cstdint>
+#include <cstdio>
+
+// Counts the calling thread's allocations, or stops counting them
+void allocTrackerArm(bool armed);
+
+// Allocations counted since the last reset, from every thread
+uint64_t allocTrackerCount(void);
+
+void allocTrackerReset(void);
+
+// The call sites counted since the last reset, the most allocations first, up to maxSites of them
+void allocTrackerReport(FILE *out, int maxSites);
+
+// Counts the thread's allocations while it's in scope
+class AllocScope {
+public:
+    AllocScope() { allocTrackerArm(true); }
+    ~AllocScope() { allocTrackerArm(false); }
+    AllocScope(const AllocScope &) = delete;
+    AllocScope &operator=(const AllocScope &) = delete;
+};
+
+#endif // ALLOC_TRACKER_H
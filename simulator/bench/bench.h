@@ -0,0 +1,91 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/**
+ * Host benchmark harness for the Bonnaroo LED code.
+ *
+ * Each benchmark is a plain function registered in bench_main.cpp. It returns
+ * 0 on success and non-zero if a correctness check failed, so the same runs
+ * double as stress checks.
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+typedef int (*bench_fn)(int argc, char* argv[]);
+
+struct BenchEntry {
+    const char* name;
+    const char* description;
+    bench_fn run;
+};
+
+inline uint64_t benchNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void listGifsUnder(const std::string& directory, const std::string& prefix, bool recursive,
+                          std::set<std::string>& seen, std::vector<std::string>& files) {
+    DIR* dir = opendir((directory + prefix).c_str());
+    if (!dir) return;
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    for (const std::string& name : names) {
+        std::string path = directory + prefix + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (recursive) listGifsUnder(directory, prefix + name + "/", recursive, seen, files);
+        } else if (name.size() > 4 && strcasecmp(name.c_str() + name.size() - 4, ".gif") == 0) {
+            // the corpus links some files from more than one directory
+            char real[PATH_MAX];
+            if (realpath(path.c_str(), real) && seen.insert(real).second) files.push_back(prefix + name);
+        }
+    }
+}
+
+/**
+ * The GIFs in directory, and with recursive in the directories under it, as
+ * paths relative to it in name order. A file linked from more than one place
+ * is listed once. Empty if the directory can't be read.
+ */
+inline std::vector<std::string> listGifs(const std::string& directory, bool recursive = false) {
+    std::set<std::string> seen;
+    std::vector<std::string> files;
+    listGifsUnder(directory + "/", "", recursive, seen, files);
+    return files;
+}
+
+// Benchmarks (one per bench_*.cpp)
+int benchRing(int argc, char* argv[]);
+int benchRam(int argc, char* argv[]);
+int benchGif(int argc, char* argv[]);
+int benchPipeline(int argc, char* argv[]);
+int benchInterp(int argc, char* argv[]);
+int benchStream(int argc, char* argv[]);
+int benchSync(int argc, char* argv[]);
+int benchDiff(int argc, char* argv[]);
+int benchFuzz(int argc, char* argv[]);
+int benchAudio(int argc, char* argv[]);
+int benchAlloc(int argc, char* argv[]);
+int benchPalette(int argc, char* argv[]);
+int benchExport(int argc, char* argv[]);
+
+#endif // BENCH_H
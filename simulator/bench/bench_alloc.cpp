@@ -0,0 +1,167 @@
+/**
+ * Steady-state heap allocation check.
+ *
+ * Plays every GIF in a directory the way the sketch's loop() does once setup()
+ * is done: decoded from an arena, presented through the frame interpolator at
+ * the sketch's 64x64 panel size on a simulated millisecond clock, with the beat
+ * detector fed and updated each millisecond. Each GIF is played for a cycle to
+ * warm up, then for another with the allocation tracker counting
+ * (alloc_tracker.h), and the run fails if that cycle allocated at all; the
+ * call sites are printed if it did.
+ *
+ *   ./led_bench alloc [directory]
+ */
+
+#include "bench.h"
+#include "../alloc_tracker.h"
+
+#include <Arduino.h>
+#include <MatrixCommon.h>
+#include <GifDecoder.h>
+#include <FrameInterpolator.h>
+#include <AudioBeat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const int kPanelWidth = 64;
+static const int kPanelHeight = 64;
+
+typedef FrameInterpolator<kPanelWidth, kPanelHeight> PanelInterpolator;
+typedef GifDecoder<320, 320, 12, true> AllocDecoder;
+
+static rgb24 g_backBuffer[kPanelWidth * kPanelHeight];
+static AllocDecoder* g_decoder = nullptr;
+static PanelInterpolator* g_interpolator = nullptr;
+static AudioBeat g_beat;
+
+static void benchScreenClear() {
+    memset((void*)g_backBuffer, 0, sizeof(g_backBuffer));
+}
+
+static void benchUpdateScreen() {
+    g_interpolator->captureFrame(g_backBuffer, g_decoder->getFrameDelay_ms());
+}
+
+static void benchDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (x < 0 || y < 0 || x >= kPanelWidth || y >= kPanelHeight) return;
+    g_backBuffer[y * kPanelWidth + x] = rgb24(red, green, blue);
+}
+
+/**
+ * One cycle from startDecoding() until its last frame has been presented,
+ * returning the decoder's error or the frames decoded.
+ */
+static int playCycle(AllocDecoder& decoder, PanelInterpolator& interpolator, std::vector<uint8_t>& data,
+                     uint32_t& now) {
+    benchScreenClear();
+    int result = decoder.startDecoding(data.data(), (int)data.size());
+    if (result < 0) return result;
+    interpolator.start();
+
+    int frames = 0;
+    bool decoding = true;
+    while (decoding || !interpolator.needsDecode(now)) {
+        if (decoding && interpolator.needsDecode(now)) {
+            interpolator.prepareDecode(g_backBuffer);
+            result = decoder.decodeFrame(false);
+            if (result < 0) return result;
+            if (result == ERROR_DONE_PARSING || ++frames >= 5000) {
+                decoding = false;
+            }
+        }
+        interpolator.present(now, g_backBuffer);
+
+        // a millisecond of samples, a 120 bpm click on a quiet floor
+        uint16_t samples[AUDIO_BEAT_SAMPLE_RATE / 1000];
+        for (uint32_t i = 0; i < AUDIO_BEAT_SAMPLE_RATE / 1000; i++) {
+            samples[i] = now % 500 < 20 ? 4000 : 2048 + (uint16_t)(i & 15);
+        }
+        g_beat.pushSamples(samples, AUDIO_BEAT_SAMPLE_RATE / 1000);
+        g_beat.update();
+        now++;
+    }
+    return frames;
+}
+
+int benchAlloc(int argc, char* argv[]) {
+    std::string directory = BENCH_REPO_ROOT "/gifs/full_gifs";
+    if (argc > 0) {
+        directory = argv[0];
+    }
+
+    std::vector<std::string> files = listGifs(directory);
+    if (files.empty()) {
+        printf("[Alloc] No GIFs in %s\n", directory.c_str());
+        return 1;
+    }
+
+    // the decoder state and the interpolator frames share one arena, as in the sketch
+    std::vector<uint8_t> block(256 * 1024);
+    GifArena arena(block.data(), block.size());
+    AllocDecoder decoder(arena);
+    PanelInterpolator interpolator;
+    if (!interpolator.begin(arena)) {
+        printf("[Alloc] arena too small\n");
+        return 1;
+    }
+    g_decoder = &decoder;
+    g_interpolator = &interpolator;
+    decoder.setScreenClearCallback(benchScreenClear);
+    decoder.setUpdateScreenCallback(benchUpdateScreen);
+    decoder.setDrawPixelCallback(benchDrawPixel);
+    g_beat.begin(0, 0);
+
+    printf("[Alloc] %zu files from %s, %dx%d panel\n", files.size(), directory.c_str(), kPanelWidth, kPanelHeight);
+    printf("%-28s %7s %10s\n", "file", "frames", "allocs");
+
+    Serial.muted = true;
+
+    int failures = 0;
+    uint32_t now = 0;
+    uint64_t totalFrames = 0;
+
+    for (const std::string& name : files) {
+        std::string path = directory + "/" + name;
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) continue;
+        std::vector<uint8_t> data;
+        uint8_t chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+            data.insert(data.end(), chunk, chunk + n);
+        }
+        fclose(f);
+
+        int result = playCycle(decoder, interpolator, data, now);
+        uint64_t allocs = 0;
+        if (result >= 0) {
+            allocTrackerReset();
+            {
+                AllocScope scope;
+                result = playCycle(decoder, interpolator, data, now);
+            }
+            allocs = allocTrackerCount();
+        }
+
+        Serial.muted = false;
+        if (result < 0) {
+            printf("%-28s skipped, decoder error %d\n", name.c_str(), result);
+        } else {
+            printf("%-28s %7d %10llu%s\n", name.c_str(), result, (unsigned long long)allocs, allocs ? "  FAIL" : "");
+            totalFrames += result;
+            if (allocs) {
+                allocTrackerReport(stdout, 10);
+                failures++;
+            }
+        }
+        Serial.muted = true;
+    }
+
+    Serial.muted = false;
+    printf("[Alloc] %llu frames played, %d GIFs allocated in steady state\n", (unsigned long long)totalFrames,
+           failures);
+    return failures ? 1 : 0;
+}
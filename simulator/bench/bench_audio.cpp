@@ -0,0 +1,259 @@
+/**
+ * Beat detection benchmark.
+ *
+ * Feeds AudioBeat synthesized tracks the way loop() takes them from the
+ * sampler's DMA ring, a few samples between calls to update(): a kick on
+ * every beat, a snare on two and four, hi-hats on the eighths, a chord pad
+ * and a noise floor, at several tempos. For each it reports how long the
+ * beat clock took to lock, the tempo it found and how far its beats landed
+ * from the kicks, and checks them: half or double the tempo passes, as it
+ * does in beat tracking evaluations, so long as the beats land on kicks. A
+ * track of noise and pad alone must not hold a lock.
+ *
+ *   ./led_bench audio [--bpm N] [--seconds N] [--verbose] [file.wav]
+ *
+ * With a WAV file, it prints the tempo and beats it finds in it instead.
+ * --verbose prints the clock every 5 s of each track.
+ *
+ * The time per hop (window, FFT, bands and onset detection) is measured
+ * around update(), and the copying of its samples in around pushSamples().
+ * Together they're compared with the hop period and AUDIO_BEAT_BUDGET_US,
+ * the share of a Teensy 4 the audio may take next to GIF decode.
+ */
+
+#include "bench.h"
+#include "../wav.h"
+
+#include <Arduino.h>
+#include <AudioBeat.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const uint32_t kRate = AUDIO_BEAT_SAMPLE_RATE;
+static const uint32_t kChunk = 32;          // samples pushed between updates, 1.5 ms of loop()
+static const double kFirstBeat = 0.37;      // s into the track
+static const double kLockWithin = 10.0;     // s
+static const double kMaxErrorMs = 35.0;     // mean distance of a beat from its kick
+
+struct Track {
+    std::vector<uint16_t> samples;
+    std::vector<double> beats;              // s, empty for no ground truth
+    double bpm;
+};
+
+static double noise(void) {
+    return rand() / (double)RAND_MAX * 2 - 1;
+}
+
+// drums at bpm (0 for none) over a pad and a noise floor
+static Track synthesize(double bpm, double seconds) {
+    Track track;
+    track.bpm = bpm;
+    size_t count = (size_t)(seconds * kRate);
+    std::vector<double> mix(count, 0.0);
+    double beat = bpm ? 60.0 / bpm : 0;
+    double hat = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        double t = (double)i / kRate;
+        // pad and noise floor
+        double tremolo = 0.75 + 0.25 * sin(2 * M_PI * 0.3 * t);
+        mix[i] = 0.06 * tremolo * (sin(2 * M_PI * 220 * t) + sin(2 * M_PI * 277 * t) + sin(2 * M_PI * 330 * t));
+        mix[i] += 0.02 * noise();
+
+        if (!bpm || t < kFirstBeat) {
+            continue;
+        }
+        double since = fmod(t - kFirstBeat, beat);
+        int index = (int)((t - kFirstBeat) / beat);
+        // kick, falling from 120 Hz to 50
+        double phase = 2 * M_PI * (50 * since + 70 * 0.03 * (1 - exp(-since / 0.03)));
+        mix[i] += 0.5 * exp(-since / 0.08) * sin(phase);
+        // snare on two and four
+        if (index % 2 == 1) {
+            mix[i] += 0.2 * exp(-since / 0.05) * noise();
+        }
+        // hi-hats on the eighths, high passed noise
+        double sinceEighth = fmod(since, beat / 2);
+        double white = noise();
+        mix[i] += 0.12 * exp(-sinceEighth / 0.015) * (white - hat);
+        hat = white;
+    }
+    for (double t = kFirstBeat; bpm && t < seconds; t += beat) {
+        track.beats.push_back(t);
+    }
+
+    track.samples.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        int reading = 2048 + (int)(mix[i] * 2047);
+        track.samples[i] = (uint16_t)std::max(0, std::min(4095, reading));
+    }
+    return track;
+}
+
+struct Result {
+    double lock_s = -1;
+    double lockedShare = 0;             // of the track after kLockWithin
+    uint32_t bpm_x10 = 0;
+    double meanError_ms = 0, meanAbsError_ms = 0;
+    int beats = 0;
+    uint64_t hops = 0, hopNs = 0;
+    uint64_t sampleNs = 0;              // in pushSamples()
+    uint32_t maxHop_us = 0;
+};
+
+static Result run(const Track& track, const char* name, bool verbose) {
+    Result result;
+    AudioBeat beat;
+    beat.begin(0, micros());
+    uint64_t lockedChunks = 0, chunksAfter = 0;
+    double errorSum = 0, absErrorSum = 0;
+    uint32_t reportAt = 5 * kRate;
+
+    for (size_t pushed = 0; pushed + kChunk <= track.samples.size(); pushed += kChunk) {
+        uint64_t start = benchNowNs();
+        beat.pushSamples(track.samples.data() + pushed, kChunk);
+        result.sampleNs += benchNowNs() - start;
+        uint32_t hops = beat.getStats().hops;
+        start = benchNowNs();
+        bool onBeat = beat.update();
+        if (beat.getStats().hops != hops) {
+            result.hopNs += benchNowNs() - start;
+            result.hops += beat.getStats().hops - hops;
+        }
+
+        double t = (double)(pushed + kChunk) / kRate;
+        if (beat.isLocked() && result.lock_s < 0) {
+            result.lock_s = t;
+        }
+        if (t >= kLockWithin) {
+            chunksAfter++;
+            lockedChunks += beat.isLocked();
+        }
+        if (onBeat && !track.beats.empty()) {
+            // against the nearest kick
+            double nearest = track.beats[0];
+            for (double b : track.beats) {
+                if (fabs(b - t) < fabs(nearest - t)) nearest = b;
+            }
+            if (t >= kLockWithin) {
+                double error = (t - nearest) * 1000;
+                errorSum += error;
+                absErrorSum += fabs(error);
+                result.beats++;
+            }
+        }
+        if (verbose && pushed + kChunk >= reportAt) {
+            uint32_t bpm = beat.bpm_x10();
+            printf("[Audio] %s %5.1f s: %s %lu.%lu bpm, confidence %u, %lu onsets, %lu beats\n", name, t,
+                   beat.isLocked() ? "locked" : "free  ", (unsigned long)bpm / 10, (unsigned long)bpm % 10,
+                   beat.getConfidence(), (unsigned long)beat.getStats().onsets, (unsigned long)beat.getStats().beats);
+            reportAt += 5 * kRate;
+        }
+    }
+    result.maxHop_us = beat.getStats().maxHop_us;
+    result.bpm_x10 = beat.bpm_x10();
+    result.lockedShare = chunksAfter ? (double)lockedChunks / chunksAfter : 0;
+    if (result.beats) {
+        result.meanError_ms = errorSum / result.beats;
+        result.meanAbsError_ms = absErrorSum / result.beats;
+    }
+    return result;
+}
+
+int benchAudio(int argc, char* argv[]) {
+    std::vector<double> tempos = { 90, 120, 128, 150, 174 };
+    double seconds = 40;
+    std::string wavPath;
+    bool verbose = false;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--bpm") == 0 && i + 1 < argc) {
+            tempos = { atof(argv[++i]) };
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else {
+            wavPath = argv[i];
+        }
+    }
+    const double hop_us = AUDIO_BEAT_HOP * 1e6 / kRate;
+    srand(1);
+
+    if (!wavPath.empty()) {
+        Track track;
+        std::string error;
+        if (!loadWav(wavPath, kRate, track.samples, error)) {
+            printf("[Audio] %s\n", error.c_str());
+            return 1;
+        }
+        printf("[Audio] %s, %.1f s\n", wavPath.c_str(), track.samples.size() / (double)kRate);
+        Result r = run(track, "wav", true);
+        double busy_us = r.hops ? (r.hopNs + r.sampleNs) / 1e3 / r.hops : 0.0;
+        printf("[Audio] locked %s at %.1f s, %.1f bpm, %.0f%% of the time after %.0f s; hop %.1f us avg, %lu us max, "
+               "%.2f us sampling (%.2f%% of the %.0f us hop)\n", r.lock_s >= 0 ? "first" : "never", r.lock_s,
+               r.bpm_x10 / 10.0, r.lockedShare * 100, kLockWithin, r.hops ? r.hopNs / 1e3 / r.hops : 0.0,
+               (unsigned long)r.maxHop_us, r.hops ? r.sampleNs / 1e3 / r.hops : 0.0, busy_us / hop_us * 100, hop_us);
+        return 0;
+    }
+
+    printf("[Audio] %.0f s tracks at %lu Hz, FFT %d, hop %d (%.1f ms), budget %d us a hop\n", seconds,
+           (unsigned long)kRate, AUDIO_BEAT_FFT_SIZE, AUDIO_BEAT_HOP, hop_us / 1000, AUDIO_BEAT_BUDGET_US);
+    printf("%-10s %8s %9s %9s %12s %14s %8s\n", "track", "lock s", "bpm", "locked", "beat err ms", "|beat err| ms",
+           "beats");
+
+    int failures = 0;
+    uint64_t hops = 0, hopNs = 0, sampleNs = 0;
+    uint32_t maxHop_us = 0;
+    for (double bpm : tempos) {
+        Track track = synthesize(bpm, seconds);
+        char name[32];
+        snprintf(name, sizeof(name), "%.0f bpm", bpm);
+        Result r = run(track, name, verbose);
+        hops += r.hops;
+        hopNs += r.hopNs;
+        sampleNs += r.sampleNs;
+        maxHop_us = std::max(maxHop_us, r.maxHop_us);
+
+        // half or double the tempo is a fair answer (the kicks at 174 bpm are the beats of 87) if the beats land
+        double foundBpm = r.bpm_x10 / 10.0;
+        const char* octave = "";
+        bool tempoOk = fabs(foundBpm - bpm) <= bpm * 0.02;
+        if (!tempoOk && fabs(foundBpm * 2 - bpm) <= bpm * 0.02) {
+            tempoOk = true;
+            octave = " (half)";
+        } else if (!tempoOk && fabs(foundBpm / 2 - bpm) <= bpm * 0.02) {
+            tempoOk = true;
+            octave = " (double)";
+        }
+        bool ok = r.lock_s >= 0 && r.lock_s <= kLockWithin && tempoOk && r.meanAbsError_ms <= kMaxErrorMs &&
+                  r.lockedShare >= 0.9;
+        printf("%-10s %8.1f %9.1f %8.0f%% %12.1f %14.1f %8d%s%s\n", name, r.lock_s, foundBpm, r.lockedShare * 100,
+               r.meanError_ms, r.meanAbsError_ms, r.beats, octave, ok ? "" : "  FAILED");
+        failures += !ok;
+    }
+
+    // no beat to find
+    Track quiet = synthesize(0, seconds);
+    Result r = run(quiet, "no beat", verbose);
+    bool ok = r.lockedShare < 0.2;
+    printf("%-10s %8.1f %9.1f %8.0f%% %12s %14s %8s%s\n", "no beat", r.lock_s, r.bpm_x10 / 10.0, r.lockedShare * 100,
+           "-", "-", "-", ok ? "" : "  FAILED");
+    failures += !ok;
+
+    // the ADC's DMA samples without the CPU, taking the samples in is the rest of the audio's cost
+    double sample_us = hops ? sampleNs / 1e3 / hops : 0;
+    double avg_us = (hops ? hopNs / 1e3 / hops : 0) + sample_us;
+    printf("[Audio] hop %.1f us avg with %.2f us sampling, %lu us max: %.2f%% of the %.0f us hop period, budget %d us "
+           "(%.0f%%)\n", avg_us, sample_us, (unsigned long)maxHop_us, avg_us / hop_us * 100, hop_us,
+           AUDIO_BEAT_BUDGET_US, AUDIO_BEAT_BUDGET_US / hop_us * 100);
+    if (avg_us > AUDIO_BEAT_BUDGET_US) {
+        printf("[Audio] over budget on the host, it won't fit on a Teensy\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,703 @@
+/**
+ * Differential check of the hot paths against reference implementations.
+ *
+ * Each path is run the way it was written when this harness was added (kept
+ * here as the reference) side by side with what the library does now and any
+ * variants registered below, and every output is compared bit for bit:
+ *
+ *   lzw   every GIF under the directory, decoded with the regular DecodeLZW
+ *         and with each variant (turbo, and both with a decode budget small
+ *         enough to split every frame across many decodeFrame() calls),
+ *         canvas compared after every frame
+ *   draw  the same GIFs, GIFDraw's compositing through drawPixel against the
+ *         variants (the library's compositeLine), canvas compared after every
+ *         frame
+ *   fill  fillRefreshRow of a background and an indexed layer with random
+ *         contents, every rgb48 row compared
+ *   calc  the Teensy 4 loadMatrixBuffers48 through the real
+ *         SmartMatrixHub75Calc (see refresh_t4_host.h) on the same random
+ *         layers, every bitplane of every row compared, for the sketch's panel
+ *         configuration and two others, with each one's row buffer size and
+ *         time per row
+ *
+ *   ./led_bench diff [directory] [--seed N] [--frames N] [--path lzw|draw|fill|calc]
+ *
+ * The directory defaults to gifs/ in the repo the bench was built from,
+ * subdirectories included. --frames is the number of random layer frames for
+ * fill and calc. The reference and each variant are timed in the same run, so
+ * a fast path is measured and checked at once: after the checked run, which
+ * warms both up, each is timed kTimedRuns times, taking turns at going first,
+ * and their medians are compared (for lzw and draw, per GIF played through).
+ * lzw, draw and fill have a "reference again" row timing the reference against itself,
+ * which should read 1.00x.
+ *
+ * A GIF wider than AnimatedGIF's MAX_WIDTH is turned away before any frame is
+ * decoded, whatever the canvas; every variant must turn it away the same way,
+ * and the table lists these as their own row. Any other GIF the reference
+ * can't start fails the run.
+ *
+ * To check a new fast path for lzw, draw or fill, add it to the path's variant
+ * table; calc always checks the library's own matrixCalculations().
+ */
+
+#include "bench.h"
+
+#include <Arduino.h>
+#include <GifDecoder.h>
+#include "refresh_t4_host.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Largest canvas AnimatedGIF opens, anything wider is turned away as too wide
+static const int kCanvasWidth = MAX_WIDTH;
+static const int kCanvasHeight = MAX_WIDTH;
+static const int kCanvasBytes = kCanvasWidth * kCanvasHeight * 3;
+
+// Layers and panel for fill and calc, as in the sketch
+static const int kLayerWidth = 64;
+static const int kLayerHeight = 64;
+static const uint8_t kDmaRows = 4;
+
+typedef GifDecoder<kCanvasWidth, kCanvasHeight, 12, true> DiffDecoder;
+typedef void (*DrawLineFn)(GIFDRAW* pDraw);
+typedef void (*FillRowFn)(SM_Layer* layer, uint16_t hardwareY, rgb48 refreshRow[]);
+
+struct LzwVariant {
+    const char* name;
+    bool turbo;
+    int budget;         // setDecodeBudget(), decodeFrame() is called until the frame is done
+};
+
+struct DrawVariant {
+    const char* name;
+    DrawLineFn draw;
+};
+
+struct FillVariant {
+    const char* name;
+    FillRowFn fill;
+};
+
+static void libraryFillRow(SM_Layer* layer, uint16_t hardwareY, rgb48 refreshRow[]) {
+    layer->fillRefreshRow(hardwareY, refreshRow);
+}
+
+static void referenceDrawLine(GIFDRAW* pDraw);
+
+// "reference again" is the control, it times the reference against itself and should come out at 1.00x
+static const LzwVariant kLzwVariants[] = {
+    { "reference again", false, 0 },
+    { "turbo", true, 0 },
+    { "budget 97", false, 97 },
+    { "turbo budget 97", true, 97 },
+};
+
+static const DrawVariant kDrawVariants[] = {
+    { "reference again", referenceDrawLine },
+    { "compositeLine", DiffDecoder::compositeLine },
+};
+
+static const FillVariant kFillVariants[] = {
+    { "fillRefreshRow", libraryFillRow },
+};
+
+struct DiffResult {
+    std::string path;
+    std::string variant;
+    uint64_t cases = 0;
+    uint64_t mismatches = 0;
+    uint64_t referenceNs = 0;
+    uint64_t variantNs = 0;
+};
+
+// Timed runs of the reference and of each variant, after the checked run warms both up
+static const int kTimedRuns = 5;
+
+static uint64_t medianNs(std::vector<uint64_t> ns) {
+    std::sort(ns.begin(), ns.end());
+    return ns[ns.size() / 2];
+}
+
+/**
+ * Times kTimedRuns runs each of reference() and variant(), taking turns at
+ * going first, and adds their medians to result. Both must give the same
+ * output every time they are run.
+ */
+template <typename Reference, typename Variant>
+static void timePair(DiffResult& result, Reference reference, Variant variant) {
+    std::vector<uint64_t> referenceNs, variantNs;
+    for (int run = 0; run < kTimedRuns; run++) {
+        for (int turn = 0; turn < 2; turn++) {
+            bool isReference = (turn == 0) == (run % 2 == 0);
+            uint64_t start = benchNowNs();
+            if (isReference) {
+                reference();
+            } else {
+                variant();
+            }
+            (isReference ? referenceNs : variantNs).push_back(benchNowNs() - start);
+        }
+    }
+    result.referenceNs += medianNs(referenceNs);
+    result.variantNs += medianNs(variantNs);
+}
+
+// ---- GIF paths --------------------------------------------------------------
+
+static uint8_t* g_canvas = nullptr;     // canvas of the decoder being run
+static DrawLineFn g_drawLine = nullptr;
+static uint64_t g_drawNs = 0;
+
+static void diffScreenClear() {
+    memset(g_canvas, 0, kCanvasBytes);
+}
+
+static void diffUpdateScreen() {
+}
+
+static void diffDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (x < 0 || y < 0 || x >= kCanvasWidth || y >= kCanvasHeight) return;
+    uint8_t* p = g_canvas + (y * kCanvasWidth + x) * 3;
+    p[0] = red;
+    p[1] = green;
+    p[2] = blue;
+}
+
+// GifDecoder::compositeLine() as written when the harness was added, drawing one pixel at a time
+static void referenceDrawLine(GIFDRAW* pDraw) {
+    int width = std::min(pDraw->iWidth, kCanvasWidth);
+    const rgb_24* palette = (const rgb_24*)pDraw->pPalette;
+    uint8_t* s = pDraw->pPixels;
+    int y = pDraw->iY + pDraw->y;
+
+    if (pDraw->ucDisposalMethod == 2) {
+        for (int x = 0; x < width; x++) {
+            if (s[x] == pDraw->ucTransparent) s[x] = pDraw->ucBackground;
+        }
+        pDraw->ucHasTransparency = 0;
+    }
+    for (int x = 0; x < width; x++) {
+        if (pDraw->ucHasTransparency && s[x] == pDraw->ucTransparent) continue;
+        const rgb_24& color = palette[s[x]];
+        diffDrawPixel(pDraw->iX + x, y, color.red, color.green, color.blue);
+    }
+}
+
+static void diffDrawIndexedLine(GIFDRAW* pDraw) {
+    uint64_t start = benchNowNs();
+    g_drawLine(pDraw);
+    g_drawNs += benchNowNs() - start;
+}
+
+// One decoder of a lockstep run, the first is the reference
+struct GifRun {
+    std::unique_ptr<DiffDecoder> decoder;
+    std::vector<uint8_t> canvas;
+    DrawLineFn drawLine = nullptr;
+    std::vector<uint64_t> ns;   // each timed run
+    int result = 0;
+};
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    data.clear();
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * Plays up to frames frames of one cycle of data on run alone, returning the
+ * time spent in decodeFrame(), or with timeDraw only in drawing the lines.
+ */
+static uint64_t timeGif(GifRun& run, std::vector<uint8_t>& data, bool timeDraw, int frames) {
+    g_canvas = run.canvas.data();
+    g_drawLine = run.drawLine;
+    memset(g_canvas, 0, kCanvasBytes);
+    int result = run.decoder->startDecoding(data.data(), (int)data.size());
+    g_drawNs = 0;
+    uint64_t start = benchNowNs();
+    for (int frame = 0; frame < frames && result >= 0 && result != ERROR_DONE_PARSING; frame++) {
+        do {
+            result = run.decoder->decodeFrame(false);
+        } while (result == ERROR_WAITING);
+    }
+    return timeDraw ? g_drawNs : benchNowNs() - start;
+}
+
+/**
+ * Plays one cycle of data on every run in lockstep and compares each run's
+ * canvas with the reference's after every frame, then times each run playing
+ * it alone kTimedRuns times, taking turns at going first. Returns the number
+ * of frames the reference decoded, or -1 if it failed to start, when every
+ * variant must have failed the same way.
+ */
+static int diffGif(std::vector<GifRun>& runs, std::vector<uint8_t>& data, bool timeDraw, const std::string& name,
+                   std::vector<DiffResult>& results) {
+    for (GifRun& run : runs) {
+        g_canvas = run.canvas.data();
+        memset(g_canvas, 0, kCanvasBytes);
+        run.result = run.decoder->startDecoding(data.data(), (int)data.size());
+    }
+    if (runs[0].result < 0) {
+        for (size_t v = 1; v < runs.size(); v++) {
+            if (runs[v].result == runs[0].result) continue;
+            results[v - 1].mismatches++;
+            printf("  %s %s: started with result %d, reference failed with %d\n", results[v - 1].variant.c_str(),
+                   name.c_str(), runs[v].result, runs[0].result);
+        }
+        return -1;
+    }
+
+    int frames = 0;
+    std::vector<bool> reported(runs.size(), false);
+    while (frames < 5000) {
+        for (GifRun& run : runs) {
+            if (run.result < 0 || run.result == ERROR_DONE_PARSING) continue;
+            g_canvas = run.canvas.data();
+            g_drawLine = run.drawLine;
+            do {
+                run.result = run.decoder->decodeFrame(false);
+            } while (run.result == ERROR_WAITING);
+        }
+        if (runs[0].result < 0 || runs[0].result == ERROR_DONE_PARSING) break;
+        frames++;
+
+        for (size_t v = 1; v < runs.size(); v++) {
+            DiffResult& result = results[v - 1];
+            result.cases++;
+            if (runs[v].result == runs[0].result && memcmp(runs[v].canvas.data(), runs[0].canvas.data(), kCanvasBytes) == 0) continue;
+            result.mismatches++;
+            if (!reported[v]) {
+                reported[v] = true;
+                printf("  %s %s: frame %d differs (result %d, reference %d)\n", result.variant.c_str(), name.c_str(),
+                       frames - 1, runs[v].result, runs[0].result);
+            }
+        }
+    }
+
+    // the checked run warmed every decoder up, the last frame is the one that found the end of the cycle
+    for (GifRun& run : runs) run.ns.clear();
+    for (int timed = 0; timed < kTimedRuns; timed++) {
+        for (size_t i = 0; i < runs.size(); i++) {
+            GifRun& run = runs[timed % 2 ? runs.size() - 1 - i : i];
+            run.ns.push_back(timeGif(run, data, timeDraw, frames + 1));
+        }
+    }
+    for (size_t v = 1; v < runs.size(); v++) {
+        results[v - 1].referenceNs += medianNs(runs[0].ns);
+        results[v - 1].variantNs += medianNs(runs[v].ns);
+    }
+    return frames;
+}
+
+static void diffGifs(const std::vector<std::string>& files, bool drawPath, std::vector<DiffResult>& results) {
+    size_t variants = drawPath ? sizeof(kDrawVariants) / sizeof(kDrawVariants[0])
+                               : sizeof(kLzwVariants) / sizeof(kLzwVariants[0]);
+
+    std::vector<uint8_t> block((variants + 1) * 256 * 1024);
+    GifArena arena(block.data(), block.size());
+    std::vector<GifRun> runs(variants + 1);
+    for (size_t v = 0; v <= variants; v++) {
+        runs[v].decoder.reset(new DiffDecoder(arena));
+        runs[v].canvas.resize(kCanvasBytes);
+        if (drawPath) {
+            runs[v].drawLine = v ? kDrawVariants[v - 1].draw : referenceDrawLine;
+        } else if (v) {
+            runs[v].decoder->setTurboMode(kLzwVariants[v - 1].turbo);
+            runs[v].decoder->setDecodeBudget(kLzwVariants[v - 1].budget);
+        }
+    }
+
+    // the callbacks are shared by every decoder of the type
+    runs[0].decoder->setScreenClearCallback(diffScreenClear);
+    runs[0].decoder->setUpdateScreenCallback(diffUpdateScreen);
+    runs[0].decoder->setDrawPixelCallback(diffDrawPixel);
+    runs[0].decoder->setDrawIndexedLineCallback(drawPath ? diffDrawIndexedLine : nullptr);
+
+    size_t first = results.size();
+    for (size_t v = 0; v < variants; v++) {
+        DiffResult result;
+        result.path = drawPath ? "draw" : "lzw";
+        result.variant = drawPath ? kDrawVariants[v].name : kLzwVariants[v].name;
+        results.push_back(result);
+    }
+    std::vector<DiffResult> fileResults(results.begin() + first, results.end());
+    DiffResult turnedAway;
+    turnedAway.path = fileResults[0].path;
+    turnedAway.variant = "turned away as too wide";
+
+    std::vector<uint8_t> data;
+    for (const std::string& path : files) {
+        if (!readFile(path, data)) continue;
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        if (diffGif(runs, data, drawPath, name, fileResults) >= 0) continue;
+
+        // the logical screen width, after the 6 byte signature
+        int width = data.size() >= 10 ? data[6] | data[7] << 8 : 0;
+        turnedAway.cases++;
+        if (runs[0].result != ERROR_GIF_TOO_WIDE || width <= MAX_WIDTH) {
+            turnedAway.mismatches++;
+            printf("  %s: decoder error %d, %d pixels wide\n", name.c_str(), runs[0].result, width);
+        } else if (!drawPath) {
+            printf("  %s: %d pixels wide, over MAX_WIDTH %d\n", name.c_str(), width, MAX_WIDTH);
+        }
+    }
+    std::copy(fileResults.begin(), fileResults.end(), results.begin() + first);
+    if (turnedAway.cases) results.push_back(turnedAway);
+}
+
+// ---- Layer paths ------------------------------------------------------------
+
+// What the harness drew into the layers, the references are computed from this
+struct LayerContents {
+    rgb24 image[kLayerHeight][kLayerWidth];
+    bool backgroundCC;
+    uint8_t mask[kLayerHeight][kLayerWidth];
+    rgb24 indexedColor;
+    bool indexedCC;
+};
+
+struct LayerSet {
+    rgb24 backgroundBitmap[2 * kLayerWidth * kLayerHeight];
+    color_chan_t lut[256];
+    uint8_t indexedBitmap[2 * kLayerWidth * (kLayerHeight / 8)];
+    SMLayerBackground<rgb24, 0> background;
+    SMLayerIndexed<rgb24, 0> indexed;
+
+    LayerSet() : background(backgroundBitmap, kLayerWidth, kLayerHeight, lut),
+                 indexed(indexedBitmap, kLayerWidth, kLayerHeight) {}
+};
+
+/**
+ * Draws new random contents into both layers and queues the swap, which the
+ * next frameRefreshCallback() applies. The kind of contents rotates with
+ * frame: noise, a solid colour, channels at 0 or 255 only, and a gradient.
+ */
+static void randomizeLayers(LayerSet& layers, LayerContents& contents, std::mt19937& rng, int frame) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    rgb24 solid(byte(rng), byte(rng), byte(rng));
+    int density = byte(rng);
+    int kind = frame % 4;
+
+    for (int y = 0; y < kLayerHeight; y++) {
+        for (int x = 0; x < kLayerWidth; x++) {
+            rgb24& pixel = contents.image[y][x];
+            if (kind == 0) {
+                pixel = rgb24(byte(rng), byte(rng), byte(rng));
+            } else if (kind == 1) {
+                pixel = solid;
+            } else if (kind == 2) {
+                pixel = rgb24((byte(rng) & 1) * 255, (byte(rng) & 1) * 255, (byte(rng) & 1) * 255);
+            } else {
+                pixel = rgb24(x * 4, y * 4, (x + y) * 2);
+            }
+            contents.mask[y][x] = kind == 1 ? 0 : kind == 2 ? 1 : byte(rng) < density;
+        }
+    }
+    contents.backgroundCC = byte(rng) & 1;
+    contents.indexedColor = rgb24(byte(rng), byte(rng), byte(rng));
+    contents.indexedCC = byte(rng) & 1;
+
+    memcpy(layers.background.backBuffer(), contents.image, sizeof(contents.image));
+    layers.background.enableColorCorrection(contents.backgroundCC);
+    layers.background.setBrightness(kind == 3 ? byte(rng) : 255);
+    layers.background.swapBuffers(false);
+
+    layers.indexed.fillScreen(0);
+    for (int y = 0; y < kLayerHeight; y++) {
+        for (int x = 0; x < kLayerWidth; x++) {
+            if (contents.mask[y][x]) layers.indexed.drawPixel(x, y, 1);
+        }
+    }
+    layers.indexed.setIndexedColor(1, contents.indexedColor);
+    layers.indexed.enableColorCorrection(contents.indexedCC);
+    layers.indexed.swapBuffers(false);
+}
+
+// fillRefreshRow() as written when the harness was added, for rgb24 layers at rotation0 and no brightness shifts
+static void referenceFillRow(const LayerSet& layers, const LayerContents& contents, int layer, int y, rgb48 row[]) {
+    for (int x = 0; x < kLayerWidth; x++) {
+        if (layer == 0) {
+            const rgb24& pixel = contents.image[y][x];
+            if (contents.backgroundCC) {
+                row[x] = rgb48(layers.lut[pixel.red], layers.lut[pixel.green], layers.lut[pixel.blue]);
+            } else {
+                row[x] = rgb48(pixel.red << 8, pixel.green << 8, pixel.blue << 8);
+            }
+        } else if (contents.mask[y][x]) {
+            const rgb24& color = contents.indexedColor;
+            if (contents.indexedCC) {
+                row[x] = rgb48(lightPowerMap16bit[color.red], lightPowerMap16bit[color.green],
+                               lightPowerMap16bit[color.blue]);
+            } else {
+                row[x] = rgb48(color.red << 8 | color.red, color.green << 8 | color.green,
+                               color.blue << 8 | color.blue);
+            }
+        }
+    }
+}
+
+static void diffFill(int frames, std::mt19937& rng, std::vector<DiffResult>& results) {
+    static LayerSet layers;
+    layers.background.begin();
+    layers.indexed.begin();
+
+    const size_t variants = sizeof(kFillVariants) / sizeof(kFillVariants[0]);
+    SM_Layer* layerList[2] = { &layers.background, &layers.indexed };
+    static rgb48 reference[kLayerHeight][kLayerWidth];
+    static rgb48 output[kLayerHeight][kLayerWidth];
+    rgb48 fill;
+
+    size_t first = results.size();
+    for (size_t v = 0; v < variants; v++) {
+        DiffResult result;
+        result.path = "fill";
+        result.variant = kFillVariants[v].name;
+        results.push_back(result);
+    }
+    DiffResult control;
+    control.path = "fill";
+    control.variant = "reference again";
+
+    for (int frame = 0; frame < frames; frame++) {
+        LayerContents contents;
+        randomizeLayers(layers, contents, rng, frame);
+        layers.background.frameRefreshCallback();
+        layers.indexed.frameRefreshCallback();
+
+        for (int layer = 0; layer < 2; layer++) {
+            // the indexed layer only writes its set pixels, start both from the same random row
+            fill = rgb48(rng(), rng(), rng());
+            std::fill(&reference[0][0], &reference[0][0] + kLayerWidth * kLayerHeight, fill);
+            auto referenceFill = [&] {
+                for (int y = 0; y < kLayerHeight; y++) {
+                    referenceFillRow(layers, contents, layer, y, reference[y]);
+                }
+            };
+            referenceFill();
+            control.cases += kLayerHeight;
+            timePair(control, referenceFill, referenceFill);
+
+            for (size_t v = 0; v < variants; v++) {
+                DiffResult& result = results[first + v];
+                std::fill(&output[0][0], &output[0][0] + kLayerWidth * kLayerHeight, fill);
+                auto variantFill = [&] {
+                    for (int y = 0; y < kLayerHeight; y++) {
+                        kFillVariants[v].fill(layerList[layer], y, output[y]);
+                    }
+                };
+                variantFill();
+                timePair(result, referenceFill, variantFill);
+
+                for (int y = 0; y < kLayerHeight; y++) {
+                    result.cases++;
+                    if (memcmp(reference[y], output[y], sizeof(output[y])) == 0) continue;
+                    if (!result.mismatches) {
+                        printf("  %s: frame %d %s row %d differs\n", result.variant.c_str(), frame,
+                               layer ? "indexed" : "background", y);
+                    }
+                    result.mismatches++;
+                }
+            }
+        }
+    }
+    results.insert(results.begin() + first, control);
+}
+
+/**
+ * loadMatrixBuffers48() as written when the harness was added, for panels
+ * without multi row refresh: each refresh row takes a row from the top and
+ * bottom half of every panel in the stack, and every bit of every colour
+ * channel goes to its FlexIO pin in that bit's plane.
+ */
+template <int refreshDepth, int matrixWidth, int matrixHeight, unsigned char panelType, uint32_t optionFlags>
+static void referenceCalc(const LayerSet& layers, const LayerContents& contents,
+                          typename SmartMatrixRefreshT4<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags>::rowDataStruct rows[]) {
+    typedef SmartMatrixRefreshT4<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags> Refresh;
+    const typename Refresh::flexPinConfigStruct& pins = Refresh::getFlexPinConfig();
+    static rgb48 top[PIXELS_PER_LATCH];
+    static rgb48 bottom[PIXELS_PER_LATCH];
+
+    memset((void*)rows, 0, sizeof(rows[0]) * MATRIX_SCAN_MOD);
+    for (int row = 0; row < MATRIX_SCAN_MOD; row++) {
+        for (int stack = 0; stack < MATRIX_STACK_HEIGHT; stack++) {
+            // C-shaped stacks alternate orientation, the one at the end of the chain is upright
+            bool flipped = (optionFlags & SMARTMATRIX_OPTIONS_C_SHAPE_STACKING) &&
+                (stack % 2) != ((MATRIX_STACK_HEIGHT - 1) % 2);
+            int panel = (optionFlags & SMARTMATRIX_OPTIONS_BOTTOM_TO_TOP_STACKING) ? stack : MATRIX_STACK_HEIGHT - 1 - stack;
+            int y0, y1;
+            if (flipped) {
+                y1 = MATRIX_SCAN_MOD - 1 - row + panel * MATRIX_PANEL_HEIGHT;
+                y0 = y1 + ROW_PAIR_OFFSET;
+            } else {
+                y0 = row + panel * MATRIX_PANEL_HEIGHT;
+                y1 = y0 + ROW_PAIR_OFFSET;
+            }
+            for (int x = 0; x < matrixWidth; x++) {
+                top[stack * matrixWidth + x] = rgb48(0, 0, 0);
+                bottom[stack * matrixWidth + x] = rgb48(0, 0, 0);
+            }
+            for (int layer = 0; layer < 2; layer++) {
+                referenceFillRow(layers, contents, layer, y0, &top[stack * matrixWidth]);
+                referenceFillRow(layers, contents, layer, y1, &bottom[stack * matrixWidth]);
+            }
+        }
+
+        for (int p = 0; p < PIXELS_PER_LATCH; p++) {
+            int stack = p / matrixWidth;
+            bool flipped = (optionFlags & SMARTMATRIX_OPTIONS_C_SHAPE_STACKING) &&
+                (stack % 2) != ((MATRIX_STACK_HEIGHT - 1) % 2);
+            int source = flipped ? stack * matrixWidth + matrixWidth - 1 - p % matrixWidth : p;
+            const rgb48& t = top[source];
+            const rgb48& b = bottom[source];
+            for (int bit = 0; bit < COLOR_DEPTH_BITS; bit++) {
+                int s = 16 - COLOR_DEPTH_BITS + bit;
+                rows[row].rowbits[bit].data[PAD_PIXELS + p] =
+                    ((t.red >> s) & 1) << pins.r0 | ((t.green >> s) & 1) << pins.g0 | ((t.blue >> s) & 1) << pins.b0 |
+                    ((b.red >> s) & 1) << pins.r1 | ((b.green >> s) & 1) << pins.g1 | ((b.blue >> s) & 1) << pins.b1;
+            }
+        }
+        rows[row].rowbits[0].rowAddress = row;
+    }
+}
+
+template <int refreshDepth, int matrixWidth, int matrixHeight, unsigned char panelType, uint32_t optionFlags>
+static DiffResult diffCalc(const char* name, int frames, std::mt19937& rng) {
+    typedef SmartMatrixRefreshT4<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags> Refresh;
+    typedef SmartMatrixHub75Calc<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags> Calc;
+    typedef typename Refresh::rowDataStruct RowData;
+    static_assert(!MULTI_ROW_REFRESH_REQUIRED, "the reference calc doesn't map multi row refresh panels");
+    static_assert(matrixWidth == kLayerWidth && matrixHeight == kLayerHeight, "the layers are kLayerWidth x kLayerHeight");
+
+    // each configuration gets its own layers, a layer can only be in one chain
+    static LayerSet layers;
+    static Calc calc(kDmaRows, nullptr);
+    static RowData reference[MATRIX_SCAN_MOD];
+    calc.addLayer(&layers.background);
+    calc.addLayer(&layers.indexed);
+    calc.begin();
+
+    DiffResult result;
+    result.path = "calc";
+    result.variant = name;
+    for (int frame = 0; frame < frames; frame++) {
+        LayerContents contents;
+        randomizeLayers(layers, contents, rng, frame);
+
+        // a frame is MATRIX_SCAN_MOD rows, handed out kDmaRows at a time as the DMA buffer frees up; the first one
+        // takes the new layer contents, the timed ones calculate the same frame again
+        auto calcFrame = [] {
+            Refresh::rowsWritten = 0;
+            while (Refresh::rowsWritten < (uint32_t)MATRIX_SCAN_MOD) {
+                Refresh::freeRows = kDmaRows;
+                Calc::matrixCalculations(false);
+            }
+        };
+        auto referenceFrame = [&] {
+            referenceCalc<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags>(layers, contents, reference);
+        };
+        calcFrame();
+        referenceFrame();
+        timePair(result, referenceFrame, calcFrame);
+
+        for (int row = 0; row < MATRIX_SCAN_MOD; row++) {
+            result.cases++;
+            if (memcmp(&reference[row], &Refresh::rows[row], sizeof(RowData)) == 0) continue;
+            if (!result.mismatches) {
+                int bit = 0, pixel = 0;
+                while (bit < COLOR_DEPTH_BITS - 1 &&
+                       !memcmp(&reference[row].rowbits[bit], &Refresh::rows[row].rowbits[bit], sizeof(reference[row].rowbits[bit]))) {
+                    bit++;
+                }
+                while (pixel < PAD_PIXELS + PIXELS_PER_LATCH - 1 &&
+                       reference[row].rowbits[bit].data[pixel] == Refresh::rows[row].rowbits[bit].data[pixel]) {
+                    pixel++;
+                }
+                printf("  %s: frame %d row %d bitplane %d differs first at pixel %d (%04x, reference %04x)\n", name,
+                       frame, row, bit, pixel - PAD_PIXELS, Refresh::rows[row].rowbits[bit].data[pixel],
+                       reference[row].rowbits[bit].data[pixel]);
+            }
+            result.mismatches++;
+        }
+    }
+    printf("  %s: %zu bytes per row buffer (%d bitplanes), %zu for the %d DMA rows, %.2f us per row\n", name,
+           sizeof(RowData), COLOR_DEPTH_BITS, sizeof(RowData) * kDmaRows, kDmaRows,
+           result.variantNs / 1e3 / ((double)frames * MATRIX_SCAN_MOD));
+    return result;
+}
+
+int benchDiff(int argc, char* argv[]) {
+    std::string directory = BENCH_REPO_ROOT "/gifs";
+    uint32_t seed = 1;
+    int frames = 200;
+    std::string only;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else {
+            directory = argv[i];
+        }
+    }
+
+    std::vector<std::string> files = listGifs(directory, true);
+    for (std::string& file : files) file = directory + "/" + file;
+    if (files.empty() && (only.empty() || only == "lzw" || only == "draw")) {
+        printf("[Diff] No GIFs in %s\n", directory.c_str());
+        return 1;
+    }
+
+    printf("[Diff] %zu GIFs from %s, %d random layer frames, seed %u\n", files.size(), directory.c_str(), frames,
+           seed);
+    std::vector<DiffResult> results;
+    std::mt19937 rng(seed);
+
+    Serial.muted = true;
+    if (only.empty() || only == "lzw") diffGifs(files, false, results);
+    if (only.empty() || only == "draw") diffGifs(files, true, results);
+    Serial.muted = false;
+    if (only.empty() || only == "fill") diffFill(frames, rng, results);
+    if (only.empty() || only == "calc") {
+        results.push_back(diffCalc<36, 64, 64, SM_PANELTYPE_HUB75_32ROW_MOD16SCAN, SMARTMATRIX_OPTIONS_C_SHAPE_STACKING>(
+            "36-bit C-shape (sketch)", frames, rng));
+        results.push_back(diffCalc<48, 64, 64, SM_PANELTYPE_HUB75_32ROW_MOD16SCAN, SMARTMATRIX_OPTIONS_NONE>(
+            "48-bit Z-shape", frames, rng));
+        results.push_back(diffCalc<24, 64, 64, SM_PANELTYPE_HUB75_64ROW_MOD32SCAN,
+                                   SMARTMATRIX_OPTIONS_C_SHAPE_STACKING | SMARTMATRIX_OPTIONS_BOTTOM_TO_TOP_STACKING>(
+            "24-bit 64-row C-shape up", frames, rng));
+    }
+
+    int failures = 0;
+    printf("%-5s %-26s %9s %9s %11s %11s %8s\n", "path", "variant", "cases", "mismatch", "ref ms", "variant ms",
+           "speedup");
+    for (const DiffResult& result : results) {
+        printf("%-5s %-26s %9llu %9llu ", result.path.c_str(), result.variant.c_str(),
+               (unsigned long long)result.cases, (unsigned long long)result.mismatches);
+        if (result.variantNs) {
+            printf("%11.2f %11.2f %7.2fx", result.referenceNs / 1e6, result.variantNs / 1e6,
+                   (double)result.referenceNs / result.variantNs);
+        } else {
+            printf("%11s %11s %8s", "-", "-", "-");
+        }
+        printf("%s\n", result.mismatches || !result.cases ? "  FAILED" : "");
+        if (result.mismatches || !result.cases) failures++;
+    }
+    printf("[Diff] %d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * Shared-memory frame export stress test and benchmark (frame_export.h).
+ *
+ * A writer thread stands in for the simulator's refresh, publishing 64x64
+ * frames each filled with its frame number, sleeping 100 us between them
+ * (still several times the window's rate, and fair to the reader on one
+ * core). A reader thread follows them through the shared memory
+ * with next(), and checks every frame it takes as whole (valid() after using
+ * it in place, or copy()) really is one frame's pixels and numbered in order. It alternates
+ * between reading straight away and dawdling, so it both keeps up and falls
+ * behind the ring. Reports what a publish costs the writer, and the frames
+ * the reader read, missed and found written over.
+ *
+ *   ./led_bench export [frames]
+ */
+
+#include "bench.h"
+#include "../frame_export.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kWidth = 64;
+static const int kHeight = 64;
+
+int benchExport(int argc, char* argv[]) {
+    uint32_t frames = argc > 0 ? (uint32_t)atoi(argv[0]) : 10000;
+    std::string name = "led_bench_export_" + std::to_string(getpid());
+
+    FrameExportWriter writer;
+    if (!writer.open(name, kWidth, kHeight)) {
+        perror("[Export] shm_open");
+        return 1;
+    }
+    FrameExportReader reader;
+    if (!reader.open(name)) {
+        printf("[Export] reader can't open /dev/shm%s\n", frameExportShmName(name).c_str());
+        return 1;
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<bool> failed(false);
+    uint64_t read = 0, torn = 0;
+
+    std::thread consumer([&]() {
+        std::vector<uint8_t> copy(kWidth * kHeight * 3);
+        std::vector<uint8_t> expected(copy.size());
+        uint64_t lastFrame = 0;
+        while (!failed) {
+            FrameView view;
+            if (!reader.next(view)) {
+                if (done) break;
+                std::this_thread::yield();
+                continue;
+            }
+            if (view.frame <= lastFrame || view.width != kWidth || view.height != kHeight) {
+                printf("[Export] frame %llu %dx%d after frame %llu\n", (unsigned long long)view.frame, view.width,
+                       view.height, (unsigned long long)lastFrame);
+                failed = true;
+                break;
+            }
+            lastFrame = view.frame;
+
+            // every other hundred frames copied after a pause as long as the ring, so some come round under it
+            bool slow = (view.frame / 100) & 1;
+            const uint8_t* pixels = view.pixels;
+            if (slow) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100 * FRAME_EXPORT_SLOTS));
+                if (!reader.copy(view, copy.data())) {
+                    torn++;
+                    continue;
+                }
+                pixels = copy.data();
+            }
+            memset(expected.data(), (uint8_t)view.frame, expected.size());
+            bool same = memcmp(pixels, expected.data(), expected.size()) == 0;
+            if (!slow && !reader.valid(view)) {
+                torn++;
+                continue;
+            }
+            if (!same) {
+                printf("[Export] frame %llu taken as whole but it isn't\n", (unsigned long long)view.frame);
+                failed = true;
+                break;
+            }
+            read++;
+        }
+    });
+
+    static uint8_t frame[kWidth * kHeight * 3];
+    uint64_t publish_ns = 0;
+    for (uint32_t n = 1; n <= frames && !failed; n++) {
+        memset(frame, (uint8_t)n, sizeof(frame));
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        uint64_t start = benchNowNs();
+        writer.publish(frame);
+        publish_ns += benchNowNs() - start;
+    }
+    done = true;
+    consumer.join();
+    writer.close();
+
+    printf("[Export] %u frames of %dx%d, publish %.0f ns each (%.1f GB/s)\n", frames, kWidth, kHeight,
+           (double)publish_ns / frames, (double)frames * sizeof(frame) / publish_ns);
+    printf("[Export] reader: %llu read, %llu missed, %llu written over while read\n", (unsigned long long)read,
+           (unsigned long long)reader.missed(), (unsigned long long)torn);
+    printf("[Export] %s\n", failed ? "FAIL" : "OK");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,465 @@
+/**
+ * Worst-case decode time on pathological and corrupt GIFs.
+ *
+ * Builds a corpus of GIFs made to be slow or to break the decoder - a canvas
+ * far past the limit, frames outside the canvas, bad LZW code sizes, the
+ * longest LZW strings, the table left full without a clear, a clear code
+ * before every pixel, one-byte sub-blocks, floods of comments and zero delay
+ * frames, LZW data that is random, cut short or refers to codes that don't
+ * exist yet - then adds random mutations (flipped, overwritten, inserted,
+ * duplicated and truncated bytes) of the GIFs under the directory.
+ *
+ * Every case is played for one cycle through a regular and a turbo decoder
+ * set up as in the sketch (64x64, kMaxCanvasPixels, kDecodeBudget), and
+ * again decoding whole frames for comparison. Reports the slowest single
+ * startDecoding() or decodeFrame() call for each. Every case is run three
+ * times and each call is taken at its fastest of the three, as a case makes
+ * the same calls every run, so a call the host happened to preempt isn't taken
+ * for a slow one.
+ *
+ *   ./led_bench fuzz [directory] [--seed N] [--mutations N] [--budget PIXELS] [--limit-us N] [--write DIR]
+ *
+ * The directory defaults to gifs/ in the repo the bench was built from,
+ * subdirectories included. --write saves the corpus there as fuzz_*.gif to
+ * replay elsewhere. Fails if a budgeted call takes longer than --limit-us,
+ * a case doesn't finish its cycle within kMaxCalls calls, a GIF that has to be
+ * turned away isn't, or the regular and turbo decoders end a crafted case
+ * differently.
+ *
+ * The budget bounds the pixels a call decodes and draws, not the bytes it
+ * reads: the slowest calls are in GIFs of one-byte sub-blocks, at about
+ * 0.7 ms with the sketch's budget on the simulator host. --limit-us defaults
+ * to 1500, twice that.
+ */
+
+#include "bench.h"
+#include "gif_writer.h"
+
+#include <Arduino.h>
+#include <GifDecoder.h>
+
+#include <limits.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// As in the sketch
+static const int kMatrixWidth = 64;
+static const int kMatrixHeight = 64;
+static const int kDecodeBudget = 16384;
+static const uint32_t kMaxCanvasPixels = 480 * 320;
+
+// A cycle that needs more calls than this is taken to be stuck
+static const uint32_t kMaxCalls = 200000;
+
+typedef GifDecoder<kMatrixWidth, kMatrixHeight, 12, true> FuzzDecoder;
+
+static uint8_t g_screen[kMatrixHeight][kMatrixWidth][3];
+
+static void fuzzScreenClear() {
+    memset(g_screen, 0, sizeof(g_screen));
+}
+
+static uint32_t g_framesShown;
+
+static void fuzzUpdateScreen() {
+    g_framesShown++;
+}
+
+static void fuzzDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (x < 0 || y < 0 || x >= kMatrixWidth || y >= kMatrixHeight) return;
+    g_screen[y][x][0] = red;
+    g_screen[y][x][1] = green;
+    g_screen[y][x][2] = blue;
+}
+
+static std::vector<uint8_t> randomPixels(int count, int colors, std::mt19937& rng) {
+    std::vector<uint8_t> pixels(count);
+    for (uint8_t& p : pixels) p = rng() % colors;
+    return pixels;
+}
+
+// ---- Corpus -----------------------------------------------------------------
+
+struct FuzzCase {
+    std::string name;
+    std::vector<uint8_t> data;
+    bool mustFail;          // has to be turned away, by startDecoding() or the first frame
+    bool mutation = false;  // a random edit of a GIF under the directory, rather than crafted
+};
+
+static void buildCorpus(std::mt19937& rng, std::vector<FuzzCase>& corpus) {
+    const int w = 480, h = 320;     // the largest canvas kMaxCanvasPixels lets through
+    GifWriter g;
+
+    // the canvas is checked before any buffer is allocated or any frame parsed
+    g = GifWriter();
+    g.header(65535, 65535, 1, rng);
+    g.image(0, 0, 1, 1, 2, lzwEncode({ 1 }, 2));
+    g.trailer();
+    corpus.push_back({ "canvas 65535x65535", g.d, true });
+
+    g = GifWriter();
+    g.header(4000, 4000, 1, rng);
+    g.image(0, 0, 1, 1, 2, lzwEncode({ 1 }, 2));
+    g.trailer();
+    corpus.push_back({ "canvas 4000x4000", g.d, true });
+
+    g = GifWriter();
+    g.header(480, 4000, 1, rng);
+    g.image(0, 0, 480, 4000, 2, lzwEncode(std::vector<uint8_t>(480 * 4000, 1), 2));
+    g.trailer();
+    corpus.push_back({ "canvas 480x4000", g.d, true });
+
+    g = GifWriter();
+    g.header(64, 64, 1, rng);
+    g.image(40, 40, 64, 64, 2, lzwEncode(std::vector<uint8_t>(64 * 64, 1), 2));
+    g.trailer();
+    corpus.push_back({ "frame outside canvas", g.d, true });
+
+    for (int size : { 0, 9, 12, 255 }) {
+        g = GifWriter();
+        g.header(64, 64, 8, rng);
+        g.image(0, 0, 64, 64, size, randomPixels(64 * 64, 256, rng));
+        g.trailer();
+        corpus.push_back({ "LZW code size " + std::to_string(size), g.d, true });
+    }
+
+    // the most codes: every pixel random from 256 colours
+    g = GifWriter();
+    g.header(w, h, 8, rng);
+    g.delay(2);
+    g.image(0, 0, w, h, 8, lzwEncode(randomPixels(w * h, 256, rng), 8));
+    g.trailer();
+    corpus.push_back({ "noise 480x320", g.d, false });
+
+    // the longest strings: one colour, every code a string one longer than the last
+    g = GifWriter();
+    g.header(w, h, 1, rng);
+    g.delay(2);
+    g.image(0, 0, w, h, 2, lzwEncode(std::vector<uint8_t>(w * h, 1), 2));
+    g.trailer();
+    corpus.push_back({ "flat 480x320", g.d, false });
+
+    // the table full from early on and never reset
+    g = GifWriter();
+    g.header(w, h, 4, rng);
+    g.delay(2);
+    g.image(0, 0, w, h, 4, lzwEncode(randomPixels(w * h, 16, rng), 4, true), 255);
+    g.trailer();
+    corpus.push_back({ "deferred clear 480x320", g.d, false });
+
+    // a clear code before every pixel, each one resets the table
+    {
+        BitWriter bits;
+        for (int i = 0; i < w * h; i++) {
+            bits.put(256, 9);
+            bits.put(rng() & 0xff, 9);
+        }
+        bits.put(257, 9);
+        g = GifWriter();
+        g.header(w, h, 8, rng);
+        g.image(0, 0, w, h, 8, bits.finish());
+        g.trailer();
+        corpus.push_back({ "clear flood 480x320", g.d, false });
+    }
+
+    // the most sub-block overhead
+    g = GifWriter();
+    g.header(w, h, 8, rng);
+    g.image(0, 0, w, h, 8, lzwEncode(randomPixels(w * h, 256, rng), 8), 1);
+    g.trailer();
+    corpus.push_back({ "1 byte sub-blocks 480x320", g.d, false });
+
+    g = GifWriter();
+    g.header(64, 64, 1, rng);
+    for (int i = 0; i < 4; i++) {
+        g.comment(1000, 255);
+        g.image(0, 0, 64, 64, 2, lzwEncode(randomPixels(64 * 64, 2, rng), 2));
+    }
+    g.trailer();
+    corpus.push_back({ "255KB comments per frame", g.d, false });
+
+    g = GifWriter();
+    g.header(64, 64, 1, rng);
+    for (int i = 0; i < 2000; i++) {
+        g.delay(0);
+        g.image(rng() % 64, rng() % 64, 1, 1, 2, lzwEncode({ (uint8_t)(i & 1) }, 2));
+    }
+    g.trailer();
+    corpus.push_back({ "2000 zero delay frames", g.d, false });
+
+    g = GifWriter();
+    g.header(w, h, 8, rng);
+    g.image(0, 0, w, h, 8, randomPixels(w * h / 4, 256, rng));
+    g.trailer();
+    corpus.push_back({ "random LZW 480x320", g.d, false });
+
+    // codes from the top of the table before any of it exists
+    {
+        BitWriter bits;
+        bits.put(256, 9);
+        bits.put(1, 9);
+        for (int i = 0; i < 5000; i++) bits.put(511, 9);
+        g = GifWriter();
+        g.header(w, h, 8, rng);
+        g.image(0, 0, w, h, 8, bits.finish());
+        g.trailer();
+        corpus.push_back({ "codes past the table", g.d, false });
+    }
+
+    // the LZW data stops a tenth of the way in, then the file ends
+    {
+        std::vector<uint8_t> lzw = lzwEncode(randomPixels(w * h, 256, rng), 8);
+        lzw.resize(lzw.size() / 10);
+        g = GifWriter();
+        g.header(w, h, 8, rng);
+        g.image(0, 0, w, h, 8, lzw);
+        corpus.push_back({ "LZW cut short 480x320", g.d, false });
+        g.d.resize(g.d.size() - 1);
+        g.d.resize(g.d.size() / 2);
+        corpus.push_back({ "file cut short 480x320", g.d, false });
+    }
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    data.clear();
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(f);
+    return true;
+}
+
+// A few random edits, mostly in the first KB where the headers, palettes and first frame are
+static std::vector<uint8_t> mutate(const std::vector<uint8_t>& base, std::mt19937& rng) {
+    std::vector<uint8_t> data = base;
+    int edits = 1 + rng() % 8;
+    for (int i = 0; i < edits && data.size() > 16; i++) {
+        size_t span = (rng() % 4) ? std::min(data.size(), (size_t)1024) : data.size();
+        size_t at = rng() % span;
+        switch (rng() % 6) {
+            case 0: data[at] ^= 1 << (rng() % 8); break;
+            case 1: data[at] = (rng() & 1) ? 0xff : 0x00; break;
+            case 2: data[at] = rng() & 0xff; break;
+            case 3: data.insert(data.begin() + at, 1 + rng() % 16, rng() & 0xff); break;
+            case 4: {
+                size_t length = std::min(data.size() - at, (size_t)(1 + rng() % 256));
+                std::vector<uint8_t> chunk(data.begin() + at, data.begin() + at + length);
+                data.insert(data.begin() + rng() % data.size(), chunk.begin(), chunk.end());
+                break;
+            }
+            case 5: data.resize(std::max((size_t)16, at + 1)); break;
+        }
+    }
+    return data;
+}
+
+// ---- Runs -------------------------------------------------------------------
+
+struct Probe {
+    std::vector<uint64_t> callNs;
+    uint64_t worstNs = 0;       // slowest call
+    uint32_t calls = 0;
+    uint32_t frames = 0;        // frames shown
+    int result = 0;             // last result, < 0 if the GIF was turned away or failed partway
+    bool stuck = false;
+};
+
+// startDecoding(), then decodeFrame() until the end of the first cycle or an error
+static Probe probe(FuzzDecoder& decoder, int budget, std::vector<uint8_t>& data) {
+    Probe p;
+    g_framesShown = 0;
+    decoder.setDecodeBudget(budget);
+    uint64_t start = benchNowNs();
+    p.result = decoder.startDecoding(data.data(), (int)data.size());
+    p.callNs.push_back(benchNowNs() - start);
+    p.calls = 1;
+    while (p.result >= 0 && p.result != ERROR_DONE_PARSING) {
+        if (p.calls == kMaxCalls) {
+            p.stuck = true;
+            break;
+        }
+        start = benchNowNs();
+        p.result = decoder.decodeFrame(false);
+        p.callNs.push_back(benchNowNs() - start);
+        p.calls++;
+    }
+    p.worstNs = *std::max_element(p.callNs.begin(), p.callNs.end());
+    p.frames = g_framesShown;
+    return p;
+}
+
+// Each call at its fastest of kRuns runs, so a call the host happened to preempt isn't taken for a slow one
+static const int kRuns = 3;
+
+static Probe probeBest(FuzzDecoder& decoder, int budget, std::vector<uint8_t>& data) {
+    Probe best = probe(decoder, budget, data);
+    for (int run = 1; run < kRuns; run++) {
+        Probe p = probe(decoder, budget, data);
+        if (p.callNs.size() != best.callNs.size()) continue;
+        for (size_t i = 0; i < p.callNs.size(); i++) {
+            best.callNs[i] = std::min(best.callNs[i], p.callNs[i]);
+        }
+    }
+    best.worstNs = *std::max_element(best.callNs.begin(), best.callNs.end());
+    return best;
+}
+
+struct CaseResult {
+    Probe budgeted[2];          // regular, turbo
+    Probe whole[2];
+    bool failed = false;
+};
+
+static CaseResult runCase(FuzzDecoder* decoders[2], int budget, uint64_t limitNs, FuzzCase& c) {
+    CaseResult r;
+    for (int t = 0; t < 2; t++) {
+        r.budgeted[t] = probeBest(*decoders[t], budget, c.data);
+        r.whole[t] = probeBest(*decoders[t], 0, c.data);
+        const Probe& p = r.budgeted[t];
+        if (p.stuck || p.worstNs > limitNs || (c.mustFail && p.result >= 0)) r.failed = true;
+        // a frame split over calls ends the same way
+        if (!p.stuck && !r.whole[t].stuck && (p.frames != r.whole[t].frames || p.result != r.whole[t].result)) {
+            r.failed = true;
+        }
+    }
+    // the crafted GIFs are all read the same way by both decoders, mutations may hit a difference in their error handling
+    if (!c.mutation && (r.whole[0].frames != r.whole[1].frames || r.whole[0].result != r.whole[1].result)) {
+        r.failed = true;
+    }
+    return r;
+}
+
+static const char* describe(const Probe& p) {
+    static char text[32];
+    if (p.stuck) return "stuck";
+    if (p.result == ERROR_DONE_PARSING) {
+        snprintf(text, sizeof(text), "%u frames", p.frames);
+    } else {
+        snprintf(text, sizeof(text), "error %d", p.result);
+    }
+    return text;
+}
+
+int benchFuzz(int argc, char* argv[]) {
+    std::string directory = BENCH_REPO_ROOT "/gifs";
+    std::string writeDirectory;
+    uint32_t seed = 1;
+    int mutations = 200;
+    int budget = kDecodeBudget;
+    uint64_t limitNs = 1500 * 1000ULL;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--mutations") == 0 && i + 1 < argc) {
+            mutations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            budget = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--limit-us") == 0 && i + 1 < argc) {
+            limitNs = strtoull(argv[++i], nullptr, 10) * 1000;
+        } else if (strcmp(argv[i], "--write") == 0 && i + 1 < argc) {
+            writeDirectory = argv[++i];
+        } else {
+            directory = argv[i];
+        }
+    }
+
+    std::mt19937 rng(seed);
+    std::vector<FuzzCase> corpus;
+    buildCorpus(rng, corpus);
+    size_t crafted = corpus.size();
+
+    std::vector<std::string> files = listGifs(directory, true);
+    for (std::string& file : files) file = directory + "/" + file;
+    std::vector<std::vector<uint8_t>> bases;
+    std::vector<std::string> baseNames;
+    for (const std::string& path : files) {
+        std::vector<uint8_t> data;
+        if (readFile(path, data) && data.size() <= 2 * 1024 * 1024) {
+            bases.push_back(data);
+            baseNames.push_back(path.substr(path.find_last_of('/') + 1));
+        }
+    }
+    for (int i = 0; i < mutations && !bases.empty(); i++) {
+        size_t b = rng() % bases.size();
+        corpus.push_back({ baseNames[b] + " #" + std::to_string(i), mutate(bases[b], rng), false, true });
+    }
+
+    if (!writeDirectory.empty()) {
+        mkdir(writeDirectory.c_str(), 0755);
+        for (size_t i = 0; i < corpus.size(); i++) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/fuzz_%03zu.gif", writeDirectory.c_str(), i);
+            FILE* f = fopen(path, "wb");
+            if (!f) continue;
+            fwrite(corpus[i].data.data(), 1, corpus[i].data.size(), f);
+            fclose(f);
+        }
+        printf("[Fuzz] corpus written to %s\n", writeDirectory.c_str());
+    }
+
+    // arena room for the turbo buffer of the largest canvas let through
+    std::vector<uint8_t> block(512 * 1024);
+    GifArena arena(block.data(), block.size());
+    FuzzDecoder regular(arena);
+    FuzzDecoder turbo(arena);
+    turbo.setTurboMode(true);
+    FuzzDecoder* decoders[2] = { &regular, &turbo };
+    for (FuzzDecoder* decoder : decoders) {
+        decoder->setCanvasLimit(kMaxCanvasPixels);
+    }
+    regular.setScreenClearCallback(fuzzScreenClear);
+    regular.setUpdateScreenCallback(fuzzUpdateScreen);
+    regular.setDrawPixelCallback(fuzzDrawPixel);
+
+    printf("[Fuzz] %zu crafted cases, %zu mutations of %zu GIFs from %s, seed %u, budget %d pixels\n", crafted,
+           corpus.size() - crafted, bases.size(), directory.c_str(), seed, budget);
+    printf("%-28s %-12s %-12s %8s %11s %11s %11s %11s\n", "case", "regular", "turbo", "calls", "regular us",
+           "turbo us", "whole reg", "whole turbo");
+
+    Serial.muted = true;
+    int failures = 0;
+    uint64_t worstNs[2] = { 0, 0 }, worstWholeNs[2] = { 0, 0 };
+    std::string worstCase[2];
+    int mutationErrors = 0;
+    for (size_t i = 0; i < corpus.size(); i++) {
+        FuzzCase& c = corpus[i];
+        CaseResult r = runCase(decoders, budget, limitNs, c);
+        for (int t = 0; t < 2; t++) {
+            if (r.budgeted[t].worstNs > worstNs[t]) {
+                worstNs[t] = r.budgeted[t].worstNs;
+                worstCase[t] = c.name;
+            }
+            worstWholeNs[t] = std::max(worstWholeNs[t], r.whole[t].worstNs);
+        }
+        if (i >= crafted && r.budgeted[0].result < 0) mutationErrors++;
+        if (r.failed) failures++;
+        // every crafted case, and the mutations that fail a check
+        if (i < crafted || r.failed) {
+            printf("%-28.28s %-12s ", c.name.c_str(), describe(r.budgeted[0]));
+            printf("%-12s %8u %11.1f %11.1f %11.1f %11.1f%s\n", describe(r.budgeted[1]),
+                   std::max(r.budgeted[0].calls, r.budgeted[1].calls), r.budgeted[0].worstNs / 1e3,
+                   r.budgeted[1].worstNs / 1e3, r.whole[0].worstNs / 1e3, r.whole[1].worstNs / 1e3,
+                   r.failed ? "  FAILED" : "");
+        }
+    }
+    Serial.muted = false;
+
+    printf("[Fuzz] mutations: %zu cases, %d ended in an error\n", corpus.size() - crafted, mutationErrors);
+    printf("[Fuzz] worst call, budgeted: regular %.1f us (%s), turbo %.1f us (%s)\n", worstNs[0] / 1e3,
+           worstCase[0].c_str(), worstNs[1] / 1e3, worstCase[1].c_str());
+    printf("[Fuzz] worst call, whole frames: regular %.1f us, turbo %.1f us\n", worstWholeNs[0] / 1e3,
+           worstWholeNs[1] / 1e3);
+    printf("[Fuzz] %d failures\n", failures);
+    return failures ? 1 : 0;
+}
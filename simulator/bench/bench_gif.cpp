@@ -0,0 +1,166 @@
+/**
+ * GIF decode benchmark.
+ *
+ * Plays one cycle of every GIF in a directory through two GifDecoders that
+ * share one GifArena: one decoding the regular way and one with the turbo
+ * buffer taken from the arena. Every frame drawn through the pixel callback is
+ * hashed, and the run fails if the two decoders disagree on any frame.
+ * Reports decode time for both paths and the arena high water mark.
+ *
+ *   ./led_bench gif [directory] [--arena BYTES]
+ *
+ * The directory defaults to gifs/full_gifs in the repo the bench was built from.
+ */
+
+#include "bench.h"
+
+#include <Arduino.h>
+#include <GifDecoder.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Largest canvas GIFDraw handles (its line buffer is 320 pixels wide)
+static const int kCanvasWidth = 320;
+static const int kCanvasHeight = 320;
+
+static uint8_t g_canvas[kCanvasHeight][kCanvasWidth][3];
+
+static void benchScreenClear() {
+    memset(g_canvas, 0, sizeof(g_canvas));
+}
+
+static void benchUpdateScreen() {
+}
+
+static void benchDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (x < 0 || y < 0 || x >= kCanvasWidth || y >= kCanvasHeight) return;
+    g_canvas[y][x][0] = red;
+    g_canvas[y][x][1] = green;
+    g_canvas[y][x][2] = blue;
+}
+
+static uint64_t hashCanvas() {
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ULL;
+    const uint8_t* p = &g_canvas[0][0][0];
+    for (size_t i = 0; i < sizeof(g_canvas); i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+typedef GifDecoder<kCanvasWidth, kCanvasHeight, 12, true> BenchDecoder;
+
+/**
+ * Decode one cycle, returning the hash of the canvas after each frame and
+ * adding the time spent in decodeFrame() to decodeNs.
+ */
+static int playCycle(BenchDecoder& decoder, std::vector<uint8_t>& data,
+                     std::vector<uint64_t>& hashes, uint64_t& decodeNs) {
+    int result = decoder.startDecoding(data.data(), (int)data.size());
+    if (result < 0) return result;
+
+    // GIFs that never report the end of a cycle are cut off
+    for (int frame = 0; frame < 5000; frame++) {
+        uint64_t start = benchNowNs();
+        result = decoder.decodeFrame(false);
+        decodeNs += benchNowNs() - start;
+        if (result < 0) return result;
+        if (result == ERROR_DONE_PARSING) break;
+        hashes.push_back(hashCanvas());
+    }
+    return 0;
+}
+
+int benchGif(int argc, char* argv[]) {
+    std::string directory = BENCH_REPO_ROOT "/gifs/full_gifs";
+    uint32_t arenaBytes = 512 * 1024;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc) {
+            arenaBytes = strtoul(argv[++i], nullptr, 10);
+        } else {
+            directory = argv[i];
+        }
+    }
+
+    std::vector<std::string> files = listGifs(directory);
+    if (files.empty()) {
+        printf("[Gif] No GIFs in %s\n", directory.c_str());
+        return 1;
+    }
+
+    std::vector<uint8_t> block(arenaBytes);
+    GifArena arena(block.data(), arenaBytes);
+
+    // both decoders share the arena, their AnimatedGIF state is taken first
+    BenchDecoder regular(arena);
+    BenchDecoder turbo(arena);
+    turbo.setTurboMode(true);
+
+    regular.setScreenClearCallback(benchScreenClear);
+    regular.setUpdateScreenCallback(benchUpdateScreen);
+    regular.setDrawPixelCallback(benchDrawPixel);
+
+    printf("[Gif] %zu files from %s, arena %lu bytes\n", files.size(), directory.c_str(), (unsigned long)arenaBytes);
+    printf("%-28s %9s %7s %11s %11s %8s\n", "file", "canvas", "frames", "regular ms", "turbo ms", "speedup");
+
+    Serial.muted = true;
+
+    int mismatches = 0;
+    uint64_t regularTotalNs = 0, turboTotalNs = 0;
+
+    for (const std::string& name : files) {
+        std::string path = directory + "/" + name;
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) continue;
+        std::vector<uint8_t> data;
+        uint8_t chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+            data.insert(data.end(), chunk, chunk + n);
+        }
+        fclose(f);
+
+        std::vector<uint64_t> regularHashes, turboHashes;
+        uint64_t regularNs = 0, turboNs = 0;
+        int regularResult = playCycle(regular, data, regularHashes, regularNs);
+        int turboResult = playCycle(turbo, data, turboHashes, turboNs);
+
+        uint16_t w = 0, h = 0;
+        if (regularResult == 0) regular.getSize(&w, &h);
+        char canvas[16];
+        snprintf(canvas, sizeof(canvas), "%ux%u", w, h);
+
+        Serial.muted = false;
+        if (regularResult < 0) {
+            printf("%-28s %9s  skipped, decoder error %d\n", name.c_str(), canvas, regularResult);
+        } else if (turboResult < 0 || regularHashes != turboHashes) {
+            size_t firstDiff = 0;
+            while (firstDiff < regularHashes.size() && firstDiff < turboHashes.size() &&
+                   regularHashes[firstDiff] == turboHashes[firstDiff]) {
+                firstDiff++;
+            }
+            printf("%-28s %9s %7zu  MISMATCH: turbo result %d, %zu frames, first difference at frame %zu\n",
+                   name.c_str(), canvas, regularHashes.size(), turboResult, turboHashes.size(), firstDiff);
+            mismatches++;
+        } else {
+            printf("%-28s %9s %7zu %11.2f %11.2f %7.2fx%s\n", name.c_str(), canvas, regularHashes.size(),
+                   regularNs / 1e6, turboNs / 1e6, turboNs ? (double)regularNs / turboNs : 0.0,
+                   turbo.isTurboActive() ? "" : "  (arena full, turbo off)");
+            regularTotalNs += regularNs;
+            turboTotalNs += turboNs;
+        }
+        Serial.muted = true;
+    }
+
+    Serial.muted = false;
+    printf("[Gif] total regular %.1f ms, turbo %.1f ms, %d mismatches\n",
+           regularTotalNs / 1e6, turboTotalNs / 1e6, mismatches);
+    arena.printReport(Serial);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/**
+ * Frame interpolation benchmark.
+ *
+ * First times FrameInterpolator::blend() for a few panel sizes and checks that
+ * alpha 0 and 256 reproduce the two frames exactly. Then plays one cycle of
+ * every GIF in a directory through the interpolator at the sketch's 64x64
+ * panel size on a simulated millisecond clock (decode and blend times are
+ * real), checking that every decoded frame is presented unchanged and in
+ * order between the blends.
+ *
+ *   ./led_bench interp [directory] [--fps N]
+ *
+ * Reports the CPU cost per interpolated frame and what share of a core the
+ * blends take at the target rate, plus per GIF how many frames were blended
+ * and how many were held because of load or too short a delay.
+ */
+
+#include "bench.h"
+
+#include <Arduino.h>
+#include <MatrixCommon.h>
+#include <GifDecoder.h>
+#include <FrameInterpolator.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const int kPanelWidth = 64;
+static const int kPanelHeight = 64;
+
+typedef FrameInterpolator<kPanelWidth, kPanelHeight> PanelInterpolator;
+typedef GifDecoder<320, 320, 12, true> InterpDecoder;
+
+static rgb24 g_backBuffer[kPanelWidth * kPanelHeight];
+static InterpDecoder* g_decoder = nullptr;
+static PanelInterpolator* g_interpolator = nullptr;
+static std::vector<uint64_t> g_decodedHashes;
+
+static uint64_t hashFrame(const rgb24* frame) {
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ULL;
+    const uint8_t* p = (const uint8_t*)frame;
+    for (size_t i = 0; i < sizeof(g_backBuffer); i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void benchScreenClear() {
+    memset((void*)g_backBuffer, 0, sizeof(g_backBuffer));
+}
+
+static void benchUpdateScreen() {
+    g_decodedHashes.push_back(hashFrame(g_backBuffer));
+    g_interpolator->captureFrame(g_backBuffer, g_decoder->getFrameDelay_ms());
+}
+
+// GIFs larger than the panel are cropped, as on the matrix
+static void benchDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (x < 0 || y < 0 || x >= kPanelWidth || y >= kPanelHeight) return;
+    g_backBuffer[y * kPanelWidth + x] = rgb24(red, green, blue);
+}
+
+template <uint16_t width, uint16_t height>
+static bool timeBlend(int fps) {
+    typedef FrameInterpolator<width, height> Interpolator;
+    std::vector<rgb24> a(Interpolator::PIXELS), b(Interpolator::PIXELS), out(Interpolator::PIXELS);
+    for (uint32_t i = 0; i < Interpolator::PIXELS; i++) {
+        a[i] = rgb24(i * 7, i * 13, i * 29);
+        b[i] = rgb24(255 - i * 3, i * 11, i >> 4);
+    }
+
+    Interpolator::blend(out.data(), a.data(), b.data(), Interpolator::PIXELS, 0);
+    bool exact = memcmp(out.data(), a.data(), Interpolator::FRAME_BYTES) == 0;
+    Interpolator::blend(out.data(), a.data(), b.data(), Interpolator::PIXELS, 256);
+    exact = exact && memcmp(out.data(), b.data(), Interpolator::FRAME_BYTES) == 0;
+
+    const int iterations = 2000;
+    uint64_t start = benchNowNs();
+    for (int i = 0; i < iterations; i++) {
+        Interpolator::blend(out.data(), a.data(), b.data(), Interpolator::PIXELS, (uint16_t)(i & 0xff));
+    }
+    double perFrame_us = (benchNowNs() - start) / 1e3 / iterations;
+
+    char size[16];
+    snprintf(size, sizeof(size), "%ux%u", width, height);
+    printf("  %-9s %8.2f us/frame  %5.2f%% of a core at %d fps%s\n", size, perFrame_us,
+           perFrame_us * fps / 1e4, fps, exact ? "" : "  ENDPOINTS NOT EXACT");
+    return exact;
+}
+
+int benchInterp(int argc, char* argv[]) {
+    std::string directory = BENCH_REPO_ROOT "/gifs/full_gifs";
+    int fps = FRAME_INTERPOLATOR_DEFAULT_FPS;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else {
+            directory = argv[i];
+        }
+    }
+
+    int failures = 0;
+    printf("[Interp] blend cost per interpolated frame\n");
+    failures += !timeBlend<32, 32>(fps);
+    failures += !timeBlend<64, 64>(fps);
+    failures += !timeBlend<128, 64>(fps);
+    failures += !timeBlend<128, 128>(fps);
+
+    std::vector<std::string> files = listGifs(directory);
+    if (files.empty()) {
+        printf("[Interp] No GIFs in %s\n", directory.c_str());
+        return 1;
+    }
+
+    // the decoder state and the interpolator frames share one arena, as in the sketch
+    std::vector<uint8_t> block(256 * 1024);
+    GifArena arena(block.data(), block.size());
+    InterpDecoder decoder(arena);
+    PanelInterpolator interpolator;
+    if (!interpolator.begin(arena, fps)) {
+        printf("[Interp] arena too small\n");
+        return 1;
+    }
+    g_decoder = &decoder;
+    g_interpolator = &interpolator;
+    decoder.setScreenClearCallback(benchScreenClear);
+    decoder.setUpdateScreenCallback(benchUpdateScreen);
+    decoder.setDrawPixelCallback(benchDrawPixel);
+
+    printf("[Interp] %zu files from %s at %d fps, %dx%d panel\n", files.size(), directory.c_str(), fps,
+           kPanelWidth, kPanelHeight);
+    printf("%-28s %7s %8s %8s %8s %10s %10s\n", "file", "frames", "blended", "held", "ms", "us/blend", "us/decode");
+
+    Serial.muted = true;
+
+    uint32_t totalKeyFrames = 0, totalBlended = 0, totalHeld = 0;
+
+    for (const std::string& name : files) {
+        std::string path = directory + "/" + name;
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) continue;
+        std::vector<uint8_t> data;
+        uint8_t chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+            data.insert(data.end(), chunk, chunk + n);
+        }
+        fclose(f);
+
+        FrameInterpolatorStats before = interpolator.getStats();
+        g_decodedHashes.clear();
+        std::vector<uint64_t> keyHashes;
+
+        benchScreenClear();
+        int result = decoder.startDecoding(data.data(), (int)data.size());
+        interpolator.start();
+
+        // one simulated millisecond per loop, until the last frame of the cycle has been presented
+        uint32_t now = 0;
+        bool decoding = result >= 0;
+        while (decoding || !interpolator.needsDecode(now)) {
+            if (decoding && interpolator.needsDecode(now)) {
+                interpolator.prepareDecode(g_backBuffer);
+                result = decoder.decodeFrame(false);
+                if (result < 0 || result == ERROR_DONE_PARSING || g_decodedHashes.size() >= 5000) {
+                    decoding = false;
+                }
+            }
+            uint32_t keyFrames = interpolator.getStats().keyFrames;
+            if (interpolator.present(now, g_backBuffer) && interpolator.getStats().keyFrames != keyFrames) {
+                keyHashes.push_back(hashFrame(g_backBuffer));
+            }
+            now++;
+        }
+
+        const FrameInterpolatorStats& stats = interpolator.getStats();
+        uint32_t blended = stats.blendedFrames - before.blendedFrames;
+        uint32_t held = stats.skippedKeyFrames - before.skippedKeyFrames;
+
+        Serial.muted = false;
+        if (result < 0) {
+            printf("%-28s skipped, decoder error %d\n", name.c_str(), result);
+        } else if (keyHashes != g_decodedHashes) {
+            printf("%-28s %7zu  MISMATCH: %zu decoded frames presented\n", name.c_str(), g_decodedHashes.size(),
+                   keyHashes.size());
+            failures++;
+        } else {
+            printf("%-28s %7zu %8u %8u %8u %10u %10u\n", name.c_str(), keyHashes.size(), blended, held, now,
+                   stats.averageBlend_us, stats.averageDecode_us);
+            totalKeyFrames += keyHashes.size();
+            totalBlended += blended;
+            totalHeld += held;
+        }
+        Serial.muted = true;
+    }
+
+    Serial.muted = false;
+    printf("[Interp] %u decoded frames, %u blended frames, %u frames held, %d failures\n",
+           totalKeyFrames, totalBlended, totalHeld, failures);
+    interpolator.printReport(Serial);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * LED Bench - Entry Point
+ *
+ * Runs host-side stress checks and throughput benchmarks without SDL, so they
+ * can be built anywhere a C++17 compiler is available.
+ *
+ *   ./led_bench            List benchmarks
+ *   ./led_bench all        Run every benchmark
+ *   ./led_bench <name> ... Run one benchmark with its own arguments
+ */
+
+#include "bench.h"
+
+#include <Arduino.h>
+#include <cstring>
+
+// Global instances for mocks
+SerialClass Serial;
+
+static const BenchEntry g_benches[] = {
+    { "ring", "SPSC ring stress test (producer/consumer threads) and throughput", benchRing },
+    { "ram",  "RAM budget breakdown for a matrix/layer/decoder configuration", benchRam },
+    { "gif",  "GIF decode time, regular vs turbo from the arena (bit-exact check)", benchGif },
+    { "pipeline", "Serial vs pipelined (reader/decoder/compositor threads) GIF playback", benchPipeline },
+    { "interp", "Frame interpolation blend cost and interpolated playback of every GIF", benchInterp },
+    { "stream", "Live frame stream encode/decode of every GIF, bandwidth vs USB full speed", benchStream },
+    { "sync", "Multi-panel frame sync on simulated drifting clocks: sync error, drift estimate, CPU", benchSync },
+    { "diff", "Bit-exact check of decode/draw/fill/calc fast paths against references, with speedups", benchDiff },
+    { "fuzz", "Worst decode time per call on pathological and mutated GIFs, budgeted vs whole frames", benchFuzz },
+    { "audio", "Beat detection on synthesized tracks: lock time, tempo, beat error, CPU per hop vs budget", benchAudio },
+    { "alloc", "Heap allocations in steady playback through the decoder, interpolator and beat detector", benchAlloc },
+    { "palette", "Compositing frames of few colours a run at a time vs a pixel at a time, bit-exact check", benchPalette },
+    { "export", "Shared-memory frame ring: publish cost, and a slow reader never taking a torn frame", benchExport },
+};
+
+static const int g_numBenches = sizeof(g_benches) / sizeof(g_benches[0]);
+
+void printUsage(const char* programName) {
+    printf("LED Bench for Bonnaroo\n\n");
+    printf("Usage: %s all | <benchmark> [args]\n\n", programName);
+    printf("Benchmarks:\n");
+    for (int i = 0; i < g_numBenches; i++) {
+        printf("  %-12s %s\n", g_benches[i].name, g_benches[i].description);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    setbuf(stdout, NULL);
+
+    if (argc < 2 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+        printUsage(argv[0]);
+        return argc < 2 ? 0 : 1;
+    }
+
+    if (strcmp(argv[1], "all") == 0) {
+        int failures = 0;
+        for (int i = 0; i < g_numBenches; i++) {
+            printf("=== %s ===\n", g_benches[i].name);
+            if (g_benches[i].run(0, nullptr) != 0) {
+                printf("[Bench] %s FAILED\n", g_benches[i].name);
+                failures++;
+            }
+        }
+        return failures ? 1 : 0;
+    }
+
+    for (int i = 0; i < g_numBenches; i++) {
+        if (strcmp(argv[1], g_benches[i].name) == 0) {
+            return g_benches[i].run(argc - 2, argv + 2);
+        }
+    }
+
+    printf("Unknown benchmark: %s\n\n", argv[1]);
+    printUsage(argv[0]);
+    return 1;
+}
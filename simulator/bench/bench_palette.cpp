@@ -0,0 +1,319 @@
+/**
+ * Palette size benchmark: drawing frames of few colours a run at a time.
+ *
+ * Plays one cycle of every GIF in a directory, decoded as in the sketch (64x64,
+ * turbo from the arena) into a background layer at the sketch's rotation
+ * through callbacks that do what the sketch's do, three ways:
+ *
+ *   pixels   every frame through drawPixelCallback, a pixel at a time
+ *   library  what GifDecoder does with a run callback: frames of up to
+ *            GIFDECODER_RUN_MAX_BPP bits per pixel, and frames after one
+ *            whose sampled lines averaged GIFDECODER_RUN_MIN_LENGTH pixel
+ *            runs, a run of one colour at a time through drawFastHLine, the
+ *            others a pixel at a time
+ *   runs     every frame a run at a time, whatever its palette
+ *
+ * and checks that the layer comes out the same after every frame all three
+ * ways. To these it adds bw_zoom_out and circle_tunnel from the directory with
+ * their frames brought down to 2, 4 and 16 shades of grey, written as 1, 2 and
+ * 4 bit GIFs. Reports per GIF the frames' largest bits per pixel, the average
+ * run, and the time spent compositing per frame each way, best of --repeat
+ * cycles.
+ *
+ *   ./led_bench palette [directory] [--repeat N]
+ *
+ * The directory defaults to gifs/ in the repo the bench was built from.
+ */
+
+#include "bench.h"
+#include "gif_writer.h"
+
+#include <Arduino.h>
+#include <MatrixCommon.h>
+#include <Layer_Background.h>
+#include <GifDecoder.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// As in the sketch
+static const int kMatrixWidth = 64;
+static const int kMatrixHeight = 64;
+
+typedef GifDecoder<kMatrixWidth, kMatrixHeight, 12, true> PaletteDecoder;
+
+enum DrawWay { WAY_PIXELS, WAY_LIBRARY, WAY_RUNS, WAY_COUNT };
+static const char* const kWayNames[WAY_COUNT] = { "pixels", "library", "runs" };
+
+static rgb24 g_bitmap[2 * kMatrixWidth * kMatrixHeight];
+static color_chan_t g_lut[256];
+static SMLayerBackground<rgb24, 0> g_layer(g_bitmap, kMatrixWidth, kMatrixHeight, g_lut);
+
+static bool g_frameChanged = false;
+static DrawWay g_way = WAY_PIXELS;
+static uint64_t g_drawNs = 0;
+static uint64_t g_runs = 0;
+static uint64_t g_runPixels = 0;
+static int g_maxBpp = 0;
+static std::vector<uint64_t> g_hashes;
+
+static uint64_t hashLayer() {
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ULL;
+    const uint8_t* p = (const uint8_t*)g_layer.backBuffer();
+    for (size_t i = 0; i < kMatrixWidth * kMatrixHeight * sizeof(rgb24); i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void paletteScreenClear() {
+    memset((void*)g_layer.backBuffer(), 0, kMatrixWidth * kMatrixHeight * sizeof(rgb24));
+}
+
+static void paletteUpdateScreen() {
+    g_hashes.push_back(hashLayer());
+    g_frameChanged = false;
+}
+
+// The sketch's drawPixelCallback and drawRunCallback
+static void paletteDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (!g_frameChanged) {
+        rgb24 pixel = g_layer.readPixel(x, y);
+        if (pixel.red == red && pixel.green == green && pixel.blue == blue) return;
+        g_frameChanged = true;
+    }
+    g_layer.drawPixel(x, y, rgb24(red, green, blue));
+}
+
+static void paletteDrawRun(int16_t x, int16_t y, int16_t count, uint8_t red, uint8_t green, uint8_t blue) {
+    g_runs++;
+    g_runPixels += count;
+    if (!g_frameChanged) {
+        while (count > 0) {
+            rgb24 pixel = g_layer.readPixel(x, y);
+            if (pixel.red != red || pixel.green != green || pixel.blue != blue) break;
+            x++;
+            count--;
+        }
+        if (!count) return;
+        g_frameChanged = true;
+    }
+    g_layer.drawFastHLine(x, x + count - 1, y, rgb24(red, green, blue));
+}
+
+static void paletteDrawLine(GIFDRAW* pDraw) {
+    g_maxBpp = std::max(g_maxBpp, (int)pDraw->ucBpp);
+    uint64_t start = benchNowNs();
+    if (g_way == WAY_RUNS) {
+        PaletteDecoder::compositeLineRuns(pDraw);
+    } else {
+        PaletteDecoder::compositeLine(pDraw);
+    }
+    g_drawNs += benchNowNs() - start;
+}
+
+struct Asset {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+struct CycleResult {
+    int result = 0;
+    uint64_t drawNs = 0;
+    std::vector<uint64_t> hashes;
+};
+
+static CycleResult playCycle(PaletteDecoder& decoder, Asset& asset, DrawWay way) {
+    CycleResult cycle;
+    g_way = way;
+    g_drawNs = 0;
+    g_hashes.clear();
+    g_frameChanged = false;
+    decoder.setDrawRunCallback(way == WAY_PIXELS ? nullptr : paletteDrawRun);
+
+    cycle.result = decoder.startDecoding(asset.data.data(), (int)asset.data.size());
+    for (int frame = 0; cycle.result >= 0 && frame < 5000; frame++) {
+        int result = decoder.decodeFrame(false);
+        if (result < 0) cycle.result = result;
+        if (result < 0 || result == ERROR_DONE_PARSING) break;
+    }
+    cycle.drawNs = g_drawNs;
+    cycle.hashes = g_hashes;
+    return cycle;
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    data.clear();
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * The frames of a GIF as the layer shows them, brought down to 2^bits shades
+ * of grey and written out as a GIF of that many bits per pixel.
+ */
+static bool makeGreyAsset(PaletteDecoder& decoder, Asset& source, int bits, Asset& grey) {
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<int> delays;
+    g_way = WAY_PIXELS;
+    decoder.setDrawRunCallback(nullptr);
+    if (decoder.startDecoding(source.data.data(), (int)source.data.size()) < 0) return false;
+    for (int frame = 0; frame < 5000; frame++) {
+        g_hashes.clear();
+        int result = decoder.decodeFrame(false);
+        if (result < 0) return false;
+        if (result == ERROR_DONE_PARSING) break;
+        if (g_hashes.empty()) continue;
+
+        std::vector<uint8_t> pixels(kMatrixWidth * kMatrixHeight);
+        for (int y = 0; y < kMatrixHeight; y++) {
+            for (int x = 0; x < kMatrixWidth; x++) {
+                rgb24 c = g_layer.readPixel(x, y);
+                int luma = (c.red * 77 + c.green * 150 + c.blue * 29) >> 8;
+                pixels[y * kMatrixWidth + x] = (uint8_t)(luma >> (8 - bits));
+            }
+        }
+        frames.push_back(pixels);
+        delays.push_back(decoder.getFrameDelay_ms() / 10);
+    }
+    if (frames.empty()) return false;
+
+    std::vector<uint8_t> palette(3 << bits);
+    for (int i = 0; i < (1 << bits); i++) {
+        uint8_t level = (uint8_t)(i * 255 / ((1 << bits) - 1));
+        palette[i * 3] = palette[i * 3 + 1] = palette[i * 3 + 2] = level;
+    }
+    GifWriter g;
+    g.header(kMatrixWidth, kMatrixHeight, bits, palette.data());
+    int minCodeSize = std::max(bits, 2);
+    for (size_t i = 0; i < frames.size(); i++) {
+        g.delay(delays[i]);
+        g.image(0, 0, kMatrixWidth, kMatrixHeight, minCodeSize, lzwEncode(frames[i], minCodeSize));
+    }
+    g.trailer();
+
+    grey.name = source.name.substr(0, source.name.rfind('.')) + " " + std::to_string(bits) + "bpp";
+    grey.data = g.d;
+    return true;
+}
+
+int benchPalette(int argc, char* argv[]) {
+    std::string directory = BENCH_REPO_ROOT "/gifs";
+    int repeat = 5;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = std::max(1, atoi(argv[++i]));
+        } else {
+            directory = argv[i];
+        }
+    }
+
+    std::vector<std::string> names = listGifs(directory);
+    if (names.empty()) {
+        printf("[Palette] No GIFs in %s\n", directory.c_str());
+        return 1;
+    }
+
+    std::vector<uint8_t> block(128 * 1024);
+    GifArena arena(block.data(), block.size());
+    PaletteDecoder decoder(arena);
+    decoder.setTurboMode(true);
+    decoder.setScreenClearCallback(paletteScreenClear);
+    decoder.setUpdateScreenCallback(paletteUpdateScreen);
+    decoder.setDrawPixelCallback(paletteDrawPixel);
+    decoder.setDrawIndexedLineCallback(paletteDrawLine);
+    g_layer.begin();
+    g_layer.setRotation(rotation270);
+
+    Serial.muted = true;
+
+    std::vector<Asset> assets;
+    for (const std::string& name : names) {
+        Asset asset;
+        asset.name = name;
+        if (readFile(directory + "/" + name, asset.data)) assets.push_back(asset);
+    }
+    size_t files = assets.size();
+    for (size_t i = 0; i < files; i++) {
+        if (assets[i].name != "bw_zoom_out.gif" && assets[i].name != "circle_tunnel.gif") continue;
+        for (int bits : { 1, 2, 4 }) {
+            Asset grey;
+            if (makeGreyAsset(decoder, assets[i], bits, grey)) assets.push_back(grey);
+        }
+    }
+
+    Serial.muted = false;
+    printf("[Palette] %zu files from %s and %zu made with fewer colours, %dx%d, best of %d\n", files,
+           directory.c_str(), assets.size() - files, kMatrixWidth, kMatrixHeight, repeat);
+    printf("%-28s %4s %7s %8s %12s %12s %12s %8s %8s\n", "file", "bpp", "frames", "avg run", "pixels us/f",
+           "library us/f", "runs us/f", "library", "runs");
+    Serial.muted = true;
+
+    int mismatches = 0;
+    double lowPixelsNs = 0, lowLibraryNs = 0, highPixelsNs = 0, highLibraryNs = 0;
+
+    for (Asset& asset : assets) {
+        CycleResult best[WAY_COUNT];
+        bool same = true;
+        g_maxBpp = 0;
+        g_runs = g_runPixels = 0;
+        for (int r = 0; r < repeat; r++) {
+            for (int way = 0; way < WAY_COUNT; way++) {
+                CycleResult cycle = playCycle(decoder, asset, (DrawWay)way);
+                if (r == 0 || cycle.drawNs < best[way].drawNs) {
+                    best[way] = cycle;
+                }
+            }
+        }
+        for (int way = 1; way < WAY_COUNT; way++) {
+            same = same && best[way].result == best[0].result && best[way].hashes == best[0].hashes;
+        }
+
+        Serial.muted = false;
+        size_t frames = best[WAY_PIXELS].hashes.size();
+        if (best[WAY_PIXELS].result < 0) {
+            printf("%-28s skipped, decoder error %d\n", asset.name.c_str(), best[WAY_PIXELS].result);
+        } else if (!same || !frames) {
+            for (int way = 1; way < WAY_COUNT; way++) {
+                if (best[way].hashes != best[0].hashes) {
+                    printf("%-28s MISMATCH: %s differs from pixels\n", asset.name.c_str(), kWayNames[way]);
+                }
+            }
+            mismatches++;
+        } else {
+            double us[WAY_COUNT];
+            for (int way = 0; way < WAY_COUNT; way++) {
+                us[way] = best[way].drawNs / 1e3 / frames;
+            }
+            printf("%-28s %4d %7zu %8.1f %12.1f %12.1f %12.1f %7.2fx %7.2fx\n", asset.name.c_str(), g_maxBpp, frames,
+                   g_runs ? (double)g_runPixels / g_runs : 0.0, us[WAY_PIXELS], us[WAY_LIBRARY], us[WAY_RUNS],
+                   us[WAY_PIXELS] / us[WAY_LIBRARY], us[WAY_PIXELS] / us[WAY_RUNS]);
+            if (g_maxBpp <= GIFDECODER_RUN_MAX_BPP) {
+                lowPixelsNs += best[WAY_PIXELS].drawNs;
+                lowLibraryNs += best[WAY_LIBRARY].drawNs;
+            } else {
+                highPixelsNs += best[WAY_PIXELS].drawNs;
+                highLibraryNs += best[WAY_LIBRARY].drawNs;
+            }
+        }
+        Serial.muted = true;
+    }
+
+    Serial.muted = false;
+    printf("[Palette] up to %d bpp: compositing %.2fx faster; over it: %.2fx (runs after frames of long runs); "
+           "%d mismatches\n", GIFDECODER_RUN_MAX_BPP, lowLibraryNs ? lowPixelsNs / lowLibraryNs : 0.0,
+           highLibraryNs ? highPixelsNs / highLibraryNs : 0.0, mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * Pipelined GIF playback experiment.
+ *
+ * Plays every GIF in a directory twice from the file, as fast as possible:
+ * once serially the way the sketch does (read, decode and composite on one
+ * thread), and once through GifPipeline with the reader, decoder and
+ * compositor on their own threads. Every presented frame is hashed and the
+ * run fails if the two disagree.
+ *
+ *   ./led_bench pipeline [directory] [--cycles N]
+ *
+ * Reports wall time for both and the measured speedup, plus each stage's
+ * busy time (wall time minus time blocked on another stage). With fewer
+ * cores than stages the stages take turns, and the pipeline has measured
+ * no faster than serial. "bound" is serial time over the slowest stage's busy
+ * time, the most a core per stage could give: an upper bound, not a
+ * measurement.
+ */
+
+#include "bench.h"
+
+#include <Arduino.h>
+#include <GifDecoder.h>
+#include <GifPipeline.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kCanvasWidth = 320;
+static const int kCanvasHeight = 320;
+
+typedef GifDecoder<kCanvasWidth, kCanvasHeight, 12> PipelineDecoder;
+typedef GifPipeline<PipelineDecoder, kCanvasWidth> BenchPipeline;
+
+static PipelineDecoder g_decoder;
+static BenchPipeline g_pipeline(g_decoder);
+
+static uint8_t g_canvas[kCanvasHeight][kCanvasWidth][3];
+static std::vector<uint64_t> g_frameHashes;
+static FILE* g_file = nullptr;
+static long g_fileSize = 0;
+
+static void benchScreenClear() {
+    memset(g_canvas, 0, sizeof(g_canvas));
+}
+
+static void benchUpdateScreen() {
+    // FNV-1a over 64-bit words, cheap enough not to dominate the compositor's time
+    uint64_t hash = 1469598103934665603ULL;
+    uint64_t word;
+    const uint8_t* p = &g_canvas[0][0][0];
+    for (size_t i = 0; i < sizeof(g_canvas); i += sizeof(word)) {
+        memcpy(&word, p + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    g_frameHashes.push_back(hash);
+}
+
+static void benchDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (x < 0 || y < 0 || x >= kCanvasWidth || y >= kCanvasHeight) return;
+    g_canvas[y][x][0] = red;
+    g_canvas[y][x][1] = green;
+    g_canvas[y][x][2] = blue;
+}
+
+static bool fileSeek(unsigned long position) { return fseek(g_file, position, SEEK_SET) == 0; }
+static unsigned long filePosition() { return ftell(g_file); }
+static int fileRead() { return fgetc(g_file); }
+static int fileReadBlock(void* buffer, int numberOfBytes) { return fread(buffer, 1, numberOfBytes, g_file); }
+static int fileSize() { return g_fileSize; }
+
+static void useSerialCallbacks() {
+    g_decoder.setScreenClearCallback(benchScreenClear);
+    g_decoder.setUpdateScreenCallback(benchUpdateScreen);
+    g_decoder.setDrawPixelCallback(benchDrawPixel);
+    g_decoder.setDrawIndexedLineCallback(nullptr);
+    g_decoder.setFileSeekCallback(fileSeek);
+    g_decoder.setFilePositionCallback(filePosition);
+    g_decoder.setFileReadCallback(fileRead);
+    g_decoder.setFileReadBlockCallback(fileReadBlock);
+    g_decoder.setFileSizeCallback(fileSize);
+}
+
+static int playSerial(int cycles, uint64_t& wallNs) {
+    useSerialCallbacks();
+    fseek(g_file, 0, SEEK_SET);
+
+    uint64_t start = benchNowNs();
+    int result = g_decoder.startDecoding();
+    int done = 0;
+    while (result >= 0 && done < cycles) {
+        result = g_decoder.decodeFrame(false);
+        if (result == ERROR_DONE_PARSING) done++;
+    }
+    wallNs = benchNowNs() - start;
+    return result < 0 ? result : 0;
+}
+
+static int playPipelined(int cycles, uint64_t& wallNs) {
+    useSerialCallbacks();
+    g_pipeline.setFileSeekCallback(fileSeek);
+    g_pipeline.setFileReadBlockCallback(fileReadBlock);
+    g_pipeline.setFileSizeCallback(fileSize);
+    g_pipeline.setScreenClearCallback(benchScreenClear);
+    g_pipeline.setUpdateScreenCallback(benchUpdateScreen);
+    g_pipeline.setRealtime(false);
+    g_pipeline.setCycleLimit(cycles);
+
+    uint64_t start = benchNowNs();
+    g_pipeline.start();
+    std::thread reader([] { g_pipeline.runReader(); });
+    std::thread decoder([] { g_pipeline.runDecoder(); });
+    g_pipeline.runCompositor();
+    g_pipeline.stop();
+    reader.join();
+    decoder.join();
+    wallNs = benchNowNs() - start;
+    return g_pipeline.getStats().lastError;
+}
+
+int benchPipeline(int argc, char* argv[]) {
+    std::string directory = BENCH_REPO_ROOT "/gifs/full_gifs";
+    int cycles = 2;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles = atoi(argv[++i]);
+        } else {
+            directory = argv[i];
+        }
+    }
+
+    std::vector<std::string> files = listGifs(directory);
+    if (files.empty()) {
+        printf("[Pipeline] No GIFs in %s\n", directory.c_str());
+        return 1;
+    }
+
+    printf("[Pipeline] %zu files from %s, %d cycles each, %u hardware threads\n",
+           files.size(), directory.c_str(), cycles, std::thread::hardware_concurrency());
+    printf("%-28s %7s %10s %10s %8s | %9s %9s %9s %10s\n", "file", "frames", "serial ms", "piped ms",
+           "speedup", "read ms", "decode ms", "blit ms", "bound");
+
+    Serial.muted = true;
+
+    int mismatches = 0;
+    uint64_t serialTotalNs = 0, pipelinedTotalNs = 0, boundTotalNs = 0;
+
+    for (const std::string& name : files) {
+        std::string path = directory + "/" + name;
+        g_file = fopen(path.c_str(), "rb");
+        if (!g_file) continue;
+        fseek(g_file, 0, SEEK_END);
+        g_fileSize = ftell(g_file);
+
+        uint64_t serialNs = 0, pipelinedNs = 0;
+        g_frameHashes.clear();
+        int serialResult = playSerial(cycles, serialNs);
+        std::vector<uint64_t> serialHashes = g_frameHashes;
+
+        g_frameHashes.clear();
+        int pipelinedResult = playPipelined(cycles, pipelinedNs);
+        std::vector<uint64_t> pipelinedHashes = g_frameHashes;
+        fclose(g_file);
+
+        Serial.muted = false;
+        if (serialResult < 0) {
+            printf("%-28s skipped, decoder error %d\n", name.c_str(), serialResult);
+        } else if (pipelinedResult < 0 || serialHashes != pipelinedHashes) {
+            printf("%-28s %7zu  MISMATCH: pipeline result %d, %zu frames\n", name.c_str(),
+                   serialHashes.size(), pipelinedResult, pipelinedHashes.size());
+            mismatches++;
+        } else {
+            const GifPipelineStats& stats = g_pipeline.getStats();
+            double wall_ms = pipelinedNs / 1e6;
+            double read_ms = wall_ms - stats.readerWait_us / 1e3;
+            double decode_ms = wall_ms - stats.decoderWait_us / 1e3;
+            double blit_ms = wall_ms - stats.compositorWait_us / 1e3;
+            double bound_ms = std::max(read_ms, std::max(decode_ms, blit_ms));
+            printf("%-28s %7zu %10.2f %10.2f %7.2fx | %9.2f %9.2f %9.2f %9.2fx\n", name.c_str(),
+                   serialHashes.size(), serialNs / 1e6, wall_ms, (double)serialNs / pipelinedNs,
+                   read_ms, decode_ms, blit_ms, serialNs / 1e6 / bound_ms);
+            serialTotalNs += serialNs;
+            pipelinedTotalNs += pipelinedNs;
+            boundTotalNs += (uint64_t)(bound_ms * 1e6);
+        }
+        Serial.muted = true;
+    }
+
+    Serial.muted = false;
+    printf("[Pipeline] total serial %.1f ms, pipelined %.1f ms, measured %.2fx on %u hardware threads "
+           "(upper bound with a core per stage %.2fx, not measured), %d mismatches\n",
+           serialTotalNs / 1e6, pipelinedTotalNs / 1e6,
+           pipelinedTotalNs ? (double)serialTotalNs / pipelinedTotalNs : 0.0, std::thread::hardware_concurrency(),
+           boundTotalNs ? (double)serialTotalNs / boundTotalNs : 0.0, mismatches);
+    return mismatches ? 1 : 0;
+}
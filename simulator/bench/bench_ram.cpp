@@ -0,0 +1,87 @@
+/**
+ * RAM budget planner.
+ *
+ * Evaluates the same constexpr model the sketch static_asserts against
+ * (RamBudget.h), but with a configuration from the command line, so larger
+ * panels, deeper refresh and GIF caches can be planned before flashing.
+ *
+ *   ./led_bench ram [width height refreshDepth dmaRows colorDepth] [--turbo] [--framebuf] [--cache BYTES]
+ *                   [--arena BYTES]
+ *
+ * Defaults match Bonnaroo.ino, where the decoder state and turbo buffer live in
+ * a 96KB GifArena. With --arena 0 the decoder state is counted in RAM1 instead,
+ * as it is when the decoder is declared without an arena. The AnimatedGIF size
+ * is the host sizeof(), slightly larger than on the Teensy (64-bit pointers),
+ * as is the sketch state: the audio beat detector, telemetry queue, frame
+ * stream and frame sync of a 64x64 panel, and the GIF name pool.
+ */
+
+#include "bench.h"
+
+#include <Arduino.h>
+#include <AnimatedGIF.h>
+#include <MatrixCommon.h>
+#include <MatrixCommonHub75.h>
+#include "RamBudget.h"
+#include "gimpbitmap.h"
+#include "AudioBeat.h"
+#include "FrameStream.h"
+#include "FrameSync.h"
+#include "Telemetry.h"
+#include "FilenameFunctions.h"
+
+#include <cstdlib>
+#include <cstring>
+
+int benchRam(int argc, char* argv[]) {
+    RamBudgetConfig config = {
+        64, 64, 36, 4, SM_PANELTYPE_HUB75_32ROW_MOD16SCAN, 24,
+        true, true, false,
+        64,                             // GifDecoder without its AnimatedGIF state
+        64, 64,
+        false, false,
+        0,
+        2 * sizeof(gimp64x64bitmap),    // bm_brat and bm_surprised_pikachu
+        sizeof(AudioBeat) + sizeof(Telemetry) + sizeof(FrameStream<64, 64>) + sizeof(FrameSync) + GIF_NAME_POOL_BYTES,
+        96 * 1024
+    };
+
+    int positional = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--turbo") == 0) {
+            config.gifTurbo = true;
+        } else if (strcmp(argv[i], "--framebuf") == 0) {
+            config.gifFrameBuffer = true;
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            config.cacheBytes = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc) {
+            config.gifArenaBytes = strtoul(argv[++i], nullptr, 10);
+            if (config.gifArenaBytes == 0) {
+                config.gifDecoderBytes += sizeof(AnimatedGIF);
+            }
+        } else {
+            int value = atoi(argv[i]);
+            switch (positional++) {
+                case 0: config.matrixWidth = config.gifCanvasWidth = value; break;
+                case 1: config.matrixHeight = config.gifCanvasHeight = value; break;
+                case 2: config.refreshDepth = value; break;
+                case 3: config.dmaBufferRows = value; break;
+                case 4: config.colorDepth = value; break;
+            }
+        }
+    }
+
+    printf("[Ram] %dx%d refreshDepth=%d dmaRows=%d COLOR_DEPTH=%d turbo=%d framebuf=%d cache=%lu arena=%lu\n",
+           config.matrixWidth, config.matrixHeight, config.refreshDepth, config.dmaBufferRows, config.colorDepth,
+           config.gifTurbo, config.gifFrameBuffer, (unsigned long)config.cacheBytes,
+           (unsigned long)config.gifArenaBytes);
+
+    RamBudget budget = planRamBudget(config);
+    printRamBudget(budget);
+
+    // Not a failure for planning runs, but make it obvious
+    if (!budget.fits()) {
+        printf("[Ram] configuration does NOT fit\n");
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * SPSC ring stress test and throughput benchmark.
+ *
+ * A producer thread stands in for the calc code and a consumer thread for the
+ * refresh ISR, sharing a CircularBuffer_SM over a small array of "rows". Every
+ * element carries a sequence number; the consumer checks that it sees each one
+ * exactly once and in order, and that a row is never read before it was
+ * completely written.
+ */
+
+#include "bench.h"
+
+#include <CircularBuffer_SM.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+
+// Large enough that a torn write (consumer reading while producer fills) is likely to be caught
+struct BenchRow {
+    uint32_t sequence;
+    uint32_t payload[15];
+};
+
+template <uint16_t staticSize>
+static bool runRing(int size, uint32_t iterations, double* opsPerSec) {
+    static BenchRow rows[64];
+    CircularBufferSPSC<staticSize> cb;
+    cbInit(&cb, size);
+
+    std::atomic<bool> failed(false);
+
+    uint64_t start = benchNowNs();
+
+    std::thread producer([&]() {
+        for (uint32_t seq = 0; seq < iterations; seq++) {
+            while (cbIsFull(&cb)) {
+                if (failed.load(std::memory_order_relaxed)) return;
+                std::this_thread::yield();
+            }
+            BenchRow& row = rows[cbGetNextWrite(&cb)];
+            row.sequence = seq;
+            for (int i = 0; i < 15; i++) row.payload[i] = seq * 31 + i;
+            cbWrite(&cb);
+        }
+    });
+
+    std::thread consumer([&]() {
+        for (uint32_t seq = 0; seq < iterations; seq++) {
+            while (cbIsEmpty(&cb)) {
+                std::this_thread::yield();
+            }
+            const BenchRow& row = rows[cbGetNextRead(&cb)];
+            bool ok = row.sequence == seq;
+            for (int i = 0; i < 15 && ok; i++) ok = row.payload[i] == seq * 31 + i;
+            if (!ok) {
+                printf("[Ring] size %d: expected sequence %u, got %u\n", size, seq, row.sequence);
+                failed = true;
+                return;
+            }
+            if (cb.count() > cb.capacity()) {
+                printf("[Ring] size %d: count %u exceeds capacity\n", size, cb.count());
+                failed = true;
+                return;
+            }
+            cbRead(&cb);
+        }
+    });
+
+    producer.join();
+    consumer.join();
+
+    uint64_t elapsed = benchNowNs() - start;
+    *opsPerSec = iterations / (elapsed / 1e9);
+
+    return !failed && cbIsEmpty(&cb);
+}
+
+int benchRing(int argc, char* argv[]) {
+    uint32_t iterations = (argc > 0) ? strtoul(argv[0], nullptr, 10) : 200000;
+    int failures = 0;
+    double opsPerSec;
+
+    // runtime sizes cover both the mask and the compare paths, as used by dmaBufferNumRows
+    static const int sizes[] = { 2, 3, 4, 5, 8, 16 };
+    printf("[Ring] %u elements per run\n", iterations);
+    for (int size : sizes) {
+        bool ok = runRing<0>(size, iterations, &opsPerSec);
+        printf("[Ring] runtime size %2d (%s): %s  %7.2f M elements/s\n", size,
+               (size & (size - 1)) == 0 ? "mask" : "wrap", ok ? "ok  " : "FAIL", opsPerSec / 1e6);
+        if (!ok) failures++;
+    }
+
+    bool ok = runRing<4>(4, iterations, &opsPerSec);
+    printf("[Ring] static size   4 (mask): %s  %7.2f M elements/s\n", ok ? "ok  " : "FAIL", opsPerSec / 1e6);
+    if (!ok) failures++;
+
+    ok = runRing<16>(16, iterations, &opsPerSec);
+    printf("[Ring] static size  16 (mask): %s  %7.2f M elements/s\n", ok ? "ok  " : "FAIL", opsPerSec / 1e6);
+    if (!ok) failures++;
+
+    return failures;
+}
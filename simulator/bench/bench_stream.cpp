@@ -0,0 +1,365 @@
+/**
+ * Live frame stream benchmark.
+ *
+ * Encodes one cycle of every GIF in a directory with FrameStreamEncoder, the
+ * way led_stream sends it to a 64x64 panel rotated like the sketch's, and
+ * feeds the packets through FrameStream in USB-sized chunks. Every presented
+ * frame must match the source bit for bit and be acked. The first GIF is also
+ * replayed with a corrupted byte to check that the panel naks, the sender
+ * answers with a key frame, and playback recovers. Before any of that, console
+ * lines and a frame are sent in one write to a port the console shares with
+ * the stream, polled the way the sketch's loop() does, and every line has to
+ * run and the frame be presented.
+ *
+ *   ./led_bench stream [directory] [--fps N] [--chunk BYTES]
+ *
+ * Reports bytes per frame, the bandwidth that needs at the target frame rate
+ * as a share of USB full speed, and the panel's time in poll() per frame.
+ */
+
+#include "bench.h"
+
+#include <Arduino.h>
+#include <MatrixCommon.h>
+#include <GifDecoder.h>
+#include <FrameStream.h>
+#include <Console.h>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const int kPanelWidth = 64;
+static const int kPanelHeight = 64;
+// 19 bulk packets of 64 bytes per 1ms USB frame
+static const double kUsbFullSpeedBytesPerSecond = 19 * 64 * 1000;
+
+typedef FrameStream<kPanelWidth, kPanelHeight> PanelStream;
+typedef FrameStreamEncoder<kPanelWidth, kPanelHeight> PanelEncoder;
+typedef GifDecoder<320, 320, 12, true> StreamDecoder;
+
+// Serial stand-in: the panel sees at most chunk bytes per poll, as from one USB transfer
+struct MemoryPort {
+    std::vector<uint8_t> input;
+    size_t position = 0;
+    size_t chunk = 512;
+    size_t allowed = 0;
+    std::vector<uint8_t> output;
+
+    int available() {
+        size_t left = input.size() - position;
+        return (int)std::min(left, allowed);
+    }
+    int peek() {
+        return input[position];
+    }
+    int read() {
+        allowed--;
+        return input[position++];
+    }
+    size_t readBytes(char* buffer, size_t length) {
+        memcpy(buffer, &input[position], length);
+        position += length;
+        allowed -= length;
+        return length;
+    }
+    size_t write(const uint8_t* buffer, size_t length) {
+        output.insert(output.end(), buffer, buffer + length);
+        return length;
+    }
+    // the console's replies, kept apart from the stream's packets
+    int printf(const char* format, ...) {
+        char text[256];
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        printed += text;
+        return n;
+    }
+    std::string printed;
+};
+
+static rgb24 g_canvas[kPanelWidth * kPanelHeight];
+static std::vector<std::vector<rgb24>> g_frames;
+
+static void benchScreenClear() {
+    memset((void*)g_canvas, 0, sizeof(g_canvas));
+}
+
+// frames are stored in the layer's buffer order, as led_stream sends them for rotation270
+static void benchUpdateScreen() {
+    std::vector<rgb24> native(kPanelWidth * kPanelHeight);
+    for (int y = 0; y < kPanelHeight; y++) {
+        for (int x = 0; x < kPanelWidth; x++) {
+            int hwx = y;
+            int hwy = (kPanelHeight - 1) - x;
+            native[hwy * kPanelWidth + hwx] = g_canvas[y * kPanelWidth + x];
+        }
+    }
+    g_frames.push_back(native);
+}
+
+static void benchDrawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (x < 0 || y < 0 || x >= kPanelWidth || y >= kPanelHeight) return;
+    g_canvas[y * kPanelWidth + x] = rgb24(red, green, blue);
+}
+
+// Reply packets the panel wrote, by type
+static void countReplies(const std::vector<uint8_t>& output, uint32_t& acks, uint32_t& naks) {
+    acks = naks = 0;
+    for (size_t i = 0; i + FRAME_STREAM_HEADER_BYTES < output.size();) {
+        if (output[i] != FRAME_STREAM_MAGIC) {
+            i++;
+            continue;
+        }
+        uint32_t length = output[i + 2] | output[i + 3] << 8;
+        if (output[i + 1] == FRAME_STREAM_ACK) acks++;
+        if (output[i + 1] == FRAME_STREAM_NAK) naks++;
+        i += FRAME_STREAM_HEADER_BYTES + length + 1;
+    }
+}
+
+struct StreamResult {
+    uint32_t presented = 0;
+    uint32_t mismatches = 0;
+    uint64_t bytes = 0;
+    uint32_t maxFrameBytes = 0;
+    uint64_t encodeNs = 0;
+    uint64_t pollNs = 0;
+    uint32_t acks = 0;
+    uint32_t naks = 0;
+    uint32_t keyFrames = 0;
+};
+
+/**
+ * Sends every frame in g_frames through a fresh encoder and panel. With
+ * corruptFrame >= 0, one byte in that frame's packets is flipped and the
+ * sender reacts to the nak before the next frame, as led_stream does.
+ */
+static StreamResult streamFrames(size_t chunk, int corruptFrame) {
+    static PanelEncoder encoder;
+    static PanelStream stream;
+    static std::vector<uint8_t> packets(PanelEncoder::MAX_FRAME_PACKETS_BYTES);
+    static rgb24 backBuffer[kPanelWidth * kPanelHeight];
+
+    encoder = PanelEncoder();
+    stream = PanelStream();
+    stream.setRotation(rotation270);
+
+    StreamResult result;
+    MemoryPort port;
+    port.chunk = chunk;
+
+    for (size_t frame = 0; frame < g_frames.size(); frame++) {
+        uint64_t start = benchNowNs();
+        uint32_t length = encoder.encode(g_frames[frame].data(), frame, packets.data());
+        result.encodeNs += benchNowNs() - start;
+        result.bytes += length;
+        result.maxFrameBytes = std::max(result.maxFrameBytes, length);
+
+        if ((int)frame == corruptFrame) {
+            packets[length / 2] ^= 0x5A;
+        }
+
+        port.input.assign(packets.begin(), packets.begin() + length);
+        port.position = 0;
+        bool ready = false;
+        start = benchNowNs();
+        while (port.position < port.input.size()) {
+            port.allowed = port.chunk;
+            if (stream.poll(port, backBuffer, frame) == FRAME_STREAM_FRAME_READY) {
+                ready = true;
+                stream.framePresented(port);
+                if (memcmp(backBuffer, g_frames[frame].data(), sizeof(backBuffer)) != 0) {
+                    result.mismatches++;
+                }
+            }
+        }
+        result.pollNs += benchNowNs() - start;
+        if (ready) result.presented++;
+
+        uint32_t acks, naks;
+        countReplies(port.output, acks, naks);
+        if (naks > result.naks) {
+            encoder.requestKeyFrame();
+        }
+        result.acks = acks;
+        result.naks = naks;
+    }
+    result.keyFrames = encoder.getKeyFrames();
+    return result;
+}
+
+static int g_benchCommands = 0;
+static int g_statsCommands = 0;
+static std::string g_benchArgument;
+
+static void benchCommand(int argc, char* argv[]) {
+    g_benchCommands++;
+    g_benchArgument = argc > 1 ? argv[1] : "";
+}
+
+static void statsCommand(int, char*[]) {
+    g_statsCommands++;
+}
+
+/**
+ * Two console lines, the first longer than a console poll, then a key frame,
+ * then another line, all in one write as Serial Monitor and led_stream would
+ * send them. Neither side may drop the other's bytes.
+ */
+static bool checkSharedPort() {
+    static const ConsoleCommand commands[] = {
+        { "bench", "", benchCommand },
+        { "stats", "", statsCommand },
+    };
+    static PanelEncoder encoder;
+    static PanelStream stream;
+    static std::vector<uint8_t> packets(PanelEncoder::MAX_FRAME_PACKETS_BYTES);
+    static rgb24 frame[kPanelWidth * kPanelHeight];
+    static rgb24 backBuffer[kPanelWidth * kPanelHeight];
+
+    Console console(commands, sizeof(commands) / sizeof(commands[0]));
+    stream.setShared(true);
+    for (int i = 0; i < kPanelWidth * kPanelHeight; i++) {
+        frame[i] = rgb24(i, i >> 4, i >> 8);
+    }
+
+    const std::string lines = "bench output-onlinegiftools.gif\nstats\n";
+    const std::string last = "stats\n";
+    uint32_t length = encoder.encode(frame, 0, packets.data());
+    MemoryPort port;
+    port.input.assign(lines.begin(), lines.end());
+    port.input.insert(port.input.end(), packets.begin(), packets.begin() + length);
+    port.input.insert(port.input.end(), last.begin(), last.end());
+
+    g_benchCommands = g_statsCommands = 0;
+    int presented = 0;
+    int loops = 0;
+    for (; port.position < port.input.size() && loops < 100; loops++) {
+        port.allowed = port.input.size();
+        if (stream.isIdle()) {
+            console.poll(port, true);
+        }
+        if (stream.poll(port, backBuffer, loops) == FRAME_STREAM_FRAME_READY) {
+            stream.framePresented(port);
+            presented += memcmp(backBuffer, frame, sizeof(frame)) == 0;
+        }
+    }
+
+    uint32_t acks, naks;
+    countReplies(port.output, acks, naks);
+    bool ok = g_benchCommands == 1 && g_benchArgument == "output-onlinegiftools.gif" && g_statsCommands == 2 &&
+        presented == 1 && acks == 1 && stream.getStats().skippedBytes == 0;
+    printf("[Stream] shared port: %zu bytes in one write, read in %d loops, %d bench + %d stats commands, "
+           "%d frame presented, %u skipped bytes%s\n", port.input.size(), loops, g_benchCommands, g_statsCommands,
+           presented, stream.getStats().skippedBytes, ok ? "" : "  LOST INPUT");
+    return ok;
+}
+
+int benchStream(int argc, char* argv[]) {
+    std::string directory = BENCH_REPO_ROOT "/gifs/full_gifs";
+    int fps = 60;
+    size_t chunk = 512;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+            chunk = strtoul(argv[++i], nullptr, 10);
+        } else {
+            directory = argv[i];
+        }
+    }
+
+    std::vector<std::string> files = listGifs(directory);
+    if (files.empty()) {
+        printf("[Stream] No GIFs in %s\n", directory.c_str());
+        return 1;
+    }
+
+    std::vector<uint8_t> block(128 * 1024);
+    GifArena arena(block.data(), block.size());
+    StreamDecoder decoder(arena);
+    decoder.setScreenClearCallback(benchScreenClear);
+    decoder.setUpdateScreenCallback(benchUpdateScreen);
+    decoder.setDrawPixelCallback(benchDrawPixel);
+
+    printf("[Stream] %zu files from %s, %dx%d panel, %zu byte chunks, %d fps, key frame %u bytes\n", files.size(),
+           directory.c_str(), kPanelWidth, kPanelHeight, chunk, fps, PanelStream::FRAME_BYTES);
+    printf("%-28s %7s %5s %9s %9s %9s %7s %9s %9s\n", "file", "frames", "keys", "avg B", "max B", "KB/s", "USB FS",
+           "enc us", "poll us");
+
+    Serial.muted = true;
+
+    int failures = checkSharedPort() ? 0 : 1;
+    bool corruptionChecked = false;
+    uint64_t totalBytes = 0;
+    uint32_t totalFrames = 0;
+    uint32_t worstFrameBytes = 0;
+
+    for (const std::string& name : files) {
+        std::string path = directory + "/" + name;
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) continue;
+        std::vector<uint8_t> data;
+        uint8_t chunkBuffer[4096];
+        size_t n;
+        while ((n = fread(chunkBuffer, 1, sizeof(chunkBuffer), f)) > 0) {
+            data.insert(data.end(), chunkBuffer, chunkBuffer + n);
+        }
+        fclose(f);
+
+        g_frames.clear();
+        benchScreenClear();
+        int decodeResult = decoder.startDecoding(data.data(), (int)data.size());
+        while (decodeResult >= 0 && g_frames.size() < 5000) {
+            decodeResult = decoder.decodeFrame(false);
+            if (decodeResult == ERROR_DONE_PARSING) break;
+        }
+
+        Serial.muted = false;
+        if (decodeResult < 0) {
+            printf("%-28s skipped, decoder error %d\n", name.c_str(), decodeResult);
+            Serial.muted = true;
+            continue;
+        }
+
+        StreamResult result = streamFrames(chunk, -1);
+        double avgBytes = (double)result.bytes / g_frames.size();
+        double bytesPerSecond = avgBytes * fps;
+        bool ok = result.presented == g_frames.size() && !result.mismatches && result.acks == g_frames.size();
+        printf("%-28s %7zu %5u %9.0f %9u %9.1f %6.1f%% %9.2f %9.2f%s\n", name.c_str(), g_frames.size(),
+               result.keyFrames, avgBytes, result.maxFrameBytes, bytesPerSecond / 1024,
+               100 * bytesPerSecond / kUsbFullSpeedBytesPerSecond, result.encodeNs / 1e3 / g_frames.size(),
+               result.pollNs / 1e3 / g_frames.size(), ok ? "" : "  MISMATCH");
+        if (!ok) failures++;
+        totalBytes += result.bytes;
+        totalFrames += g_frames.size();
+        worstFrameBytes = std::max(worstFrameBytes, result.maxFrameBytes);
+
+        // corrupt a frame past the first key frame, expect one nak and a clean recovery
+        if (!corruptionChecked && g_frames.size() > 4) {
+            corruptionChecked = true;
+            StreamResult corrupt = streamFrames(chunk, 2);
+            bool recovered = corrupt.naks == 1 && corrupt.presented == g_frames.size() - 1 &&
+                !corrupt.mismatches && corrupt.keyFrames == 2;
+            printf("  corrupted frame 2: %u nak, %u key frames, %u of %zu frames presented, %u mismatches%s\n",
+                   corrupt.naks, corrupt.keyFrames, corrupt.presented, g_frames.size(), corrupt.mismatches,
+                   recovered ? "" : "  RECOVERY FAILED");
+            if (!recovered) failures++;
+        }
+        Serial.muted = true;
+    }
+
+    Serial.muted = false;
+    double average = totalFrames ? (double)totalBytes / totalFrames : 0;
+    printf("[Stream] %u frames, %.0f bytes/frame on average (%.1f%% of USB FS at %d fps), worst frame %u bytes "
+           "(%.1f%%), %d failures\n", totalFrames, average, 100 * average * fps / kUsbFullSpeedBytesPerSecond, fps,
+           worstFrameBytes, 100.0 * worstFrameBytes * fps / kUsbFullSpeedBytesPerSecond, failures);
+    return failures ? 1 : 0;
+}
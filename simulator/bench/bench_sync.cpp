@@ -0,0 +1,248 @@
+/**
+ * Frame sync benchmark.
+ *
+ * Runs a leader and three followers through FrameSync on simulated clocks:
+ * each rig's crystal is off by a few hundred ppm, its loop comes around every
+ * 1-4 ms (longer on frames it decodes), and the serial link delivers bytes at
+ * FRAME_SYNC_BAUD. The rigs play the same synthetic GIF, paced the way
+ * Bonnaroo.ino paces frames. One follower joins late, and halfway through
+ * the leader switches to another GIF.
+ *
+ *   ./led_bench sync [seconds] [--broadcast]
+ *
+ * --broadcast drops the followers' return path, as with the leader's TX wired
+ * to every RX: no pongs, so latency falls back to the wire time.
+ *
+ * The true sync error (leader's position minus each follower's, at the same
+ * instant) is sampled every millisecond once a follower has locked; it must
+ * stay within a frame. Also reports the drift estimates against the simulated
+ * crystals, and the real CPU time per update().
+ */
+
+#include "bench.h"
+
+#include <Arduino.h>
+#include <FrameSync.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+// delays of the two synthetic GIFs, in ms
+static const uint16_t kGifA[] = { 40, 40, 60, 40, 80, 40, 40, 100, 40, 40, 60, 70 };
+static const uint16_t kGifB[] = { 50, 50, 50, 50, 50, 50, 50, 50, 120, 30, 30, 30, 30, 30 };
+static const uint32_t kByte_us = 10 * 1000000 / FRAME_SYNC_BAUD + 1;
+// a follower counts as locked this long after it joined or switched GIF
+static const uint32_t kSettle_us = 3000000;
+
+static uint64_t g_now_us = 0;       // true time
+
+// One direction of a UART: bytes arrive kByte_us apart, after the ones already on the wire
+struct Wire {
+    std::deque<std::pair<uint64_t, uint8_t>> bytes;
+    uint64_t free_us = 0;
+
+    void send(const uint8_t* data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            free_us = std::max(free_us, g_now_us) + kByte_us;
+            bytes.push_back(std::make_pair(free_us, data[i]));
+        }
+    }
+    int available() {
+        int n = 0;
+        for (auto& b : bytes) {
+            if (b.first > g_now_us) break;
+            n++;
+        }
+        return n;
+    }
+    int read() {
+        uint8_t b = bytes.front().second;
+        bytes.pop_front();
+        return b;
+    }
+};
+
+struct Rig;
+static std::vector<Rig*> g_rigs;
+static bool g_broadcast = false;
+
+// Serial3 as seen by one rig: the leader writes to every follower's wire, followers to the leader's
+struct RigPort {
+    Rig* rig;
+    int available();
+    int read();
+    size_t write(const uint8_t* data, size_t length);
+};
+
+struct Rig {
+    const char* name;
+    double drift_ppm;               // how fast its crystal runs
+    uint32_t boot_us;               // its micros() at true time 0
+    uint64_t join_us;               // true time it powers up
+    FrameSyncRole role;
+    FrameSync sync;
+    Wire inbox;
+    RigPort port;
+
+    bool running = false;
+    uint64_t nextLoop_us = 0;
+    const uint16_t* delays = kGifA;
+    size_t frames = sizeof(kGifA) / 2;
+    uint16_t gif = 0;
+    bool firstFrame = true;
+    size_t frame = 0;
+    uint32_t cycle_ms = 0;
+    uint32_t lastFrame_ms = 0;
+    uint32_t frameDelay_ms = 0;
+    uint64_t locked_us = 0;         // true time its errors start counting
+
+    uint32_t micros() const { return boot_us + (uint32_t)(g_now_us * (1 + drift_ppm / 1e6)); }
+
+    // drawImageWithSD(), minus the pixels
+    bool play(uint32_t frameTime) {
+        if (firstFrame) {
+            firstFrame = false;
+            frame = 0;
+            cycle_ms = 0;
+            lastFrame_ms = frameTime;
+            frameDelay_ms = 0;
+            sync.gifStarted(gif, frameTime);
+        }
+        if (frameTime - lastFrame_ms <= frameDelay_ms) return false;
+        lastFrame_ms = frameTime;
+        frameDelay_ms = delays[frame];
+        sync.frameShown(frameTime, frameDelay_ms, cycle_ms);
+        if (++frame == frames) {
+            frame = 0;
+            cycle_ms = 0;
+            for (size_t i = 0; i < frames; i++) cycle_ms += delays[i];
+        }
+        return true;
+    }
+
+    void selectGif(uint16_t index) {
+        gif = index;
+        delays = index ? kGifB : kGifA;
+        frames = index ? sizeof(kGifB) / 2 : sizeof(kGifA) / 2;
+        firstFrame = true;
+    }
+};
+
+int RigPort::available() { return rig->inbox.available(); }
+int RigPort::read() { return rig->inbox.read(); }
+size_t RigPort::write(const uint8_t* data, size_t length) {
+    for (Rig* other : g_rigs) {
+        if (other == rig || !other->running) continue;
+        if (rig->role == FRAME_SYNC_LEADER || (other->role == FRAME_SYNC_LEADER && !g_broadcast)) {
+            other->inbox.send(data, length);
+        }
+    }
+    return length;
+}
+
+int benchSync(int argc, char* argv[]) {
+    int seconds = 60;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--broadcast") == 0) {
+            g_broadcast = true;
+        } else {
+            seconds = atoi(argv[i]);
+        }
+    }
+    const uint64_t end_us = (uint64_t)seconds * 1000000;
+    const uint64_t switch_us = end_us / 2;
+
+    Rig rigs[] = {
+        { "leader", 0, 123456789, 0, FRAME_SYNC_LEADER },
+        { "follower +150ppm", 150, 4000000000U, 0, FRAME_SYNC_FOLLOWER },
+        { "follower -220ppm", -220, 777, 300000, FRAME_SYNC_FOLLOWER },
+        { "late follower +60ppm", 60, 2000000000, 7100000, FRAME_SYNC_FOLLOWER },
+    };
+    const int count = sizeof(rigs) / sizeof(rigs[0]);
+    g_rigs.clear();
+    for (Rig& rig : rigs) {
+        rig.port.rig = &rig;
+        g_rigs.push_back(&rig);
+    }
+
+    std::vector<double> errorSum(count, 0), errorMax(count, 0);
+    std::vector<uint64_t> samples(count, 0);
+    uint64_t updateNs = 0, updates = 0;
+    srand(1);
+
+    printf("[Sync] %d s, %d rigs, %s link at %d baud\n", seconds, count, g_broadcast ? "broadcast" : "two-way",
+           FRAME_SYNC_BAUD);
+
+    for (g_now_us = 0; g_now_us < end_us; g_now_us += 100) {
+        if (g_now_us == switch_us) {
+            rigs[0].selectGif(1);
+        }
+
+        for (int r = 0; r < count; r++) {
+            Rig& rig = rigs[r];
+            if (!rig.running) {
+                if (g_now_us < rig.join_us) continue;
+                rig.running = true;
+                rig.sync.begin(rig.role, rig.micros());
+                rig.nextLoop_us = g_now_us;
+            }
+            if (g_now_us < rig.nextLoop_us) continue;
+
+            // the sketch's loop(): update the sync, follow the leader's GIF, then play
+            uint32_t now_us = rig.micros();
+            uint64_t start = benchNowNs();
+            rig.sync.update(rig.port, now_us);
+            updateNs += benchNowNs() - start;
+            updates++;
+            int32_t gif = rig.sync.leaderGif(now_us);
+            if (gif >= 0 && gif != rig.gif) {
+                rig.selectGif(gif);
+                rig.locked_us = g_now_us + kSettle_us;
+            } else if (!rig.locked_us && rig.sync.isFollowing(now_us)) {
+                rig.locked_us = g_now_us + kSettle_us;
+            }
+            bool decoded = rig.play(rig.sync.frameTime());
+            rig.nextLoop_us = g_now_us + 1000 + rand() % 3000 + (decoded ? 2000 + rand() % 6000 : 0);
+        }
+
+        // true error, wrapped to the cycle like the followers do
+        if (g_now_us % 1000) continue;
+        for (int r = 1; r < count; r++) {
+            Rig& rig = rigs[r];
+            bool switching = g_now_us >= switch_us && g_now_us < switch_us + kSettle_us;
+            if (!rig.running || !rig.locked_us || g_now_us < rig.locked_us || switching) continue;
+            double cycle = 0;
+            for (size_t i = 0; i < rig.frames; i++) cycle += rig.delays[i] * 1000.0;
+            double error = fmod((double)rigs[0].sync.position_us() - rig.sync.position_us() + cycle, cycle);
+            if (error > cycle / 2) error -= cycle;
+            errorSum[r] += fabs(error);
+            errorMax[r] = std::max(errorMax[r], fabs(error));
+            samples[r]++;
+        }
+    }
+
+    Serial.muted = false;
+    int failures = 0;
+    printf("%-22s %10s %10s %8s %8s %10s %8s\n", "rig", "avg err us", "max err us", "steps", "latency", "drift ppm",
+           "expected");
+    for (int r = 1; r < count; r++) {
+        const FrameSyncStats& stats = rigs[r].sync.getStats();
+        // the leader's crystal relative to this one's
+        double expected = (1e6 + rigs[0].drift_ppm) / (1e6 + rigs[r].drift_ppm) * 1e6 - 1e6;
+        // within a frame, and the drift estimate within 50 ppm
+        bool ok = samples[r] && errorMax[r] < 30000 && fabs(stats.drift_ppm - expected) < 50;
+        printf("%-22s %10.0f %10.0f %8u %8u %10d %8.0f%s\n", rigs[r].name, samples[r] ? errorSum[r] / samples[r] : 0,
+               errorMax[r], stats.steps, stats.latency_us, stats.drift_ppm, expected, ok ? "" : "  FAILED");
+        if (!ok) failures++;
+    }
+    printf("[Sync] %.2f us per update(), %lu updates, %d failures\n", updateNs / 1e3 / updates,
+           (unsigned long)updates, failures);
+    for (Rig& rig : rigs) {
+        rig.sync.printReport(Serial, rig.micros());
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,168 @@
+/**
+ * LED Frames - follows the frames a simulator run with --export writes to shared memory
+ *
+ *   ./led_frames [NAME] [--seconds N] [--raw FILE] [--ppm FILE]
+ *
+ * Waits for /dev/shm/NAME (led_frames if not given) and reads every frame
+ * as it's written, counting its lit pixels in place. Once a second it prints
+ * the frames read, the ones the ring moved past first, the ones written over
+ * while they were being read, how long after the refresh they were read and
+ * how much of the panel was lit. --raw appends each frame to FILE as raw rgb24, for example for
+ *
+ *   ffmpeg -f rawvideo -pix_fmt rgb24 -s 64x64 -r 60 -i FILE out.mp4
+ *
+ * and --ppm writes the last frame read to FILE when it stops: after
+ * --seconds, or when the simulator has gone. It's also the example of
+ * frame_export.h's reader.
+ */
+
+#include "../frame_export.h"
+
+#include <signal.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void onSignal(int) {
+    g_stop = 1;
+}
+
+static bool writePpm(const char* path, const uint8_t* pixels, int width, int height) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    fwrite(pixels, 3, width * height, file);
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::string name = "led_frames";
+    int seconds = 0;
+    const char* rawPath = nullptr;
+    const char* ppmPath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else if (arg == "--raw" && i + 1 < argc) {
+            rawPath = argv[++i];
+        } else if (arg == "--ppm" && i + 1 < argc) {
+            ppmPath = argv[++i];
+        } else if (arg == "--help" || arg == "-h" || arg[0] == '-') {
+            fprintf(stderr, "usage: %s [NAME] [--seconds N] [--raw FILE] [--ppm FILE]\n", argv[0]);
+            return arg[0] == '-' && arg != "--help" && arg != "-h" ? 1 : 0;
+        } else {
+            name = arg;
+        }
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    FrameExportReader reader;
+    printf("[Frames] waiting for /dev/shm%s\n", frameExportShmName(name).c_str());
+    while (!g_stop && !reader.open(name)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (g_stop) {
+        return 0;
+    }
+    int width = reader.width();
+    int height = reader.height();
+    printf("[Frames] %dx%d from pid %u, from frame %llu\n", width, height, reader.writerPid(),
+           (unsigned long long)reader.latest() + 1);
+
+    FILE* raw = nullptr;
+    if (rawPath && !(raw = fopen(rawPath, "wb"))) {
+        perror(rawPath);
+        return 1;
+    }
+    std::vector<uint8_t> frame(width * height * 3);
+    std::vector<uint8_t> last(frame.size());
+    bool haveLast = false;
+
+    uint64_t start_us = frameExportTime_us();
+    uint64_t report_us = start_us + 1000000;
+    uint64_t idleSince_us = start_us;
+    uint64_t frames = 0, torn = 0, reportFrames = 0, reportTorn = 0, reportMissed = 0;
+    uint64_t latencyTotal_us = 0, latencyMax_us = 0, litTotal = 0;
+
+    while (!g_stop) {
+        uint64_t now_us = frameExportTime_us();
+        if (seconds && now_us - start_us >= (uint64_t)seconds * 1000000) {
+            break;
+        }
+        if (now_us >= report_us) {
+            uint64_t missed = reader.missed() - reportMissed;
+            uint64_t read = frames - reportFrames;
+            printf("[Frames] %4llu read  %3llu missed  %3llu torn  latency %5.2f ms avg %5.2f max  lit %5.1f%%\n",
+                   (unsigned long long)read, (unsigned long long)missed, (unsigned long long)(torn - reportTorn),
+                   read ? latencyTotal_us / 1000.0 / read : 0.0, latencyMax_us / 1000.0,
+                   read ? litTotal * 100.0 / read / (width * height) : 0.0);
+            reportFrames = frames;
+            reportTorn = torn;
+            reportMissed = reader.missed();
+            latencyTotal_us = 0;
+            latencyMax_us = 0;
+            litTotal = 0;
+            report_us += 1000000;
+        }
+
+        FrameView view;
+        if (!reader.next(view)) {
+            // the simulator quit (or stopped refreshing) a second ago
+            if (now_us - idleSince_us > 1000000 && kill(reader.writerPid(), 0) != 0) {
+                printf("[Frames] the simulator has gone\n");
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        idleSince_us = now_us;
+
+        // in place, and only counted if the slot still held the frame after
+        int lit = 0;
+        for (int i = 0; i < width * height; i++) {
+            const uint8_t* pixel = &view.pixels[i * 3];
+            lit += (pixel[0] | pixel[1] | pixel[2]) != 0;
+        }
+        if (!reader.valid(view) || (raw && !reader.copy(view, frame.data()))) {
+            torn++;
+            continue;
+        }
+        frames++;
+        litTotal += lit;
+        uint64_t latency_us = frameExportTime_us() - view.time_us;
+        latencyTotal_us += latency_us;
+        latencyMax_us = std::max(latencyMax_us, latency_us);
+        if (raw) {
+            fwrite(frame.data(), 1, frame.size(), raw);
+        }
+        if (ppmPath && (raw || reader.copy(view, frame.data()))) {
+            last.swap(frame);
+            haveLast = true;
+        }
+    }
+
+    if (raw) {
+        fclose(raw);
+    }
+    if (ppmPath && haveLast) {
+        if (!writePpm(ppmPath, last.data(), width, height)) {
+            perror(ppmPath);
+            return 1;
+        }
+        printf("[Frames] last frame in %s\n", ppmPath);
+    }
+    printf("[Frames] %llu frames read, %llu missed, %llu torn\n", (unsigned long long)frames,
+           (unsigned long long)reader.missed(), (unsigned long long)torn);
+    return 0;
+}
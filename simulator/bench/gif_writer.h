@@ -0,0 +1,126 @@
+#ifndef GIF_WRITER_H
+#define GIF_WRITER_H
+
+/**
+ * Writes GIFs for the benches that need ones made to order: the fuzz
+ * corpus and the low colour GIFs of bench_palette.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+struct BitWriter {
+    std::vector<uint8_t> bytes;
+    uint32_t bits = 0;
+    int count = 0;
+
+    void put(uint32_t code, int size) {
+        bits |= code << count;
+        count += size;
+        while (count >= 8) {
+            bytes.push_back(bits & 0xff);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+    std::vector<uint8_t>& finish() {
+        if (count) bytes.push_back(bits & 0xff);
+        count = 0;
+        return bytes;
+    }
+};
+
+// GIF flavoured LZW; with deferClear the table is left full instead of being reset
+inline std::vector<uint8_t> lzwEncode(const std::vector<uint8_t>& pixels, int minCodeSize, bool deferClear = false) {
+    const uint32_t clear = 1 << minCodeSize;
+    BitWriter out;
+    std::map<uint32_t, uint32_t> table;
+    int codeSize = minCodeSize + 1;
+    uint32_t next = clear + 2;
+
+    out.put(clear, codeSize);
+    uint32_t prefix = pixels[0];
+    for (size_t i = 1; i < pixels.size(); i++) {
+        uint32_t key = (prefix << 8) | pixels[i];
+        auto found = table.find(key);
+        if (found != table.end()) {
+            prefix = found->second;
+            continue;
+        }
+        out.put(prefix, codeSize);
+        if (next < 4096) {
+            table[key] = next++;
+            if (next > (1u << codeSize) && codeSize < 12) codeSize++;
+        } else if (!deferClear) {
+            out.put(clear, codeSize);
+            table.clear();
+            codeSize = minCodeSize + 1;
+            next = clear + 2;
+        }
+        prefix = pixels[i];
+    }
+    out.put(prefix, codeSize);
+    out.put(clear + 1, codeSize);
+    return out.finish();
+}
+
+struct GifWriter {
+    std::vector<uint8_t> d;
+
+    void u16(int v) {
+        d.push_back(v & 0xff);
+        d.push_back((v >> 8) & 0xff);
+    }
+    // canvas with a global palette of 2^bits colours, RGB
+    void header(int width, int height, int bits, const uint8_t* palette) {
+        const char* magic = "GIF89a";
+        d.insert(d.end(), magic, magic + 6);
+        u16(width);
+        u16(height);
+        d.push_back(0xf0 | (bits - 1));
+        d.push_back(0);
+        d.push_back(0);
+        d.insert(d.end(), palette, palette + (3 << bits));
+    }
+    // ... of random colours
+    void header(int width, int height, int bits, std::mt19937& rng) {
+        std::vector<uint8_t> palette(3 << bits);
+        for (uint8_t& c : palette) c = rng() & 0xff;
+        header(width, height, bits, palette.data());
+    }
+    void delay(int centiseconds) {
+        const uint8_t gce[] = { '!', 0xf9, 4, 0, (uint8_t)centiseconds, (uint8_t)(centiseconds >> 8), 0, 0 };
+        d.insert(d.end(), gce, gce + sizeof(gce));
+    }
+    void comment(int blocks, int length) {
+        d.push_back('!');
+        d.push_back(0xfe);
+        for (int i = 0; i < blocks; i++) {
+            d.push_back(length);
+            d.insert(d.end(), length, 'x');
+        }
+        d.push_back(0);
+    }
+    // image descriptor and LZW data split into sub-blocks of up to blockSize bytes
+    void image(int x, int y, int width, int height, int minCodeSize, const std::vector<uint8_t>& lzw, int blockSize = 255) {
+        d.push_back(',');
+        u16(x);
+        u16(y);
+        u16(width);
+        u16(height);
+        d.push_back(0);
+        d.push_back(minCodeSize);
+        for (size_t i = 0; i < lzw.size(); i += blockSize) {
+            size_t n = std::min(lzw.size() - i, (size_t)blockSize);
+            d.push_back(n);
+            d.insert(d.end(), lzw.begin() + i, lzw.begin() + i + n);
+        }
+        d.push_back(0);
+    }
+    void trailer() { d.push_back(';'); }
+};
+
+#endif // GIF_WRITER_H
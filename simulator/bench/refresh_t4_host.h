@@ -0,0 +1,114 @@
+#ifndef REFRESH_T4_HOST_H
+#define REFRESH_T4_HOST_H
+
+/**
+ * Host stand-in for the Teensy 4 HUB75 refresh class, so the real
+ * SmartMatrixHub75Calc (MatrixTeensy4Hub75Calc_Impl.h) runs on the host.
+ *
+ * There is no FlexIO or DMA: one row buffer is handed to the calc at a time,
+ * and writeRowBuffer() copies it into rows[] where the caller can compare the
+ * bitplanes. isRowBufferFree() reports room for freeRows more rows, so the
+ * caller decides how many rows each matrixCalculations() call fills.
+ *
+ * The FlexIO pin offsets are the ones hardwareSetup() works out for the V5
+ * shield (R0 pin 6, G0 pin 9, B0 pin 10, R1 pin 12, G1 pin 11, B1 pin 13 on
+ * FlexIO2).
+ */
+
+#define SM_INTERNAL
+#define MATRIX_HARDWARE_H
+
+#ifndef FASTRUN
+#define FASTRUN
+#endif
+
+#include <SmartMatrix.h>
+
+#include <cstring>
+
+#define RGBDATA_SHIFTERS                4
+#define PAD_PIXELS                      (((-PIXELS_PER_LATCH) % SHIFTER_PIXELS + SHIFTER_PIXELS) % SHIFTER_PIXELS + SHIFTER_PIXELS)
+#define PIXELS_PER_WORD                 2
+#define SHIFTER_PIXELS                  (RGBDATA_SHIFTERS*PIXELS_PER_WORD)
+
+#define MIN_REFRESH_RATE                30
+#define MAX_REFRESH_RATE                1000
+
+template <int refreshDepth, int matrixWidth, int matrixHeight, unsigned char panelType, uint32_t optionFlags>
+class SmartMatrixRefreshT4 {
+    public:
+        struct __attribute__((packed, aligned(2))) timerpair {
+            uint16_t timer_oe;
+            uint16_t timer_period;
+        };
+
+        struct __attribute__((packed, aligned(4))) rowBitStruct {
+            uint16_t data[PAD_PIXELS + PIXELS_PER_LATCH];
+            uint32_t rowAddress;
+            timerpair timerValues __attribute__((aligned(2)));
+        };
+
+        struct rowDataStruct {
+            rowBitStruct rowbits[refreshDepth / COLOR_CHANNELS_PER_PIXEL];
+        };
+
+        struct flexPinConfigStruct {
+            union { uint8_t r0; uint8_t addx0; };
+            union { uint8_t g0; uint8_t addx1; };
+            union { uint8_t b0; uint8_t addx2; };
+            union { uint8_t r1; uint8_t addx3; };
+            union { uint8_t g1; uint8_t addx4; };
+            uint8_t b1;
+        };
+
+        typedef void (*matrix_underrun_callback)(void);
+        typedef void (*matrix_calc_callback)(bool initial);
+
+        static const int kRows = MATRIX_SCAN_MOD;
+
+        // the last row the calc wrote for each row address
+        static rowDataStruct rows[kRows];
+        static uint32_t freeRows;
+        static uint32_t rowsWritten;
+
+        static void begin(void) {}
+
+        static volatile rowDataStruct * getNextRowBufferPtr(void) {
+            memset(&rowBuffer, 0, sizeof(rowBuffer));
+            return &rowBuffer;
+        }
+        static void writeRowBuffer(uint8_t currentRow) {
+            memcpy(&rows[currentRow], &rowBuffer, sizeof(rowBuffer));
+            freeRows--;
+            rowsWritten++;
+        }
+        static void recoverFromDmaUnderrun(void) {}
+        static bool isRowBufferFree(void) { return freeRows > 0; }
+        static void setRefreshRate(uint16_t newRefreshRate) {}
+        static void setBrightness(uint8_t newBrightness) {}
+        static void setMatrixCalculationsCallback(matrix_calc_callback f) {}
+        static void setMatrixUnderrunCallback(matrix_underrun_callback f) {}
+        static const flexPinConfigStruct & getFlexPinConfig(void) {
+            static const flexPinConfigStruct config = { { 10 }, { 11 }, { 0 }, { 1 }, { 2 }, 3 };
+            return config;
+        }
+
+    private:
+        static rowDataStruct rowBuffer;
+};
+
+template <int refreshDepth, int matrixWidth, int matrixHeight, unsigned char panelType, uint32_t optionFlags>
+typename SmartMatrixRefreshT4<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags>::rowDataStruct
+    SmartMatrixRefreshT4<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags>::rows[kRows];
+template <int refreshDepth, int matrixWidth, int matrixHeight, unsigned char panelType, uint32_t optionFlags>
+typename SmartMatrixRefreshT4<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags>::rowDataStruct
+    SmartMatrixRefreshT4<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags>::rowBuffer;
+template <int refreshDepth, int matrixWidth, int matrixHeight, unsigned char panelType, uint32_t optionFlags>
+uint32_t SmartMatrixRefreshT4<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags>::freeRows = 0;
+template <int refreshDepth, int matrixWidth, int matrixHeight, unsigned char panelType, uint32_t optionFlags>
+uint32_t SmartMatrixRefreshT4<refreshDepth, matrixWidth, matrixHeight, panelType, optionFlags>::rowsWritten = 0;
+
+#include <MatrixTeensy4Hub75Calc.h>
+#include <MatrixTeensy4Hub75Calc_Impl.h>
+
+#endif // REFRESH_T4_HOST_H
@@ -0,0 +1,423 @@
+/**
+ * LED Show - compiles a show's cue list into the file the sketch plays from its SD card
+ *
+ *   ./led_show <show.txt> [-o show.bin] [--gifs DIR] [--lead MS] [--dump]
+ *
+ * A show is a line per cue, '#' starts a comment:
+ *
+ *   loop                                  start over at the end (otherwise GIFs play on as usual after it)
+ *   <time> gif <name> [fade <ms>]         switch GIFs, with a fade through black centred on time
+ *   <time> brightness <0-255> [over <ms>]
+ *   <time> pulse|flash <percent>          beat pulse and flash (AudioBeat.h)
+ *   <time> tempo on|off                   GIFs paced to the beat or not
+ *   <time> smooth <fps>                   frame interpolation rate, 0 for none (FrameInterpolator.h)
+ *   <time> end                            the show's length, required
+ *
+ * Times are seconds from the start of the show, as s, m:s or h:m:s, with a fraction if need be (1:05.250).  Cues
+ * come out sorted by time, those at the same time in the order they're written.
+ *
+ * Knowing the whole timeline, the compiler adds a prefetch cue --lead ms (SHOW_PREFETCH_LEAD_MS) before each GIF,
+ * or as close to it as leaves a second after the GIF before goes up: the sketch opens the GIF then and reads its
+ * first blocks between frames.  A looping show prefetches its first GIF before the end.  --gifs checks the GIFs
+ * are there, --dump prints the cues compiled.
+ *
+ * See Show.h for the format.
+ */
+
+#include <Arduino.h>
+#include <Show.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// A prefetch is left until this long after the GIF before goes up, clear of its first frames
+static const uint32_t kPrefetchSettle_ms = 1000;
+
+struct Cue {
+    ShowCue cue;
+    int line;
+    int order;                      // among cues at the same time
+};
+
+// Cues at the same time fire fades first, then the switch, then everything else
+static int rank(uint8_t type) {
+    switch (type) {
+        case SHOW_CUE_FADE_OUT: return 0;
+        case SHOW_CUE_GIF: return 1;
+        case SHOW_CUE_FADE_IN: return 2;
+        case SHOW_CUE_END: return 4;
+        default: return 3;
+    }
+}
+
+static const char* typeName(uint8_t type) {
+    switch (type) {
+        case SHOW_CUE_PREFETCH: return "prefetch";
+        case SHOW_CUE_GIF: return "gif";
+        case SHOW_CUE_BRIGHTNESS: return "brightness";
+        case SHOW_CUE_FADE_OUT: return "fade out";
+        case SHOW_CUE_FADE_IN: return "fade in";
+        case SHOW_CUE_EFFECT: return "effect";
+        case SHOW_CUE_END: return "end";
+        default: return "?";
+    }
+}
+
+// s, m:s or h:m:s with an optional fraction, -1 if it isn't a time
+static int64_t parseTime(const char* text) {
+    double total = 0;
+    const char* p = text;
+    for (;;) {
+        char* end;
+        double part = strtod(p, &end);
+        if (end == p || part < 0) {
+            return -1;
+        }
+        total = total * 60 + part;
+        if (*end == ':') {
+            p = end + 1;
+        } else if (*end == 0) {
+            break;
+        } else {
+            return -1;
+        }
+    }
+    return (int64_t)(total * 1000 + 0.5);
+}
+
+static bool parseNumber(const char* text, long low, long high, long& value) {
+    char* end;
+    value = strtol(text, &end, 10);
+    return *text && *end == 0 && value >= low && value <= high;
+}
+
+class Compiler {
+public:
+    bool loop = false;
+    uint32_t lead_ms = SHOW_PREFETCH_LEAD_MS;
+    std::vector<std::string> gifs;
+    std::vector<Cue> cues;
+    int64_t end_ms = -1;
+    int prefetches = 0, tooClose = 0;
+
+    bool parse(FILE* in, const char* path) {
+        char text[256];
+        int line = 0;
+        while (fgets(text, sizeof(text), in)) {
+            line++;
+            char* hash = strchr(text, '#');
+            if (hash) {
+                *hash = 0;
+            }
+            std::vector<char*> words;
+            for (char* word = strtok(text, " \t\r\n"); word; word = strtok(NULL, " \t\r\n")) {
+                words.push_back(word);
+            }
+            if (words.empty()) {
+                continue;
+            }
+            if (!parseLine(words, line)) {
+                fprintf(stderr, "[Show] %s:%d: %s\n", path, line, error.c_str());
+                return false;
+            }
+        }
+        if (end_ms < 0) {
+            fprintf(stderr, "[Show] %s: no end cue\n", path);
+            return false;
+        }
+        for (const Cue& c : cues) {
+            if (c.cue.time_ms > end_ms) {
+                fprintf(stderr, "[Show] %s:%d: after the end\n", path, c.line);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Fades split in two, prefetches added, everything sorted
+    void compile(void) {
+        sortCues();
+        std::vector<const ShowCue*> switches;
+        for (const Cue& c : cues) {
+            if (c.cue.type == SHOW_CUE_GIF) {
+                switches.push_back(&c.cue);
+            }
+        }
+        std::vector<Cue> hints;
+        for (size_t i = 1; i < switches.size(); i++) {
+            addPrefetch(hints, *switches[i], switches[i - 1]->time_ms, switches[i - 1]->gif, switches[i]->time_ms);
+        }
+        // a loop's first GIF is next after its last
+        if (loop && switches.size() > 1) {
+            const ShowCue& first = *switches.front();
+            const ShowCue& last = *switches.back();
+            addPrefetch(hints, first, last.time_ms, last.gif, (uint32_t)end_ms + first.time_ms);
+        }
+        for (Cue& hint : hints) {
+            if (hint.cue.time_ms >= end_ms) {
+                hint.cue.time_ms -= (uint32_t)end_ms;
+            }
+            cues.push_back(hint);
+        }
+        sortCues();
+    }
+
+    std::vector<uint8_t> write(void) const {
+        ShowHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = SHOW_MAGIC;
+        h.version = SHOW_VERSION;
+        h.flags = loop ? SHOW_LOOP : 0;
+        h.gifCount = (uint16_t)gifs.size();
+        h.cueBytes = SHOW_CUE_BYTES;
+        h.cueCount = (uint32_t)cues.size();
+        h.length_ms = (uint32_t)end_ms;
+        h.cuesOffset = SHOW_HEADER_BYTES + (uint32_t)gifs.size() * SHOW_NAME_BYTES;
+
+        std::vector<uint8_t> out(h.cuesOffset + cues.size() * SHOW_CUE_BYTES, 0);
+        memcpy(&out[0], &h, sizeof(h));
+        for (size_t i = 0; i < gifs.size(); i++) {
+            memcpy(&out[SHOW_HEADER_BYTES + i * SHOW_NAME_BYTES], gifs[i].c_str(), gifs[i].size());
+        }
+        for (size_t i = 0; i < cues.size(); i++) {
+            memcpy(&out[h.cuesOffset + i * SHOW_CUE_BYTES], &cues[i].cue, SHOW_CUE_BYTES);
+        }
+        return out;
+    }
+
+    void dump(FILE* out) const {
+        for (const Cue& c : cues) {
+            const ShowCue& q = c.cue;
+            fprintf(out, "%4u:%06.3f  %-10s", q.time_ms / 60000, q.time_ms % 60000 / 1000.0, typeName(q.type));
+            if (q.type == SHOW_CUE_GIF || q.type == SHOW_CUE_PREFETCH) {
+                fprintf(out, " %s", gifs[q.gif].c_str());
+            } else if (q.type == SHOW_CUE_BRIGHTNESS) {
+                fprintf(out, " %u over %u ms", q.value, q.ms);
+            } else if (q.type == SHOW_CUE_FADE_OUT || q.type == SHOW_CUE_FADE_IN) {
+                fprintf(out, " over %u ms", q.ms);
+            } else if (q.type == SHOW_CUE_EFFECT) {
+                static const char* effects[] = { "?", "pulse", "flash", "tempo", "smooth" };
+                fprintf(out, " %s %u", effects[q.effect < 5 ? q.effect : 0], q.value);
+            }
+            fprintf(out, "\n");
+        }
+    }
+
+private:
+    std::string error;
+
+    bool fail(const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    void add(uint32_t time_ms, uint8_t type, int line, uint16_t gif = 0, uint16_t ms = 0, uint16_t value = 0,
+             uint8_t effect = 0) {
+        Cue c;
+        memset(&c.cue, 0, sizeof(c.cue));
+        c.cue.time_ms = time_ms;
+        c.cue.type = type;
+        c.cue.gif = gif;
+        c.cue.ms = ms;
+        c.cue.value = value;
+        c.cue.effect = effect;
+        c.line = line;
+        c.order = (int)cues.size();
+        cues.push_back(c);
+    }
+
+    bool parseLine(const std::vector<char*>& words, int line) {
+        if (strcmp(words[0], "loop") == 0 && words.size() == 1) {
+            loop = true;
+            return true;
+        }
+        int64_t time = parseTime(words[0]);
+        if (time < 0 || time > UINT32_MAX / 2) {
+            return fail(std::string("not a time: ") + words[0]);
+        }
+        if (words.size() < 2) {
+            return fail("no cue after the time");
+        }
+        const char* what = words[1];
+        uint32_t t = (uint32_t)time;
+        long value, ms;
+
+        if (strcmp(what, "gif") == 0 && (words.size() == 3 || (words.size() == 5 && strcmp(words[3], "fade") == 0))) {
+            if (strlen(words[2]) >= SHOW_NAME_BYTES) {
+                return fail("GIF names can be up to " + std::to_string(SHOW_NAME_BYTES - 1) + " characters");
+            }
+            uint16_t gif = gifIndex(words[2]);
+            if (gif >= SHOW_MAX_GIFS) {
+                return fail("more than " + std::to_string(SHOW_MAX_GIFS) + " GIFs");
+            }
+            ms = 0;
+            if (words.size() == 5 && !parseNumber(words[4], 1, 65535, ms)) {
+                return fail("fade is 1 to 65535 ms");
+            }
+            if (ms) {
+                // centred on the switch, black at the moment the GIF changes
+                uint32_t half = (uint32_t)ms / 2;
+                add(t >= half ? t - half : 0, SHOW_CUE_FADE_OUT, line, 0, (uint16_t)std::min(half, t));
+                add(t, SHOW_CUE_GIF, line, gif);
+                add(t, SHOW_CUE_FADE_IN, line, 0, (uint16_t)(ms - half));
+            } else {
+                add(t, SHOW_CUE_GIF, line, gif);
+            }
+        } else if (strcmp(what, "brightness") == 0 &&
+                   (words.size() == 3 || (words.size() == 5 && strcmp(words[3], "over") == 0))) {
+            ms = 0;
+            if (!parseNumber(words[2], 0, 255, value) ||
+                (words.size() == 5 && !parseNumber(words[4], 0, 65535, ms))) {
+                return fail("brightness is 0 to 255, over 0 to 65535 ms");
+            }
+            add(t, SHOW_CUE_BRIGHTNESS, line, 0, (uint16_t)ms, (uint16_t)value);
+        } else if ((strcmp(what, "pulse") == 0 || strcmp(what, "flash") == 0) && words.size() == 3) {
+            if (!parseNumber(words[2], 0, 100, value)) {
+                return fail(std::string(what) + " is 0 to 100%");
+            }
+            add(t, SHOW_CUE_EFFECT, line, 0, 0, (uint16_t)value,
+                strcmp(what, "pulse") == 0 ? SHOW_EFFECT_PULSE : SHOW_EFFECT_FLASH);
+        } else if (strcmp(what, "tempo") == 0 && words.size() == 3 &&
+                   (strcmp(words[2], "on") == 0 || strcmp(words[2], "off") == 0)) {
+            add(t, SHOW_CUE_EFFECT, line, 0, 0, strcmp(words[2], "on") == 0, SHOW_EFFECT_TEMPO);
+        } else if (strcmp(what, "smooth") == 0 && words.size() == 3) {
+            if (!parseNumber(words[2], 0, 255, value)) {
+                return fail("smooth is 0 to 255 fps");
+            }
+            add(t, SHOW_CUE_EFFECT, line, 0, 0, (uint16_t)value, SHOW_EFFECT_SMOOTH);
+        } else if (strcmp(what, "end") == 0 && words.size() == 2) {
+            if (end_ms >= 0) {
+                return fail("a second end");
+            }
+            end_ms = t;
+            add(t, SHOW_CUE_END, line);
+        } else {
+            return fail(std::string("can't make out the ") + what + " cue");
+        }
+        return true;
+    }
+
+    uint16_t gifIndex(const char* name) {
+        for (size_t i = 0; i < gifs.size(); i++) {
+            if (strcasecmp(gifs[i].c_str(), name) == 0) {
+                return (uint16_t)i;
+            }
+        }
+        gifs.push_back(name);
+        return (uint16_t)(gifs.size() - 1);
+    }
+
+    // A prefetch of next, due at due_ms, after the GIF before went up at before_ms
+    void addPrefetch(std::vector<Cue>& hints, const ShowCue& next, uint32_t before_ms, uint16_t beforeGif,
+                     uint32_t due_ms) {
+        if (next.gif == beforeGif) {
+            return;
+        }
+        uint32_t at = std::max<int64_t>((int64_t)due_ms - lead_ms, (int64_t)before_ms + kPrefetchSettle_ms);
+        if (at >= due_ms) {
+            tooClose++;
+            return;
+        }
+        Cue c;
+        memset(&c.cue, 0, sizeof(c.cue));
+        c.cue.time_ms = at;
+        c.cue.type = SHOW_CUE_PREFETCH;
+        c.cue.gif = next.gif;
+        c.line = 0;
+        c.order = (int)(cues.size() + hints.size());
+        hints.push_back(c);
+        prefetches++;
+    }
+
+    void sortCues(void) {
+        std::stable_sort(cues.begin(), cues.end(), [](const Cue& a, const Cue& b) {
+            if (a.cue.time_ms != b.cue.time_ms) {
+                return a.cue.time_ms < b.cue.time_ms;
+            }
+            if (rank(a.cue.type) != rank(b.cue.type)) {
+                return rank(a.cue.type) < rank(b.cue.type);
+            }
+            return a.order < b.order;
+        });
+    }
+};
+
+int main(int argc, char* argv[]) {
+    const char* path = nullptr;
+    const char* outPath = "show.bin";
+    const char* gifDir = nullptr;
+    bool dump = false;
+    Compiler compiler;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (strcmp(argv[i], "--gifs") == 0 && i + 1 < argc) {
+            gifDir = argv[++i];
+        } else if (strcmp(argv[i], "--lead") == 0 && i + 1 < argc) {
+            compiler.lead_ms = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dump") == 0) {
+            dump = true;
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s <show.txt> [-o show.bin] [--gifs DIR] [--lead MS] [--dump]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "[Show] can't open %s\n", path);
+        return 1;
+    }
+    bool ok = compiler.parse(in, path);
+    fclose(in);
+    if (!ok) {
+        return 1;
+    }
+    if (gifDir) {
+        int missing = 0;
+        for (const std::string& gif : compiler.gifs) {
+            std::string gifPath = std::string(gifDir) + "/" + gif;
+            FILE* f = fopen(gifPath.c_str(), "rb");
+            if (!f) {
+                fprintf(stderr, "[Show] %s isn't in %s\n", gif.c_str(), gifDir);
+                missing++;
+            } else {
+                fclose(f);
+            }
+        }
+        if (missing) {
+            return 1;
+        }
+    }
+
+    compiler.compile();
+    std::vector<uint8_t> data = compiler.write();
+    FILE* out = fopen(outPath, "wb");
+    if (!out || fwrite(data.data(), 1, data.size(), out) != data.size()) {
+        fprintf(stderr, "[Show] can't write %s\n", outPath);
+        if (out) {
+            fclose(out);
+        }
+        return 1;
+    }
+    fclose(out);
+
+    if (dump) {
+        compiler.dump(stdout);
+    }
+    fprintf(stderr, "[Show] %s: %zu cues, %zu GIFs, %.3f s%s, %d prefetches %u ms ahead (%d GIFs too soon after "
+                    "the one before), %zu bytes\n", outPath, compiler.cues.size(), compiler.gifs.size(),
+            compiler.end_ms / 1000.0, compiler.loop ? " looped" : "", compiler.prefetches, compiler.lead_ms,
+            compiler.tooClose, data.size());
+    return 0;
+}
@@ -0,0 +1,296 @@
+/**
+ * LED Stream - sends a GIF to the panel (or the simulator) as a live frame stream
+ *
+ *   ./led_stream <gif> <device> [--fps N] [--seconds N]
+ *
+ * The device is the panel's serial port (e.g. /dev/ttyACM0), the pty the
+ * simulator printed for --stream pty, or the UNIX socket it is listening on
+ * with --stream <path>. Frames go out at the GIF's own timing unless --fps is
+ * given, as fast as the panel acks them at most, and the GIF loops until
+ * --seconds have passed or the program is interrupted.
+ *
+ * See FrameStream.h for the protocol.
+ */
+
+#include <Arduino.h>
+#include <MatrixCommon.h>
+#include <GifDecoder.h>
+#include <FrameStream.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+SerialClass Serial;
+
+static const int kPanelWidth = 64;
+static const int kPanelHeight = 64;
+
+typedef FrameStreamEncoder<kPanelWidth, kPanelHeight> PanelEncoder;
+typedef GifDecoder<320, 320, 12, true> StreamDecoder;
+
+static rgb24 g_canvas[kPanelWidth * kPanelHeight];
+static bool g_frameReady = false;
+
+static void screenClear() {
+    memset((void*)g_canvas, 0, sizeof(g_canvas));
+}
+
+static void updateScreen() {
+    g_frameReady = true;
+}
+
+static void drawPixel(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue) {
+    if (x < 0 || y < 0 || x >= kPanelWidth || y >= kPanelHeight) return;
+    g_canvas[y * kPanelWidth + x] = rgb24(red, green, blue);
+}
+
+// Same mapping as SMLayerBackground::drawPixel()
+static void toBufferOrder(const rgb24* canvas, rgb24* native, uint8_t rotation) {
+    for (int y = 0; y < kPanelHeight; y++) {
+        for (int x = 0; x < kPanelWidth; x++) {
+            int hwx = x, hwy = y;
+            if (rotation == rotation180) {
+                hwx = (kPanelWidth - 1) - x;
+                hwy = (kPanelHeight - 1) - y;
+            } else if (rotation == rotation90) {
+                hwx = (kPanelWidth - 1) - y;
+                hwy = x;
+            } else if (rotation == rotation270) {
+                hwx = y;
+                hwy = (kPanelHeight - 1) - x;
+            }
+            native[hwy * kPanelWidth + hwx] = canvas[y * kPanelWidth + x];
+        }
+    }
+}
+
+static int openDevice(const char* path) {
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            perror("connect");
+            return -1;
+        }
+        return fd;
+    }
+
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    struct termios tty;
+    if (tcgetattr(fd, &tty) == 0) {
+        cfmakeraw(&tty);
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+    return fd;
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t length) {
+    while (length) {
+        ssize_t n = write(fd, data, length);
+        if (n <= 0) return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+// Packets from the panel, anything else on the port (its Serial prints) is skipped
+struct ReplyReader {
+    std::vector<uint8_t> buffer;
+
+    // Returns the type of the next complete packet, with its payload, or 0 if there isn't one yet
+    uint8_t next(std::vector<uint8_t>& payload) {
+        while (!buffer.empty()) {
+            if (buffer[0] != FRAME_STREAM_MAGIC) {
+                buffer.erase(buffer.begin());
+                continue;
+            }
+            if (buffer.size() < FRAME_STREAM_HEADER_BYTES) return 0;
+            uint32_t length = buffer[2] | buffer[3] << 8;
+            if (length > 16) {
+                buffer.erase(buffer.begin());
+                continue;
+            }
+            if (buffer.size() < FRAME_STREAM_HEADER_BYTES + length + 1) return 0;
+            uint8_t sum = 0;
+            for (uint32_t i = 1; i < FRAME_STREAM_HEADER_BYTES + length; i++) sum += buffer[i];
+            uint8_t type = buffer[1];
+            bool good = sum == buffer[FRAME_STREAM_HEADER_BYTES + length];
+            payload.assign(buffer.begin() + FRAME_STREAM_HEADER_BYTES, buffer.begin() + FRAME_STREAM_HEADER_BYTES + length);
+            buffer.erase(buffer.begin(), buffer.begin() + (good ? FRAME_STREAM_HEADER_BYTES + length + 1 : 1));
+            if (good) return type;
+        }
+        return 0;
+    }
+
+    // Waits up to timeout_ms for more bytes
+    bool fill(int fd, int timeout_ms) {
+        struct pollfd p = { fd, POLLIN, 0 };
+        if (::poll(&p, 1, timeout_ms) <= 0) return false;
+        uint8_t chunk[1024];
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) return false;
+        buffer.insert(buffer.end(), chunk, chunk + n);
+        return true;
+    }
+};
+
+static uint32_t readNumber(const std::vector<uint8_t>& payload) {
+    return payload.size() < 4 ? 0 : payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t)payload[3] << 24;
+}
+
+int main(int argc, char* argv[]) {
+    setbuf(stdout, NULL);
+
+    const char* gifPath = nullptr;
+    const char* devicePath = nullptr;
+    int fps = 0;
+    int seconds = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else if (!gifPath) {
+            gifPath = argv[i];
+        } else {
+            devicePath = argv[i];
+        }
+    }
+    if (!gifPath || !devicePath) {
+        printf("Usage: %s <gif> <device> [--fps N] [--seconds N]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* f = fopen(gifPath, "rb");
+    if (!f) {
+        printf("[Stream] Cannot open %s\n", gifPath);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(f);
+
+    int fd = openDevice(devicePath);
+    if (fd < 0) return 1;
+
+    // hello until the panel answers with its size and rotation
+    static uint8_t packets[PanelEncoder::MAX_FRAME_PACKETS_BYTES];
+    ReplyReader reader;
+    std::vector<uint8_t> payload;
+    uint8_t rotation = 0, window = 1;
+    bool connected = false;
+    for (int attempt = 0; attempt < 10 && !connected; attempt++) {
+        uint32_t length = PanelEncoder::writePacket(packets, FRAME_STREAM_HELLO, nullptr, 0);
+        writeAll(fd, packets, length);
+        unsigned long start = millis();
+        while (!connected && millis() - start < 500) {
+            reader.fill(fd, 50);
+            uint8_t type;
+            while ((type = reader.next(payload)) != 0) {
+                if (type == FRAME_STREAM_HELLO && payload.size() >= 6) {
+                    uint16_t width = payload[0] | payload[1] << 8;
+                    uint16_t height = payload[2] | payload[3] << 8;
+                    rotation = payload[4];
+                    window = payload[5];
+                    if (width != kPanelWidth || height != kPanelHeight) {
+                        printf("[Stream] Panel is %ux%u, led_stream only sends %dx%d\n", width, height, kPanelWidth,
+                               kPanelHeight);
+                        return 1;
+                    }
+                    connected = true;
+                }
+            }
+        }
+    }
+    if (!connected) {
+        printf("[Stream] No reply from %s\n", devicePath);
+        return 1;
+    }
+    printf("[Stream] Connected to a %dx%d panel, rotation %u, window %u\n", kPanelWidth, kPanelHeight, rotation,
+           window);
+
+    Serial.muted = true;
+    std::vector<uint8_t> block(128 * 1024);
+    GifArena arena(block.data(), block.size());
+    StreamDecoder decoder(arena);
+    decoder.setScreenClearCallback(screenClear);
+    decoder.setUpdateScreenCallback(updateScreen);
+    decoder.setDrawPixelCallback(drawPixel);
+    if (decoder.startDecoding(data.data(), (int)data.size()) < 0) {
+        printf("[Stream] Cannot decode %s\n", gifPath);
+        return 1;
+    }
+
+    static PanelEncoder encoder;
+    static rgb24 native[kPanelWidth * kPanelHeight];
+    uint32_t sent = 0, acked = 0, naks = 0;
+    uint64_t bytes = 0;
+    unsigned long start = millis();
+    unsigned long nextFrameAt = start;
+
+    while (!seconds || millis() - start < (unsigned long)seconds * 1000) {
+        g_frameReady = false;
+        int result = decoder.decodeFrame(false);
+        if (result < 0) {
+            printf("[Stream] Decoder error %d\n", result);
+            break;
+        }
+        if (!g_frameReady) continue;
+
+        // wait for the frame's turn and for room in the window, reading acks and naks meanwhile
+        int delay = fps ? 1000 / fps : decoder.getFrameDelay_ms();
+        while ((long)(nextFrameAt - millis()) > 0 || sent - acked >= window) {
+            long wait = (long)(nextFrameAt - millis());
+            reader.fill(fd, sent - acked >= window ? 100 : (int)std::max(wait, 1L));
+            uint8_t type;
+            while ((type = reader.next(payload)) != 0) {
+                if (type == FRAME_STREAM_ACK) {
+                    acked++;
+                } else if (type == FRAME_STREAM_NAK) {
+                    // the frame won't be acked, count it and start over from a key frame
+                    acked++;
+                    naks++;
+                    encoder.requestKeyFrame();
+                    printf("[Stream] Frame %u dropped by the panel\n", readNumber(payload));
+                }
+            }
+        }
+        nextFrameAt += delay;
+        if ((long)(millis() - nextFrameAt) > 1000) nextFrameAt = millis();
+
+        toBufferOrder(g_canvas, native, rotation);
+        uint32_t length = encoder.encode(native, sent, packets);
+        if (!writeAll(fd, packets, length)) {
+            printf("[Stream] Device closed\n");
+            break;
+        }
+        sent++;
+        bytes += length;
+    }
+
+    double elapsed = (millis() - start) / 1000.0;
+    printf("[Stream] %u frames (%u key) in %.1f s, %.1f fps, %.0f bytes/frame, %.1f KB/s, %u dropped\n", sent,
+           encoder.getKeyFrames(), elapsed, sent / elapsed, sent ? (double)bytes / sent : 0.0,
+           bytes / 1024.0 / elapsed, naks);
+    close(fd);
+    return 0;
+}
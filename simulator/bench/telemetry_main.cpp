@@ -0,0 +1,222 @@
+/**
+ * LED Telemetry - reads back the black box a rig (or the simulator) keeps on its SD card
+ *
+ *   ./led_telemetry <telemetry.bin> [--csv FILE] [--svg FILE] [--boot N]
+ *
+ * Puts the ring's blocks back in order, checks their CRCs and writes every
+ * record as CSV (to stdout without --csv), one row per TELEMETRY_PERIOD_MS
+ * with the boot it's from. --svg plots frame rate, worst lateness, worst
+ * decode and current over time for one boot, the last unless --boot picks
+ * another (1 is the oldest still in the ring). A summary of each boot goes
+ * to stderr: how long it ran, its stutters, the worst frame and the peak
+ * current.
+ *
+ * See Telemetry.h for the format.
+ */
+
+#include <Arduino.h>
+#include <Telemetry.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Block {
+    TelemetryHeader header;
+    TelemetryRecord records[TELEMETRY_BLOCK_RECORDS];
+};
+
+struct Boot {
+    uint32_t bootSequence;
+    std::vector<TelemetryRecord> records;
+};
+
+static bool readBlocks(const char* path, std::vector<Block>& blocks, uint32_t& bad) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "[Telemetry] can't open %s\n", path);
+        return false;
+    }
+    uint8_t data[TELEMETRY_BLOCK_BYTES];
+    bad = 0;
+    while (fread(data, 1, sizeof(data), file) == sizeof(data)) {
+        Block block;
+        memcpy(&block.header, data, sizeof(block.header));
+        if (block.header.magic != TELEMETRY_MAGIC) {
+            continue;   // never written
+        }
+        uint32_t crc = block.header.crc;
+        memset(data + offsetof(TelemetryHeader, crc), 0, sizeof(crc));
+        if (Telemetry::crc32(data, sizeof(data)) != crc || block.header.version != TELEMETRY_VERSION ||
+            block.header.recordBytes != TELEMETRY_RECORD_BYTES || block.header.count > TELEMETRY_BLOCK_RECORDS) {
+            bad++;
+            continue;
+        }
+        memcpy(block.records, data + TELEMETRY_HEADER_BYTES, sizeof(block.records));
+        blocks.push_back(block);
+    }
+    fclose(file);
+    std::sort(blocks.begin(), blocks.end(),
+              [](const Block& a, const Block& b) { return a.header.sequence < b.header.sequence; });
+    return true;
+}
+
+static double fps(const TelemetryRecord& r) {
+    return r.frames * 1000.0 / TELEMETRY_PERIOD_MS;
+}
+
+static void writeCsv(FILE* out, const std::vector<Boot>& boots) {
+    fprintf(out, "boot,time_ms,loops,frames,fps,loop_max_us,decode_avg_us,decode_max_us,swap_max_us,late_avg_us,"
+                 "late_max_us,stutters,gif,brightness,current_ma,streaming,following,beat_locked,swap_pending,dropped\n");
+    for (size_t b = 0; b < boots.size(); b++) {
+        for (const TelemetryRecord& r : boots[b].records) {
+            fprintf(out, "%zu,%u,%u,%u,%.1f,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%d,%d,%d,%u\n", b + 1, r.time_ms, r.loops,
+                    r.frames, fps(r), r.loopMax_us, r.decodeAvg_us, r.decodeMax_us, r.swapMax_us, r.lateAvg_us,
+                    r.lateMax_us, r.stutters, r.gif, r.brightness, r.current_mA, !!(r.flags & TELEMETRY_STREAMING),
+                    !!(r.flags & TELEMETRY_FOLLOWING), !!(r.flags & TELEMETRY_BEAT_LOCKED),
+                    !!(r.flags & TELEMETRY_SWAP_PENDING), r.dropped);
+        }
+    }
+}
+
+struct Series {
+    const char* name;
+    const char* unit;
+    double (*value)(const TelemetryRecord&);
+};
+
+static const Series kSeries[] = {
+    { "frame rate", "fps", fps },
+    { "worst lateness", "ms", [](const TelemetryRecord& r) { return r.lateMax_us / 1000.0; } },
+    { "worst decode", "ms", [](const TelemetryRecord& r) { return r.decodeMax_us / 1000.0; } },
+    { "current", "mA", [](const TelemetryRecord& r) { return (double)r.current_mA; } },
+};
+
+// One chart per series, stacked, over the boot's time
+static bool writeSvg(const char* path, const Boot& boot, size_t number) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "[Telemetry] can't write %s\n", path);
+        return false;
+    }
+    const int width = 1000, chartHeight = 150, left = 70, right = 20, top = 30, gap = 40;
+    const int count = sizeof(kSeries) / sizeof(kSeries[0]);
+    const int height = top + count * (chartHeight + gap);
+    double t0 = boot.records.front().time_ms / 1000.0;
+    double t1 = std::max(boot.records.back().time_ms / 1000.0, t0 + 1);
+    auto x = [&](double t) { return left + (t - t0) / (t1 - t0) * (width - left - right); };
+
+    fprintf(out, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" font-family=\"sans-serif\" "
+                 "font-size=\"12\">\n<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>\n", width, height);
+    fprintf(out, "<text x=\"%d\" y=\"18\" font-size=\"14\">boot %zu, %.0f-%.0f s</text>\n", left, number, t0, t1);
+    for (int s = 0; s < count; s++) {
+        const Series& series = kSeries[s];
+        double high = 0;
+        for (const TelemetryRecord& r : boot.records) {
+            high = std::max(high, series.value(r));
+        }
+        high = high > 0 ? high * 1.1 : 1;
+        int y0 = top + s * (chartHeight + gap);
+        auto y = [&](double v) { return y0 + chartHeight - v / high * chartHeight; };
+
+        fprintf(out, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"none\" stroke=\"#999\"/>\n", left, y0,
+                width - left - right, chartHeight);
+        fprintf(out, "<text x=\"%d\" y=\"%d\">%s</text>\n", left, y0 - 6, series.name);
+        fprintf(out, "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">%.0f %s</text>\n", left - 6, y0 + 12, high,
+                series.unit);
+        fprintf(out, "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">0</text>\n", left - 6, y0 + chartHeight);
+        fprintf(out, "<polyline fill=\"none\" stroke=\"#c33\" stroke-width=\"1\" points=\"");
+        for (const TelemetryRecord& r : boot.records) {
+            fprintf(out, "%.1f,%.1f ", x(r.time_ms / 1000.0), y(series.value(r)));
+        }
+        fprintf(out, "\"/>\n");
+    }
+    fprintf(out, "<text x=\"%d\" y=\"%d\" text-anchor=\"end\">%.0f s</text>\n", width - right, height - gap + 16, t1);
+    fprintf(out, "</svg>\n");
+    fclose(out);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = nullptr;
+    const char* csvPath = nullptr;
+    const char* svgPath = nullptr;
+    int bootNumber = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csvPath = argv[++i];
+        } else if (strcmp(argv[i], "--svg") == 0 && i + 1 < argc) {
+            svgPath = argv[++i];
+        } else if (strcmp(argv[i], "--boot") == 0 && i + 1 < argc) {
+            bootNumber = atoi(argv[++i]);
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s <telemetry.bin> [--csv FILE] [--svg FILE] [--boot N]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Block> blocks;
+    uint32_t bad = 0;
+    if (!readBlocks(path, blocks, bad)) {
+        return 1;
+    }
+    std::vector<Boot> boots;
+    for (const Block& block : blocks) {
+        if (boots.empty() || boots.back().bootSequence != block.header.bootSequence) {
+            boots.push_back({ block.header.bootSequence, {} });
+        }
+        boots.back().records.insert(boots.back().records.end(), block.records, block.records + block.header.count);
+    }
+    fprintf(stderr, "[Telemetry] %s: %zu blocks, %u bad, %zu boots\n", path, blocks.size(), bad, boots.size());
+
+    for (size_t b = 0; b < boots.size(); b++) {
+        const std::vector<TelemetryRecord>& records = boots[b].records;
+        uint32_t stutters = 0, dropped = 0, peak_mA = 0;
+        const TelemetryRecord* worst = &records[0];
+        for (const TelemetryRecord& r : records) {
+            stutters += r.stutters;
+            dropped += r.dropped;
+            peak_mA = std::max<uint32_t>(peak_mA, r.current_mA);
+            if (r.lateMax_us > worst->lateMax_us) {
+                worst = &r;
+            }
+        }
+        fprintf(stderr, "  boot %zu: %.1f-%.1f s, %zu records, %u stutters, worst frame %.1f ms late at %.1f s, "
+                        "peak %u mA, %u records dropped\n", b + 1, records.front().time_ms / 1000.0,
+                records.back().time_ms / 1000.0, records.size(), stutters, worst->lateMax_us / 1000.0,
+                worst->time_ms / 1000.0, peak_mA, dropped);
+    }
+
+    FILE* csv = csvPath ? fopen(csvPath, "w") : stdout;
+    if (!csv) {
+        fprintf(stderr, "[Telemetry] can't write %s\n", csvPath);
+        return 1;
+    }
+    writeCsv(csv, boots);
+    if (csvPath) {
+        fclose(csv);
+    }
+
+    if (svgPath) {
+        if (boots.empty()) {
+            fprintf(stderr, "[Telemetry] nothing to plot\n");
+            return 1;
+        }
+        if (bootNumber < 1 || bootNumber > (int)boots.size()) {
+            bootNumber = (int)boots.size();
+        }
+        if (!writeSvg(svgPath, boots[bootNumber - 1], bootNumber)) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,334 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+/**
+ * The simulator's frames in shared memory, for tools that want them as they're shown (a test runner, a recorder, a
+ * second viewer) without screenshots of the window. --export NAME puts them in /dev/shm/NAME, led_frames reads them.
+ *
+ * The shared memory is a FrameExportHeader and a ring of FRAME_EXPORT_SLOTS slots, each a FrameExportSlot (its
+ * frame number, when it was refreshed and its size) and the frame's rgb24 pixels, row by row. The simulator writes
+ * every refresh into the next slot round the ring with one memcpy, and never waits for a reader: each slot is a
+ * seqlock, its sequence odd while the slot is being written, so a reader knows a frame it copied (or used in place)
+ * wasn't overwritten under it if the sequence is the same even number after as before. A reader that falls more
+ * than the ring behind misses frames, it can't hold the simulator up.
+ *
+ * Both ends are here, header only, so a tool needs nothing else to read the frames:
+ *
+ *   FrameExportReader reader;
+ *   if (reader.open("led_frames")) {
+ *       FrameView view;
+ *       while (...) {
+ *           if (!reader.next(view)) { sleep a little; continue; }
+ *           ... use view.pixels in place ...
+ *           if (!reader.valid(view)) { it was overwritten meanwhile, drop what came of it }
+ *       }
+ *   }
+ *
+ * Frame numbers start at 1 each time the simulator starts. Times are std::chrono::steady_clock in microseconds,
+ * the host's monotonic clock, so a reader can compare them with its own.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#define FRAME_EXPORT_MAGIC      0x4644454C      // "LEDF"
+#define FRAME_EXPORT_VERSION    1
+#define FRAME_EXPORT_SLOTS      8               // 133 ms of frames at the window's 60 Hz
+#define FRAME_EXPORT_ALIGN      64
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the seqlock needs lock-free 64 bit atomics");
+
+struct FrameExportHeader {
+    std::atomic<uint32_t> magic;        // FRAME_EXPORT_MAGIC once the rest is filled in
+    uint16_t version;
+    uint16_t slots;
+    uint16_t width;
+    uint16_t height;
+    uint32_t slotBytes;                 // from one slot to the next, its FrameExportSlot and pixels
+    uint32_t writerPid;
+    std::atomic<uint64_t> latest;       // the last frame written, 0 for none yet
+};
+
+struct FrameExportSlot {
+    std::atomic<uint32_t> sequence;     // odd while the slot is being written
+    uint16_t width;
+    uint16_t height;
+    std::atomic<uint64_t> frame;
+    std::atomic<uint64_t> time_us;
+};
+
+// A frame in the ring, its pixels in place (width * height rgb24, 3 bytes each)
+struct FrameView {
+    const uint8_t *pixels;
+    uint64_t frame;
+    uint64_t time_us;
+    uint16_t width;
+    uint16_t height;
+    uint32_t sequence;
+};
+
+inline uint64_t frameExportTime_us(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Where the header, a slot and its pixels go, and the size of the whole
+inline uint32_t frameExportHeaderBytes(void) {
+    return (sizeof(FrameExportHeader) + FRAME_EXPORT_ALIGN - 1) / FRAME_EXPORT_ALIGN * FRAME_EXPORT_ALIGN;
+}
+
+inline uint32_t frameExportSlotHeaderBytes(void) {
+    return (sizeof(FrameExportSlot) + FRAME_EXPORT_ALIGN - 1) / FRAME_EXPORT_ALIGN * FRAME_EXPORT_ALIGN;
+}
+
+inline uint32_t frameExportSlotBytes(int width, int height) {
+    uint32_t bytes = frameExportSlotHeaderBytes() + width * height * 3;
+    return (bytes + FRAME_EXPORT_ALIGN - 1) / FRAME_EXPORT_ALIGN * FRAME_EXPORT_ALIGN;
+}
+
+// "led_frames" and "/led_frames" are both /dev/shm/led_frames
+inline std::string frameExportShmName(const std::string &name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+class FrameExportWriter {
+public:
+    ~FrameExportWriter() { close(); }
+
+    // Makes (or takes over) the shared memory for width x height frames, false with errno if it can't
+    bool open(const std::string &name, int width, int height) {
+        shmName = frameExportShmName(name);
+        int fd = shm_open(shmName.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        slotBytes = frameExportSlotBytes(width, height);
+        size = frameExportHeaderBytes() + FRAME_EXPORT_SLOTS * slotBytes;
+        void *memory = MAP_FAILED;
+        if (ftruncate(fd, size) == 0) {
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+            shm_unlink(shmName.c_str());
+            return false;
+        }
+        base = (uint8_t *)memory;
+
+        // a reader of the last run's frames sees the magic go while the header changes under it
+        header()->magic.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header()->version = FRAME_EXPORT_VERSION;
+        header()->slots = FRAME_EXPORT_SLOTS;
+        header()->width = width;
+        header()->height = height;
+        header()->slotBytes = slotBytes;
+        header()->writerPid = getpid();
+        header()->latest.store(0, std::memory_order_relaxed);
+        for (int i = 0; i < FRAME_EXPORT_SLOTS; i++) {
+            FrameExportSlot *s = slot(i);
+            s->sequence.store(0, std::memory_order_relaxed);
+            s->width = width;
+            s->height = height;
+            s->frame.store(0, std::memory_order_relaxed);
+            s->time_us.store(0, std::memory_order_relaxed);
+        }
+        header()->magic.store(FRAME_EXPORT_MAGIC, std::memory_order_release);
+        this->width = width;
+        this->height = height;
+        frame = 0;
+        return true;
+    }
+
+    bool isOpen(void) const { return base != nullptr; }
+
+    // The next frame into the ring, width x height rgb24 as given to open()
+    void publish(const void *pixels) {
+        if (!base) {
+            return;
+        }
+        frame++;
+        FrameExportSlot *s = slot(frame % FRAME_EXPORT_SLOTS);
+        uint32_t sequence = s->sequence.load(std::memory_order_relaxed);
+        s->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        s->frame.store(frame, std::memory_order_relaxed);
+        s->time_us.store(frameExportTime_us(), std::memory_order_relaxed);
+        memcpy((uint8_t *)s + frameExportSlotHeaderBytes(), pixels, width * height * 3);
+
+        s->sequence.store(sequence + 2, std::memory_order_release);
+        header()->latest.store(frame, std::memory_order_release);
+    }
+
+    // Unmaps and removes the shared memory, readers that have it mapped keep what's there
+    void close(void) {
+        if (!base) {
+            return;
+        }
+        munmap(base, size);
+        shm_unlink(shmName.c_str());
+        base = nullptr;
+    }
+
+private:
+    FrameExportHeader *header(void) { return (FrameExportHeader *)base; }
+    FrameExportSlot *slot(int i) { return (FrameExportSlot *)(base + frameExportHeaderBytes() + i * slotBytes); }
+
+    std::string shmName;
+    uint8_t *base = nullptr;
+    size_t size = 0;
+    uint32_t slotBytes = 0;
+    int width = 0;
+    int height = 0;
+    uint64_t frame = 0;
+};
+
+class FrameExportReader {
+public:
+    ~FrameExportReader() { close(); }
+
+    // Maps a simulator's frames read only, false if they aren't there (yet)
+    bool open(const std::string &name) {
+        close();
+        int fd = shm_open(frameExportShmName(name).c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        void *memory = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= frameExportHeaderBytes()) {
+            size = st.st_size;
+            memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+            return false;
+        }
+        base = (const uint8_t *)memory;
+
+        const FrameExportHeader *h = header();
+        if (h->magic.load(std::memory_order_acquire) != FRAME_EXPORT_MAGIC || h->version != FRAME_EXPORT_VERSION ||
+            frameExportHeaderBytes() + (size_t)h->slots * h->slotBytes > size ||
+            h->slotBytes < frameExportSlotBytes(h->width, h->height)) {
+            close();
+            return false;
+        }
+        nextFrame = h->latest.load(std::memory_order_acquire) + 1;
+        missedFrames = 0;
+        return true;
+    }
+
+    bool isOpen(void) const { return base != nullptr; }
+    int width(void) const { return base ? header()->width : 0; }
+    int height(void) const { return base ? header()->height : 0; }
+    uint32_t writerPid(void) const { return base ? header()->writerPid : 0; }
+
+    // The last frame written, 0 for none
+    uint64_t latest(void) const { return base ? header()->latest.load(std::memory_order_acquire) : 0; }
+
+    // The frames the ring moved past before next() got to them
+    uint64_t missed(void) const { return missedFrames; }
+
+    /**
+     * The frame after the last one next() gave, false if it hasn't been written yet. Starts from the frames
+     * written after open(), and skips ahead to the oldest still in the ring if the reader fell behind.
+     */
+    bool next(FrameView &view) {
+        if (!base) {
+            return false;
+        }
+        uint64_t last = latest();
+        if (last + 1 < nextFrame) {
+            // the simulator started again, its frame numbers with it
+            nextFrame = last + 1;
+        }
+        while (nextFrame <= last) {
+            if (last - nextFrame >= header()->slots) {
+                uint64_t oldest = last - header()->slots + 1;
+                missedFrames += oldest - nextFrame;
+                nextFrame = oldest;
+            }
+            if (get(nextFrame, view)) {
+                nextFrame++;
+                return true;
+            }
+            // written over since latest() was read, on to the ones now in the ring
+            uint64_t now = latest();
+            if (now == last) {
+                return false;
+            }
+            last = now;
+        }
+        return false;
+    }
+
+    // Frame n in place, false if it's not in the ring (not written yet, or written over)
+    bool get(uint64_t n, FrameView &view) const {
+        const FrameExportHeader *h = header();
+        const FrameExportSlot *s = slot(n % h->slots);
+        for (int attempt = 0; attempt < 100; attempt++) {
+            uint32_t sequence = s->sequence.load(std::memory_order_acquire);
+            if (sequence & 1) {
+                // mid-write, for a memcpy's worth
+                std::this_thread::yield();
+                continue;
+            }
+            view.pixels = (const uint8_t *)s + frameExportSlotHeaderBytes();
+            view.frame = s->frame.load(std::memory_order_relaxed);
+            view.time_us = s->time_us.load(std::memory_order_relaxed);
+            view.width = s->width;
+            view.height = s->height;
+            view.sequence = sequence;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s->sequence.load(std::memory_order_relaxed) != sequence) {
+                continue;
+            }
+            return view.frame == n;
+        }
+        return false;
+    }
+
+    // Whether the slot view points at still holds its frame, after using its pixels in place
+    bool valid(const FrameView &view) const {
+        const FrameExportSlot *s = slot(view.frame % header()->slots);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return s->sequence.load(std::memory_order_relaxed) == view.sequence;
+    }
+
+    // Copies view's pixels to out (width * height * 3 bytes), false if it was written over before the copy finished
+    bool copy(const FrameView &view, uint8_t *out) const {
+        memcpy(out, view.pixels, view.width * view.height * 3);
+        return valid(view);
+    }
+
+    void close(void) {
+        if (!base) {
+            return;
+        }
+        munmap((void *)base, size);
+        base = nullptr;
+    }
+
+private:
+    const FrameExportHeader *header(void) const { return (const FrameExportHeader *)base; }
+    const FrameExportSlot *slot(int i) const {
+        return (const FrameExportSlot *)(base + frameExportHeaderBytes() + i * header()->slotBytes);
+    }
+
+    const uint8_t *base = nullptr;
+    size_t size = 0;
+    uint64_t nextFrame = 1;
+    uint64_t missedFrames = 0;
+};
+
+#endif // FRAME_EXPORT_H
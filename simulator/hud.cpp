@@ -0,0 +1,188 @@
+/**
+ * Live stats over the simulator window, see hud.h.
+ */
+
+#include "hud.h"
+
+#include <MatrixFontCommon.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#define HUD_GLYPH_WIDTH     6       // apple5x7's 5 pixels and a space
+#define HUD_GLYPH_HEIGHT    8
+#define HUD_FIRST_GLYPH     32
+#define HUD_GLYPHS          96
+
+static const struct {
+    const char *label;
+    const char *format;
+    SDL_Color color;
+} kMetrics[Hud::METRICS] = {
+    { "fps",        "%6.1f", { 120, 230, 120, 255 } },
+    { "late ms",    "%6.2f", { 240, 120, 100, 255 } },
+    { "decode ms",  "%6.2f", { 110, 180, 250, 255 } },
+    { "swap ms",    "%6.2f", { 230, 200, 90, 255 } },
+    { "compose ms", "%6.2f", { 200, 140, 240, 255 } },
+    { "SD KB/s",    "%6.0f", { 90, 220, 220, 255 } },
+    { "cache %",    "%6.1f", { 220, 220, 220, 255 } },
+};
+
+static const SDL_Color kLabelColor = { 150, 150, 150, 255 };
+
+bool Hud::begin(SDL_Renderer *renderer) {
+    static uint32_t pixels[HUD_GLYPH_HEIGHT][HUD_GLYPHS * HUD_GLYPH_WIDTH];
+    memset(pixels, 0, sizeof(pixels));
+    for (int glyph = 0; glyph < HUD_GLYPHS; glyph++) {
+        for (int y = 0; y < apple5x7.Height && y < HUD_GLYPH_HEIGHT; y++) {
+            uint16_t row = getBitmapFontRowAtXY(HUD_FIRST_GLYPH + glyph, y, &apple5x7);
+            for (int x = 0; x < HUD_GLYPH_WIDTH - 1; x++) {
+                if (row & (0x80 >> x)) {
+                    pixels[y][glyph * HUD_GLYPH_WIDTH + x] = 0xFFFFFFFF;
+                }
+            }
+        }
+    }
+
+    glyphs = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC,
+                               HUD_GLYPHS * HUD_GLYPH_WIDTH, HUD_GLYPH_HEIGHT);
+    if (!glyphs) {
+        printf("[Simulator] HUD glyphs could not be created: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_UpdateTexture(glyphs, nullptr, pixels, sizeof(pixels[0]));
+    SDL_SetTextureBlendMode(glyphs, SDL_BLENDMODE_BLEND);
+    return true;
+}
+
+void Hud::sample(const HudSample &s) {
+    nextSample_ms = s.time_ms + HUD_SAMPLE_MS;
+
+    std::lock_guard<std::mutex> guard(lock);
+    const HudSample p = previous;
+    // the stats command starts the sketch's stats over, so a sample is only compared with one since then
+    bool compare = havePrevious && s.playback.elapsed_ms > p.playback.elapsed_ms;
+    previous = s;
+    havePrevious = true;
+    if (!compare) {
+        return;
+    }
+
+    float seconds = (s.playback.elapsed_ms - p.playback.elapsed_ms) / 1000.0f;
+    auto average_ms = [](const StageTimer &now, const StageTimer &before) {
+        uint32_t count = now.count - before.count;
+        return count ? (now.total_us - before.total_us) / 1000.0f / count : -1.0f;
+    };
+    uint32_t hit = s.cache.hitBytes - p.cache.hitBytes;
+    uint32_t card = (s.cache.missBytes - p.cache.missBytes) + (s.cache.uncachedBytes - p.cache.uncachedBytes);
+
+    history[FPS][head] = (s.playback.framesShown - p.playback.framesShown) / seconds;
+    history[LATE][head] = average_ms(s.playback.lateness.late, p.playback.lateness.late);
+    history[DECODE][head] = average_ms(s.playback.decode, p.playback.decode);
+    history[SWAP][head] = average_ms(s.playback.swap, p.playback.swap);
+    history[COMPOSITE][head] = average_ms(s.playback.composite, p.playback.composite);
+    history[CARD][head] = card / 1024.0f / seconds;
+    history[CACHE][head] = hit + card ? hit * 100.0f / (hit + card) : -1.0f;
+    head = (head + 1) % HUD_HISTORY;
+    samples = std::min(samples + 1, HUD_HISTORY);
+}
+
+void Hud::drawText(SDL_Renderer *renderer, int x, int y, int scale, const char *text, SDL_Color color) {
+    SDL_SetTextureColorMod(glyphs, color.r, color.g, color.b);
+    for (; *text; text++, x += HUD_GLYPH_WIDTH * scale) {
+        int glyph = (unsigned char)*text - HUD_FIRST_GLYPH;
+        if (glyph <= 0 || glyph >= HUD_GLYPHS) {
+            continue;
+        }
+        SDL_Rect source = { glyph * HUD_GLYPH_WIDTH, 0, HUD_GLYPH_WIDTH, HUD_GLYPH_HEIGHT };
+        SDL_Rect target = { x, y, HUD_GLYPH_WIDTH * scale, HUD_GLYPH_HEIGHT * scale };
+        SDL_RenderCopy(renderer, glyphs, &source, &target);
+    }
+}
+
+void Hud::draw(SDL_Renderer *renderer, int width, uint32_t framePeriod_us) {
+    if (!visible || !glyphs) {
+        return;
+    }
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    static float values[METRICS][HUD_HISTORY];
+    int count, first;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        memcpy(values, history, sizeof(values));
+        count = samples;
+        first = (head - samples + HUD_HISTORY) % HUD_HISTORY;
+    }
+
+    int scale = width >= 480 ? 2 : 1;
+    int margin = 4 * scale;
+    int lineHeight = (HUD_GLYPH_HEIGHT + 2) * scale;
+    int valueX = margin + 11 * HUD_GLYPH_WIDTH * scale;
+    int sparkX = valueX + 7 * HUD_GLYPH_WIDTH * scale;
+    int sparkWidth = std::max(width - sparkX - margin, HUD_HISTORY / 4);
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 190);
+    SDL_Rect panel = { 0, 0, width, 2 * margin + (METRICS + 1) * lineHeight };
+    SDL_RenderFillRect(renderer, &panel);
+
+    char text[64];
+    for (int m = 0; m < METRICS; m++) {
+        int y = margin + m * lineHeight;
+        drawText(renderer, margin, y, scale, kMetrics[m].label, kLabelColor);
+
+        float latest = count ? values[m][(first + count - 1) % HUD_HISTORY] : -1.0f;
+        if (latest >= 0) {
+            snprintf(text, sizeof(text), kMetrics[m].format, latest);
+        } else {
+            snprintf(text, sizeof(text), "%6s", "-");
+        }
+        drawText(renderer, valueX, y, scale, text, kMetrics[m].color);
+
+        // scaled to the largest in the history, newest on the right, broken where there was nothing to measure
+        float largest = 0;
+        for (int i = 0; i < count; i++) {
+            largest = std::max(largest, values[m][(first + i) % HUD_HISTORY]);
+        }
+        if (largest <= 0) {
+            largest = 1;
+        }
+        int top = y + scale;
+        int height = HUD_GLYPH_HEIGHT * scale - scale;
+        SDL_Point points[HUD_HISTORY];
+        int run = 0;
+        SDL_SetRenderDrawColor(renderer, kMetrics[m].color.r, kMetrics[m].color.g, kMetrics[m].color.b, 255);
+        for (int i = 0; i <= count; i++) {
+            float v = i < count ? values[m][(first + i) % HUD_HISTORY] : -1.0f;
+            if (v >= 0) {
+                points[run].x = sparkX + sparkWidth - 1 - (count - 1 - i) * (sparkWidth - 1) / (HUD_HISTORY - 1);
+                points[run].y = top + height - (int)(v / largest * height);
+                run++;
+            } else if (run) {
+                if (run == 1) {
+                    SDL_RenderDrawPoint(renderer, points[0].x, points[0].y);
+                } else {
+                    SDL_RenderDrawLines(renderer, points, run);
+                }
+                run = 0;
+            }
+        }
+    }
+
+    float period_ms = framePeriod_us / 1000.0f;
+    snprintf(text, sizeof(text), "H hides  hud %u us, %.2f%% of the %.1f ms frame", (unsigned)cost_us,
+             framePeriod_us ? cost_us * 100.0f / framePeriod_us : 0.0f, period_ms);
+    drawText(renderer, margin, margin + METRICS * lineHeight, 1, text, kLabelColor);
+
+    drawTicks += SDL_GetPerformanceCounter() - start;
+    draws++;
+    uint32_t now = SDL_GetTicks();
+    if (now - windowStart_ms >= 1000) {
+        cost_us = draws ? (uint32_t)(drawTicks * 1000000 / SDL_GetPerformanceFrequency() / draws) : 0;
+        drawTicks = 0;
+        draws = 0;
+        windowStart_ms = now;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef HUD_H
+#define HUD_H
+
+/**
+ * Live stats over the simulator window, shown and hidden with H.
+ *
+ * Every HUD_SAMPLE_MS the Arduino thread hands the HUD the sketch's stats between loop() calls (the stats command's
+ * PlaybackStats and the file cache's FileCacheStats). The HUD keeps what changed since the sample before for the last
+ * HUD_HISTORY samples: frames per second, how late GIF frames went up, the time decodeFrame() took, swapBuffers()
+ * waited and the compositing took, what was read from the SD card and how much of it the file cache had. The render
+ * thread draws each as its latest value and a sparkline of its history over the frame, before it's presented.
+ *
+ * Text is SmartMatrix's apple5x7 bitmap font, from a texture of its glyphs made once in begin(), so nothing depends on
+ * the system's fonts. The HUD times its own drawing and shows it against the render loop's frame period.
+ */
+
+#include <SDL2/SDL.h>
+
+#include <cstdint>
+#include <mutex>
+
+#include "PlaybackStats.h"
+#include "FilenameFunctions.h"
+
+#define HUD_SAMPLE_MS       250
+#define HUD_HISTORY         120     // 30 s of samples
+
+struct HudSample {
+    uint32_t time_ms;
+    PlaybackStats playback;
+    FileCacheStats cache;
+};
+
+class Hud {
+public:
+    enum Metric { FPS, LATE, DECODE, SWAP, COMPOSITE, CARD, CACHE, METRICS };
+
+    // Makes the glyph texture, before the sketch runs
+    bool begin(SDL_Renderer *renderer);
+
+    void toggle(void) { visible = !visible; }
+    bool isVisible(void) const { return visible; }
+
+    // From the Arduino thread, between loop() calls
+    bool sampleDue(uint32_t now_ms) const { return (int32_t)(now_ms - nextSample_ms) >= 0; }
+    void sample(const HudSample &sample);
+
+    // From the render thread, over the frame drawn, framePeriod_us the time between the render loop's frames
+    void draw(SDL_Renderer *renderer, int width, uint32_t framePeriod_us);
+
+private:
+    void drawText(SDL_Renderer *renderer, int x, int y, int scale, const char *text, SDL_Color color);
+
+    SDL_Texture *glyphs = nullptr;
+    bool visible = false;
+    uint32_t nextSample_ms = 0;
+
+    // written by sample(), read by draw()
+    std::mutex lock;
+    bool havePrevious = false;
+    HudSample previous = {};
+    float history[METRICS][HUD_HISTORY] = {};   // negative where there was nothing to measure
+    int samples = 0;                            // in history, up to HUD_HISTORY
+    int head = 0;                               // where the next goes
+
+    // the HUD's own cost, over the last second of draws
+    uint64_t drawTicks = 0;
+    uint32_t draws = 0;
+    uint32_t windowStart_ms = 0;
+    uint32_t cost_us = 0;
+};
+
+#endif // HUD_H
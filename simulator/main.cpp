@@ -6,10 +6,16 @@
  */
 
 #include <SDL2/SDL.h>
-#include <SDL_ttf.h>
 #include <cstdio>
 #include <string>
 #include <cstdlib>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <vector>
 
 // Include stb_image implementation
 #define STB_IMAGE_IMPLEMENTATION
@@ -22,28 +28,25 @@
 #include "mocks/MatrixHardware_Teensy4_ShieldV5.h"
 #include "mocks/IRremote.hpp"
 #include <GifDecoder.h>
+#include <FrameSync.h>
+#include <AudioBeat.h>
+
+#include "alloc_tracker.h"
+#include "frame_export.h"
+#include "hud.h"
+#include "scenario.h"
+#include "wall.h"
+#include "wav.h"
 
 // Generic SmartMatrix Layer header (from real library)
 #include "Layer.h"
 
-// Global instances for mocks
-SerialClass Serial;
-SPIClass SPI;
-SPIClass SPI1;
-SDClass SD;
-IRrecv IrReceiver;
-
-// Fonts (just need to exist, not actually used for rendering in simulator)
-const void* font3x5 = nullptr;
-const void* font5x7 = nullptr;
-const void* font6x10 = nullptr;
-const void* font8x13 = nullptr;
-
 // SDL globals
 static SDL_Window* g_window = nullptr;
 static SDL_Renderer* g_renderer = nullptr;
 static SDL_Texture* g_texture = nullptr;
-static TTF_Font* g_font = nullptr;
+static Hud g_hud;
+static FrameExportWriter g_frames;
 static int g_scale = 8;
 static int g_gap = 1;
 static bool g_running = true;
@@ -61,6 +64,7 @@ void SD_setBasePath(const std::string& path) {
 // Forward declarations of the Arduino functions
 void setup();
 void loop();
+void getPlaybackStats(PlaybackStats &stats);
 
 /**
  * Initialize SDL2 and create the display window.
@@ -94,20 +98,9 @@ bool initSDL() {
         return false;
     }
     
-    // Initialize TTF
-    if (TTF_Init() < 0) {
-        printf("TTF could not initialize! TTF_Error: %s\n", TTF_GetError());
-    } else {
-        // Try to load a system font
-        g_font = TTF_OpenFont("/System/Library/Fonts/Helvetica.ttc", 14);
-        if (!g_font) {
-            g_font = TTF_OpenFont("/System/Library/Fonts/SFNSMono.ttf", 14);
-        }
-        if (!g_font) {
-            printf("[Simulator] Warning: Could not load font, text will not display\n");
-        }
-    }
-    
+    // the stats HUD draws its text with a bitmap font, so it needs no system fonts
+    g_hud.begin(g_renderer);
+
     printf("[Simulator] Window created: %dx%d (scale=%d)\n", windowWidth, windowHeight, g_scale);
     return true;
 }
@@ -123,22 +116,22 @@ extern SmartMatrixShim matrix;
  * Update the simulator display by asking SmartMatrix layers to render
  */
 void SmartMatrixShim::updateSimulator(SDL_Renderer* renderer) {
-    int width = 64;
-    int height = 64;
+    const int width = 64;
+    const int height = 64;
     
-    // Buffer for a single row (using rgb24 as per color depth)
-    rgb24 rowBuffer[64];
+    // The whole frame, with brightness applied, for --export's ring as well as the window
+    static rgb24 frame[width * height];
     
     // Clear screen first (background)
     SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
     SDL_RenderClear(renderer);
 
-    // Simulate vertical sync / new frame interrupt
+    // Simulate vertical sync / new frame interrupt, then ask the layers for every row
     // This is CRITICAL: calls handleBufferSwap() internally to clear swapPending flags
     // Without this, any code calling swapBuffers() will hang indefinitely
-    for (auto* layer : layers) {
-        layer->frameRefreshCallback();
-    }
+    refreshFrame(frame, width, height);
+    static_assert(sizeof(rgb24) == 3, "frames are exported as packed rgb24");
+    g_frames.publish(frame);
 
     static bool lutTested = false;
     if (!lutTested) {
@@ -162,49 +155,12 @@ void SmartMatrixShim::updateSimulator(SDL_Renderer* renderer) {
     
     // Iterate over all rows
     for (int y = 0; y < height; y++) {
-        // Clear the row buffer to black/transparent before rendering layers
-        memset(rowBuffer, 0, sizeof(rowBuffer));
-        
-        // Ask each layer to fill the row
-        for (auto* layer : layers) {
-            layer->fillRefreshRow(y, rowBuffer);
-        }
-        
-        // Debug: Check first row for data (once per second)
-        static uint32_t lastLogTime = 0;
-        uint32_t now = SDL_GetTicks();
-        if (now - lastLogTime > 1000) {
-            
-            // Check pixel data in row 32
-            int nonBlack = 0;
-            rgb24 sample = {0,0,0};
-            // Note: Use 32 if height > 32, else 0
-            int debugRow = (height > 32) ? 32 : 0;
-            
-            // We must read the data AFTER fillRefreshRow has run on this row.
-            // But we are in the 'y' loop. We should check ONLY when y == debugRow.
-            if (y == debugRow) {
-                 for(int x=0; x<width; x++) {
-                    if(rowBuffer[x].red > 0 || rowBuffer[x].green > 0 || rowBuffer[x].blue > 0) {
-                        nonBlack++;
-                        sample = rowBuffer[x];
-                    }
-                }
-                printf("[Simulator] Layers: %lu. Row %d Info: %d non-black pixels. Sample: %d,%d,%d. Brightness: %d\n", 
-                       layers.size(), debugRow, nonBlack, sample.red, sample.green, sample.blue, brightness);
-                lastLogTime = now;
-            }
-        }
-        
         // Now draw this row to SDL
         for (int x = 0; x < width; x++) {
-            rgb24& pixel = rowBuffer[x];
-            
-            // Apply brightness (basic scaling)
-            float factor = brightness / 255.0f;
-            uint8_t r = (uint8_t)(pixel.red * factor);
-            uint8_t g = (uint8_t)(pixel.green * factor);
-            uint8_t b = (uint8_t)(pixel.blue * factor);
+            rgb24& pixel = frame[y * width + x];
+            uint8_t r = pixel.red;
+            uint8_t g = pixel.green;
+            uint8_t b = pixel.blue;
             
             // Simulator rotation logic (reused from before)
             int dispX = x, dispY = y;
@@ -222,13 +178,145 @@ void SmartMatrixShim::updateSimulator(SDL_Renderer* renderer) {
             SDL_RenderFillRect(renderer, &rect);
         }
     }
-    
-    SDL_RenderPresent(renderer);
 }
 
-// Global render function called by main loop
-void renderDisplay() {
+// Global render function called by main loop, the HUD over the frame
+void renderDisplay(uint32_t framePeriod_us) {
     matrix.updateSimulator(g_renderer);
+    g_hud.draw(g_renderer, g_matrix_width * g_scale, framePeriod_us);
+    SDL_RenderPresent(g_renderer);
+}
+
+/**
+ * Feed Serial from a pty or UNIX socket, so led_stream can send frames without hardware.
+ * "pty" opens a pseudo terminal and prints the device to pass to led_stream, anything else is a socket path to
+ * listen on. Each new connection replaces the last one.
+ */
+bool startStreamInput(const std::string& path) {
+    if (path == "pty") {
+        int fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+            perror("[Simulator] pty");
+            return false;
+        }
+        struct termios tty;
+        if (tcgetattr(fd, &tty) == 0) {
+            cfmakeraw(&tty);
+            tcsetattr(fd, TCSANOW, &tty);
+        }
+        Serial.streamFd = fd;
+        printf("[Simulator] Stream input on %s\n", ptsname(fd));
+        return true;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(path.c_str());
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 1) < 0) {
+        perror("[Simulator] stream socket");
+        return false;
+    }
+    printf("[Simulator] Stream input on socket %s\n", path.c_str());
+
+    // acks to a sender that has hung up would otherwise kill the simulator
+    signal(SIGPIPE, SIG_IGN);
+
+    std::thread([listener]() {
+        while (g_running) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) continue;
+            int old = Serial.streamFd.exchange(fd);
+            if (old >= 0) close(old);
+            printf("[Simulator] Stream connected\n");
+        }
+    }).detach();
+    return true;
+}
+
+/**
+ * Frame sync link between simulator instances (FrameSync.h).
+ *
+ * The leader listens on a UNIX socket and relays between its Serial3 and every
+ * follower that connects, like a UART TX wired to several RX pins (plus the
+ * return path for pings). A follower connects to the leader's socket, retrying
+ * until it's up.
+ */
+bool startSyncLeader(const std::string& path) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    unlink(path.c_str());
+    int pair[2];
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, 8) < 0 ||
+        socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+        perror("[Simulator] sync socket");
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    Serial3.streamFd = pair[0];
+    _digital_inputs[FRAME_SYNC_LEADER_PIN] = HIGH;
+    printf("[Simulator] Sync leader on socket %s\n", path.c_str());
+
+    std::thread([listener, hub = pair[1]]() {
+        std::vector<int> followers;
+        uint8_t buffer[1024];
+        while (g_running) {
+            std::vector<struct pollfd> fds = { { listener, POLLIN, 0 }, { hub, POLLIN, 0 } };
+            for (int fd : followers) fds.push_back({ fd, POLLIN, 0 });
+            if (poll(fds.data(), fds.size(), 100) <= 0) continue;
+
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0) {
+                    followers.push_back(fd);
+                    printf("[Simulator] Sync follower connected (%zu)\n", followers.size());
+                }
+            }
+            // leader to every follower
+            if (fds[1].revents & POLLIN) {
+                ssize_t n = read(hub, buffer, sizeof(buffer));
+                for (int fd : followers) {
+                    if (n > 0) write(fd, buffer, n);
+                }
+            }
+            // followers to the leader, dropping the ones that hung up
+            for (size_t i = 2; i < fds.size(); i++) {
+                if (!fds[i].revents) continue;
+                ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+                if (n > 0) {
+                    write(hub, buffer, n);
+                } else {
+                    close(fds[i].fd);
+                    followers.erase(std::find(followers.begin(), followers.end(), fds[i].fd));
+                    printf("[Simulator] Sync follower disconnected (%zu)\n", followers.size());
+                }
+            }
+        }
+    }).detach();
+    return true;
+}
+
+void startSyncFollower(const std::string& path) {
+    printf("[Simulator] Sync follower of socket %s\n", path.c_str());
+    signal(SIGPIPE, SIG_IGN);
+    std::thread([path]() {
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        while (g_running) {
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+                Serial3.streamFd = fd;
+                printf("[Simulator] Sync link up\n");
+                return;
+            }
+            if (fd >= 0) close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }).detach();
 }
 
 /**
@@ -242,6 +330,104 @@ bool checkQuit() {
     return false;
 }
 
+/**
+ * The IR remote code for a key, 0 for none (shared with the wall, see wall.cpp).
+ */
+uint32_t irCodeForKey(int32_t key) {
+    uint32_t code = 0;
+
+    switch (key) {
+        // Volume/brightness controls
+        case SDLK_MINUS:
+        case SDLK_KP_MINUS:
+            code = 0xFF00BF00;  // BUT_VOL_DOWN
+            break;
+        case SDLK_EQUALS:
+        case SDLK_PLUS:
+        case SDLK_KP_PLUS:
+            code = 0xFD02BF00;  // BUT_VOL_UP
+            break;
+        
+        // Navigation
+        case SDLK_LEFT:
+            code = 0xF708BF00;  // BUT_LEFT
+            break;
+        case SDLK_RIGHT:
+            code = 0xF50ABF00;  // BUT_RIGHT
+            break;
+        case SDLK_UP:
+            code = 0xFD02BF00;  // BUT_VOL_UP (Brightness Up)
+            break;
+        case SDLK_DOWN:
+            code = 0xFF00BF00;  // BUT_VOL_DOWN (Brightness Down)
+            break;
+        
+        // Action buttons
+        case SDLK_RETURN:
+        case SDLK_KP_ENTER:
+            code = 0xF609BF00;  // BUT_ENTER
+            break;
+        case SDLK_SPACE:
+            code = 0xFE01BF00;  // BUT_PLAY
+            break;
+        case SDLK_BACKSPACE:
+        case SDLK_ESCAPE:
+            code = 0xF10EBF00;  // BUT_BACK
+            break;
+        case SDLK_s:
+            code = 0xF906BF00;  // BUT_STOP
+            break;
+        
+        // Number keys
+        case SDLK_0:
+        case SDLK_KP_0:
+            code = 0xF30CBF00;  // BUT_0
+            break;
+        case SDLK_1:
+        case SDLK_KP_1:
+            code = 0xEF10BF00;  // BUT_1
+            break;
+        case SDLK_2:
+        case SDLK_KP_2:
+            code = 0xEE11BF00;  // BUT_2
+            break;
+        case SDLK_3:
+        case SDLK_KP_3:
+            code = 0xED12BF00;  // BUT_3
+            break;
+        case SDLK_4:
+        case SDLK_KP_4:
+            code = 0xEB14BF00;  // BUT_4
+            break;
+        case SDLK_5:
+        case SDLK_KP_5:
+            code = 0xEA15BF00;  // BUT_5
+            break;
+        case SDLK_6:
+        case SDLK_KP_6:
+            code = 0xE916BF00;  // BUT_6
+            break;
+        case SDLK_7:
+        case SDLK_KP_7:
+            code = 0xE718BF00;  // BUT_7
+            break;
+        case SDLK_8:
+        case SDLK_KP_8:
+            code = 0xE619BF00;  // BUT_8
+            break;
+        case SDLK_9:
+        case SDLK_KP_9:
+            code = 0xE51ABF00;  // BUT_9
+            break;
+        
+        // Quit on Q
+        case SDLK_q:
+            code = 0xFFFFFFFF;  // Special quit code
+            break;
+    }
+    return code;
+}
+
 /**
  * Print usage information.
  */
@@ -252,11 +438,27 @@ void printUsage(const char* programName) {
     printf("  --help           Show this help message\n");
     printf("  --scale N        Set display scale (default: 8)\n");
     printf("  --no-gap         Disable gap between LEDs\n");
+    printf("  --stream PATH    Take live frames (led_stream) on a UNIX socket at PATH, or a pty with \"pty\"\n");
+    printf("  --sync-leader PATH    Lead a frame-synced wall, followers connect to the UNIX socket at PATH\n");
+    printf("  --sync-follower PATH  Follow the leader listening at PATH\n");
+    printf("  --clock-drift PPM     Run this instance's clock PPM fast (negative for slow)\n");
+    printf("  --wall N         Simulate a wall of N rigs, each running its own copy of the sketch, tiled in one window\n");
+    printf("  --threads N      ... on a pool of N threads (default: one per rig, up to the host's cores)\n");
+    printf("  --headless       ... without a window\n");
+    printf("  --seconds N      ... for N seconds, then report the whole run and quit\n");
+    printf("  --report N       ... reporting each rig's frame timing every N seconds (default: 5)\n");
+    printf("  --wall-verbose   ... with every rig's Serial output, not only the first's\n");
+    printf("  --scenario FILE  Run the scripted scenario in FILE headless (see scenario.h, simulator/scenarios)\n");
+    printf("  --metrics FILE   ... writing its metrics as JSON to FILE (default: stdout)\n");
+    printf("  --audio FILE     Play the WAV file FILE into the microphone pin, looped (see AudioBeat.h)\n");
+    printf("  --export NAME    Write every frame to a ring in /dev/shm/NAME for led_frames and other tools (see frame_export.h)\n");
+    printf("\nConsole commands (stats, set, cache, trace, bench - \"help\" lists them) are read from stdin\n");
     printf("\nControls:\n");
     printf("  Left/Right       Previous/Next image\n");
     printf("  Up/Down          Increase/Decrease brightness\n");
     printf("  -/+              Decrease/Increase brightness\n");
     printf("  Space            Play/Pause\n");
+    printf("  H                Show/hide the stats HUD\n");
     printf("  Q                Quit\n");
 }
 
@@ -292,6 +494,17 @@ int main(int argc, char* argv[]) {
         basePath = "../..";
     }
     
+    std::string streamPath;
+    std::string syncLeaderPath;
+    std::string syncFollowerPath;
+    std::string scenarioPath;
+    std::string audioPath;
+    std::string metricsPath;
+    std::string exportName;
+    WallOptions wall;
+    wall.rigs = 0;
+    bool scaleSet = false;
+
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
@@ -302,17 +515,89 @@ int main(int argc, char* argv[]) {
             g_scale = atoi(argv[++i]);
             if (g_scale < 1) g_scale = 1;
             if (g_scale > 20) g_scale = 20;
+            scaleSet = true;
         } else if (arg == "--no-gap") {
             g_gap = 0;
         } else if (arg == "--base-path" && i + 1 < argc) {
             basePath = argv[++i];
+        } else if (arg == "--stream" && i + 1 < argc) {
+            streamPath = argv[++i];
+        } else if (arg == "--sync-leader" && i + 1 < argc) {
+            syncLeaderPath = argv[++i];
+        } else if (arg == "--sync-follower" && i + 1 < argc) {
+            syncFollowerPath = argv[++i];
+        } else if (arg == "--clock-drift" && i + 1 < argc) {
+            _clock_drift_ppm = atoi(argv[++i]);
+        } else if (arg == "--wall" && i + 1 < argc) {
+            wall.rigs = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            wall.threads = atoi(argv[++i]);
+        } else if (arg == "--headless") {
+            wall.headless = true;
+        } else if (arg == "--seconds" && i + 1 < argc) {
+            wall.seconds = atoi(argv[++i]);
+        } else if (arg == "--report" && i + 1 < argc) {
+            wall.reportSeconds = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--wall-verbose") {
+            wall.verbose = true;
+        } else if (arg == "--audio" && i + 1 < argc) {
+            audioPath = argv[++i];
+        } else if (arg == "--scenario" && i + 1 < argc) {
+            scenarioPath = argv[++i];
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if (arg == "--export" && i + 1 < argc) {
+            exportName = argv[++i];
         }
     }
     
     printf("[Simulator] Base path: %s\n", basePath.c_str());
+
+    if (wall.rigs > 0) {
+        wall.basePath = basePath;
+        if (scaleSet) wall.scale = g_scale;
+        return runWall(wall);
+    }
     
     // Set SD card base path
     SD_setBasePath(basePath);
+
+    if (!audioPath.empty()) {
+        std::string error;
+        if (!loadWav(audioPath, AUDIO_BEAT_SAMPLE_RATE, _analog_samples, error)) {
+            printf("[Simulator] %s\n", error.c_str());
+            return 1;
+        }
+        printf("[Simulator] Audio: %s, %.1f s\n", audioPath.c_str(),
+               _analog_samples.size() / (double)AUDIO_BEAT_SAMPLE_RATE);
+    }
+
+    if (!exportName.empty()) {
+        if (!g_frames.open(exportName, g_matrix_width, g_matrix_height)) {
+            perror(("[Simulator] export " + exportName).c_str());
+            return 1;
+        }
+        printf("[Simulator] Frames to /dev/shm%s\n", frameExportShmName(exportName).c_str());
+    }
+
+    if (!scenarioPath.empty()) {
+        return runScenario(scenarioPath, metricsPath, basePath, exportName.empty() ? nullptr : &g_frames);
+    }
+
+    if (!streamPath.empty() && !startStreamInput(streamPath)) {
+        return 1;
+    }
+    if (!syncLeaderPath.empty() && !startSyncLeader(syncLeaderPath)) {
+        return 1;
+    }
+    if (!syncFollowerPath.empty()) {
+        startSyncFollower(syncFollowerPath);
+    }
+
+    // console commands are typed on stdin, unless it's the terminal of a job in the background (reading would stop us)
+    if (!isatty(STDIN_FILENO) || tcgetpgrp(STDIN_FILENO) == getpgrp()) {
+        Serial.consoleFd = STDIN_FILENO;
+    }
     
     // Initialize SDL
     if (!initSDL()) {
@@ -326,19 +611,26 @@ int main(int argc, char* argv[]) {
         setup();
         printf("[Simulator] Entering main loop (thread)...\n");
         while (g_running) {
-            loop();
-            // Yield to prevent CPU hogging in the tight loop
-            std::this_thread::yield(); 
-            // Small delay to simulate partial timing? 
-            // Actually delay() is mocked to sleep, so loop() shouldn't spin too fast if logic implies delays.
-            // But if loop() is tight, we need to breathe.
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            // loop() sleeps between frames itself (Idle.h), as it would on the Teensy
+            {
+                AllocScope scope;
+                loop();
+            }
+            if (g_hud.sampleDue(millis())) {
+                HudSample sample;
+                sample.time_ms = millis();
+                getPlaybackStats(sample.playback);
+                sample.cache = getFileCacheStats();
+                g_hud.sample(sample);
+            }
+            std::this_thread::yield();
         }
     });
     
     printf("[Simulator] Entering main render loop...\n");
     
     // Main render loop
+    uint64_t lastFrame = SDL_GetPerformanceCounter();
     while (g_running) {
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
@@ -347,98 +639,12 @@ int main(int argc, char* argv[]) {
                 break;
             }
             
-            if (event.type == SDL_KEYDOWN) {
-                IRRawDataType code = 0;
-                
-                switch (event.key.keysym.sym) {
-                    // Volume/brightness controls
-                    case SDLK_MINUS:
-                    case SDLK_KP_MINUS:
-                        code = 0xFF00BF00;  // BUT_VOL_DOWN
-                        break;
-                    case SDLK_EQUALS:
-                    case SDLK_PLUS:
-                    case SDLK_KP_PLUS:
-                        code = 0xFD02BF00;  // BUT_VOL_UP
-                        break;
-                    
-                    // Navigation
-                    case SDLK_LEFT:
-                        code = 0xF708BF00;  // BUT_LEFT
-                        break;
-                    case SDLK_RIGHT:
-                        code = 0xF50ABF00;  // BUT_RIGHT
-                        break;
-                    case SDLK_UP:
-                        code = 0xFD02BF00;  // BUT_VOL_UP (Brightness Up)
-                        break;
-                    case SDLK_DOWN:
-                        code = 0xFF00BF00;  // BUT_VOL_DOWN (Brightness Down)
-                        break;
-                    
-                    // Action buttons
-                    case SDLK_RETURN:
-                    case SDLK_KP_ENTER:
-                        code = 0xF609BF00;  // BUT_ENTER
-                        break;
-                    case SDLK_SPACE:
-                        code = 0xFE01BF00;  // BUT_PLAY
-                        break;
-                    case SDLK_BACKSPACE:
-                    case SDLK_ESCAPE:
-                        code = 0xF10EBF00;  // BUT_BACK
-                        break;
-                    case SDLK_s:
-                        code = 0xF906BF00;  // BUT_STOP
-                        break;
-                    
-                    // Number keys
-                    case SDLK_0:
-                    case SDLK_KP_0:
-                        code = 0xF30CBF00;  // BUT_0
-                        break;
-                    case SDLK_1:
-                    case SDLK_KP_1:
-                        code = 0xEF10BF00;  // BUT_1
-                        break;
-                    case SDLK_2:
-                    case SDLK_KP_2:
-                        code = 0xEE11BF00;  // BUT_2
-                        break;
-                    case SDLK_3:
-                    case SDLK_KP_3:
-                        code = 0xED12BF00;  // BUT_3
-                        break;
-                    case SDLK_4:
-                    case SDLK_KP_4:
-                        code = 0xEB14BF00;  // BUT_4
-                        break;
-                    case SDLK_5:
-                    case SDLK_KP_5:
-                        code = 0xEA15BF00;  // BUT_5
-                        break;
-                    case SDLK_6:
-                    case SDLK_KP_6:
-                        code = 0xE916BF00;  // BUT_6
-                        break;
-                    case SDLK_7:
-                    case SDLK_KP_7:
-                        code = 0xE718BF00;  // BUT_7
-                        break;
-                    case SDLK_8:
-                    case SDLK_KP_8:
-                        code = 0xE619BF00;  // BUT_8
-                        break;
-                    case SDLK_9:
-                    case SDLK_KP_9:
-                        code = 0xE51ABF00;  // BUT_9
-                        break;
-                    
-                    // Quit on Q
-                    case SDLK_q:
-                        g_running = false;
-                        code = 0xFFFFFFFF;  // Special quit code
-                        break;
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_h) {
+                g_hud.toggle();
+            } else if (event.type == SDL_KEYDOWN) {
+                IRRawDataType code = irCodeForKey(event.key.keysym.sym);
+                if (code == 0xFFFFFFFF) {
+                    g_running = false;
                 }
                 
                 if (code != 0) {
@@ -450,7 +656,9 @@ int main(int argc, char* argv[]) {
         // Render the display
         // This calls updateSimulator which calls frameRefreshCallback
         // This clears swapPending flags, allowing the Arduino thread to proceed past swapBuffers()
-        renderDisplay();
+        uint64_t now = SDL_GetPerformanceCounter();
+        renderDisplay((uint32_t)((now - lastFrame) * 1000000 / SDL_GetPerformanceFrequency()));
+        lastFrame = now;
         
         // Simulate 60FPS refresh rate (approx 16ms)
         // This controls how often we clear the swap buffers
@@ -461,6 +669,12 @@ int main(int argc, char* argv[]) {
     if (arduinoThread.joinable()) {
         arduinoThread.join();
     }
+
+    // the sketch runs from fixed buffers once setup() is done, see alloc_tracker.h
+    if (allocTrackerCount()) {
+        printf("[Simulator] loop() allocated %llu times, from:\n", (unsigned long long)allocTrackerCount());
+        allocTrackerReport(stdout, 10);
+    }
     
     // Cleanup
     if (g_renderer) SDL_DestroyRenderer(g_renderer);
@@ -15,16 +15,27 @@
 #include <chrono>
 #include <thread>
 #include <string>
+#include <vector>
 #include <cstdarg>
+#include <atomic>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
 
 // Arduino types
 typedef uint8_t byte;
 typedef bool boolean;
 
+// Program memory is ordinary memory on the host
+#define PROGMEM
+#define memcpy_P memcpy
+
 // Pin modes (not used in simulator)
 #define INPUT 0
 #define OUTPUT 1
 #define INPUT_PULLUP 2
+#define INPUT_PULLDOWN 3
 
 #define HIGH 1
 #define LOW 0
@@ -35,14 +46,17 @@ typedef bool boolean;
 // Time functions using std::chrono
 static auto _start_time = std::chrono::steady_clock::now();
 
-inline unsigned long millis() {
-    auto now = std::chrono::steady_clock::now();
-    return std::chrono::duration_cast<std::chrono::milliseconds>(now - _start_time).count();
-}
+// Set by the simulator's --clock-drift, the clock then runs this many ppm fast (or slow), like a real crystal
+inline int32_t _clock_drift_ppm = 0;
 
 inline unsigned long micros() {
     auto now = std::chrono::steady_clock::now();
-    return std::chrono::duration_cast<std::chrono::microseconds>(now - _start_time).count();
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - _start_time).count();
+    return (unsigned long)(us + us * _clock_drift_ppm / 1000000);
+}
+
+inline unsigned long millis() {
+    return micros() / 1000;
 }
 
 inline void delay(unsigned long ms) {
@@ -152,32 +166,83 @@ public:
 // Serial mock (prints to stdout)
 class SerialClass {
 public:
+    // set by the bench so library chatter doesn't drown its report, and for all but one rig of a simulated wall
+    bool muted = false;
+
     void begin(unsigned long baud) {
         // Nothing to do for simulator
         (void)baud;
     }
     
-    void print(const char* s) { printf("%s", s); }
-    void print(const String& s) { printf("%s", s.c_str()); }
-    void print(int n) { printf("%d", n); }
-    void print(unsigned int n) { printf("%u", n); }
-    void print(long n) { printf("%ld", n); }
-    void print(unsigned long n) { printf("%lu", n); }
-    void print(double n) { printf("%f", n); }
+    void print(const char* s) { if (!muted) printf("%s", s); }
+    void print(const String& s) { if (!muted) printf("%s", s.c_str()); }
+    void print(int n) { if (!muted) printf("%d", n); }
+    void print(unsigned int n) { if (!muted) printf("%u", n); }
+    void print(long n) { if (!muted) printf("%ld", n); }
+    void print(unsigned long n) { if (!muted) printf("%lu", n); }
+    void print(double n) { if (!muted) printf("%f", n); }
     
-    void println() { printf("\n"); }
-    void println(const char* s) { printf("%s\n", s); }
-    void println(const String& s) { printf("%s\n", s.c_str()); }
-    void println(int n) { printf("%d\n", n); }
-    void println(unsigned int n) { printf("%u\n", n); }
-    void println(long n) { printf("%ld\n", n); }
-    void println(unsigned long n) { printf("%lu\n", n); }
-    void println(double n) { printf("%f\n", n); }
+    void println() { if (!muted) printf("\n"); }
+    void println(const char* s) { if (!muted) printf("%s\n", s); }
+    void println(const String& s) { if (!muted) printf("%s\n", s.c_str()); }
+    void println(int n) { if (!muted) printf("%d\n", n); }
+    void println(unsigned int n) { if (!muted) printf("%u\n", n); }
+    void println(long n) { if (!muted) printf("%ld\n", n); }
+    void println(unsigned long n) { if (!muted) printf("%lu\n", n); }
+    void println(double n) { if (!muted) printf("%f\n", n); }
     
-    int available() { return 0; }
-    int read() { return -1; }
+    // Input comes from the simulator's --stream socket or pty, if any, and write() goes back to it
+    std::atomic<int> streamFd{-1};
+    // Input otherwise, for the console (stdin in the simulator)
+    int consoleFd = -1;
+
+    int available() {
+        int fd = inputFd();
+        int n = 0;
+        if (fd >= 0 && ioctl(fd, FIONREAD, &n) < 0) n = 0;
+        return n + (peeked >= 0);
+    }
+
+    int peek() {
+        if (peeked < 0) peeked = readFd();
+        return peeked;
+    }
+
+    int read() {
+        if (peeked >= 0) {
+            int b = peeked;
+            peeked = -1;
+            return b;
+        }
+        return readFd();
+    }
+
+    size_t readBytes(char* buffer, size_t length) {
+        size_t done = 0;
+        if (length && peeked >= 0) {
+            buffer[done++] = (char)peeked;
+            peeked = -1;
+        }
+        int fd = inputFd();
+        while (fd >= 0 && done < length) {
+            ssize_t n = ::read(fd, buffer + done, length - done);
+            if (n <= 0) break;
+            done += n;
+        }
+        return done;
+    }
+
+    size_t write(uint8_t b) { return write(&b, 1); }
+
+    size_t write(const uint8_t* buffer, size_t length) {
+        int fd = streamFd;
+        if (fd < 0) return fwrite(buffer, 1, length, stdout);
+        ssize_t n = ::write(fd, buffer, length);
+        return n < 0 ? 0 : n;
+    }
 
     void printf(const char* format, ...) {
+        if (muted) return;
         va_list args;
         va_start(args, format);
         vprintf(format, args);
@@ -187,11 +252,83 @@ public:
     void flush() {
         fflush(stdout);
     }
+
+    // Where input comes from, -1 without any
+    int inputFd() {
+        int fd = streamFd;
+        return fd >= 0 ? fd : consoleFd;
+    }
+
+private:
+    int peeked = -1;
+
+    int readFd() {
+        uint8_t b;
+        int fd = inputFd();
+        return (fd >= 0 && ::read(fd, &b, 1) == 1) ? b : -1;
+    }
 };
 
 extern SerialClass Serial;
+// Hardware UART for the frame sync link, connected by the simulator's --sync-leader/--sync-follower
+extern SerialClass Serial3;
+
+// The sketch's idle sleep (Idle.h), where the Teensy waits for an interrupt: _idle_wait() sleeps until deadline_us
+// on micros(), input on Serial or Serial3, or a _idle_wake() - which the simulator calls wherever else the Teensy
+// would take an interrupt, an IR code or a refresh.  A wake while the sketch isn't waiting ends its next wait.  The
+// rigs of a simulated wall share their threads and don't sleep.
+inline bool _idle_enabled = true;
+
+inline struct _IdlePipe {
+    int fds[2] = { -1, -1 };
+    _IdlePipe() {
+        if (pipe(fds) == 0) {
+            fcntl(fds[0], F_SETFL, O_NONBLOCK);
+            fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        }
+    }
+} _idle_pipe;
+
+// input whose far end has gone reads as ready for ever, so it's left out until it's replaced
+inline int _idle_closed_fds[2] = { -1, -1 };
+
+inline void _idle_wait(unsigned long deadline_us) {
+    int32_t us = (int32_t)(deadline_us - micros());
+    if (us <= 0) {
+        return;
+    }
+    struct pollfd fds[3] = { { _idle_pipe.fds[0], POLLIN, 0 }, { Serial.inputFd(), POLLIN, 0 },
+                             { Serial3.inputFd(), POLLIN, 0 } };
+    for (int i = 1; i < 3; i++) {
+        if (fds[i].fd == _idle_closed_fds[i - 1]) {
+            fds[i].fd = -1;
+        }
+    }
+    struct timespec timeout = { us / 1000000, (long)(us % 1000000) * 1000 };
+    if (ppoll(fds, 3, &timeout, nullptr) <= 0) {
+        return;
+    }
+    uint8_t drain[64];
+    while (read(_idle_pipe.fds[0], drain, sizeof(drain)) > 0) {
+    }
+    for (int i = 1; i < 3; i++) {
+        int n = 0;
+        if (fds[i].revents && (ioctl(fds[i].fd, FIONREAD, &n) < 0 || n == 0)) {
+            _idle_closed_fds[i - 1] = fds[i].fd;
+        }
+    }
+}
+
+inline void _idle_wake() {
+    uint8_t b = 1;
+    ssize_t n = write(_idle_pipe.fds[1], &b, 1);
+    (void)n;
+}
+
+// Levels the simulator drives on input pins (e.g. the sync leader jumper), LOW otherwise
+inline int _digital_inputs[64] = {};
 
-// Pin functions (no-ops for simulator)
+// Pin functions (outputs are no-ops for simulator)
 inline void pinMode(uint8_t pin, uint8_t mode) {
     (void)pin; (void)mode;
 }
@@ -201,13 +338,23 @@ inline void digitalWrite(uint8_t pin, uint8_t val) {
 }
 
 inline int digitalRead(uint8_t pin) {
-    (void)pin;
-    return LOW;
+    return pin < 64 ? _digital_inputs[pin] : LOW;
 }
 
+// Readings analogRead() returns in turn, whichever pin: the simulator's --audio WAV file as a microphone's (see
+// wav.h), looped, or silence at its mid-rail bias
+inline std::vector<uint16_t> _analog_samples;
+inline size_t _analog_next = 0;
+
 inline int analogRead(uint8_t pin) {
     (void)pin;
-    return 0;
+    if (_analog_samples.empty()) {
+        return 2048;
+    }
+    if (_analog_next >= _analog_samples.size()) {
+        _analog_next = 0;
+    }
+    return _analog_samples[_analog_next++];
 }
 
 inline void analogWrite(uint8_t pin, int val) {
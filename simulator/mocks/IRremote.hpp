@@ -9,6 +9,8 @@
 
 #include "Arduino.h"
 #include <SDL2/SDL.h>
+#include <mutex>
+#include <vector>
 
 // IR data type matching the original
 typedef uint32_t IRRawDataType;
@@ -39,8 +41,17 @@ public:
     
     // Inject a key code (called from main thread)
     void injectCode(IRRawDataType code) {
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            _inputQueue.push_back(code);
+        }
+        _idle_wake();
+    }
+
+    // True when there's a code for decode(), without taking it
+    bool available() {
         std::lock_guard<std::mutex> lock(_queueMutex);
-        _inputQueue.push_back(code);
+        return !_inputQueue.empty();
     }
     
     // Check for accumulated inputs
@@ -44,6 +44,7 @@ class SmartMatrixShim {
 private:
     std::vector<SM_Layer*> layers;
     uint8_t brightness = 255;
+    uint16_t refreshRate = 240;
     
 public:
     SmartMatrixShim(int bufferRows, void* data) {
@@ -64,12 +65,38 @@ public:
         brightness = newBrightness;
     }
     
-    void setRefreshRate(uint8_t rate) {
-        (void)rate;
+    // Kept for getRefreshRate(), the simulator always renders at its own rate and never lowers it
+    void setRefreshRate(uint16_t rate) {
+        refreshRate = rate;
     }
+
+    uint16_t getRefreshRate() { return refreshRate; }
+    bool getRefreshRateLoweredFlag() { return false; }
+    bool getdmaBufferUnderrunFlag() { return false; }
     
     // Simulator specific update function
     void updateSimulator(SDL_Renderer* renderer);
+
+    // One refresh of the layers into frame (width x height), with brightness applied, for the simulator's wall mode
+    void refreshFrame(rgb24 frame[], int width, int height) {
+        for (auto* layer : layers) {
+            layer->frameRefreshCallback();
+        }
+        // a swap the sketch was waiting for has gone through
+        _idle_wake();
+        for (int y = 0; y < height; y++) {
+            rgb24* row = &frame[y * width];
+            memset((void*)row, 0, width * sizeof(rgb24));
+            for (auto* layer : layers) {
+                layer->fillRefreshRow(y, row);
+            }
+            for (int x = 0; x < width; x++) {
+                row[x].red = row[x].red * brightness / 255;
+                row[x].green = row[x].green * brightness / 255;
+                row[x].blue = row[x].blue * brightness / 255;
+            }
+        }
+    }
     
     // Rotation support
     rotationDegrees rotation = rotation0;
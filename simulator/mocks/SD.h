@@ -5,16 +5,32 @@
  * SD.h Mock for LED Grid Simulator
  * 
  * Provides SD card API that reads from the local filesystem.
+ *
+ * FILE_WRITE opens for reading and writing, creating the file if need be (seek() before writing, on a Teensy it
+ * starts at the end).  A file open for writing is locked, so rigs of a --wall sharing a card can't both write it:
+ * the second open fails as if the card were read only.
+ *
+ * As on the Teensy, where SD.open() and openNextFile() wrap the file in a new SDFile, each open File takes one
+ * allocation from the heap for its state and gives it back on close(), so the allocation counts of alloc_tracker.h
+ * are the ones a rig would make.  Files are read and written with plain file descriptors, which take nothing else
+ * from the heap; a directory's listing (opendir()) takes one more on the host.
  */
 
 #include "Arduino.h"
 #include <cstdio>
 #include <cstring>
 #include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/file.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <string>
 #include <vector>
 
+#define FILE_READ "rb"
+#define FILE_WRITE "r+b"
+
 // Forward declare for SPI config
 class SPIClass;
 extern SPIClass SPI1;
@@ -27,36 +43,47 @@ public:
     }
 };
 
-// File class that wraps FILE*
+// File class that wraps a file descriptor or a directory listing
 class File {
 private:
-    FILE* _file;
-    std::string _name;
-    std::string _path;
-    bool _isDir;
-    DIR* _dir;
-    std::string _basePath;  // For directory iteration
-    
+    struct State {
+        int fd = -1;
+        DIR* dir = nullptr;
+        char name[NAME_MAX + 1];
+        char path[PATH_MAX];
+    };
+    State* _state;
+
 public:
-    File() : _file(nullptr), _isDir(false), _dir(nullptr) {}
+    File() : _state(nullptr) {}
     
-    File(const std::string& path, const char* mode = "rb") 
-        : _file(nullptr), _path(path), _isDir(false), _dir(nullptr) {
-        
-        // Extract filename from path
-        size_t pos = path.rfind('/');
-        _name = (pos != std::string::npos) ? path.substr(pos + 1) : path;
-        
+    File(const char* path, const char* mode = "rb") : _state(nullptr) {
+        bool writing = strchr(mode, '+') || strchr(mode, 'w');
+        int fd = -1;
+        DIR* dir = nullptr;
         struct stat st;
-        if (stat(path.c_str(), &st) == 0) {
+        if (stat(path, &st) == 0) {
             if (S_ISDIR(st.st_mode)) {
-                _isDir = true;
-                _dir = opendir(path.c_str());
-                _basePath = path;
+                dir = opendir(path);
             } else {
-                _file = fopen(path.c_str(), mode);
+                fd = open(path, writing ? O_RDWR : O_RDONLY);
             }
+        } else if (writing) {
+            fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
         }
+        if (fd >= 0 && writing && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        if (fd < 0 && !dir) return;
+
+        _state = new State;
+        _state->fd = fd;
+        _state->dir = dir;
+        snprintf(_state->path, sizeof(_state->path), "%s", path);
+        // Extract filename from path
+        const char* slash = strrchr(path, '/');
+        snprintf(_state->name, sizeof(_state->name), "%s", slash ? slash + 1 : path);
     }
     
     ~File() {
@@ -64,26 +91,16 @@ public:
     }
     
     // Move constructor
-    File(File&& other) noexcept 
-        : _file(other._file), _name(std::move(other._name)), 
-          _path(std::move(other._path)), _isDir(other._isDir),
-          _dir(other._dir), _basePath(std::move(other._basePath)) {
-        other._file = nullptr;
-        other._dir = nullptr;
+    File(File&& other) noexcept : _state(other._state) {
+        other._state = nullptr;
     }
     
     // Move assignment
     File& operator=(File&& other) noexcept {
         if (this != &other) {
             close();
-            _file = other._file;
-            _name = std::move(other._name);
-            _path = std::move(other._path);
-            _isDir = other._isDir;
-            _dir = other._dir;
-            _basePath = std::move(other._basePath);
-            other._file = nullptr;
-            other._dir = nullptr;
+            _state = other._state;
+            other._state = nullptr;
         }
         return *this;
     }
@@ -93,74 +110,76 @@ public:
     File& operator=(const File&) = delete;
     
     operator bool() const {
-        return _file != nullptr || _dir != nullptr;
+        return _state != nullptr;
     }
     
     const char* name() const {
-        return _name.c_str();
+        return _state ? _state->name : "";
     }
     
     uint32_t size() {
-        if (!_file) return 0;
-        long pos = ftell(_file);
-        fseek(_file, 0, SEEK_END);
-        long sz = ftell(_file);
-        fseek(_file, pos, SEEK_SET);
-        return (uint32_t)sz;
+        struct stat st;
+        if (!_state || _state->fd < 0 || fstat(_state->fd, &st) != 0) return 0;
+        return (uint32_t)st.st_size;
     }
     
     int read() {
-        if (!_file) return -1;
-        int c = fgetc(_file);
-        return (c == EOF) ? -1 : c;
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
     }
     
     int read(uint8_t* buf, size_t size) {
-        if (!_file) return 0;
-        return fread(buf, 1, size, _file);
+        if (!_state || _state->fd < 0) return 0;
+        ssize_t n = ::read(_state->fd, buf, size);
+        return n < 0 ? 0 : (int)n;
     }
     
+    size_t write(const uint8_t* buf, size_t size) {
+        if (!_state || _state->fd < 0) return 0;
+        ssize_t n = ::write(_state->fd, buf, size);
+        return n < 0 ? 0 : (size_t)n;
+    }
+
+    // writes go straight to the file
+    void flush() {
+    }
+
     bool seek(uint32_t pos) {
-        if (!_file) return false;
-        return fseek(_file, pos, SEEK_SET) == 0;
+        if (!_state || _state->fd < 0) return false;
+        return lseek(_state->fd, pos, SEEK_SET) == (off_t)pos;
     }
     
     uint32_t position() {
-        if (!_file) return 0;
-        return (uint32_t)ftell(_file);
+        if (!_state || _state->fd < 0) return 0;
+        return (uint32_t)lseek(_state->fd, 0, SEEK_CUR);
     }
     
     void close() {
-        if (_file) {
-            fclose(_file);
-            _file = nullptr;
-        }
-        if (_dir) {
-            closedir(_dir);
-            _dir = nullptr;
-        }
+        if (!_state) return;
+        if (_state->fd >= 0) ::close(_state->fd);
+        if (_state->dir) closedir(_state->dir);
+        delete _state;
+        _state = nullptr;
     }
     
     bool isDirectory() {
-        return _isDir;
+        return _state && _state->dir;
     }
     
     File openNextFile() {
-        if (!_dir) return File();
+        if (!_state || !_state->dir) return File();
         
         struct dirent* entry;
-        while ((entry = readdir(_dir)) != nullptr) {
+        while ((entry = readdir(_state->dir)) != nullptr) {
             // Skip . and ..
             if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
                 continue;
             }
             
-            std::string fullPath = _basePath;
-            if (!fullPath.empty() && fullPath.back() != '/') {
-                fullPath += '/';
-            }
-            fullPath += entry->d_name;
-            
+            char fullPath[PATH_MAX];
+            size_t length = strlen(_state->path);
+            snprintf(fullPath, sizeof(fullPath), "%s%s%s", _state->path,
+                     length && _state->path[length - 1] != '/' ? "/" : "", entry->d_name);
             return File(fullPath);
         }
         
@@ -199,22 +218,16 @@ public:
     }
     
     File open(const char* path, const char* mode = "rb") {
-        std::string fullPath;
-        
-        // If path is absolute, use it directly
-        if (path[0] == '/') {
-            fullPath = _basePath + path;
-        } else {
-            fullPath = _basePath + "/" + path;
-        }
-        
+        char fullPath[PATH_MAX];
+        snprintf(fullPath, sizeof(fullPath), "%s%s%s", _basePath.c_str(), path[0] == '/' ? "" : "/", path);
         return File(fullPath, mode);
     }
     
     bool exists(const char* path) {
-        std::string fullPath = _basePath + path;
+        char fullPath[PATH_MAX];
+        snprintf(fullPath, sizeof(fullPath), "%s%s", _basePath.c_str(), path);
         struct stat st;
-        return stat(fullPath.c_str(), &st) == 0;
+        return stat(fullPath, &st) == 0;
     }
 };
 
@@ -0,0 +1,752 @@
+/**
+ * Scripted scenario runner, see scenario.h.
+ */
+
+#include "mocks/Arduino.h"
+#include "mocks/MatrixHardware_Teensy4_ShieldV5.h"
+#include "mocks/IRremote.hpp"
+
+#include "PlaybackStats.h"
+#include "alloc_tracker.h"
+#include "frame_export.h"
+#include "scenario.h"
+#include "wall.h"
+
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// From Bonnaroo.cpp
+void setup();
+void loop();
+void getPlaybackStats(PlaybackStats &stats);
+void resetPlaybackStats(void);
+extern SmartMatrixShim matrix;
+
+#define SCENARIO_IR_GAP_MS          450     // the sketch ignores presses less than 400 ms apart
+#define SCENARIO_BRIGHTNESS_MS      100
+#define SCENARIO_STALL_MS           5000    // no frame for this long, a GIF that won't play
+#define SCENARIO_TIMEOUT_MS         60000
+#define SCENARIO_ALLOC_SITES        10      // call sites printed for a step that allocated too much
+
+#define IR_RIGHT                    0xF50ABF00
+
+static const struct {
+    const char *name;
+    uint32_t code;
+} kButtons[] = {
+    { "LEFT", 0xF708BF00 }, { "RIGHT", IR_RIGHT }, { "ENTER", 0xF609BF00 }, { "PLAY", 0xFE01BF00 },
+    { "STOP", 0xF906BF00 }, { "BACK", 0xF10EBF00 }, { "SETUP", 0xFB04BF00 }, { "UP", 0xFA05BF00 },
+    { "DOWN", 0xF20DBF00 }, { "VOL_UP", 0xFD02BF00 }, { "VOL_DOWN", 0xFF00BF00 },
+    { "0", 0xF30CBF00 }, { "1", 0xEF10BF00 }, { "2", 0xEE11BF00 }, { "3", 0xED12BF00 }, { "4", 0xEB14BF00 },
+    { "5", 0xEA15BF00 }, { "6", 0xE916BF00 }, { "7", 0xE718BF00 }, { "8", 0xE619BF00 }, { "9", 0xE51ABF00 },
+};
+
+enum StepOp { STEP_WAIT, STEP_KEY, STEP_CONSOLE, STEP_PLAY, STEP_EACH, STEP_SWITCH, STEP_BRIGHTNESS };
+
+struct Step {
+    int line;
+    std::string text;               // as written, for the metrics
+    StepOp op;
+    int64_t at_ms = -1;             // start no earlier than this after the scenario's start
+    uint32_t code = 0;
+    int count = 1;                  // presses, cycles or GIF switches
+    int from = 0, to = 0, step = 0;
+    uint32_t every_ms = 0;
+    uint32_t timeout_ms = SCENARIO_TIMEOUT_MS;
+    int64_t maxAllocs = -1;         // heap allocations loop() may make during the step, -1 for any
+    int64_t allocsPerSwitch = 0;    // ... and for each GIF switch in it
+    uint32_t ms = 0;
+    std::string command;
+};
+
+// One step's share of the sketch's stats, or the run's
+struct StepMetrics {
+    std::string text;
+    int line = 0;
+    uint64_t duration_ms = 0;
+    uint64_t frames = 0;
+    uint64_t framesHeld = 0;
+    uint64_t swapPendingLoops = 0;
+    uint64_t cpuNs = 0;
+    int gifsPlayed = 0;
+    int gifsSkipped = 0;
+    bool timedOut = false;
+    uint64_t heapAllocs = 0;        // by loop()
+    bool overAllocs = false;        // more than the step's "allocs N"
+
+    // StageTimer, but a run can outgrow its 32 bit total
+    struct Timer {
+        uint64_t count = 0, total_us = 0, max_us = 0;
+
+        void add(const StageTimer &t) {
+            count += t.count;
+            total_us += t.total_us;
+            max_us = std::max<uint64_t>(max_us, t.max_us);
+        }
+
+        void add(const Timer &t) {
+            count += t.count;
+            total_us += t.total_us;
+            max_us = std::max(max_us, t.max_us);
+        }
+    } loop, decode, swap, stream, sync, audio, gifSwitch, gifAdvance, late, idle;
+    uint64_t lateBuckets[LATENESS_BUCKETS] = {};
+
+    void add(const PlaybackStats &s) {
+        frames += s.framesShown;
+        framesHeld += s.framesHeld;
+        swapPendingLoops += s.swapPendingLoops;
+        loop.add(s.loop);
+        decode.add(s.decode);
+        swap.add(s.swap);
+        stream.add(s.stream);
+        sync.add(s.sync);
+        audio.add(s.audio);
+        gifSwitch.add(s.gifSwitch);
+        gifAdvance.add(s.gifAdvance);
+        late.add(s.lateness.late);
+        idle.add(s.idle);
+        for (int i = 0; i < LATENESS_BUCKETS; i++) {
+            lateBuckets[i] += s.lateness.buckets[i];
+        }
+    }
+
+    void add(const StepMetrics &m) {
+        duration_ms += m.duration_ms;
+        frames += m.frames;
+        framesHeld += m.framesHeld;
+        swapPendingLoops += m.swapPendingLoops;
+        cpuNs += m.cpuNs;
+        gifsPlayed += m.gifsPlayed;
+        gifsSkipped += m.gifsSkipped;
+        timedOut |= m.timedOut;
+        heapAllocs += m.heapAllocs;
+        overAllocs |= m.overAllocs;
+        loop.add(m.loop);
+        decode.add(m.decode);
+        swap.add(m.swap);
+        stream.add(m.stream);
+        sync.add(m.sync);
+        audio.add(m.audio);
+        gifSwitch.add(m.gifSwitch);
+        gifAdvance.add(m.gifAdvance);
+        late.add(m.late);
+        idle.add(m.idle);
+        for (int i = 0; i < LATENESS_BUCKETS; i++) {
+            lateBuckets[i] += m.lateBuckets[i];
+        }
+    }
+};
+
+static uint64_t threadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool parseNumber(const std::string &word, int64_t &value) {
+    char *end;
+    value = strtoll(word.c_str(), &end, 0);
+    return !word.empty() && *end == '\0';
+}
+
+static bool parseButton(const std::string &word, uint32_t &code) {
+    for (const auto &button : kButtons) {
+        if (strcasecmp(word.c_str(), button.name) == 0) {
+            code = button.code;
+            return true;
+        }
+    }
+    int64_t value;
+    if (word.compare(0, 2, "0x") == 0 && parseNumber(word, value) && value > 0 && value <= 0xFFFFFFFFLL) {
+        code = (uint32_t)value;
+        return true;
+    }
+    return false;
+}
+
+class ScenarioRunner {
+public:
+    bool load(const std::string &path) {
+        std::ifstream file(path);
+        if (!file) {
+            printf("[Scenario] can't open %s\n", path.c_str());
+            return false;
+        }
+        name_ = path.substr(path.rfind('/') + 1);
+        name_ = name_.substr(0, name_.rfind('.'));
+
+        std::string text;
+        for (int line = 1; std::getline(file, text); line++) {
+            text = text.substr(0, text.find('#'));
+            std::istringstream in(text);
+            std::vector<std::string> words;
+            for (std::string word; in >> word;) {
+                words.push_back(word);
+            }
+            if (words.empty()) {
+                continue;
+            }
+            if (words[0] == "name" && words.size() > 1) {
+                name_ = text.substr(text.find(words[1]));
+                name_.erase(name_.find_last_not_of(" \t\r") + 1);
+                continue;
+            }
+            Step step;
+            std::string error = parseStep(words, text, step);
+            if (!error.empty()) {
+                printf("[Scenario] %s:%d: %s\n", path.c_str(), line, error.c_str());
+                return false;
+            }
+            step.line = line;
+            steps_.push_back(step);
+        }
+        if (steps_.empty()) {
+            printf("[Scenario] %s has no steps\n", path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Starts the scenario's clock, once setup() has returned
+    void start(uint32_t now) {
+        start_ = now;
+        lastPress_ = now - SCENARIO_IR_GAP_MS;
+    }
+
+    // Carries out the steps up to now, called between loops, returns false when they're all done
+    bool poll(uint32_t now) {
+        while (index_ < steps_.size()) {
+            const Step &step = steps_[index_];
+            if (!active_) {
+                if (step.at_ms >= 0 && (int64_t)(now - start_) < step.at_ms) {
+                    return true;
+                }
+                begin(step, now);
+            }
+            if (!run(step, now)) {
+                return true;
+            }
+            finish(step, now);
+        }
+        return false;
+    }
+
+    void writeMetrics(FILE *out) const {
+        StepMetrics total;
+        for (const StepMetrics &m : metrics_) {
+            total.add(m);
+        }
+        fprintf(out, "{\n  \"scenario\": \"%s\",\n  \"steps\": [\n", jsonEscape(name_).c_str());
+        for (size_t i = 0; i < metrics_.size(); i++) {
+            writeStep(out, metrics_[i], "    ", i + 1 < metrics_.size() ? "," : "");
+        }
+        fprintf(out, "  ],\n  \"total\":\n");
+        writeStep(out, total, "  ", "");
+        fprintf(out, "}\n");
+    }
+
+    void printSummary(void) const {
+        for (const StepMetrics &m : metrics_) {
+            printf("[Scenario] line %-3d %-32s %7.1f s %6.1f fps  switch %6.1f ms (max %6.1f)  late %5.2f ms "
+                   "(max %6.1f)  cpu %5.1f%%  idle %5.1f%%  allocs %llu%s%s\n",
+                   m.line, m.text.c_str(), m.duration_ms / 1e3, fps(m), avg_ms(m.gifSwitch), m.gifSwitch.max_us / 1e3,
+                   avg_ms(m.late), m.late.max_us / 1e3, cpuPercent(m), idlePercent(m), (unsigned long long)m.heapAllocs,
+                   m.overAllocs ? "  TOO MANY ALLOCATIONS" : "", m.timedOut ? "  TIMED OUT" : "");
+        }
+    }
+
+    // True if a step's loop() allocated more than its "allocs N"
+    bool failed(void) const {
+        for (const StepMetrics &m : metrics_) {
+            if (m.overAllocs) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int consoleFd = -1;             // the write end of the sketch's console
+
+private:
+    static std::string parseStep(const std::vector<std::string> &all, const std::string &text, Step &step) {
+        std::vector<std::string> words = all;
+        int64_t value;
+        if (words[0][0] == '@') {
+            if (!parseNumber(words[0].substr(1), value) || value < 0) {
+                return "bad start time " + words[0];
+            }
+            step.at_ms = value;
+            words.erase(words.begin());
+            if (words.empty()) {
+                return "no step after " + all[0];
+            }
+        }
+        const std::string &op = words[0];
+        step.text = text.substr(text.find(op));
+        step.text.erase(step.text.find_last_not_of(" \t\r") + 1);
+
+        if (op == "console") {
+            step.op = STEP_CONSOLE;
+            step.command = step.text.substr(op.size());
+            step.command.erase(0, step.command.find_first_not_of(" \t"));
+            return step.command.empty() ? "console needs a command" : "";
+        }
+
+        // the positional numbers, then "times N", "every MS", "timeout MS" and "allocs N [per switch M]"
+        std::vector<int64_t> numbers;
+        size_t i = 1;
+        if (op == "key") {
+            if (words.size() < 2 || !parseButton(words[1], step.code)) {
+                return "key needs a button or a 0x code";
+            }
+            i = 2;
+        }
+        for (; i < words.size(); i++) {
+            if (words[i] == "times" || words[i] == "every" || words[i] == "timeout") {
+                if (i + 1 >= words.size() || !parseNumber(words[i + 1], value) || value < 1) {
+                    return words[i] + " needs a number over 0";
+                }
+                if (words[i] == "times") {
+                    step.count = (int)value;
+                } else if (words[i] == "every") {
+                    step.every_ms = (uint32_t)value;
+                } else {
+                    step.timeout_ms = (uint32_t)value;
+                }
+                i++;
+            } else if (words[i] == "allocs") {
+                if (i + 1 >= words.size() || !parseNumber(words[i + 1], value) || value < 0) {
+                    return "allocs needs a number";
+                }
+                step.maxAllocs = value;
+                i++;
+                if (i + 2 < words.size() && words[i + 1] == "per" && words[i + 2] == "switch") {
+                    if (i + 3 >= words.size() || !parseNumber(words[i + 3], value) || value < 0) {
+                        return "per switch needs a number";
+                    }
+                    step.allocsPerSwitch = value;
+                    i += 3;
+                }
+            } else if (parseNumber(words[i], value)) {
+                numbers.push_back(value);
+            } else {
+                return "unexpected " + words[i];
+            }
+        }
+
+        if (op == "wait" && numbers.size() == 1 && numbers[0] >= 0) {
+            step.op = STEP_WAIT;
+            step.ms = (uint32_t)numbers[0];
+        } else if (op == "key" && numbers.empty()) {
+            step.op = STEP_KEY;
+            step.every_ms = step.every_ms ? step.every_ms : SCENARIO_IR_GAP_MS;
+        } else if ((op == "play" || op == "each") && numbers.size() == 1 && numbers[0] > 0) {
+            step.op = op == "play" ? STEP_PLAY : STEP_EACH;
+            step.count = (int)numbers[0];
+        } else if (op == "switch" && numbers.size() == 1 && numbers[0] > 0) {
+            step.op = STEP_SWITCH;
+            step.count = (int)numbers[0];
+            step.every_ms = step.every_ms ? step.every_ms : SCENARIO_IR_GAP_MS;
+        } else if (op == "brightness" && numbers.size() == 3 && numbers[2] > 0) {
+            step.op = STEP_BRIGHTNESS;
+            step.from = (int)numbers[0];
+            step.to = (int)numbers[1];
+            step.step = (int)numbers[2];
+            step.every_ms = step.every_ms ? step.every_ms : SCENARIO_BRIGHTNESS_MS;
+        } else {
+            return "bad step \"" + step.text + "\"";
+        }
+        return "";
+    }
+
+    void begin(const Step &step, uint32_t now) {
+        printf("[Scenario] line %d: %s\n", step.line, step.text.c_str());
+        resetPlaybackStats();
+        getPlaybackStats(stats_);
+        allocTrackerReset();
+        active_ = true;
+        stepStart_ = now;
+        stepCpu_ = threadCpuNs();
+        current_ = StepMetrics();
+        current_.text = step.text;
+        current_.line = step.line;
+
+        done_ = 0;
+        next_ = now;
+        value_ = step.from;
+        waitingForSwitch_ = false;
+        pendingPress_ = false;
+        gifStart_ = now;
+        gif_ = stats_.gif;
+        cycles_ = stats_.gifCycles;
+        cyclesPending_ = stats_.gifStarting;
+        switches_ = 0;
+        frames_ = 0;
+        lastFrame_ = now;
+    }
+
+    void finish(const Step &step, uint32_t now) {
+        getPlaybackStats(stats_);
+        current_.duration_ms = now - stepStart_;
+        current_.cpuNs = threadCpuNs() - stepCpu_;
+        current_.add(stats_);
+        current_.heapAllocs = allocTrackerCount();
+        uint64_t switches = current_.gifSwitch.count + current_.gifAdvance.count;
+        int64_t allowed = step.maxAllocs + step.allocsPerSwitch * (int64_t)switches;
+        if (step.maxAllocs >= 0 && current_.heapAllocs > (uint64_t)allowed) {
+            printf("[Scenario] line %d: loop() allocated %llu times over %llu GIF switches, over the %lld allowed, "
+                   "from:\n", step.line, (unsigned long long)current_.heapAllocs, (unsigned long long)switches,
+                   (long long)allowed);
+            allocTrackerReport(stdout, SCENARIO_ALLOC_SITES);
+            current_.overAllocs = true;
+        }
+        metrics_.push_back(current_);
+        active_ = false;
+        index_++;
+    }
+
+    void press(uint32_t code, uint32_t now) {
+        IrReceiver.injectCode(code);
+        lastPress_ = now;
+    }
+
+    // A press due at next_, or the first of a step once the one before's last is far enough back
+    bool pressDue(uint32_t now) const {
+        return (int32_t)(now - next_) >= 0 && (done_ || now - lastPress_ >= SCENARIO_IR_GAP_MS);
+    }
+
+    void console(const std::string &line) {
+        std::string text = line + "\n";
+        if (write(consoleFd, text.data(), text.size()) != (ssize_t)text.size()) {
+            printf("[Scenario] console write failed\n");
+        }
+    }
+
+    // Tracks frames and cycles of the GIF playing, true once it's done count cycles or given up
+    bool gifDone(const Step &step, uint32_t now) {
+        if (stats_.framesShown != frames_) {
+            frames_ = stats_.framesShown;
+            lastFrame_ = now;
+        }
+        if (stats_.gif != gif_) {
+            // switched by something else (a key step just before), count cycles of the new one from its first frame -
+            // one that resumed from a snapshot has some already
+            gif_ = stats_.gif;
+            cyclesPending_ = true;
+            gifStart_ = now;
+        }
+        if (cyclesPending_ && !stats_.gifStarting) {
+            cycles_ = stats_.gifCycles;
+            cyclesPending_ = false;
+        }
+        if (!cyclesPending_ && stats_.gifCycles >= cycles_ + step.count) {
+            current_.gifsPlayed++;
+            return true;
+        }
+        if (now - lastFrame_ >= SCENARIO_STALL_MS) {
+            printf("[Scenario] GIF %d showed no frame for %d ms, skipped\n", gif_, SCENARIO_STALL_MS);
+            current_.gifsSkipped++;
+            return true;
+        }
+        if (now - gifStart_ >= step.timeout_ms) {
+            printf("[Scenario] GIF %d timed out after %u ms\n", gif_, (unsigned)step.timeout_ms);
+            current_.timedOut = true;
+            return true;
+        }
+        return false;
+    }
+
+    // Carries on with the step, true when it's done
+    bool run(const Step &step, uint32_t now) {
+        getPlaybackStats(stats_);
+        switch (step.op) {
+            case STEP_WAIT:
+                return now - stepStart_ >= step.ms;
+
+            case STEP_CONSOLE:
+                console(step.command);
+                return true;
+
+            case STEP_KEY:
+                if (done_ < step.count && pressDue(now)) {
+                    press(step.code, now);
+                    next_ = now + step.every_ms;
+                    done_++;
+                }
+                return done_ >= step.count;
+
+            case STEP_BRIGHTNESS:
+                if ((int32_t)(now - next_) >= 0) {
+                    bool up = step.to >= step.from;
+                    if (up ? value_ > step.to : value_ < step.to) {
+                        return true;
+                    }
+                    console("set brightness " + std::to_string(value_));
+                    value_ += up ? step.step : -step.step;
+                    next_ = now + step.every_ms;
+                }
+                return false;
+
+            case STEP_SWITCH:
+                if (done_ < step.count) {
+                    if (pressDue(now)) {
+                        press(IR_RIGHT, now);
+                        next_ = now + step.every_ms;
+                        done_++;
+                        lastFrame_ = now;
+                    }
+                    return false;
+                }
+                // then until the last GIF's first frame is up
+                if ((int)stats_.gifSwitch.count >= step.count) {
+                    return true;
+                }
+                if (now - lastFrame_ >= SCENARIO_STALL_MS) {
+                    current_.timedOut = true;
+                    return true;
+                }
+                return false;
+
+            case STEP_PLAY:
+                return gifDone(step, now);
+
+            case STEP_EACH:
+                if (pendingPress_) {
+                    // RIGHT once the IR remote's gap is up
+                    if ((int32_t)(now - next_) >= 0) {
+                        pendingPress_ = false;
+                        switches_ = stats_.gifSwitch.count;
+                        press(IR_RIGHT, now);
+                        lastFrame_ = now;
+                    }
+                    return false;
+                }
+                if (waitingForSwitch_) {
+                    if (stats_.gifSwitch.count > switches_ || now - lastFrame_ >= SCENARIO_STALL_MS) {
+                        waitingForSwitch_ = false;
+                        gif_ = stats_.gif;
+                        cycles_ = stats_.gifCycles;
+                        cyclesPending_ = false;
+                        gifStart_ = now;
+                        lastFrame_ = now;
+                        frames_ = stats_.framesShown;
+                    }
+                    return false;
+                }
+                if (done_ == 0 && stats_.gifCount == 0) {
+                    return true;
+                }
+                if (!gifDone(step, now)) {
+                    return false;
+                }
+                if (++done_ >= stats_.gifCount) {
+                    return true;
+                }
+                waitingForSwitch_ = true;
+                next_ = lastPress_ + SCENARIO_IR_GAP_MS;
+                pendingPress_ = true;
+                return false;
+        }
+        return true;
+    }
+
+    static double fps(const StepMetrics &m) {
+        return m.duration_ms ? m.frames * 1e3 / m.duration_ms : 0.0;
+    }
+
+    static double avg_ms(const StepMetrics::Timer &t) {
+        return t.count ? t.total_us / 1e3 / t.count : 0.0;
+    }
+
+    static double cpuPercent(const StepMetrics &m) {
+        return m.duration_ms ? m.cpuNs / 1e4 / m.duration_ms : 0.0;
+    }
+
+    // of the step, the sketch asleep between frames
+    static double idlePercent(const StepMetrics &m) {
+        return m.duration_ms ? m.idle.total_us / 10.0 / m.duration_ms : 0.0;
+    }
+
+    static std::string jsonEscape(const std::string &text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += (unsigned char)c < 0x20 ? ' ' : c;
+        }
+        return out;
+    }
+
+    static void writeTimer(FILE *out, const char *indent, const char *name, const StepMetrics::Timer &t,
+                           const char *comma) {
+        fprintf(out, "%s  \"%s\": { \"count\": %llu, \"avg\": %llu, \"max\": %llu, \"total\": %llu }%s\n", indent,
+                name, (unsigned long long)t.count, (unsigned long long)(t.count ? t.total_us / t.count : 0),
+                (unsigned long long)t.max_us, (unsigned long long)t.total_us, comma);
+    }
+
+    static void writeStep(FILE *out, const StepMetrics &m, const char *indent, const char *comma) {
+        fprintf(out, "%s{\n", indent);
+        if (m.line) {
+            fprintf(out, "%s  \"line\": %d,\n%s  \"step\": \"%s\",\n", indent, m.line, indent,
+                    jsonEscape(m.text).c_str());
+        }
+        fprintf(out, "%s  \"duration_ms\": %llu,\n", indent, (unsigned long long)m.duration_ms);
+        fprintf(out, "%s  \"timed_out\": %s,\n", indent, m.timedOut ? "true" : "false");
+        fprintf(out, "%s  \"frames\": %llu,\n%s  \"fps\": %.2f,\n", indent, (unsigned long long)m.frames, indent,
+                fps(m));
+        fprintf(out, "%s  \"frames_held\": %llu,\n", indent, (unsigned long long)m.framesHeld);
+        fprintf(out, "%s  \"gifs_played\": %d,\n%s  \"gifs_skipped\": %d,\n", indent, m.gifsPlayed, indent,
+                m.gifsSkipped);
+        fprintf(out, "%s  \"cpu_ms\": %.1f,\n%s  \"cpu_percent\": %.1f,\n", indent, m.cpuNs / 1e6, indent,
+                cpuPercent(m));
+        fprintf(out, "%s  \"idle_percent\": %.1f,\n", indent, idlePercent(m));
+        fprintf(out, "%s  \"heap_allocs\": %llu,\n", indent, (unsigned long long)m.heapAllocs);
+        fprintf(out, "%s  \"swap_pending_loops\": %llu,\n", indent, (unsigned long long)m.swapPendingLoops);
+        fprintf(out, "%s  \"switch_latency_us\": { \"count\": %llu, \"avg\": %llu, \"max\": %llu },\n", indent,
+                (unsigned long long)m.gifSwitch.count,
+                (unsigned long long)(m.gifSwitch.count ? m.gifSwitch.total_us / m.gifSwitch.count : 0),
+                (unsigned long long)m.gifSwitch.max_us);
+        fprintf(out, "%s  \"advance_cut_us\": { \"count\": %llu, \"avg\": %llu, \"max\": %llu },\n", indent,
+                (unsigned long long)m.gifAdvance.count,
+                (unsigned long long)(m.gifAdvance.count ? m.gifAdvance.total_us / m.gifAdvance.count : 0),
+                (unsigned long long)m.gifAdvance.max_us);
+        fprintf(out, "%s  \"lateness_us\": { \"count\": %llu, \"avg\": %llu, \"max\": %llu, \"histogram\": {", indent,
+                (unsigned long long)m.late.count,
+                (unsigned long long)(m.late.count ? m.late.total_us / m.late.count : 0),
+                (unsigned long long)m.late.max_us);
+        for (uint8_t i = 0; i < LATENESS_BUCKETS; i++) {
+            if (i < LATENESS_BUCKETS - 1) {
+                fprintf(out, " \"<=%lums\": %llu,", (unsigned long)LatenessHistogram::limit_us(i) / 1000,
+                        (unsigned long long)m.lateBuckets[i]);
+            } else {
+                fprintf(out, " \"more\": %llu", (unsigned long long)m.lateBuckets[i]);
+            }
+        }
+        fprintf(out, " } },\n%s  \"stages_us\": {\n", indent);
+        std::string inner = std::string(indent) + "  ";
+        writeTimer(out, inner.c_str(), "loop", m.loop, ",");
+        writeTimer(out, inner.c_str(), "decode", m.decode, ",");
+        writeTimer(out, inner.c_str(), "swap", m.swap, ",");
+        writeTimer(out, inner.c_str(), "stream", m.stream, ",");
+        writeTimer(out, inner.c_str(), "sync", m.sync, ",");
+        writeTimer(out, inner.c_str(), "audio", m.audio, ",");
+        writeTimer(out, inner.c_str(), "idle", m.idle, "");
+        fprintf(out, "%s  }\n%s}%s\n", indent, indent, comma);
+    }
+
+    std::string name_;
+    std::vector<Step> steps_;
+    std::vector<StepMetrics> metrics_;
+    size_t index_ = 0;
+    uint32_t start_ = 0;
+    uint32_t lastPress_ = 0;
+
+    // the step under way
+    bool active_ = false;
+    uint32_t stepStart_ = 0;
+    uint64_t stepCpu_ = 0;
+    StepMetrics current_;
+    PlaybackStats stats_;
+    int done_ = 0;                  // presses made, or GIFs played
+    uint32_t next_ = 0;             // when the next press or console line is due
+    int value_ = 0;
+    bool waitingForSwitch_ = false;
+    bool pendingPress_ = false;
+    uint32_t gifStart_ = 0;
+    int gif_ = -1;
+    uint32_t cycles_ = 0;           // gifCycles of gif_ when the step started on it
+    bool cyclesPending_ = false;    // gif_ switched to, cycles_ is taken once its first frame is up
+    uint32_t switches_ = 0;
+    uint32_t frames_ = 0;
+    uint32_t lastFrame_ = 0;
+};
+
+int runScenario(const std::string &scenarioPath, const std::string &metricsPath, const std::string &basePath,
+                FrameExportWriter *frames) {
+    ScenarioRunner runner;
+    if (!runner.load(scenarioPath)) {
+        return 1;
+    }
+
+    // setup() waits forever for a card with GIFs on it
+    struct stat st;
+    if (stat((basePath + "/gifs").c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        printf("[Scenario] no gifs directory in %s\n", basePath.c_str());
+        return 1;
+    }
+
+    // the console's input is a pipe the runner writes to
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+        perror("[Scenario] pipe");
+        return 1;
+    }
+    Serial.consoleFd = pipeFds[0];
+    runner.consoleFd = pipeFds[1];
+
+    // the same GIFs in the same order every run
+    srand(1);
+
+    std::atomic<bool> finished{false};
+    std::thread arduinoThread([&]() {
+        setup();
+        runner.start(millis());
+        while (true) {
+            uint32_t now = millis();
+            if (!runner.poll(now)) {
+                break;
+            }
+            {
+                AllocScope scope;
+                loop();
+            }
+            std::this_thread::yield();
+        }
+        finished = true;
+    });
+
+    // the refresh, at 60 Hz as the window's would be
+    static rgb24 frame[WALL_RIG_WIDTH * WALL_RIG_HEIGHT];
+    auto next = std::chrono::steady_clock::now();
+    while (!finished) {
+        matrix.refreshFrame(frame, WALL_RIG_WIDTH, WALL_RIG_HEIGHT);
+        if (frames) {
+            frames->publish(frame);
+        }
+        next += std::chrono::microseconds(16667);
+        std::this_thread::sleep_until(next);
+    }
+    arduinoThread.join();
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    Serial.consoleFd = -1;
+
+    runner.printSummary();
+    int result = runner.failed() ? 1 : 0;
+    if (metricsPath.empty()) {
+        runner.writeMetrics(stdout);
+        return result;
+    }
+    FILE *out = fopen(metricsPath.c_str(), "w");
+    if (!out) {
+        perror(metricsPath.c_str());
+        return 1;
+    }
+    runner.writeMetrics(out);
+    fclose(out);
+    printf("[Scenario] metrics in %s\n", metricsPath.c_str());
+    return result;
+}
@@ -0,0 +1,45 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+/**
+ * Scripted scenarios for reproducible performance runs.
+ *
+ * A scenario file is a list of steps, one per line, run in order from the moment the sketch's setup() returns. '#'
+ * starts a comment, and "@MS step" holds a step back until MS milliseconds after the start:
+ *
+ *   name <text>                               the scenario's name in the metrics
+ *   wait <ms>
+ *   key <button|0xCODE> [times N] [every MS]  presses on the IR remote, 450 ms apart by default (the sketch ignores
+ *                                             presses less than 400 ms apart); buttons are LEFT, RIGHT, ENTER, PLAY,
+ *                                             STOP, BACK, SETUP, UP, DOWN, VOL_UP, VOL_DOWN and 0-9
+ *   console <command>                         a line typed on the console, e.g. "console set cache 32"
+ *   play <cycles> [timeout MS]                until the GIF playing has been through cycles more times
+ *   each <cycles> [timeout MS]                every GIF in the playlist in turn for cycles, from the one playing
+ *   switch <count> [every MS]                 rapid switching, count presses of RIGHT
+ *   brightness <from> <to> <step> [every MS]  set brightness over a range on the console, 100 ms apart by default
+ *
+ * play and each give up on a GIF that hasn't shown a frame for 5 s (one too big to play, say) or has played for
+ * timeout ms (default 60 s) without getting through the cycles.
+ *
+ * Any step can end in "allocs N [per switch M]": the run fails if loop() allocates from the heap more than N times
+ * during it, plus M for each GIF switch in it, and the call sites are printed (alloc_tracker.h).  scenarios/allocs.scn
+ * holds steady playback to none at all, and switching GIFs to the File each opens.
+ *
+ * The runner is headless: it runs the sketch's loop() as the simulator's Arduino thread does, loop() sleeping between
+ * frames itself, and between loops carries out the steps, and the layers are refreshed at 60 Hz.  Each step's metrics
+ * are the sketch's stats for its duration (PlaybackStats.h): frames and fps, GIF switch latency, how late
+ * frames went up, the per-stage timings, the sketch thread's CPU time and loop()'s heap allocations.  They're written
+ * as JSON with the totals of the run.
+ */
+
+#include <string>
+
+class FrameExportWriter;
+
+// Runs the scenario on the GIFs in basePath (set with SD_setBasePath() already) and writes its metrics to metricsPath,
+// or stdout if it's empty, returns the process exit code: 1 if it couldn't run or a step allocated too much. Each
+// refresh goes to frames too if it's given (--export, see frame_export.h).
+int runScenario(const std::string &scenarioPath, const std::string &metricsPath, const std::string &basePath,
+                FrameExportWriter *frames = nullptr);
+
+#endif // SCENARIO_H
@@ -0,0 +1,24 @@
+/**
+ * The mocks' global instances and the fonts the sketch refers to.
+ *
+ * Linked into led_simulator, and into each rig of a simulated wall
+ * (led_sketch.so, see wall.h) so every rig has its own.
+ */
+
+#include "mocks/Arduino.h"
+#include "mocks/SPI.h"
+#include "mocks/SD.h"
+#include "mocks/IRremote.hpp"
+
+SerialClass Serial;
+SerialClass Serial3;
+SPIClass SPI;
+SPIClass SPI1;
+SDClass SD;
+IRrecv IrReceiver;
+
+// Fonts (just need to exist, not actually used for rendering in simulator)
+const void* font3x5 = nullptr;
+const void* font5x7 = nullptr;
+const void* font6x10 = nullptr;
+const void* font8x13 = nullptr;
@@ -0,0 +1,432 @@
+/**
+ * Simulated LED wall, see wall.h.
+ */
+
+#include "wall.h"
+
+#include <SDL2/SDL.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// From main.cpp
+uint32_t irCodeForKey(int32_t key);
+
+// A rig's loop() calls, added up by the thread that ran them
+struct LoopStats {
+    std::atomic<uint64_t> loops{0};
+    std::atomic<uint64_t> wallNs{0};
+    std::atomic<uint64_t> maxNs{0};
+    std::atomic<uint64_t> cpuNs{0};
+};
+
+// Frames the refresh saw change, kept by the main thread
+struct FrameStats {
+    uint64_t frames = 0;
+    uint64_t maxGapNs = 0;
+};
+
+struct Rig {
+    void *handle = nullptr;
+    const WallSketch *sketch = nullptr;
+    bool setupDone = false;
+    Clock::time_point nextRun;
+    int presses = 0;                // presses of RIGHT still to send, so each rig plays a different GIF
+
+    LoopStats loop;
+    FrameStats frame;
+    uint64_t lastHash = 0;
+    Clock::time_point lastChange;
+    uint8_t pixels[WALL_RIG_WIDTH * WALL_RIG_HEIGHT * 3];
+};
+
+// The totals of one rig over a report's interval
+struct RigReport {
+    uint64_t loops, wallNs, maxNs, cpuNs, frames, maxGapNs;
+};
+
+static uint64_t threadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t hashFrame(const uint8_t *pixels, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ pixels[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static std::string sketchModulePath() {
+    char exe[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (n <= 0) return "led_sketch.so";
+    exe[n] = 0;
+    std::string path = exe;
+    return path.substr(0, path.rfind('/') + 1) + "led_sketch.so";
+}
+
+static bool copyFile(const std::string &from, const std::string &to) {
+    int in = open(from.c_str(), O_RDONLY);
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0700);
+    bool ok = in >= 0 && out >= 0;
+    char buffer[65536];
+    ssize_t n;
+    while (ok && (n = read(in, buffer, sizeof(buffer))) > 0) {
+        ok = write(out, buffer, n) == n;
+    }
+    if (in >= 0) close(in);
+    if (out >= 0) close(out);
+    return ok;
+}
+
+// The dynamic loader shares one copy of a library between every dlopen() of the same file, so each rig loads its own
+// copy of led_sketch.so.  The module is linked with -Bsymbolic and -fno-gnu-unique, so nothing in it binds to another
+// copy's symbols.
+static bool loadRig(Rig &rig, const std::string &module, const std::string &directory, int index) {
+    std::string path = directory + "/rig" + std::to_string(index) + ".so";
+    if (!copyFile(module, path)) {
+        printf("[Wall] can't copy %s to %s\n", module.c_str(), path.c_str());
+        return false;
+    }
+    rig.handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    unlink(path.c_str());
+    if (!rig.handle) {
+        printf("[Wall] %s\n", dlerror());
+        return false;
+    }
+    WallSketchEntry entry = (WallSketchEntry)dlsym(rig.handle, "wallSketch");
+    if (!entry) {
+        printf("[Wall] %s has no wallSketch()\n", module.c_str());
+        return false;
+    }
+    rig.sketch = entry();
+    return true;
+}
+
+class RigPool {
+public:
+    RigPool(std::vector<Rig> &rigs, int threads) : rigs(rigs) {
+        for (size_t i = 0; i < rigs.size(); i++) ready.push_back(i);
+        for (int i = 0; i < threads; i++) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    int setupCount() const { return setups; }
+    int busyCount() const { return busy; }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running = false;
+        }
+        wake.notify_all();
+    }
+
+    void join() {
+        for (std::thread &worker : workers) worker.join();
+    }
+
+    void detach() {
+        for (std::thread &worker : workers) worker.detach();
+    }
+
+private:
+    // Takes the rig that has waited longest, runs setup() or one loop(), and puts it back a millisecond later as the
+    // simulator's Arduino thread does
+    void work() {
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [this]() { return !running || !ready.empty(); });
+                if (!running) return;
+                index = ready.front();
+                ready.pop_front();
+                busy++;
+            }
+            Rig &rig = rigs[index];
+            std::this_thread::sleep_until(rig.nextRun);
+
+            if (!rig.setupDone) {
+                rig.sketch->setup();
+                rig.setupDone = true;
+                setups++;
+            } else {
+                Clock::time_point start = Clock::now();
+                uint64_t cpu = threadCpuNs();
+                rig.sketch->loop();
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+                rig.loop.cpuNs += threadCpuNs() - cpu;
+                rig.loop.wallNs += ns;
+                rig.loop.loops++;
+                uint64_t max = rig.loop.maxNs;
+                while (ns > max && !rig.loop.maxNs.compare_exchange_weak(max, ns)) {
+                }
+            }
+            rig.nextRun = Clock::now() + std::chrono::milliseconds(1);
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                ready.push_back(index);
+                busy--;
+            }
+            wake.notify_one();
+        }
+    }
+
+    std::vector<Rig> &rigs;
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<size_t> ready;
+    bool running = true;
+    std::atomic<int> setups{0};
+    std::atomic<int> busy{0};
+};
+
+static RigReport takeReport(Rig &rig) {
+    RigReport r;
+    r.loops = rig.loop.loops.exchange(0);
+    r.wallNs = rig.loop.wallNs.exchange(0);
+    r.maxNs = rig.loop.maxNs.exchange(0);
+    r.cpuNs = rig.loop.cpuNs.exchange(0);
+    r.frames = rig.frame.frames;
+    r.maxGapNs = rig.frame.maxGapNs;
+    rig.frame = FrameStats();
+    return r;
+}
+
+static void addReport(RigReport &total, const RigReport &r) {
+    total.loops += r.loops;
+    total.wallNs += r.wallNs;
+    total.maxNs = std::max(total.maxNs, r.maxNs);
+    total.cpuNs += r.cpuNs;
+    total.frames += r.frames;
+    total.maxGapNs = std::max(total.maxGapNs, r.maxGapNs);
+}
+
+static void printReportLine(const char *rig, const RigReport &r, double seconds) {
+    printf("%4s %7.1f %13.1f %8lu %12.1f %12.1f %7.1f %13.1f\n", rig, r.frames / seconds, r.maxGapNs / 1e6,
+           (unsigned long)r.loops, r.loops ? r.wallNs / 1e3 / r.loops : 0.0, r.maxNs / 1e3, r.cpuNs / 1e7 / seconds,
+           r.frames ? r.cpuNs / 1e3 / r.frames : 0.0);
+}
+
+static void printReport(const char *title, const std::vector<RigReport> &reports, double seconds) {
+    printf("[Wall] %s, %.1f s\n", title, seconds);
+    printf("%4s %7s %13s %8s %12s %12s %7s %13s\n", "rig", "fps", "worst gap ms", "loops", "loop avg us",
+           "loop max us", "cpu %", "cpu us/frame");
+    RigReport all = {};
+    for (size_t i = 0; i < reports.size(); i++) {
+        printReportLine(std::to_string(i).c_str(), reports[i], seconds);
+        addReport(all, reports[i]);
+    }
+    printReportLine("all", all, seconds);
+}
+
+int runWall(const WallOptions &options) {
+    int rigCount = std::max(1, options.rigs);
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    int threads = options.threads > 0 ? options.threads : std::min(rigCount, cores);
+
+    // a rig without GIFs stops in setup() for good, as the sketch does
+    struct stat st;
+    std::string gifs = options.basePath + "/gifs";
+    if (stat(gifs.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        printf("[Wall] no gifs directory in %s\n", options.basePath.c_str());
+        return 1;
+    }
+
+    char directory[] = "/tmp/led_wall.XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror("[Wall] mkdtemp");
+        return 1;
+    }
+    std::string module = sketchModulePath();
+    std::vector<Rig> rigs(rigCount);
+    bool loaded = true;
+    for (int i = 0; i < rigCount && loaded; i++) {
+        loaded = loadRig(rigs[i], module, directory, i);
+    }
+    rmdir(directory);
+    if (!loaded) return 1;
+
+    for (int i = 0; i < rigCount; i++) {
+        Rig &rig = rigs[i];
+        rig.sketch->setBasePath(options.basePath.c_str());
+        rig.sketch->setMuted(i > 0 && !options.verbose);
+        rig.presses = i;
+    }
+
+    int columns = (int)std::ceil(std::sqrt((double)rigCount));
+    int rows = (rigCount + columns - 1) / columns;
+    int gap = options.scale;
+    int tileWidth = WALL_RIG_WIDTH * options.scale, tileHeight = WALL_RIG_HEIGHT * options.scale;
+
+    SDL_Window *window = nullptr;
+    SDL_Renderer *renderer = nullptr;
+    SDL_Texture *texture = nullptr;
+    if (!options.headless) {
+        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+            printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+            return 1;
+        }
+        window = SDL_CreateWindow("LED Grid Simulator - wall", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                  columns * (tileWidth + gap) - gap, rows * (tileHeight + gap) - gap, SDL_WINDOW_SHOWN);
+        renderer = window ? SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED) : nullptr;
+        texture = renderer ? SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STREAMING,
+                                               WALL_RIG_WIDTH, WALL_RIG_HEIGHT * rigCount) : nullptr;
+        if (!texture) {
+            printf("[Wall] can't open a window: %s\n", SDL_GetError());
+            return 1;
+        }
+    }
+
+    printf("[Wall] %d rigs on %d threads (%d host cores), %s\n", rigCount, threads, cores,
+           options.headless ? "headless" : "tiled in one window");
+    RigPool pool(rigs, threads);
+
+    // The refresh: every rig's layers at 60 Hz, which also lets their swapBuffers() return
+    const auto tick = std::chrono::microseconds(16667);
+    // the sketch ignores presses of the remote less than 400 ms apart
+    const auto pressInterval = std::chrono::milliseconds(450);
+    Clock::time_point nextTick = Clock::now();
+    Clock::time_point nextPress = nextTick;
+    Clock::time_point started, lastReport;
+    bool measuring = false;
+    bool running = true;
+    std::vector<RigReport> totals(rigCount, RigReport());
+    double totalSeconds = 0;
+
+    while (running) {
+        Clock::time_point now = Clock::now();
+        for (Rig &rig : rigs) {
+            rig.sketch->refresh(rig.pixels);
+            uint64_t hash = hashFrame(rig.pixels, sizeof(rig.pixels));
+            if (hash != rig.lastHash) {
+                rig.lastHash = hash;
+                rig.frame.frames++;
+                uint64_t gapNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - rig.lastChange).count();
+                rig.frame.maxGapNs = std::max(rig.frame.maxGapNs, gapNs);
+                rig.lastChange = now;
+            }
+        }
+
+        if (window) {
+            SDL_Event event;
+            while (SDL_PollEvent(&event)) {
+                if (event.type == SDL_QUIT) running = false;
+                if (event.type != SDL_KEYDOWN) continue;
+                uint32_t code = irCodeForKey(event.key.keysym.sym);
+                if (code == 0xFFFFFFFF) running = false;
+                // the whole wall is on one remote
+                if (code) {
+                    for (Rig &rig : rigs) rig.sketch->injectCode(code);
+                }
+            }
+            for (int i = 0; i < rigCount; i++) {
+                SDL_Rect source = { 0, i * WALL_RIG_HEIGHT, WALL_RIG_WIDTH, WALL_RIG_HEIGHT };
+                SDL_UpdateTexture(texture, &source, rigs[i].pixels, WALL_RIG_WIDTH * 3);
+            }
+            SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
+            SDL_RenderClear(renderer);
+            for (int i = 0; i < rigCount; i++) {
+                SDL_Rect source = { 0, i * WALL_RIG_HEIGHT, WALL_RIG_WIDTH, WALL_RIG_HEIGHT };
+                SDL_Rect target = { (i % columns) * (tileWidth + gap), (i / columns) * (tileHeight + gap), tileWidth,
+                                    tileHeight };
+                SDL_RenderCopy(renderer, texture, &source, &target);
+            }
+            SDL_RenderPresent(renderer);
+        }
+
+        // each rig starts one GIF further along its playlist than the last
+        bool staggered = true;
+        if (pool.setupCount() == rigCount && now >= nextPress) {
+            for (Rig &rig : rigs) {
+                if (!rig.presses) continue;
+                rig.sketch->injectCode(irCodeForKey(SDLK_RIGHT));
+                rig.presses--;
+                staggered = false;
+            }
+            nextPress = now + pressInterval;
+        } else {
+            staggered = now >= nextPress;
+        }
+
+        // measure once every rig has been set up and has taken its last press
+        if (!measuring && pool.setupCount() == rigCount && staggered) {
+            measuring = true;
+            started = lastReport = now;
+            for (Rig &rig : rigs) {
+                takeReport(rig);
+                rig.lastChange = now;
+            }
+            printf("[Wall] all rigs set up, measuring\n");
+        }
+        if (measuring) {
+            double seconds = std::chrono::duration<double>(now - lastReport).count();
+            bool done = options.seconds && now - started >= std::chrono::seconds(options.seconds);
+            if (seconds >= options.reportSeconds || done || !running) {
+                std::vector<RigReport> reports;
+                for (int i = 0; i < rigCount; i++) {
+                    reports.push_back(takeReport(rigs[i]));
+                    addReport(totals[i], reports.back());
+                }
+                totalSeconds += seconds;
+                printReport("last interval", reports, seconds);
+                lastReport = now;
+            }
+            if (done) running = false;
+        }
+
+        nextTick += tick;
+        if (nextTick < Clock::now()) nextTick = Clock::now();
+        std::this_thread::sleep_until(nextTick);
+    }
+
+    if (totalSeconds > 0) printReport("whole run", totals, totalSeconds);
+
+    // keep refreshing until every worker has finished its loop(), one blocked in swapBuffers() needs it
+    pool.stop();
+    Clock::time_point deadline = Clock::now() + std::chrono::seconds(2);
+    while (pool.busyCount() && Clock::now() < deadline) {
+        for (Rig &rig : rigs) rig.sketch->refresh(rig.pixels);
+        std::this_thread::sleep_for(tick);
+    }
+    if (pool.busyCount()) {
+        // a rig stuck in setup() (no gifs directory) never returns
+        printf("[Wall] %d rigs didn't stop\n", pool.busyCount());
+        pool.detach();
+        fflush(stdout);
+        _exit(1);
+    }
+    pool.join();
+
+    if (window) {
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef WALL_H
+#define WALL_H
+
+/**
+ * A simulated LED wall: several rigs, each running its own copy of the sketch, in one process.
+ *
+ * The sketch and everything it links (the libraries and the mocks' globals) are built as led_sketch.so, and each rig
+ * loads a private copy of it, so every rig has its own globals - matrix, decoder, arena, Serial, SD, IrReceiver and
+ * the libraries' static members - without changing a line of the sketch. Only the host's C and C++ runtimes (malloc,
+ * stdio, rand) are shared, as the rigs' hardware would be if it were one board.
+ *
+ * A pool of threads takes turns running the rigs' loop(), and one refresh tick releases their swapBuffers() and draws
+ * them tiled in one window, or headless. Every few seconds, and at the end, the wall reports each rig's frame rate,
+ * worst gap between frames and the wall and CPU time of its loop() calls, so scaling across host cores and contention
+ * in the shared code show up as CPU time per frame going up with the number of rigs.
+ */
+
+#include <stdint.h>
+#include <string>
+
+// What led_sketch.so exports (wallSketch()), one copy per rig
+struct WallSketch {
+    void (*setup)(void);
+    void (*loop)(void);
+    // one refresh of the rig's layers into frame, WALL_RIG_WIDTH x WALL_RIG_HEIGHT rgb24 pixels
+    void (*refresh)(uint8_t *frame);
+    void (*setBasePath)(const char *path);
+    void (*injectCode)(uint32_t code);
+    void (*setMuted)(bool muted);
+};
+
+typedef const WallSketch *(*WallSketchEntry)(void);
+
+// Matrix dimensions (must match Bonnaroo.ino)
+#define WALL_RIG_WIDTH      64
+#define WALL_RIG_HEIGHT     64
+
+struct WallOptions {
+    int rigs = 4;
+    int threads = 0;                // 0 = one per rig, up to the host's cores
+    int scale = 4;
+    bool headless = false;
+    int seconds = 0;                // 0 = until the window is closed (or forever, headless)
+    int reportSeconds = 5;
+    bool verbose = false;           // every rig's Serial output, not only the first's
+    std::string basePath;
+};
+
+// Runs the wall until it's closed or options.seconds have passed, returns the process exit code
+int runWall(const WallOptions &options);
+
+#endif // WALL_H
@@ -0,0 +1,50 @@
+/**
+ * Entry point of led_sketch.so, the sketch as one rig of a simulated wall (wall.h).
+ */
+
+#include "mocks/Arduino.h"
+#include "mocks/SD.h"
+#include "mocks/MatrixHardware_Teensy4_ShieldV5.h"
+#include "mocks/IRremote.hpp"
+
+#include "wall.h"
+
+// From Bonnaroo.cpp
+void setup();
+void loop();
+extern SmartMatrixShim matrix;
+
+// Rigs share the pool's threads, a rig's loop() mustn't sleep in one
+static void wallSetup(void) {
+    _idle_enabled = false;
+    setup();
+}
+
+static void wallRefresh(uint8_t *frame) {
+    matrix.refreshFrame((rgb24 *)frame, WALL_RIG_WIDTH, WALL_RIG_HEIGHT);
+}
+
+static void wallSetBasePath(const char *path) {
+    SD.setBasePath(path);
+}
+
+static void wallInjectCode(uint32_t code) {
+    IrReceiver.injectCode(code);
+}
+
+static void wallSetMuted(bool muted) {
+    Serial.muted = muted;
+}
+
+static const WallSketch kSketch = {
+    wallSetup,
+    loop,
+    wallRefresh,
+    wallSetBasePath,
+    wallInjectCode,
+    wallSetMuted,
+};
+
+extern "C" __attribute__((visibility("default"))) const WallSketch *wallSketch(void) {
+    return &kSketch;
+}
@@ -0,0 +1,99 @@
+#ifndef WAV_H
+#define WAV_H
+
+/**
+ * WAV files as a microphone's 12 bit ADC readings, for the simulator's --audio and led_bench audio.
+ *
+ * 8 or 16 bit PCM and 32 bit float, mono or stereo (mixed down), resampled linearly to the rate asked for.
+ * Readings are centred on 2048, the microphone's mid-rail bias, a full scale file spans 0-4095.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+inline bool loadWav(const std::string &path, uint32_t rate, std::vector<uint16_t> &samples, std::string &error) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        error = "can't open " + path;
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(file);
+
+    auto get16 = [&](size_t at) { return (uint32_t)data[at] | (uint32_t)data[at + 1] << 8; };
+    auto get32 = [&](size_t at) { return get16(at) | get16(at + 2) << 16; };
+    if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) != 0 || memcmp(&data[8], "WAVE", 4) != 0) {
+        error = path + " isn't a WAV file";
+        return false;
+    }
+
+    uint32_t format = 0, channels = 0, fileRate = 0, bits = 0;
+    size_t pcm = 0, pcmBytes = 0;
+    for (size_t at = 12; at + 8 <= data.size();) {
+        uint32_t size = get32(at + 4);
+        if (memcmp(&data[at], "fmt ", 4) == 0 && size >= 16 && at + 24 <= data.size()) {
+            format = get16(at + 8);
+            channels = get16(at + 10);
+            fileRate = get32(at + 12);
+            bits = get16(at + 22);
+        } else if (memcmp(&data[at], "data", 4) == 0) {
+            pcm = at + 8;
+            pcmBytes = std::min<size_t>(size, data.size() - pcm);
+        }
+        at += 8 + size + (size & 1);
+    }
+    bool supported = (format == 1 && (bits == 8 || bits == 16)) || (format == 3 && bits == 32);
+    if (!supported || channels < 1 || channels > 2 || !fileRate || !pcm) {
+        error = path + ": only 8/16 bit PCM or float, mono or stereo";
+        return false;
+    }
+
+    // mixed down to mono, -1 to 1
+    size_t frameBytes = channels * bits / 8;
+    std::vector<float> mono(pcmBytes / frameBytes);
+    for (size_t i = 0; i < mono.size(); i++) {
+        float sum = 0;
+        for (uint32_t c = 0; c < channels; c++) {
+            size_t at = pcm + i * frameBytes + c * bits / 8;
+            if (bits == 8) {
+                sum += (data[at] - 128) / 128.0f;
+            } else if (bits == 16) {
+                sum += (int16_t)get16(at) / 32768.0f;
+            } else {
+                uint32_t word = get32(at);
+                float value;
+                memcpy(&value, &word, sizeof(value));
+                sum += value;
+            }
+        }
+        mono[i] = sum / channels;
+    }
+
+    samples.clear();
+    if (mono.empty()) {
+        return true;
+    }
+    size_t count = (size_t)((uint64_t)mono.size() * rate / fileRate);
+    samples.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        double at = (double)i * fileRate / rate;
+        size_t index = (size_t)at;
+        float next = index + 1 < mono.size() ? mono[index + 1] : mono[index];
+        float value = mono[index] + (next - mono[index]) * (float)(at - index);
+        int reading = 2048 + (int)(value * 2047);
+        samples.push_back((uint16_t)std::max(0, std::min(4095, reading)));
+    }
+    return true;
+}
+
+#endif // WAV_H
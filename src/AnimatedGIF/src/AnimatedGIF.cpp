@@ -233,6 +233,65 @@ int AnimatedGIF::open(const char *szFilename, GIF_OPEN_CALLBACK *pfnOpen, GIF_CL
 
 } /* open() */
 
+//
+// Saves where the file is between frames, for resume() to carry on from there
+// returns 0 partway through a frame
+//
+int AnimatedGIF::getResume(GIFRESUME *pResume)
+{
+    if (_gif.bFramePending)
+        return 0;
+    pResume->iPos = _gif.GIFFile.iPos;
+    pResume->iSize = _gif.GIFFile.iSize;
+    pResume->iCommentPos = _gif.iCommentPos;
+    pResume->sCommentLen = _gif.sCommentLen;
+    pResume->iCanvasWidth = _gif.iCanvasWidth;
+    pResume->iCanvasHeight = _gif.iCanvasHeight;
+    pResume->iBpp = _gif.iBpp;
+    pResume->ucBackground = _gif.ucBackground;
+    pResume->ucGIFBits = _gif.ucGIFBits;
+    pResume->ucTransparent = _gif.ucTransparent;
+    pResume->ucGlobalBits = _gif.ucGlobalBits;
+    memcpy(pResume->pPalette, _gif.pPalette, sizeof(pResume->pPalette));
+    return 1;
+} /* getResume() */
+
+//
+// Like open(), for a file getResume() was called on, but carries on from the frame after the one it was called after
+// returns 0 if the file isn't open or its size has changed, the file is left where it was
+//
+int AnimatedGIF::resume(const GIFRESUME *pResume, GIF_OPEN_CALLBACK *pfnOpen, GIF_CLOSE_CALLBACK *pfnClose, GIF_READ_CALLBACK *pfnRead, GIF_SEEK_CALLBACK *pfnSeek, GIF_DRAW_CALLBACK *pfnDraw)
+{
+    _gif.iError = GIF_SUCCESS;
+    _gif.pfnRead = pfnRead;
+    _gif.pfnSeek = pfnSeek;
+    _gif.pfnDraw = pfnDraw;
+    _gif.pfnOpen = pfnOpen;
+    _gif.pfnClose = pfnClose;
+    _gif.GIFFile.fHandle = (*pfnOpen)("", &_gif.GIFFile.iSize);
+    if (_gif.GIFFile.fHandle == NULL) {
+       _gif.iError = GIF_FILE_NOT_OPEN;
+       return 0;
+    }
+    if (_gif.GIFFile.iSize != pResume->iSize || pResume->iPos < 0 || pResume->iPos >= pResume->iSize) {
+       _gif.iError = GIF_BAD_FILE;
+       return 0;
+    }
+    _gif.bFramePending = 0;
+    _gif.iCommentPos = pResume->iCommentPos;
+    _gif.sCommentLen = pResume->sCommentLen;
+    _gif.iCanvasWidth = _gif.iWidth = pResume->iCanvasWidth;
+    _gif.iCanvasHeight = _gif.iHeight = pResume->iCanvasHeight;
+    _gif.iBpp = pResume->iBpp;
+    _gif.ucBackground = pResume->ucBackground;
+    _gif.ucGIFBits = pResume->ucGIFBits;
+    _gif.ucTransparent = pResume->ucTransparent;
+    _gif.ucGlobalBits = pResume->ucGlobalBits;
+    memcpy(_gif.pPalette, pResume->pPalette, sizeof(_gif.pPalette));
+    (*pfnSeek)(&_gif.GIFFile, pResume->iPos);
+    return 1;
+} /* resume() */
+
 void AnimatedGIF::close()
 {
     if (_gif.pfnClose)
@@ -242,6 +301,7 @@ void AnimatedGIF::close()
 void AnimatedGIF::reset()
 {
     _gif.iError = GIF_SUCCESS;
+    _gif.bFramePending = 0;
     (*_gif.pfnSeek)(&_gif.GIFFile, 0);
 } /* reset() */
 
@@ -260,6 +320,7 @@ void AnimatedGIF::begin(unsigned char ucPaletteType)
 // 1 = good result and more frames exist
 // 0 = no more frames exist, a frame may or may not have been played: use getLastError() and look for GIF_SUCCESS to know if a frame was played
 // -1 = error
+// GIF_FRAME_PENDING = the decode budget ran out partway through the frame, call again to carry on with it
 int AnimatedGIF::playFrame(bool bSync, int *delayMilliseconds, void *pUser)
 {
 int rc;
@@ -267,37 +328,43 @@ int rc;
 long lTime = millis();
 #endif
 
-    if (_gif.GIFFile.iPos >= _gif.GIFFile.iSize-1) // no more data exists
-    {
-        (*_gif.pfnSeek)(&_gif.GIFFile, 0); // seek to start
-    }
-    if (GIFParseInfo(&_gif, 0))
+    if (!_gif.bFramePending) // otherwise carry on with the frame, the file is still positioned in its LZW data
     {
-        _gif.pUser = pUser;
-        if (_gif.iError == GIF_EMPTY_FRAME) // don't try to decode it
-            return 0;
-        if (_gif.pTurboBuffer) {
-            rc = DecodeLZWTurbo(&_gif, 0);
-        } else {
-            rc = DecodeLZW(&_gif, 0);
+        if (_gif.GIFFile.iPos >= _gif.GIFFile.iSize-1) // no more data exists
+        {
+            (*_gif.pfnSeek)(&_gif.GIFFile, 0); // seek to start
         }
-        if (rc != 0) // problem
-            return -1;
-    }
-    else
-    {
-        // The file is "malformed" in that there is a bunch of non-image data after
-        // the last frame. Return as if all is well, though if needed getLastError()
-        // can be used to see if a frame was actually processed:
-        // GIF_SUCCESS -> frame processed, GIF_EMPTY_FRAME -> no frame processed
-        if (_gif.iError == GIF_EMPTY_FRAME)
+        if (!GIFParseInfo(&_gif, 0))
         {
-	    if (delayMilliseconds)
-                *delayMilliseconds = 0;
+            // The file is "malformed" in that there is a bunch of non-image data after
+            // the last frame. Return as if all is well, though if needed getLastError()
+            // can be used to see if a frame was actually processed:
+            // GIF_SUCCESS -> frame processed, GIF_EMPTY_FRAME -> no frame processed
+            if (_gif.iError == GIF_EMPTY_FRAME)
+            {
+                if (delayMilliseconds)
+                    *delayMilliseconds = 0;
+                return 0;
+            }
+            return -1; // error parsing the frame info, we may be at the end of the file
+        }
+        if (_gif.iError == GIF_EMPTY_FRAME) // don't try to decode it, but its delay (if it has one) still counts
+        {
+            if (delayMilliseconds)
+                *delayMilliseconds = _gif.iFrameDelay;
             return 0;
         }
-        return -1; // error parsing the frame info, we may be at the end of the file
     }
+    _gif.pUser = pUser;
+    if (_gif.pTurboBuffer) {
+        rc = DecodeLZWTurbo(&_gif, 0);
+    } else {
+        rc = DecodeLZW(&_gif, 0);
+    }
+    if (rc == GIF_FRAME_PENDING)
+        return GIF_FRAME_PENDING;
+    if (rc != 0) // problem
+        return -1;
     // Return 1 for more frames or 0 if this was the last frame
     if (bSync)
     {
@@ -311,4 +378,18 @@ long lTime = millis();
         *delayMilliseconds = _gif.iFrameDelay;
     return (_gif.GIFFile.iPos < _gif.GIFFile.iSize-10);
 } /* playFrame() */
+//
+// Limit the work done by each playFrame() call to about iPixels pixels decoded (in turbo mode, decoded plus sent to
+// the GIFDraw callback); a frame that needs more returns GIF_FRAME_PENDING and is finished by the calls after it.
+// 0 (the default) decodes each frame in one call
+//
+void AnimatedGIF::setDecodeBudget(int iPixels)
+{
+    _gif.iDecodeBudget = (iPixels > 0) ? iPixels : 0;
+} /* setDecodeBudget() */
+
+int AnimatedGIF::isFramePending()
+{
+    return _gif.bFramePending;
+} /* isFramePending() */
 
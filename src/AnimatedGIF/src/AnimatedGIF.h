@@ -51,7 +51,10 @@
 // a 128x32 display will not need a max code size of 12 nor a palette
 // with 256 entries
 //
-#define TURBO_BUFFER_SIZE 0x6100
+// LZW tables used by DecodeLZWTurbo() after the frame pixels: padding for LZWCopyBytes() overshoot, 256 root
+// symbols, then 4096 32-bit offsets and 4096 16-bit lengths
+#define TURBO_OVERSHOOT_PAD 8
+#define TURBO_BUFFER_SIZE (0x6100 + TURBO_OVERSHOOT_PAD)
 
 // If you intend to decode generic GIFs, you want this value to be 12. If you are using GIFs solely for animations in
 // your own project, and you control the GIFs you intend to play, then you can save additional RAM here: 
@@ -84,6 +87,10 @@
 // expanded LZW buffer for Turbo mode
 #define LZW_BUF_SIZE_TURBO (LZW_BUF_SIZE + (2<<MAX_CODE_SIZE) + (PIXEL_LAST*2) + MAX_WIDTH)
 #define LZW_HIGHWATER_TURBO ((LZW_BUF_SIZE_TURBO * 14) / 16)
+// playFrame() result when the decode budget ran out partway through a frame
+#define GIF_FRAME_PENDING 2
+// what a table reset (a clear code) is charged against the decode budget, in pixels
+#define LZW_CLEAR_PIXELS 64
 
 //
 // Pixel types
@@ -161,6 +168,7 @@ typedef struct gif_draw_tag
     uint8_t ucBackground; // background color
     uint8_t ucPaletteType; // type of palette entries
     uint8_t ucIsGlobalPalette; // Flag to indicate that a global palette, rather than a local palette is being used
+    uint8_t ucBpp; // bits per pixel of this frame (1-8): its pixels are all below 1 << ucBpp
 } GIFDRAW;
 
 // Callback function prototypes
@@ -189,8 +197,16 @@ typedef struct gif_image_tag
     short sCommentLen; // length of comment
     unsigned char bEndOfFrame;
     unsigned char ucGIFBits, ucBackground, ucTransparent, ucCodeStart, ucMap, bUseLocalPalette;
+    unsigned char ucGlobalBits; // Log2(size) of the global color table, 8 without one
+    unsigned char ucFrameBpp; // bits per pixel of the current frame, the smaller of its color table's and its LZW codes'
     unsigned char ucPaletteType; // RGB565 or RGB888
     unsigned char ucDrawType; // RAW or COOKED
+    unsigned char bFramePending; // the decode budget ran out partway through this frame: 1 = in the LZW codes, 2 = turbo lines still to draw
+    int iDecodeBudget; // pixels decoded (and in turbo mode, drawn) per playFrame() call, 0 = whole frame
+    // LZW state kept between playFrame() calls while a frame is pending
+    int iLZWBitNum, iLZWOffset; // iLZWOffset = turbo output offset, then the next line to draw
+    uint16_t usLZWCodeSize, usLZWNextCode, usLZWOldCode;
+    unsigned char ucLZWPixel;
     GIF_READ_CALLBACK *pfnRead;
     GIF_SEEK_CALLBACK *pfnSeek;
     GIF_DRAW_CALLBACK *pfnDraw;
@@ -211,6 +227,20 @@ typedef struct gif_image_tag
     unsigned char ucLineBuf[MAX_WIDTH]; // current line
 } GIFIMAGE;
 
+//
+// What resume() needs to carry on with a file from between two frames, where getResume() left it, without opening it
+// from the start again: the file position and the fields the header and the frames before leave set
+//
+typedef struct gif_resume_tag
+{
+    int32_t iPos, iSize; // file position, and its size to know it's the same file
+    int iCommentPos;
+    short sCommentLen;
+    uint16_t iCanvasWidth, iCanvasHeight, iBpp;
+    unsigned char ucBackground, ucGIFBits, ucTransparent, ucGlobalBits;
+    unsigned short pPalette[(MAX_COLORS * 3)/2]; // the global palette
+} GIFRESUME;
+
 #ifdef __cplusplus
 //
 // The GIF class wraps portable C code which does the actual work
@@ -221,11 +251,15 @@ class AnimatedGIF
     int open(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw);
     int openFLASH(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw);
     int open(const char *szFilename, GIF_OPEN_CALLBACK *pfnOpen, GIF_CLOSE_CALLBACK *pfnClose, GIF_READ_CALLBACK *pfnRead, GIF_SEEK_CALLBACK *pfnSeek, GIF_DRAW_CALLBACK *pfnDraw);
+    int getResume(GIFRESUME *pResume);
+    int resume(const GIFRESUME *pResume, GIF_OPEN_CALLBACK *pfnOpen, GIF_CLOSE_CALLBACK *pfnClose, GIF_READ_CALLBACK *pfnRead, GIF_SEEK_CALLBACK *pfnSeek, GIF_DRAW_CALLBACK *pfnDraw);
     void close();
     void reset();
     void begin(uint8_t ucPaletteType = GIF_PALETTE_RGB565_LE);
     void begin(int iEndian, uint8_t ucPaletteType) { begin(ucPaletteType); };
     int playFrame(bool bSync, int *delayMilliseconds, void *pUser = NULL);
+    void setDecodeBudget(int iPixels);
+    int isFramePending();
     int getCanvasWidth();
     int getFrameWidth();
     int getFrameHeight();
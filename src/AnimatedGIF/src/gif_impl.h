@@ -31,7 +31,7 @@ static const unsigned char cGIFBits[9] = {1,4,4,4,8,8,8,8,8}; // convert odd bpp
 static int GIFInit(GIFIMAGE *pGIF);
 static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly);
 static int GIFGetMoreData(GIFIMAGE *pPage);
-static void GIFMakePels(GIFIMAGE *pPage, unsigned int code);
+static int GIFMakePels(GIFIMAGE *pPage, unsigned int code);
 static int DecodeLZW(GIFIMAGE *pImage, int iOptions);
 static int DecodeLZWTurbo(GIFIMAGE *pImage, int iOptions);
 static int32_t readMem(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen);
@@ -89,6 +89,7 @@ void GIF_begin(GIFIMAGE *pGIF, unsigned char ucPaletteType)
 
 void GIF_reset(GIFIMAGE *pGIF)
 {
+    pGIF->bFramePending = 0;
     (*pGIF->pfnSeek)(&pGIF->GIFFile, 0);
 } /* GIF_reset() */
 
@@ -248,6 +249,7 @@ static int32_t readFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen)
 static int GIFInit(GIFIMAGE *pGIF)
 {
     pGIF->GIFFile.iPos = 0; // start at beginning of file
+    pGIF->bFramePending = 0; // any frame of the last file is abandoned
     if (!GIFParseInfo(pGIF, 1)) // gather info for the first frame
        return 0; // something went wrong; not a GIF file?
     (*pGIF->pfnSeek)(&pGIF->GIFFile, 0); // seek back to start of the file
@@ -300,6 +302,7 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
         pPage->iCanvasHeight = pPage->iHeight = INTELSHORT(&p[8]);
         pPage->iBpp = ((p[10] & 0x70) >> 4) + 1;
         iColorTableBits = (p[10] & 7) + 1; // Log2(size) of the color table
+        pPage->ucGlobalBits = (p[10] & 0x80) ? iColorTableBits : 8;
         pPage->ucBackground = p[11]; // background color
         pPage->ucGIFBits = 0;
         iOffset = 13;
@@ -335,8 +338,23 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
             }
         }
     }
-    while (p[iOffset] != ',' && p[iOffset] != ';') /* Wait for image separator */
+    while (1) /* Wait for image separator */
     {
+        if ((iBytesRead - iOffset) < 32) // keep enough data in the buffer for the next block header
+        {
+            if (iOffset >= iBytesRead) // the file ends in the middle of a block
+            {
+                pPage->iError = GIF_EARLY_EOF;
+                return 0;
+            }
+            memmove(pPage->ucFileBuf, &pPage->ucFileBuf[iOffset], (iBytesRead-iOffset)); // move existing data down
+            iBytesRead -= iOffset;
+            iStartPos += iOffset;
+            iOffset = 0;
+            iBytesRead += (*pPage->pfnRead)(&pPage->GIFFile, &pPage->ucFileBuf[iBytesRead], MAX_CHUNK_SIZE);
+        }
+        if (p[iOffset] == ',' || p[iOffset] == ';')
+            break;
         if (p[iOffset] == '!') /* Extension block */
         {
             iOffset++;
@@ -359,6 +377,11 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
                     c = 1;
                     while (c) /* Skip all data sub-blocks */
                     {
+                        if (iOffset >= iBytesRead) // the file ends before the block terminator
+                        {
+                            pPage->iError = GIF_EARLY_EOF;
+                            return 0;
+                        }
                         c = p[iOffset++]; /* Block length */
                         if ((iBytesRead - iOffset) < (c+32)) // need to read more data first
                         {
@@ -368,6 +391,11 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
                             iOffset = 0;
                             iBytesRead += (*pPage->pfnRead)(&pPage->GIFFile, &pPage->ucFileBuf[iBytesRead], c+32);
                         }
+                        if ((iBytesRead - iOffset) < c) // the file ends inside this sub-block
+                        {
+                            pPage->iError = GIF_EARLY_EOF;
+                            return 0;
+                        }
                         if (c == 11) // fixed block length
                         { // Netscape app block contains the repeat count
                             if (memcmp(&p[iOffset], "NETSCAPE2.0", 11) == 0)
@@ -384,7 +412,25 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
                     j = 0;
                     while (c) /* Skip all data sub-blocks */
                     {
+                        if (iOffset >= iBytesRead) // the file ends before the block terminator
+                        {
+                            pPage->iError = GIF_EARLY_EOF;
+                            return 0;
+                        }
                         c = p[iOffset++]; /* Block length */
+                        if ((iBytesRead - iOffset) < (c+32)) // need to read more data first
+                        {
+                            memmove(pPage->ucFileBuf, &pPage->ucFileBuf[iOffset], (iBytesRead-iOffset)); // move existing data down
+                            iBytesRead -= iOffset;
+                            iStartPos += iOffset;
+                            iOffset = 0;
+                            iBytesRead += (*pPage->pfnRead)(&pPage->GIFFile, &pPage->ucFileBuf[iBytesRead], c+32);
+                        }
+                        if ((iBytesRead - iOffset) < c) // the file ends inside this sub-block
+                        {
+                            pPage->iError = GIF_EARLY_EOF;
+                            return 0;
+                        }
                         if (j == 0) // use only first block
                         {
                             j = c;
@@ -401,6 +447,11 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
                     c = 1;
                     while (c) /* Skip all data sub-blocks */
                     {
+                        if (iOffset >= iBytesRead) // the file ends before the block terminator
+                        {
+                            pPage->iError = GIF_EARLY_EOF;
+                            return 0;
+                        }
                         c = p[iOffset++]; /* Block length */
                         if ((iBytesRead - iOffset) < (c+32)) // need to read more data first
                         {
@@ -410,6 +461,11 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
                             iOffset = 0;
                             iBytesRead += (*pPage->pfnRead)(&pPage->GIFFile, &pPage->ucFileBuf[iBytesRead], c+32);
                         }
+                        if ((iBytesRead - iOffset) < c) // the file ends inside this sub-block
+                        {
+                            pPage->iError = GIF_EARLY_EOF;
+                            return 0;
+                        }
                         if (pPage->iCommentPos == 0) // Save first block info
                         {
                             pPage->iCommentPos = iStartPos + iOffset;
@@ -499,8 +555,17 @@ static int GIFParseInfo(GIFIMAGE *pPage, int bInfoOnly)
         pPage->bUseLocalPalette = 1;
     }
     pPage->ucCodeStart = p[iOffset++]; /* initial code size */
+    if (pPage->ucCodeStart < 1 || pPage->ucCodeStart > 8) // the code tables only have room for 2-256 colors
+    {
+        pPage->iError = GIF_DECODE_ERROR;
+        return 0;
+    }
     /* Since GIF can be 1-8 bpp, we only allow 1,4,8 */
     pPage->iBpp = cGIFBits[pPage->ucCodeStart];
+    // the frame's own bits per pixel, for draw callbacks with paths for frames of few colors
+    pPage->ucFrameBpp = (pPage->ucMap & 0x80) ? (pPage->ucMap & 7) + 1 : pPage->ucGlobalBits;
+    if (pPage->ucCodeStart < pPage->ucFrameBpp)
+        pPage->ucFrameBpp = pPage->ucCodeStart;
     // we are re-using the same buffer turning GIF file data
     // into "pure" LZW
    pPage->iLZWSize = 0; // we're starting with no LZW data yet
@@ -1117,14 +1182,19 @@ uint32_t u32Offset;
 // backwards through the linked list of codes when outputting pixels. It also doesn't
 // have to copy pixels in reverse order, then unwind them.
 //
+// Returns 0 when the frame is done or GIF_FRAME_PENDING when the decode budget ran out, either in the LZW codes or in
+// drawing the decoded lines; the state is kept in pImage and the next call carries on from there. Codes which don't
+// exist yet, or strings which would run past the end of the frame, can only come from a corrupt file and end the
+// frame early rather than write past the buffer.
+//
 static int DecodeLZWTurbo(GIFIMAGE *pImage, int iOptions)
 {
-int i, bitnum;
+int i, bitnum, iBudget, iPixels, iStartOffset, iYieldAt;
 int iUncompressedLen;
 uint32_t code, oldcode, codesize, nextcode, nextlim;
 uint32_t cc, eoi;
 uint32_t sMask;
-uint8_t c, *p, *buf, codestart, *pHighWater;
+uint8_t c, *p, *buf, *pRoots, codestart, *pHighWater;
 BIGUINT ulBits;
 int iLen, iColors;
 int iErr = GIF_SUCCESS;
@@ -1133,12 +1203,9 @@ uint32_t *pSymbols;
 uint16_t *pLengths;
 
     (void)iOptions;
-    pImage->iYCount = pImage->iHeight; // count down the lines
-    pImage->iXCount = pImage->iWidth;
-    bitnum = 0;
+    iPixels = 0; // pixels decoded and drawn by this call
+    iBudget = (pImage->iDecodeBudget) ? pImage->iDecodeBudget : 0x7fffffff;
     pHighWater = pImage->ucLZW + LZW_HIGHWATER_TURBO;
-    pImage->iLZWOff = 0; // Offset into compressed data
-    GIFGetMoreData(pImage); // Read some data to start
     codestart = pImage->ucCodeStart;
     iColors = 1 << codestart;
     sMask = -1 << (codestart+1);
@@ -1147,16 +1214,43 @@ uint16_t *pLengths;
     eoi = cc + 1;
     iUncompressedLen = (pImage->iWidth * pImage->iHeight);
     buf = (uint8_t *)pImage->pTurboBuffer;
-    pSymbols = (uint32_t *)&buf[iUncompressedLen+256]; // we need 32-bits (really 23) for the offsets
+    // LZWCopyBytes() can overshoot the output by up to sizeof(BIGUINT)-1 bytes, so the root symbols start past that
+    // padding; otherwise copies near the end of the frame corrupt the first few root symbols
+    pRoots = &buf[iUncompressedLen + TURBO_OVERSHOOT_PAD];
+    pSymbols = (uint32_t *)&pRoots[256]; // we need 32-bits (really 23) for the offsets
     pLengths = (uint16_t *)&pSymbols[4096]; // but only 16-bits for the length of any single string
-    iOffset = 0; // output data offset
+    if (pImage->bFramePending == 2) { // the frame is decoded, carry on drawing its lines
+        pImage->bFramePending = 0;
+        goto draw_lines;
+    }
+    if (pImage->bFramePending) { // pick up where the last call left off
+        pImage->bFramePending = 0;
+        bitnum = pImage->iLZWBitNum;
+        codesize = pImage->usLZWCodeSize;
+        nextcode = pImage->usLZWNextCode;
+        nextlim = (1 << codesize);
+        sMask = nextlim - 1;
+        code = oldcode = pImage->usLZWOldCode;
+        iOffset = iStartOffset = pImage->iLZWOffset;
+        iYieldAt = (iBudget < iUncompressedLen - iOffset) ? iOffset + iBudget : 0x7fffffff;
+        p = &pImage->ucLZW[pImage->iLZWOff];
+        ulBits = INTELLONG(p); // the register always holds the bits from p on
+        goto decode_codes;
+    }
+    pImage->iYCount = pImage->iHeight; // count down the lines
+    pImage->iXCount = pImage->iWidth;
+    bitnum = 0;
+    pImage->iLZWOff = 0; // Offset into compressed data
+    GIFGetMoreData(pImage); // Read some data to start
+    iOffset = iStartOffset = 0; // output data offset
+    iYieldAt = (iBudget < iUncompressedLen) ? iBudget : 0x7fffffff; // output offset this call stops at
     p = pImage->ucLZW; // un-chunked LZW data
     ulBits = INTELLONG(p); // start by reading some LZW data
     // set up the default symbols (0..iColors-1)
    for (i = 0; i<iColors; i++) {
-       pSymbols[i] = iUncompressedLen + i; // root symbols
+       pSymbols[i] = iUncompressedLen + TURBO_OVERSHOOT_PAD + i; // root symbols
        pLengths[i] = 1;
-       buf[iUncompressedLen + i] = (unsigned char) i;
+       pRoots[i] = (unsigned char) i;
    }
 init_codetable:
    codesize = codestart + 1;
@@ -1168,21 +1262,37 @@ init_codetable:
     if (code == cc) { // we just reset the dictionary; get another code
         GET_CODE_TURBO
     }
+    if (code >= cc) // only a root can follow a reset, anything else is a corrupt (or empty) frame
+        goto draw_lines;
     buf[iOffset++] = (unsigned char) code; // first code after a dictionary reset is just stored
     oldcode = code;
+decode_codes:
+    if (iOffset >= iYieldAt)
+        goto save_state;
     GET_CODE_TURBO
     while (code != eoi && iOffset < iUncompressedLen) { /* Loop through all the data */
         if (code == cc) { /* Clear code? */
-           goto init_codetable;
+            if (p >= pHighWater) { // a run of clear codes never gets to the refill below
+                pImage->iLZWOff = (int)(p - pImage->ucLZW);
+                GIFGetMoreData(pImage);
+                p = &pImage->ucLZW[pImage->iLZWOff];
+                if (p > &pImage->ucLZW[pImage->iLZWSize]) // ran out of data, the frame was cut short
+                    break;
+            }
+            goto init_codetable;
         }
         if (code != eoi) {
             if (nextcode < nextlim) { // for deferred cc case, don't let it overwrite the last entry (fff)
                 if (code != nextcode) { // most probable case
+                    if (code > nextcode || iOffset + pLengths[code] > iUncompressedLen)
+                        break; // corrupt data
                     iLen = LZWCopyBytes(buf, iOffset, &pSymbols[code], &pLengths[code]);
                     pSymbols[nextcode] = (pSymbols[oldcode] | 0x800000 | (buf[iOffset] << 24));
                     pLengths[nextcode] = pLengths[oldcode];
                     iOffset += iLen;
                 } else { // new code
+                    if (iOffset + pLengths[oldcode] + 1 > iUncompressedLen)
+                        break; // corrupt data
                     iLen = LZWCopyBytes(buf, iOffset, &pSymbols[oldcode], &pLengths[oldcode]);
                     pLengths[nextcode] = iLen+1;
                     pSymbols[nextcode] = iOffset;
@@ -1191,6 +1301,8 @@ init_codetable:
                     buf[iOffset++] = c; // repeat first character of old code on the end
                 }
             } else { // Deferred CC case - continue to use codes, but don't generate new ones
+                if (iOffset + pLengths[code] > iUncompressedLen)
+                    break; // corrupt data
                 iLen = LZWCopyBytes(buf, iOffset, &pSymbols[code], &pLengths[code]);
                 iOffset += iLen;
             }
@@ -1204,12 +1316,20 @@ init_codetable:
                 pImage->iLZWOff = (int)(p - pImage->ucLZW); // restore object member var
                 GIFGetMoreData(pImage); // We need to read more LZW data
                 p = &pImage->ucLZW[pImage->iLZWOff];
+                if (p > &pImage->ucLZW[pImage->iLZWSize]) // ran out of data, the frame was cut short
+                    break;
             }
             oldcode = code;
+            if (iOffset >= iYieldAt)
+                goto save_state;
             GET_CODE_TURBO
         } /* while not end of LZW code stream */
     } // while not end of frame
-    if (pImage->ucDrawType == GIF_DRAW_COOKED && pImage->pfnDraw && pImage->pFrameBuffer) { // convert each line through the palette
+    iPixels = iOffset - iStartOffset;
+    pImage->iLZWOffset = 0; // first line to draw
+draw_lines:
+    // RAW lines go straight from the decoded canvas to the GIFDraw callback, COOKED ones are converted through the palette
+    if (pImage->pfnDraw && (pImage->ucDrawType == GIF_DRAW_RAW || pImage->pFrameBuffer)) {
         GIFDRAW gd;
         gd.iX = pImage->iX;
         gd.iY = pImage->iY;
@@ -1218,9 +1338,16 @@ init_codetable:
         gd.pPalette = (pImage->bUseLocalPalette) ? pImage->pLocalPalette : pImage->pPalette;
         gd.pPalette24 = (uint8_t *)gd.pPalette; // just cast the pointer for RGB888
         gd.ucIsGlobalPalette = pImage->bUseLocalPalette==1?0:1;
+        gd.ucBpp = pImage->ucFrameBpp;
         gd.pUser = pImage->pUser;
         gd.ucPaletteType = pImage->ucPaletteType;
-        for (int y=0; y<pImage->iHeight; y++) {
+        for (int y=pImage->iLZWOffset; y<pImage->iHeight; y++) {
+            if (iPixels >= iBudget) {
+                pImage->iLZWOffset = y; // out of time for this call, draw the rest next time
+                pImage->bFramePending = 2;
+                return GIF_FRAME_PENDING;
+            }
+            iPixels += pImage->iWidth;
             gd.y = y;
             gd.pPixels = &buf[(y * pImage->iWidth)]; // source pixels
             // Ugly logic to handle the interlaced line position, but it
@@ -1241,20 +1368,32 @@ init_codetable:
             gd.ucHasTransparency = pImage->ucGIFBits & 1;
             gd.ucBackground = pImage->ucBackground;
             gd.iCanvasWidth = pImage->iCanvasWidth;
-            DrawCooked(pImage, &gd, &buf[pImage->iCanvasHeight * pImage->iCanvasWidth]); // dest = past end of canvas
-            gd.pPixels = &buf[pImage->iCanvasHeight * pImage->iCanvasWidth]; // point to the line we just converted
+            if (pImage->ucDrawType == GIF_DRAW_COOKED) {
+                DrawCooked(pImage, &gd, &buf[pImage->iCanvasHeight * pImage->iCanvasWidth]); // dest = past end of canvas
+                gd.pPixels = &buf[pImage->iCanvasHeight * pImage->iCanvasWidth]; // point to the line we just converted
+            }
             (*pImage->pfnDraw)(&gd); // callback to handle this line
         }
     }
     return iErr;
+save_state:
+    pImage->iLZWOff = (int)(p - pImage->ucLZW);
+    pImage->iLZWBitNum = bitnum;
+    pImage->usLZWCodeSize = (uint16_t)codesize;
+    pImage->usLZWNextCode = (uint16_t)((nextcode > PIXEL_LAST) ? PIXEL_LAST : nextcode); // past the table it only has to stay there
+    pImage->usLZWOldCode = (uint16_t)oldcode;
+    pImage->iLZWOffset = iOffset;
+    pImage->bFramePending = 1;
+    return GIF_FRAME_PENDING;
 } /* DecodeLZWTurbo() */
 
 //
 // GIFMakePels
+// Returns the length of the string, for the decode budget
 //
-static void GIFMakePels(GIFIMAGE *pPage, unsigned int code)
+static int GIFMakePels(GIFIMAGE *pPage, unsigned int code)
 {
-    int iPixCount;
+    int iPixCount, iLen;
     unsigned short *giftabs;
     unsigned char *buf, *s, *pEnd, *gifpels;
     /* Copy this string of sequential pixels to output buffer */
@@ -1268,12 +1407,12 @@ static void GIFMakePels(GIFIMAGE *pPage, unsigned int code)
     {
         if (s == pEnd) /* Houston, we have a problem */
         {
-            return; /* Exit with error */
+            return FILE_BUF_SIZE; /* Exit with error */
         }
         *(--s) = gifpels[code];
         code = giftabs[code];
     }
-    iPixCount = (int)(intptr_t)(pEnd + FILE_BUF_SIZE - s);
+    iPixCount = iLen = (int)(intptr_t)(pEnd + FILE_BUF_SIZE - s);
     while (iPixCount && pPage->iYCount > 0)
     {
         if (pPage->iXCount > iPixCount)  /* Pixels fit completely on the line */
@@ -1296,7 +1435,7 @@ static void GIFMakePels(GIFIMAGE *pPage, unsigned int code)
             //         iPixCount = 0;
             if (pPage->iLZWOff >= LZW_HIGHWATER)
                 GIFGetMoreData(pPage); // We need to read more LZW data
-            return;
+            return iLen;
         }
         else  /* Pixels cross into next line */
         {
@@ -1317,6 +1456,7 @@ static void GIFMakePels(GIFIMAGE *pPage, unsigned int code)
             gd.pPalette = (pPage->bUseLocalPalette) ? pPage->pLocalPalette : pPage->pPalette;
             gd.pPalette24 = (uint8_t *)gd.pPalette; // just cast the pointer for RGB888
             gd.ucIsGlobalPalette = pPage->bUseLocalPalette==1?0:1;
+            gd.ucBpp = pPage->ucFrameBpp;
             gd.y = pPage->iHeight - pPage->iYCount;
             // Ugly logic to handle the interlaced line position, but it
             // saves having to have another set of state variables
@@ -1381,7 +1521,7 @@ static void GIFMakePels(GIFIMAGE *pPage, unsigned int code)
     } /* while */
     if (pPage->iLZWOff >= LZW_HIGHWATER)
         GIFGetMoreData(pPage); // We need to read more LZW data
-    return;
+    return iLen;
 } /* GIFMakePels() */
 //
 // Macro to extract a variable length code
@@ -1392,10 +1532,12 @@ static void GIFMakePels(GIFIMAGE *pPage, unsigned int code)
         code &= sMask; bitnum += codesize;
 //
 // Decode LZW into an image
+// Returns 0 when the frame is done, 1 for a problem, or GIF_FRAME_PENDING when the decode budget (pixels) ran out:
+// the state is kept in pImage and the next call carries on from the next code
 //
 static int DecodeLZW(GIFIMAGE *pImage, int iOptions)
 {
-    int i, bitnum;
+    int i, bitnum, iPixels, iBudget;
     unsigned short oldcode, codesize, nextcode, nextlim;
     unsigned short *giftabs, cc, eoi;
     signed short sMask;
@@ -1424,6 +1566,21 @@ static int DecodeLZW(GIFIMAGE *pImage, int iOptions)
     eoi = cc + 1;
     giftabs = pImage->usGIFTable;
     gifpels = pImage->ucGIFPixels;
+    iPixels = 0;
+    iBudget = (pImage->iDecodeBudget) ? pImage->iDecodeBudget : 0x7fffffff;
+    if (pImage->bFramePending) // pick up where the last call left off
+    {
+        pImage->bFramePending = 0;
+        bitnum = pImage->iLZWBitNum;
+        codesize = pImage->usLZWCodeSize;
+        nextcode = pImage->usLZWNextCode;
+        nextlim = (unsigned short) (1 << codesize);
+        sMask = nextlim - 1;
+        code = oldcode = pImage->usLZWOldCode;
+        c = pImage->ucLZWPixel;
+        ulBits = INTELLONG(&p[pImage->iLZWOff]); // the register always holds the bits from iLZWOff on
+        goto decode_codes;
+    }
     pImage->iYCount = pImage->iHeight; // count down the lines
     pImage->iXCount = pImage->iWidth;
     bitnum = 0;
@@ -1445,6 +1602,7 @@ init_codetable:
     nextlim = (unsigned short) ((1 << codesize));
     // This part of the table needs to be reset multiple times
     memset(&giftabs[cc], LINK_UNUSED, sizeof(pImage->usGIFTable) - sizeof(giftabs[0])*cc);
+    iPixels += LZW_CLEAR_PIXELS; // so a flood of clear codes can't reset the table thousands of times in one call
     ulBits = INTELLONG(&p[pImage->iLZWOff]); // start by reading 4 bytes of LZW data
     GET_CODE
     if (code == cc) // we just reset the dictionary, so get another code
@@ -1452,10 +1610,23 @@ init_codetable:
       GET_CODE
     }
     c = oldcode = code;
-    GIFMakePels(pImage, code); // first code is output as the first pixel
+    iPixels += GIFMakePels(pImage, code); // first code is output as the first pixel
+decode_codes:
     // Main decode loop
     while (code != eoi && pImage->iYCount > 0) // && y < pImage->iHeight+1) /* Loop through all lines of the image (or strip) */
     {
+        if (iPixels >= iBudget) // out of time for this call, save our place
+        {
+            pImage->iLZWBitNum = bitnum;
+            pImage->usLZWCodeSize = codesize;
+            pImage->usLZWNextCode = nextcode;
+            pImage->usLZWOldCode = oldcode;
+            pImage->ucLZWPixel = c;
+            pImage->bFramePending = 1;
+            return GIF_FRAME_PENDING;
+        }
+        if (pImage->iLZWOff > pImage->iLZWSize) // ran out of data, the frame was cut short
+            break;
         GET_CODE
         if (code == cc) /* Clear code?, and not first code */
             goto init_codetable;
@@ -1474,7 +1645,7 @@ init_codetable:
                     nextlim <<= 1;
                     sMask = nextlim - 1;
                 }
-            GIFMakePels(pImage, code);
+            iPixels += GIFMakePels(pImage, code);
             oldcode = code;
         }
     } /* while not end of LZW code stream */
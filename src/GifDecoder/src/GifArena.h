@@ -0,0 +1,165 @@
+#ifndef _GIFARENA_H_
+#define _GIFARENA_H_
+
+/*
+    Fixed arena for GIF decoder state and per-file buffers
+
+    One static block is carved up at runtime instead of reserving every buffer for the worst case: the AnimatedGIF
+    state of each decoder, the turbo/frame buffers sized for the canvas of the file being played, and any caches the
+    sketch wants to keep next to them.  Blocks are first-fit with neighbouring free blocks merged on free(), so a
+    decoder can drop its buffers for one file and take differently sized ones for the next, and several decoders can
+    share one arena as long as their buffers fit together.
+
+    Nothing here touches the heap, and alloc() returning NULL is an expected outcome that callers handle by falling
+    back (e.g. decoding without the turbo buffer).  Not thread safe, allocate from one context only.
+*/
+
+#include <stdint.h>
+
+// Place the arena in OCRAM on Teensy 4 so it doesn't compete with the layers and stack for RAM1 (DTCM)
+#if defined(__IMXRT1062__)
+  #define GIF_ARENA_MEMORY DMAMEM
+#else
+  #define GIF_ARENA_MEMORY
+#endif
+
+#define GIF_ARENA_ALLOCATE(arena_name, arena_bytes) \
+  static uint8_t arena_name##Block[(arena_bytes)] GIF_ARENA_MEMORY __attribute__((aligned(8))); \
+  static GifArena arena_name(arena_name##Block, sizeof(arena_name##Block))
+
+class GifArena {
+public:
+  GifArena(void *block, uint32_t blockSize) {
+    // start and size rounded to the allocation alignment
+    uintptr_t start = ((uintptr_t)block + ALIGN - 1) & ~(uintptr_t)(ALIGN - 1);
+    base = (uint8_t *)start;
+    size = (blockSize - (uint32_t)(start - (uintptr_t)block)) & ~(ALIGN - 1);
+    reset();
+  }
+
+  // Returns NULL if no free block is large enough, the tag is kept for printReport() and must be a string literal
+  void * alloc(uint32_t bytes, const char *tag = "") {
+    uint32_t needed = HEADER_SIZE + ((bytes + ALIGN - 1) & ~(ALIGN - 1));
+
+    // first fit among the freed blocks below top
+    for (uint32_t offset = 0; offset < top; offset += header(offset)->size) {
+      BlockHeader *h = header(offset);
+      if (h->used || h->size < needed)
+        continue;
+
+      // split off the remainder if it can still hold a minimal block
+      if (h->size - needed >= HEADER_SIZE + ALIGN) {
+        BlockHeader *rest = header(offset + needed);
+        rest->size = h->size - needed;
+        rest->used = 0;
+        rest->tag = "";
+        h->size = needed;
+      }
+      return claim(h, bytes, tag);
+    }
+
+    // otherwise grow from the top
+    if (needed > size - top) {
+      failedAllocations++;
+      return NULL;
+    }
+    BlockHeader *h = header(top);
+    h->size = needed;
+    top += needed;
+    if (top > highWaterMark)
+      highWaterMark = top;
+    return claim(h, bytes, tag);
+  }
+
+  void free(void *p) {
+    if (!p)
+      return;
+
+    BlockHeader *h = (BlockHeader *)((uint8_t *)p - HEADER_SIZE);
+    h->used = 0;
+    bytesInUse -= h->requested;
+    h->requested = 0;
+    liveBlocks--;
+
+    // merge runs of free blocks, and give a free run at the end back to top
+    uint32_t offset = 0;
+    while (offset < top) {
+      BlockHeader *run = header(offset);
+      if (!run->used) {
+        while (offset + run->size < top && !header(offset + run->size)->used)
+          run->size += header(offset + run->size)->size;
+        if (offset + run->size == top) {
+          top = offset;
+          break;
+        }
+      }
+      offset += run->size;
+    }
+  }
+
+  void reset(void) {
+    top = 0;
+    bytesInUse = 0;
+    liveBlocks = 0;
+  }
+
+  // Bytes of the largest allocation that would currently succeed
+  uint32_t largestFree(void) const {
+    uint32_t largest = size - top;
+    for (uint32_t offset = 0; offset < top; offset += header(offset)->size) {
+      if (!header(offset)->used && header(offset)->size > largest)
+        largest = header(offset)->size;
+    }
+    return largest > HEADER_SIZE ? largest - HEADER_SIZE : 0;
+  }
+
+  uint32_t capacity(void) const { return size; }
+  uint32_t inUse(void) const { return bytesInUse; }           // sum of requested sizes of live blocks
+  uint32_t highWater(void) const { return highWaterMark; }    // highest offset reached, including headers and padding
+  uint32_t failures(void) const { return failedAllocations; }
+
+  // printer is Serial or anything else with printf(), e.g. printReport(Serial)
+  template <typename Printer>
+  void printReport(Printer &out) const {
+    out.printf("GIF arena: %lu / %lu bytes in use in %u blocks, high water %lu, largest free %lu, %lu failed\n",
+      (unsigned long)bytesInUse, (unsigned long)size, (unsigned)liveBlocks, (unsigned long)highWaterMark,
+      (unsigned long)largestFree(), (unsigned long)failedAllocations);
+    for (uint32_t offset = 0; offset < top; offset += header(offset)->size) {
+      const BlockHeader *h = header(offset);
+      if (h->used)
+        out.printf("  %7lu  %7lu  %s\n", (unsigned long)offset, (unsigned long)h->requested, h->tag);
+    }
+  }
+
+private:
+  struct BlockHeader {
+    uint32_t size;        // whole block including this header
+    uint32_t requested;   // payload bytes asked for, 0 when free
+    const char *tag;
+    uint32_t used;
+  };
+
+  static const uint32_t ALIGN = 8;
+  static const uint32_t HEADER_SIZE = (sizeof(BlockHeader) + ALIGN - 1) & ~(ALIGN - 1);
+
+  BlockHeader * header(uint32_t offset) const { return (BlockHeader *)(base + offset); }
+
+  void * claim(BlockHeader *h, uint32_t bytes, const char *tag) {
+    h->used = 1;
+    h->requested = bytes;
+    h->tag = tag;
+    bytesInUse += bytes;
+    liveBlocks++;
+    return (uint8_t *)h + HEADER_SIZE;
+  }
+
+  uint8_t *base;
+  uint32_t size;
+  uint32_t top = 0;               // blocks are laid out back to back below top
+  uint32_t bytesInUse = 0;
+  uint32_t liveBlocks = 0;
+  uint32_t highWaterMark = 0;
+  uint32_t failedAllocations = 0;
+};
+
+#endif
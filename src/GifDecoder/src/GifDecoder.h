@@ -7,6 +7,7 @@
 #else
   #include "../../AnimatedGIF/src/AnimatedGIF.h"
 #endif
+#include "GifArena.h"
 
 #define DISPLAY_WIDTH maxGifWidth
 #define DISPLAY_HEIGHT maxGifHeight
@@ -26,6 +27,14 @@
 #define ERROR_GIF_EMPTY_FRAME           -9
 #define ERROR_GIF_DECODE_ERROR          -10
 #define ERROR_MISSING_CALLBACK_FUNCTION -11
+#define ERROR_GIF_OUT_OF_MEMORY         -12
+
+// Frames of up to this many bits per pixel (16 colors) are drawn a run of one color at a time when there's a run
+// callback: they're mostly long runs, where more colors mostly aren't
+#define GIFDECODER_RUN_MAX_BPP          4
+// Other frames are drawn a run at a time too when the runs in every 8th line of the frame before averaged at least
+// this many pixels, below it the calls per run cost more than drawing a pixel at a time
+#define GIFDECODER_RUN_MIN_LENGTH       4
 
 typedef void (*callback)(void);
 typedef void (*pixel_callback)(int16_t x, int16_t y, uint8_t red, uint8_t green,
@@ -33,6 +42,8 @@ typedef void (*pixel_callback)(int16_t x, int16_t y, uint8_t red, uint8_t green,
 typedef void (*line_callback)(int16_t x, int16_t y, uint8_t *buf, int16_t wid,
                               uint16_t *palette565, int16_t skip);
 typedef void *(*get_buffer_callback)(void);
+typedef void (*indexed_line_callback)(GIFDRAW *pDraw);
+typedef void (*run_callback)(int16_t x, int16_t y, int16_t count, uint8_t red, uint8_t green, uint8_t blue);
 
 typedef bool (*file_seek_callback)(unsigned long position);
 typedef unsigned long (*file_position_callback)(void);
@@ -46,17 +57,38 @@ typedef struct rgb_24 {
   uint8_t blue;
 } rgb_24;
 
+// Where a GIF read through the file callbacks is between two frames, saved by saveState() for resumeDecoding()
+struct GifDecoderState {
+  GIFRESUME gif;
+  int cycleNumber;
+  int cycleTime;
+  unsigned long frameNumber;
+  int frameCount;
+  int frameDelay_ms;
+};
+
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc=false> class GifDecoder {
 public:
   GifDecoder(void);
+  // Takes the AnimatedGIF state from the arena when useMalloc is set (the name predates the arena: the state is kept
+  // outside the object either way), and uses the arena for any per-file buffers
+  GifDecoder(GifArena &arena);
   int startDecoding(void);
   int startDecoding(uint8_t *pData, int iDataSize);
   int decodeFrame(bool delayAfterDecode = true);
+  // Saves where the GIF is, false partway through a frame or for a GIF in memory.  resumeDecoding() carries on from
+  // there later, with the file callbacks on the same file again: the next decodeFrame() decodes the frame after the
+  // last one decoded before saveState(), drawing over the canvas as it was then, which the caller puts back.  Nothing
+  // is cleared or reparsed
+  bool saveState(GifDecoderState &state);
+  int resumeDecoding(const GifDecoderState &state);
   int getCycleTime(void) { return cycleTime; }      // only valid when cycleNumber > 0, ideal number of ms to play one cycle of GIF
   int getFrameNumber(void) { return frameNumber; }  // count of the current frame decoded, resets on each cycle
   int getCycleNumber(void) { return cycleNumber; }  // number indicates number of cycles the GIF has gone through, 0 on first pass,
   int getFrameCount(void) { return frameCount; }    // only valid when cycleNumber > 0, number of frames in one cycle of GIF
   unsigned int getFrameDelay_ms(void) { return frameDelay_ms; } // delay of the last frame decoded
+  // the last frame decoded had no image data, only a delay: nothing was drawn and updateScreenCallback wasn't called
+  bool isFrameEmpty(void) { return frameEmpty; }
   void getSize(uint16_t *w, uint16_t *h) {
     *w = gif->getCanvasWidth();
     *h = gif->getCanvasHeight();
@@ -67,6 +99,12 @@ public:
   void setDrawPixelCallback(pixel_callback f);
   void setDrawLineCallback(line_callback f); // note this callback is not currently used, but may be used in the future
   void setStartDrawingCallback(callback f); // note this callback is not currently used
+  // Receives each decoded line as 8-bit palette indexes instead of it being composited through drawPixelCallback,
+  // the line can be composited later (e.g. on another core) with compositeLine()
+  void setDrawIndexedLineCallback(indexed_line_callback f);
+  // Receives the lines of frames of few colors (GIFDECODER_RUN_MAX_BPP), or of long runs (GIFDECODER_RUN_MIN_LENGTH),
+  // as runs of one color, x to x + count - 1, instead of a pixel at a time through drawPixelCallback
+  void setDrawRunCallback(run_callback f);
 
   void setFileSeekCallback(file_seek_callback f);
   void setFilePositionCallback(file_position_callback f);
@@ -74,11 +112,37 @@ public:
   void setFileReadBlockCallback(file_read_block_callback f);
   void setFileSizeCallback(file_size_callback f);
 
+  // Turbo decoding needs a buffer sized for the canvas of each file, this comes from the arena in startDecoding() and
+  // decoding quietly falls back to the regular path when the arena is too full
+  void setTurboMode(bool enable) { turboMode = enable; }
+  bool isTurboActive(void) { return turboBuffer != NULL; }
+
+  // Bounds the time of each decodeFrame() call: once it has decoded about `pixels` pixels (with turbo active, decoded
+  // plus drawn) it returns ERROR_WAITING, and the next calls carry on with the same frame.  0 decodes each frame in one
+  // call
+  void setDecodeBudget(int pixels);
+  bool isFramePending(void) { return beginCalled && gif->isFramePending(); }
+  // startDecoding() turns away GIFs with a canvas of more pixels than this with ERROR_GIF_TOO_WIDE, before any buffers
+  // are allocated or frames decoded.  0 allows any canvas AnimatedGIF accepts
+  void setCanvasLimit(uint32_t pixels) { canvasLimit = pixels; }
+
+  // Applies disposal and transparency, converts through the palette and draws with drawPixelCallback, or
+  // drawRunCallback for a frame of few colors or long runs
+  static void compositeLine(GIFDRAW *pDraw);
+  // compositeLine() drawing runs with drawRunCallback whatever the frame's colors
+  static void compositeLineRuns(GIFDRAW *pDraw);
+
 private:
   AnimatedGIF * gif;
   uint8_t buffer[useMalloc ? 0 : sizeof(AnimatedGIF)];
 
-  bool beginCalled;
+  GifArena *arena = NULL;
+  bool turboMode = false;
+  uint8_t *turboBuffer = NULL;
+  int decodeBudget = 0;
+  uint32_t canvasLimit = 0;
+
+  bool beginCalled = false;
   bool usingFileCallbacks = true;
 
   uint8_t *gifPData;
@@ -89,6 +153,7 @@ private:
   unsigned long frameNumber;
   int frameCount;
   int frameDelay_ms;
+  bool frameEmpty = false;
 
   uint32_t frameStartTime;
 
@@ -97,6 +162,12 @@ private:
   static pixel_callback drawPixelCallback;
   static line_callback drawLineCallback;
   static callback startDrawingCallback;
+  static indexed_line_callback drawIndexedLineCallback;
+  static run_callback drawRunCallback;
+  // pixels and runs in the lines sampled since the frame began, and whether its lines are drawn as runs
+  static int runSamplePixels;
+  static int runSampleRuns;
+  static bool longRunFrame;
   static file_seek_callback fileSeekCallback;
   static file_position_callback filePositionCallback;
   static file_read_callback fileReadCallback;
@@ -109,7 +180,12 @@ private:
   static int32_t GIFReadFile(GIFFILE *pFile, uint8_t *pBuf, int32_t iLen);
   static int32_t GIFSeekFile(GIFFILE *pFile, int32_t iPosition);
   static void DrawPixelRow(int startX, int y, int numPixels, rgb_24 * data);
+  static void DrawRuns(int startX, int y, int numPixels, const uint8_t *s, const rgb_24 *palette, int transparent);
+  static int countRuns(const uint8_t *s, int numPixels);
+  static int applyDisposal(GIFDRAW *pDraw);
   int translateGifErrorCode(int code);
+  bool isCanvasTooBig(void);
+  void allocFileBuffers(void);
 };
 
 #include "GifDecoder_Impl.h"
@@ -44,6 +44,16 @@ line_callback GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::draw
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
 callback GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::startDrawingCallback;
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+indexed_line_callback GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::drawIndexedLineCallback;
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+run_callback GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::drawRunCallback;
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::runSamplePixels;
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::runSampleRuns;
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+bool GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::longRunFrame;
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
 file_seek_callback GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::fileSeekCallback;
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
 file_position_callback GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::filePositionCallback;
@@ -63,6 +73,15 @@ GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::GifDecoder(void) {
     gif = (AnimatedGIF*)malloc(sizeof(AnimatedGIF));
 }
 
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::GifDecoder(GifArena &arena) {
+  this->arena = &arena;
+  if(!useMalloc)
+    gif = (AnimatedGIF*)buffer;
+  else
+    gif = (AnimatedGIF*)arena.alloc(sizeof(AnimatedGIF), "AnimatedGIF");
+}
+
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
 void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::setStartDrawingCallback(
     callback f) {
@@ -87,6 +106,18 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::setDrawLineCa
   drawLineCallback = f;
 }
 
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::setDrawIndexedLineCallback(
+    indexed_line_callback f) {
+  drawIndexedLineCallback = f;
+}
+
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::setDrawRunCallback(
+    run_callback f) {
+  drawRunCallback = f;
+}
+
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
 void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::setScreenClearCallback(
     callback f) {
@@ -132,23 +163,53 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::DrawPixelRow(
   }
 }
 
+// Draws each run of one color in s with drawRunCallback, skipping the transparent color's (-1 for none)
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::DrawRuns(int startX, int y, int numPixels, const uint8_t *s, const rgb_24 *palette, int transparent) {
+  if(!drawRunCallback)
+    return;
+
+  int x = 0;
+  while (x < numPixels)
+  {
+    uint8_t c = s[x];
+    int run = 1;
+    while (x + run < numPixels && s[x + run] == c)
+      run++;
+    if (c != transparent)
+      (*drawRunCallback)(startX + x, y, run, palette[c].red, palette[c].green, palette[c].blue);
+    x += run;
+  }
+}
+
+// The runs of one color in s, counted without branching on the pixels
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::countRuns(const uint8_t *s, int numPixels) {
+  int runs = 1;
+  for (int x = 1; x < numPixels; x++)
+    runs += s[x] != s[x - 1];
+  return runs;
+}
+
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
 void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::GIFDraw(GIFDRAW *pDraw) {
-  int x_offset = 0;
-  int y_offset = 0;
+  if(drawIndexedLineCallback)
+    (*drawIndexedLineCallback)(pDraw);
+  else
+    compositeLine(pDraw);
+}
 
+// Clips the line to the display and, for disposal method 2, puts the background color in its transparent pixels.
+// Returns the width to draw
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::applyDisposal(GIFDRAW *pDraw) {
+  int x, iWidth;
   uint8_t *s;
-  //uint16_t *d, *usPalette, usTemp[320];
-  int x, y, iWidth;
-  rgb_24 *d, *usPalette, usTemp[320];
 
   iWidth = pDraw->iWidth;
   if (iWidth > DISPLAY_WIDTH)
     iWidth = DISPLAY_WIDTH;
-  usPalette = (rgb_24*)pDraw->pPalette;
 
-  y = pDraw->iY + pDraw->y; // current line
-  
   s = pDraw->pPixels;
   if (pDraw->ucDisposalMethod == 2) // restore to background color
   {
@@ -159,6 +220,50 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::GIFDraw(GIFDR
     }
     pDraw->ucHasTransparency = 0;
   }
+  return iWidth;
+}
+
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::compositeLineRuns(GIFDRAW *pDraw) {
+  int iWidth = applyDisposal(pDraw);
+  DrawRuns(pDraw->iX, pDraw->iY + pDraw->y, iWidth, pDraw->pPixels, (const rgb_24 *)pDraw->pPalette,
+    pDraw->ucHasTransparency ? pDraw->ucTransparent : -1);
+}
+
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::compositeLine(GIFDRAW *pDraw) {
+  int x_offset = 0;
+  int y_offset = 0;
+
+  uint8_t *s;
+  //uint16_t *d, *usPalette, usTemp[320];
+  int x, y, iWidth;
+  rgb_24 *d, *usPalette, usTemp[320];
+
+  if (drawRunCallback) {
+    // the frame before decides, from a sample of its lines that costs too little to matter
+    if (pDraw->y == 0) {
+      longRunFrame = runSampleRuns && runSamplePixels >= runSampleRuns * GIFDECODER_RUN_MIN_LENGTH;
+      runSamplePixels = runSampleRuns = 0;
+    }
+    if ((pDraw->y & 7) == 0) {
+      iWidth = pDraw->iWidth < DISPLAY_WIDTH ? pDraw->iWidth : DISPLAY_WIDTH;
+      runSamplePixels += iWidth;
+      runSampleRuns += countRuns(pDraw->pPixels, iWidth);
+    }
+    // few colors, or long runs
+    if (pDraw->ucBpp <= GIFDECODER_RUN_MAX_BPP || longRunFrame) {
+      compositeLineRuns(pDraw);
+      return;
+    }
+  }
+
+  iWidth = applyDisposal(pDraw);
+  usPalette = (rgb_24*)pDraw->pPalette;
+
+  y = pDraw->iY + pDraw->y; // current line
+  
+  s = pDraw->pPixels;
   // Apply the new pixels to the main image
   if (pDraw->ucHasTransparency) // if transparency used
   {
@@ -259,14 +364,54 @@ int32_t GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::GIFSeekFil
   return pFile->iPos;
 }
 
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::setDecodeBudget(int pixels) {
+  decodeBudget = pixels;
+  // begin() clears the AnimatedGIF state, startDecoding() passes the budget on after it
+  if(beginCalled)
+    gif->setDecodeBudget(pixels);
+}
+
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+bool GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::isCanvasTooBig(void) {
+  uint32_t pixels = (uint32_t)gif->getCanvasWidth() * gif->getCanvasHeight();
+  if(!canvasLimit || pixels <= canvasLimit)
+    return false;
+
+  Serial.printf("GIF canvas %d x %d is over the limit of %lu pixels\n", gif->getCanvasWidth(), gif->getCanvasHeight(),
+    (unsigned long)canvasLimit);
+  return true;
+}
+
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::allocFileBuffers(void) {
+  // release the last file's buffer first so a same-sized or smaller one can take its place
+  if(turboBuffer) {
+    gif->setTurboBuf(NULL);
+    arena->free(turboBuffer);
+    turboBuffer = NULL;
+  }
+
+  if(!turboMode || !arena)
+    return;
+
+  // only the canvas part of the turbo buffer depends on the file, the rest holds the LZW tables
+  turboBuffer = (uint8_t *)arena->alloc(TURBO_BUFFER_SIZE + gif->getCanvasWidth() * gif->getCanvasHeight(), "GIF turbo buffer");
+  gif->setTurboBuf(turboBuffer);
+}
+
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
 int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::startDecoding(void) {
+  if(!gif)
+    return ERROR_GIF_OUT_OF_MEMORY;
+
   usingFileCallbacks = true;
   if(!beginCalled) {
     beginCalled = true;
 
     // using RGB888 = rgb24 palette instead of default RGB565
     gif->begin(BIG_ENDIAN_PIXELS, GIF_PALETTE_RGB888);
+    gif->setDecodeBudget(decodeBudget);
   }
 
   // check for callbacks working first
@@ -288,7 +433,10 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::startDecoding(
   // file is already open, and we don't know the name, send a 0-length string instead
   if (gif->open("", GIFOpenFile, GIFCloseFile, GIFReadFile, GIFSeekFile, GIFDraw))
   {
+    if(isCanvasTooBig())
+      return ERROR_GIF_TOO_WIDE;
     Serial.printf("Successfully opened GIF; Canvas size = %d x %d\n", gif->getCanvasWidth(), gif->getCanvasHeight());
+    allocFileBuffers();
 #if 0
     GIFINFO gi;
     if (gif->getInfo(&gi)) {
@@ -310,6 +458,9 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::startDecoding(
 
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
 int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::startDecoding(uint8_t *pData, int iDataSize) {
+  if(!gif)
+    return ERROR_GIF_OUT_OF_MEMORY;
+
   usingFileCallbacks = false;
 
   // we need these again to open the file next cycle
@@ -321,6 +472,7 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::startDecoding(
 
     // using RGB888 = rgb24 palette instead of default RGB565
     gif->begin(BIG_ENDIAN_PIXELS, GIF_PALETTE_RGB888);
+    gif->setDecodeBudget(decodeBudget);
   }
 
   // check for callbacks working first
@@ -340,7 +492,10 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::startDecoding(
   // file is already open, and we don't know the name, send a 0-length string instead
   if (gif->open(gifPData, gifIDataSize, GIFDraw))
   {
+    if(isCanvasTooBig())
+      return ERROR_GIF_TOO_WIDE;
     Serial.printf("Successfully opened GIF; Canvas size = %d x %d\n", gif->getCanvasWidth(), gif->getCanvasHeight());
+    allocFileBuffers();
 #if 0
     GIFINFO gi;
     if (gif->getInfo(&gi)) {
@@ -360,6 +515,48 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::startDecoding(
   return ERROR_NONE;
 }
 
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+bool GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::saveState(GifDecoderState &state) {
+  if(!gif || !beginCalled || !usingFileCallbacks || !gif->getResume(&state.gif))
+    return false;
+
+  state.cycleNumber = cycleNumber;
+  state.cycleTime = cycleTime;
+  state.frameNumber = frameNumber;
+  state.frameCount = frameCount;
+  state.frameDelay_ms = frameDelay_ms;
+  return true;
+}
+
+template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
+int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::resumeDecoding(const GifDecoderState &state) {
+  if(!gif || !beginCalled)
+    return ERROR_GIF_INVALID_PARAMETER;
+
+  if((!screenClearCallback || !updateScreenCallback || !drawPixelCallback) ||
+    (!fileSeekCallback || !filePositionCallback || !fileReadCallback || !fileReadBlockCallback || !fileSizeCallback)) {
+    Serial.println("Error: missing a callback function");
+    return ERROR_MISSING_CALLBACK_FUNCTION;
+  }
+
+  if(canvasLimit && (uint32_t)state.gif.iCanvasWidth * state.gif.iCanvasHeight > canvasLimit)
+    return ERROR_GIF_TOO_WIDE;
+
+  usingFileCallbacks = true;
+  if(!gif->resume(&state.gif, GIFOpenFile, GIFCloseFile, GIFReadFile, GIFSeekFile, GIFDraw))
+    return translateGifErrorCode(gif->getLastError());
+  allocFileBuffers();
+
+  cycleNumber = state.cycleNumber;
+  cycleTime = state.cycleTime;
+  frameNumber = state.frameNumber;
+  frameCount = state.frameCount;
+  frameDelay_ms = state.frameDelay_ms;
+  frameEmpty = false;
+  frameStartTime = micros();
+  return ERROR_NONE;
+}
+
 template <int maxGifWidth, int maxGifHeight, int lzwMaxBits, bool useMalloc>
 int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::translateGifErrorCode(int code) {
   switch (gif->getLastError()) {
@@ -381,6 +578,8 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::translateGifEr
       return ERROR_GIF_EMPTY_FRAME;
     case  GIF_BAD_FILE:
       return ERROR_BADGIFFORMAT;
+    case  GIF_ERROR_MEMORY:
+      return ERROR_GIF_OUT_OF_MEMORY;
     default:
       return -99;
   }
@@ -391,6 +590,9 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::decodeFrame(bo
   // Parse gif data
   int frameStatus;
 
+  if(!gif)
+    return ERROR_GIF_OUT_OF_MEMORY;
+
   // check for callbacks working first - this is inefficient, but it may helpful temporarily with the API change
   if((!screenClearCallback || !updateScreenCallback || !drawPixelCallback) ||
     (usingFileCallbacks && (!fileSeekCallback || !filePositionCallback ||
@@ -401,6 +603,10 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::decodeFrame(bo
 
   frameStatus = gif->playFrame(delayAfterDecode, &frameDelay_ms);
 
+  // the decode budget ran out partway through the frame, the next calls finish it
+  if(frameStatus == GIF_FRAME_PENDING)
+    return ERROR_WAITING;
+
   if(frameStatus < 0) {
     Serial.print("playFrame failed: ");
     Serial.println(gif->getLastError());
@@ -409,15 +615,16 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits, useMalloc>::decodeFrame(bo
   }
 
   // only run this code if a new frame was processed, otherwise we got error GIF_EMPTY_FRAME
-  if(gif->getLastError() == GIF_SUCCESS) {
+  frameEmpty = gif->getLastError() != GIF_SUCCESS;
+  if(!frameEmpty) {
     if(updateScreenCallback)
         (*updateScreenCallback)();
 
     frameNumber++;
-    // only track cycleTime on first frame
-    if(!cycleNumber)
-      cycleTime += frameDelay_ms;    
   }
+  // only track cycleTime on first frame, an empty frame's delay still holds the one before it up
+  if(!cycleNumber)
+    cycleTime += frameDelay_ms;
 
   // if done parsing
   if (frameStatus == 0) {
@@ -0,0 +1,457 @@
+#ifndef _GIFPIPELINE_H_
+#define _GIFPIPELINE_H_
+
+/*
+    Pipelined GIF playback
+
+    Splits GifDecoder playback into three stages connected by bounded lock-free single-producer/single-consumer
+    queues, so each stage can run on its own thread or core:
+
+      reader      file -> read-ahead window (file blocks, read sequentially ahead of the decoder)
+      decoder     GIF blocks, de-chunking and LZW (AnimatedGIF) -> 8-bit palette index lines
+      compositor  disposal, transparency and palette -> drawPixelCallback, then updateScreen at each frame's due time
+
+    The LZW sub-block de-chunking stays in the decoder stage, AnimatedGIF refills its LZW buffer from inside the
+    decode loop.  The engine doesn't create threads: run runReader(), runDecoder() and runCompositor() from one thread
+    or task each.  In the simulator those are std::threads.  On ESP32 the reader and decoder tasks go on core 0 and the
+    compositor on core 1 next to loop(), with the window and queues in internal RAM: the queues use
+    CircularBufferSPSC, whose acquire/release barriers are correct across the two cores.
+
+    GifDecoder's callbacks are static, so there is one pipeline per decoder type.  The sketch sets drawPixelCallback on
+    the decoder as usual, and gives the pipeline its file and screen callbacks, which the pipeline calls from the stage
+    that owns them: file callbacks from the reader, screen callbacks from the compositor.
+
+    This is an experiment, the sketch doesn't use it and only `led_bench pipeline` runs it.  On the single-core hosts
+    it has been measured on it is no faster than serial playback (0.67x to 1.03x of serial, the stages taking turns on
+    one core), and on a single-core Teensy it can't be.  The per-stage busy times bound what a core per stage could
+    give, that hasn't been measured.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef SIMULATOR_MODE
+  #include <CircularBuffer_SM.h>
+  #include <thread>
+#else
+  #include "../../SmartMatrix/src/CircularBuffer_SM.h"
+#endif
+
+#include "GifDecoder.h"
+
+// Called while a stage waits on another one, must let the other stages run when they share a core
+#ifndef GIF_PIPELINE_WAIT
+  #if defined(SIMULATOR_MODE)
+    #define GIF_PIPELINE_WAIT() std::this_thread::yield()
+  #elif defined(ESP32)
+    #define GIF_PIPELINE_WAIT() vTaskDelay(1)
+  #else
+    #define GIF_PIPELINE_WAIT() yield()
+  #endif
+#endif
+
+#define GIF_PIPELINE_LOAD_ACQUIRE(ptr)         __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define GIF_PIPELINE_STORE_RELEASE(ptr, val)   __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+// Per-stage counters, the wait times are time spent blocked on another stage, so wall time minus wait is busy time
+struct GifPipelineStats {
+  uint32_t framesDecoded;
+  uint32_t framesPresented;
+  uint32_t cycles;
+  uint32_t linesDecoded;
+  uint32_t bytesRead;
+  uint32_t windowRestarts;      // backwards seeks outside the window, e.g. at the start of every cycle
+  uint32_t readerWait_us;       // window full
+  uint32_t decoderWait_us;      // window empty, line queue or palette queue full
+  uint32_t compositorWait_us;   // line queue empty, not counting waits for a frame's due time
+  int lastError;
+};
+
+/* maxLineWidth: widest line passed to the compositor, longer lines are cut (GIFDraw also limits lines to the display)
+ * lineSlots: line queue depth, a few frames' worth of lines lets the decoder run ahead
+ * windowBytes: read-ahead window, power of two
+ */
+template <class Decoder, int maxLineWidth, uint16_t lineSlots = 128, uint32_t windowBytes = 32768>
+class GifPipeline {
+public:
+  GifPipeline(Decoder &decoder) : decoder(decoder) {}
+
+  void setFileSeekCallback(file_seek_callback f) { fileSeek = f; }
+  void setFileReadBlockCallback(file_read_block_callback f) { fileReadBlock = f; }
+  void setFileSizeCallback(file_size_callback f) { fileSize = f; }
+  void setScreenClearCallback(callback f) { screenClear = f; }
+  void setUpdateScreenCallback(callback f) { updateScreen = f; }
+
+  // When false, frames are presented as soon as they're composited (benchmarks)
+  void setRealtime(bool enable) { realtime = enable; }
+
+  // Call with the file already open and no stage running, then start the stage threads
+  void start(void) {
+    instance = this;
+    memset(&stats, 0, sizeof(stats));
+    lines.init(lineSlots);
+    palettes.init(PALETTE_SLOTS);
+    fill = 0;
+    consumed = 0;
+    restartOffset = 0;
+    restartRequest = 0;
+    restartAck = 0;
+    size = fileSize();
+    fileSeek(0);
+    currentPalette = -1;
+    nextPresent_ms = 0;
+
+    decoder.setFileSeekCallback(windowSeek);
+    decoder.setFilePositionCallback(windowPosition);
+    decoder.setFileReadCallback(windowRead);
+    decoder.setFileReadBlockCallback(windowReadBlock);
+    decoder.setFileSizeCallback(windowSize);
+    decoder.setScreenClearCallback(queueClear);
+    decoder.setUpdateScreenCallback(queueFrameEnd);
+    decoder.setDrawIndexedLineCallback(queueLine);
+
+    GIF_PIPELINE_STORE_RELEASE(&running, true);
+  }
+
+  // Stops all stages, they return from their run functions soon after.  Restore the decoder's callbacks before using
+  // it directly again
+  void stop(void) {
+    GIF_PIPELINE_STORE_RELEASE(&running, false);
+  }
+
+  bool isRunning(void) { return GIF_PIPELINE_LOAD_ACQUIRE(&running); }
+
+  // stops after this many complete cycles, 0 = play forever
+  void setCycleLimit(uint32_t cycles) { cycleLimit = cycles; }
+
+  const GifPipelineStats & getStats(void) { return stats; }
+
+  // Stage 1: keeps the window filled ahead of the decoder
+  void runReader(void) {
+    while (isRunning()) {
+      uint32_t request = GIF_PIPELINE_LOAD_ACQUIRE(&restartRequest);
+      if (request != restartAck) {
+        // the decoder seeked outside the window, it's waiting for this
+        fileSeek(restartOffset);
+        GIF_PIPELINE_STORE_RELEASE(&fill, restartOffset);
+        GIF_PIPELINE_STORE_RELEASE(&restartAck, request);
+        stats.windowRestarts++;
+        continue;
+      }
+
+      uint32_t f = fill;
+      uint32_t c = GIF_PIPELINE_LOAD_ACQUIRE(&consumed);
+      if (c > f) {
+        // the decoder skipped ahead of what was read
+        fileSeek(c);
+        f = c;
+        GIF_PIPELINE_STORE_RELEASE(&fill, f);
+      }
+
+      // c can drop below f - windowBytes while a restart is pending, nothing is read until it's handled
+      uint32_t used = f - c;
+      uint32_t space = used < windowBytes ? windowBytes - used : 0;
+      uint32_t toEnd = windowBytes - (f & (windowBytes - 1));
+      uint32_t n = size - f;
+      if (n > space) n = space;
+      if (n > toEnd) n = toEnd;
+      if (n > READ_BLOCK) n = READ_BLOCK;
+
+      if (!n) {
+        uint32_t start = micros();
+        GIF_PIPELINE_WAIT();
+        stats.readerWait_us += micros() - start;
+        continue;
+      }
+
+      int r = fileReadBlock(&window[f & (windowBytes - 1)], n);
+      if (r <= 0) {
+        // treat a failed read as end of file so the decoder errors out instead of waiting forever
+        GIF_PIPELINE_STORE_RELEASE(&size, f);
+        continue;
+      }
+      stats.bytesRead += r;
+      GIF_PIPELINE_STORE_RELEASE(&fill, f + r);
+    }
+  }
+
+  // Stage 2: decodes frames into the line queue
+  void runDecoder(void) {
+    int result = decoder.startDecoding();
+    while (isRunning() && result >= 0) {
+      result = decoder.decodeFrame(false);
+      if (result == ERROR_DONE_PARSING) {
+        stats.cycles++;
+        if (cycleLimit && stats.cycles >= cycleLimit) {
+          pushRecord(RECORD_END, 0);
+          break;
+        }
+      }
+    }
+    if (result < 0) {
+      stats.lastError = result;
+      pushRecord(RECORD_END, 0);
+    }
+  }
+
+  // Stage 3: composites lines and presents frames, returns at the end of the last cycle or on stop()
+  void runCompositor(void) {
+    while (isRunning()) {
+      if (lines.isEmpty()) {
+        uint32_t start = micros();
+        GIF_PIPELINE_WAIT();
+        stats.compositorWait_us += micros() - start;
+        continue;
+      }
+
+      LineRecord &record = records[lines.getNextRead()];
+      switch (record.type) {
+        case RECORD_LINE: {
+          GIFDRAW draw;
+          memset(&draw, 0, sizeof(draw));
+          draw.iX = record.x;
+          draw.iY = record.y;
+          draw.iWidth = record.width;
+          draw.pPixels = record.pixels;
+          draw.pPalette = (uint16_t *)palette[record.palette];
+          draw.ucTransparent = record.transparent;
+          draw.ucHasTransparency = record.hasTransparency;
+          draw.ucDisposalMethod = record.disposal;
+          draw.ucBackground = record.background;
+          draw.ucBpp = record.bpp;
+          Decoder::compositeLine(&draw);
+          break;
+        }
+        case RECORD_CLEAR:
+          if (screenClear)
+            screenClear();
+          break;
+        case RECORD_FRAME_END:
+          if (realtime) {
+            while (isRunning() && (int32_t)(millis() - nextPresent_ms) < 0)
+              GIF_PIPELINE_WAIT();
+            nextPresent_ms = millis() + record.delay_ms;
+          }
+          if (updateScreen)
+            updateScreen();
+          stats.framesPresented++;
+          // the frame's palette can be reused once all of its lines are drawn
+          if (record.palette != NO_PALETTE)
+            palettes.read();
+          break;
+        case RECORD_END:
+          lines.read();
+          stop();
+          return;
+      }
+      lines.read();
+    }
+  }
+
+private:
+  enum { RECORD_LINE, RECORD_CLEAR, RECORD_FRAME_END, RECORD_END };
+
+  static const uint16_t PALETTE_SLOTS = 4;
+  static const uint8_t NO_PALETTE = 0xff;
+  static const uint32_t READ_BLOCK = 4096;
+
+  struct LineRecord {
+    uint8_t type;
+    uint8_t palette;
+    uint8_t transparent;
+    uint8_t hasTransparency;
+    uint8_t disposal;
+    uint8_t background;
+    uint8_t bpp;
+    int16_t x, y, width;
+    uint16_t delay_ms;
+    uint8_t pixels[maxLineWidth];
+  };
+
+  // waits for a free slot in the line queue, returns NULL if the pipeline was stopped meanwhile
+  LineRecord * nextRecord(void) {
+    uint32_t start = micros();
+    bool waited = false;
+    while (lines.isFull()) {
+      if (!isRunning())
+        return NULL;
+      GIF_PIPELINE_WAIT();
+      waited = true;
+    }
+    if (waited)
+      stats.decoderWait_us += micros() - start;
+    return &records[lines.getNextWrite()];
+  }
+
+  void pushRecord(uint8_t type, uint16_t delay_ms) {
+    LineRecord *record = nextRecord();
+    if (!record)
+      return;
+    record->type = type;
+    record->delay_ms = delay_ms;
+    record->palette = NO_PALETTE;
+    if (type == RECORD_FRAME_END) {
+      // hands the frame's palette slot to the compositor along with the end of the frame
+      record->palette = currentPalette < 0 ? NO_PALETTE : (uint8_t)currentPalette;
+      currentPalette = -1;
+    }
+    lines.write();
+  }
+
+  // Decoder-side callbacks, GifDecoder's callbacks are plain functions so these go through the single instance
+
+  static void queueLine(GIFDRAW *pDraw) {
+    GifPipeline *p = instance;
+
+    if (p->currentPalette < 0) {
+      // first line of a frame: copy the palette the decoder is using, it may be overwritten by the next frame
+      uint32_t start = micros();
+      bool waited = false;
+      while (p->palettes.isFull()) {
+        if (!p->isRunning())
+          return;
+        GIF_PIPELINE_WAIT();
+        waited = true;
+      }
+      if (waited)
+        p->stats.decoderWait_us += micros() - start;
+      p->currentPalette = p->palettes.getNextWrite();
+      memcpy(p->palette[p->currentPalette], pDraw->pPalette, sizeof(p->palette[0]));
+      p->palettes.write();
+    }
+
+    LineRecord *record = p->nextRecord();
+    if (!record)
+      return;
+    int width = pDraw->iWidth > maxLineWidth ? maxLineWidth : pDraw->iWidth;
+    record->type = RECORD_LINE;
+    record->palette = (uint8_t)p->currentPalette;
+    record->transparent = pDraw->ucTransparent;
+    record->hasTransparency = pDraw->ucHasTransparency;
+    record->disposal = pDraw->ucDisposalMethod;
+    record->background = pDraw->ucBackground;
+    record->bpp = pDraw->ucBpp;
+    record->x = pDraw->iX;
+    record->y = pDraw->iY + pDraw->y;
+    record->width = width;
+    memcpy(record->pixels, pDraw->pPixels, width);
+    p->lines.write();
+    p->stats.linesDecoded++;
+  }
+
+  static void queueClear(void) {
+    instance->pushRecord(RECORD_CLEAR, 0);
+  }
+
+  static void queueFrameEnd(void) {
+    GifPipeline *p = instance;
+    p->stats.framesDecoded++;
+    p->pushRecord(RECORD_FRAME_END, p->decoder.getFrameDelay_ms());
+  }
+
+  // Decoder-side file access, served from the window
+
+  static bool windowSeek(unsigned long position) {
+    instance->position = position;
+    return true;
+  }
+
+  static unsigned long windowPosition(void) {
+    return instance->position;
+  }
+
+  static int windowSize(void) {
+    return instance->size;
+  }
+
+  static int windowRead(void) {
+    uint8_t c;
+    return windowReadBlock(&c, 1) == 1 ? c : -1;
+  }
+
+  static int windowReadBlock(void *buffer, int numberOfBytes) {
+    GifPipeline *p = instance;
+    uint32_t pos = p->position;
+
+    // AnimatedGIF only seeks back to the start of its last read, except when starting a cycle over
+    if (pos < GIF_PIPELINE_LOAD_ACQUIRE(&p->consumed)) {
+      p->restartOffset = pos;
+      GIF_PIPELINE_STORE_RELEASE(&p->consumed, pos);
+      uint32_t request = p->restartRequest + 1;
+      GIF_PIPELINE_STORE_RELEASE(&p->restartRequest, request);
+      while (GIF_PIPELINE_LOAD_ACQUIRE(&p->restartAck) != request) {
+        if (!p->isRunning())
+          return 0;
+        GIF_PIPELINE_WAIT();
+      }
+    } else {
+      GIF_PIPELINE_STORE_RELEASE(&p->consumed, pos);
+    }
+
+    uint32_t end = pos + numberOfBytes;
+    if (end > p->size) end = p->size;
+    if (end <= pos) return 0;
+
+    uint32_t start = micros();
+    bool waited = false;
+    while (GIF_PIPELINE_LOAD_ACQUIRE(&p->fill) < end) {
+      // size shrinks if the reader hit a read error
+      if (!p->isRunning() || GIF_PIPELINE_LOAD_ACQUIRE(&p->size) < end)
+        return 0;
+      GIF_PIPELINE_WAIT();
+      waited = true;
+    }
+    if (waited)
+      p->stats.decoderWait_us += micros() - start;
+
+    uint32_t n = end - pos;
+    uint32_t offset = pos & (windowBytes - 1);
+    uint32_t first = windowBytes - offset < n ? windowBytes - offset : n;
+    memcpy(buffer, &p->window[offset], first);
+    memcpy((uint8_t *)buffer + first, p->window, n - first);
+    p->position = end;
+    return n;
+  }
+
+  static_assert((windowBytes & (windowBytes - 1)) == 0, "windowBytes must be a power of two");
+  static_assert(windowBytes >= 2 * READ_BLOCK, "windowBytes must hold at least two read blocks");
+
+  static GifPipeline *instance;
+
+  Decoder &decoder;
+  file_seek_callback fileSeek = NULL;
+  file_read_block_callback fileReadBlock = NULL;
+  file_size_callback fileSize = NULL;
+  callback screenClear = NULL;
+  callback updateScreen = NULL;
+  bool realtime = true;
+  uint32_t cycleLimit = 0;
+  bool running = false;
+
+  // window: written by the reader, fill and restartAck published to the decoder
+  uint8_t window[windowBytes];
+  uint32_t fill;
+  uint32_t restartAck;
+  // decoder side: consumed, restartOffset and restartRequest published to the reader
+  uint32_t consumed;
+  uint32_t restartOffset;
+  uint32_t restartRequest;
+  uint32_t position;
+  uint32_t size;
+  int currentPalette;
+
+  // decoder -> compositor
+  CircularBufferSPSC<lineSlots> lines;
+  LineRecord records[lineSlots];
+  CircularBufferSPSC<PALETTE_SLOTS> palettes;
+  uint8_t palette[PALETTE_SLOTS][256 * 3];
+  uint32_t nextPresent_ms;
+
+  GifPipelineStats stats;
+};
+
+template <class Decoder, int maxLineWidth, uint16_t lineSlots, uint32_t windowBytes>
+GifPipeline<Decoder, maxLineWidth, lineSlots, windowBytes> *
+GifPipeline<Decoder, maxLineWidth, lineSlots, windowBytes>::instance;
+
+#endif
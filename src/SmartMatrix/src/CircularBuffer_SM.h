@@ -1,32 +1,127 @@
 #ifndef _SMARTMATRIX_CIRCULARBUFFER_H_
 #define _SMARTMATRIX_CIRCULARBUFFER_H_
 
-// TODO: Consider INLINE for several functions - many small, only used in one place, in frequently used code
+/* CircularBuffer_SM.h
+Lock-free single-producer/single-consumer ring of indexes (the data elements live in the caller's array, this only
+tracks which slot to write or read next).
 
-/* Circular buffer object */
-typedef struct {
-    int         size;   /* maximum number of elements           */
-    int         start;  /* index of oldest element              */
-    int         count;    /* new  */
-} CircularBuffer_SM;
+The producer (calc code) is the only writer of head and the consumer (DMA/refresh ISR) is the only writer of tail, so
+neither side has to disable interrupts.  Both indexes run over [0, 2*size) so a full ring and an empty ring can be told
+apart without a shared fill count.  When size is a power of two the wrap and slot lookups reduce to masks.
 
-void cbInit(CircularBuffer_SM *cb, int size);
+Unlike the previous fill-count version, writing to a full ring no longer overwrites the oldest element (that would make
+the producer move the consumer's index) - check cbIsFull() first, as all of the refresh classes already do.
+*/
 
-int cbIsFull(CircularBuffer_SM *cb);
+#include <stdint.h>
 
-int cbIsEmpty(CircularBuffer_SM *cb);
+// The GCC atomic builtins emit the barrier each target needs: DMB on Cortex-M7 (Teensy 4), MEMW on Xtensa (ESP32, where
+// the refresh ISR may run on the other core), and only a compiler barrier on x86 hosts.  The producer must make its
+// writes to the slot visible before publishing head, and the consumer must finish with the slot before publishing tail.
+#define SM_CB_LOAD_ACQUIRE(ptr)         __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define SM_CB_STORE_RELEASE(ptr, val)   __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define SM_CB_LOAD_RELAXED(ptr)         __atomic_load_n((ptr), __ATOMIC_RELAXED)
+
+// staticSize = 0: size is given at runtime to init() (the refresh classes get dmaBufferNumRows from the sketch)
+// staticSize > 0: size is fixed at compile time, and a power of two compiles down to masks only
+template <uint16_t staticSize = 0>
+class CircularBufferSPSC {
+public:
+    void init(uint16_t newSize) {
+        size = staticSize ? staticSize : newSize;
+        isPowerOfTwo = (size & (size - 1)) == 0;
+        head = 0;
+        tail = 0;
+    }
+
+    uint16_t capacity(void) const { return staticSize ? staticSize : size; }
+
+    // safe to call from either side
+    uint16_t count(void) const {
+        return distance(SM_CB_LOAD_ACQUIRE(&head), SM_CB_LOAD_ACQUIRE(&tail));
+    }
+
+    // producer side
+    bool isFull(void) const {
+        return distance(SM_CB_LOAD_RELAXED(&head), SM_CB_LOAD_ACQUIRE(&tail)) == capacity();
+    }
+
+    uint16_t getNextWrite(void) const {
+        return slot(SM_CB_LOAD_RELAXED(&head));
+    }
+
+    void write(void) {
+        SM_CB_STORE_RELEASE(&head, advance(SM_CB_LOAD_RELAXED(&head)));
+    }
+
+    // consumer side
+    bool isEmpty(void) const {
+        return SM_CB_LOAD_ACQUIRE(&head) == SM_CB_LOAD_RELAXED(&tail);
+    }
+
+    uint16_t getNextRead(void) const {
+        return slot(SM_CB_LOAD_RELAXED(&tail));
+    }
+
+    void read(void) {
+        SM_CB_STORE_RELEASE(&tail, advance(SM_CB_LOAD_RELAXED(&tail)));
+    }
+
+private:
+    bool pow2(void) const { return staticSize ? ((staticSize & (staticSize - 1)) == 0) : isPowerOfTwo; }
+
+    uint16_t advance(uint16_t index) const {
+        if (pow2())
+            return (index + 1) & (2 * capacity() - 1);
+        index++;
+        return (index == 2 * capacity()) ? 0 : index;
+    }
+
+    uint16_t slot(uint16_t index) const {
+        if (pow2())
+            return index & (capacity() - 1);
+        return (index >= capacity()) ? index - capacity() : index;
+    }
+
+    uint16_t distance(uint16_t from, uint16_t to) const {
+        if (pow2())
+            return (from - to) & (2 * capacity() - 1);
+        return (from >= to) ? from - to : from + 2 * capacity() - to;
+    }
+
+    uint16_t size;
+    bool isPowerOfTwo;
+    uint16_t head;  /* written only by the producer */
+    uint16_t tail;  /* written only by the consumer */
+};
+
+typedef CircularBufferSPSC<> CircularBuffer_SM;
+
+// C-style wrappers kept so the refresh classes and their ISRs read the same as before, now inlined
+
+template <uint16_t staticSize>
+static inline void cbInit(CircularBufferSPSC<staticSize> *cb, int size) { cb->init(size); }
+
+template <uint16_t staticSize>
+static inline int cbIsFull(CircularBufferSPSC<staticSize> *cb) { return cb->isFull(); }
+
+template <uint16_t staticSize>
+static inline int cbIsEmpty(CircularBufferSPSC<staticSize> *cb) { return cb->isEmpty(); }
 
 // returns index of next element to write
-int cbGetNextWrite(CircularBuffer_SM *cb);
+template <uint16_t staticSize>
+static inline int cbGetNextWrite(CircularBufferSPSC<staticSize> *cb) { return cb->getNextWrite(); }
 
 // mark next element as written
-void cbWrite(CircularBuffer_SM *cb);
+template <uint16_t staticSize>
+static inline void cbWrite(CircularBufferSPSC<staticSize> *cb) { cb->write(); }
 
 // returns index of next element to read
-int cbGetNextRead(CircularBuffer_SM *cb);
+template <uint16_t staticSize>
+static inline int cbGetNextRead(CircularBufferSPSC<staticSize> *cb) { return cb->getNextRead(); }
 
 // marks next element as read
-void cbRead(CircularBuffer_SM *cb);
-
+template <uint16_t staticSize>
+static inline void cbRead(CircularBufferSPSC<staticSize> *cb) { cb->read(); }
 
 #endif // _SMARTMATRIX_CIRCULARBUFFER_H_